@@ -0,0 +1,123 @@
+// bin/compile-lexicon-tree.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "tree/context-dep.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "lm/const-arpa-lm.h"
+#include "decoder/lexicon-tree-decoder.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Creates the lexicon-tree decoding graph for latgen-lexicon-tree-mapped\n"
+        "(see LexiconTreeDecoder): HCLG where G is the unigram part of the\n"
+        "language model, pushed towards the start for language-model lookahead.\n"
+        "It is about the size of the lexicon; the full language model is applied\n"
+        "while decoding, and must be the same one as given here.\n"
+        "The lexicon is in integer form, one pronunciation per line:\n"
+        "<word-id> <phone-id1> <phone-id2> ...\n"
+        "The language model is in ConstArpaLm format, or G.fst if --lm-fst=true.\n"
+        "\n"
+        "Usage:   compile-lexicon-tree [options] <tree-in> <model-in> "
+        "<lexicon-in> <lm-in> <graph-out>\n"
+        "e.g.: \n"
+        " compile-lexicon-tree --silence-phone=1 tree final.mdl lexicon.int "
+        "G.carpa tree.fst\n";
+    ParseOptions po(usage);
+
+    LexiconTreeOptions opts;
+    int32 silence_phone = 0;
+    bool lm_fst = false;
+    opts.Register(&po);
+    po.Register("silence-phone", &silence_phone, "If >0, the phone to allow "
+                "optionally between words (see --silence-prob).");
+    po.Register("lm-fst", &lm_fst, "If true, the language model is an FST "
+                "(G.fst) rather than in ConstArpaLm format.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string tree_rxfilename = po.GetArg(1),
+        model_rxfilename = po.GetArg(2),
+        lexicon_rxfilename = po.GetArg(3),
+        lm_rxfilename = po.GetArg(4),
+        graph_wxfilename = po.GetArg(5);
+
+    ContextDependency ctx_dep;
+    ReadKaldiObject(tree_rxfilename, &ctx_dep);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_rxfilename, &trans_model);
+
+    std::vector<std::vector<int32> > lexicon;
+    {
+      Input ki(lexicon_rxfilename);
+      ReadLexiconInt(ki.Stream(), &lexicon);
+    }
+    int32 max_word = 0;
+    for (size_t i = 0; i < lexicon.size(); i++)
+      max_word = std::max(max_word, lexicon[i][0]);
+
+    std::vector<BaseFloat> unigram_costs;
+    if (lm_fst) {
+      VectorFst<StdArc> *lm = fst::ReadFstKaldi(lm_rxfilename);
+      GetUnigramCostsFromG(*lm, &unigram_costs);
+      delete lm;
+      if (unigram_costs.size() <= static_cast<size_t>(max_word))
+        unigram_costs.resize(max_word + 1,
+                             std::numeric_limits<BaseFloat>::infinity());
+    } else {
+      ConstArpaLm lm;
+      ReadKaldiObject(lm_rxfilename, &lm);
+      GetUnigramCostsFromConstArpa(lm, max_word, &unigram_costs);
+    }
+
+    VectorFst<StdArc> *graph = CompileLexiconTree(lexicon, unigram_costs,
+                                                  silence_phone, ctx_dep,
+                                                  trans_model, opts);
+    {  // convert to ConstFst and write.
+      fst::ConstFst<StdArc> const_graph(*graph);
+      bool binary = true, write_binary_header = false;  // suppress the ^@B
+      Output ko(graph_wxfilename, binary, write_binary_header);
+      fst::FstWriteOptions wopts(PrintableWxfilename(graph_wxfilename));
+      const_graph.Write(ko.Stream(), wopts);
+    }
+    KALDI_LOG << "Wrote lexicon-tree graph with " << graph->NumStates()
+              << " states for " << lexicon.size() << " pronunciations to "
+              << graph_wxfilename;
+    delete graph;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,359 @@
+// bin/decoder-benchmark.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "util/hash-list.h"
+#include "util/flat-hash-list.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/faster-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/compact-graph-fst.h"
+
+namespace kaldi {
+
+struct SyntheticGraphOptions {
+  int32 num_states;
+  int32 arcs_per_state;
+  int32 num_pdfs;
+  int32 num_words;
+  int32 max_jump;
+  BaseFloat epsilon_prob;
+  BaseFloat final_prob;
+
+  SyntheticGraphOptions(): num_states(200000), arcs_per_state(3),
+                           num_pdfs(3000), num_words(10000), max_jump(200),
+                           epsilon_prob(0.2), final_prob(0.05) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("num-states", &num_states, "Number of states in the "
+                   "synthetic decoding graph.");
+    opts->Register("arcs-per-state", &arcs_per_state, "Number of emitting "
+                   "arcs per state, including the self-loop.");
+    opts->Register("num-pdfs", &num_pdfs, "Number of distinct input labels "
+                   "(columns of the synthetic log-likelihood matrix).");
+    opts->Register("num-words", &num_words, "Number of distinct output "
+                   "labels.");
+    opts->Register("max-jump", &max_jump, "Emitting arcs go to a state at "
+                   "most this far away, which gives the graph some locality "
+                   "like a real HCLG.");
+    opts->Register("epsilon-prob", &epsilon_prob, "Probability that a state "
+                   "has an input-epsilon arc (to a random state, with a "
+                   "word label).");
+    opts->Register("final-prob", &final_prob, "Probability that a state is "
+                   "final.");
+  }
+};
+
+// Creates a random graph that looks a little like an HCLG: each state has a
+// self-loop and some emitting arcs to nearby states, and some states have an
+// epsilon arc with a word label to anywhere in the graph.
+void CreateSyntheticGraph(const SyntheticGraphOptions &opts,
+                          fst::StdVectorFst *fst) {
+  typedef fst::StdArc Arc;
+  KALDI_ASSERT(opts.num_states > 1 && opts.arcs_per_state > 0 &&
+               opts.num_pdfs > 0 && opts.num_words > 0 && opts.max_jump > 0);
+  fst->DeleteStates();
+  for (int32 s = 0; s < opts.num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < opts.num_states; s++) {
+    int32 pdf = 1 + RandInt(0, opts.num_pdfs - 1);
+    fst->AddArc(s, Arc(pdf, 0, 0.7 + 0.5 * RandUniform(), s));
+    for (int32 i = 1; i < opts.arcs_per_state; i++) {
+      int32 next_pdf = 1 + RandInt(0, opts.num_pdfs - 1),
+          next_state = (s + RandInt(1, opts.max_jump)) % opts.num_states;
+      fst->AddArc(s, Arc(next_pdf, 0, 0.5 + 2.0 * RandUniform(),
+                         next_state));
+    }
+    if (WithProb(opts.epsilon_prob)) {
+      int32 word = 1 + RandInt(0, opts.num_words - 1),
+          next_state = RandInt(0, opts.num_states - 1);
+      fst->AddArc(s, Arc(0, word, 2.0 + 8.0 * RandUniform(), next_state));
+    }
+    if (WithProb(opts.final_prob))
+      fst->SetFinal(s, 5.0 * RandUniform());
+  }
+}
+
+
+// Does beam-pruned Viterbi token passing over "fst" in the same way as
+// FasterDecoder does (GetCutoff, then emitting arcs, then epsilon arcs),
+// using HashType as the state->cost map.  This isolates the cost of the
+// hash, since there is no lattice or traceback.  Returns the best final cost
+// and outputs the total number of tokens created.
+template<class HashType>
+BaseFloat TokenPassing(const fst::StdVectorFst &fst,
+                       const MatrixBase<BaseFloat> &loglikes,
+                       BaseFloat acoustic_scale,
+                       BaseFloat beam, int32 max_active,
+                       int64 *num_tokens) {
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef typename HashType::Elem Elem;
+  HashType toks;
+  toks.SetSize(1000);
+  toks.Insert(fst.Start(), 0.0);
+  std::vector<BaseFloat> costs;
+  std::vector<StateId> queue;
+  int64 tok_count = 1;
+  for (int32 frame = 0; frame < loglikes.NumRows(); frame++) {
+    Elem *last_toks = toks.Clear();
+    // Compute the cutoff from the beam and max-active, like GetCutoff().
+    costs.clear();
+    BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity();
+    for (Elem *e = last_toks; e != NULL; e = e->tail) {
+      costs.push_back(e->val);
+      best_cost = std::min(best_cost, e->val);
+    }
+    BaseFloat cutoff = best_cost + beam;
+    if (costs.size() > static_cast<size_t>(max_active)) {
+      std::nth_element(costs.begin(), costs.begin() + max_active, costs.end());
+      cutoff = std::min(cutoff, costs[max_active]);
+    }
+    size_t new_size = 2 * std::min(costs.size(),
+                                   static_cast<size_t>(max_active));
+    if (new_size > toks.Size())
+      toks.SetSize(new_size);
+
+    BaseFloat next_best = std::numeric_limits<BaseFloat>::infinity();
+    SubVector<BaseFloat> frame_loglikes(loglikes, frame);
+    for (Elem *e = last_toks, *e_tail; e != NULL; e = e_tail) {
+      if (e->val < cutoff) {
+        for (fst::ArcIterator<fst::StdVectorFst> aiter(fst, e->key);
+             !aiter.Done(); aiter.Next()) {
+          const Arc &arc = aiter.Value();
+          if (arc.ilabel == 0) continue;
+          BaseFloat cost = e->val + arc.weight.Value() -
+              acoustic_scale * frame_loglikes(arc.ilabel - 1);
+          Elem *e_found = toks.Find(arc.nextstate);
+          if (e_found == NULL) {
+            toks.Insert(arc.nextstate, cost);
+            tok_count++;
+          } else if (cost < e_found->val) {
+            e_found->val = cost;
+          }
+          next_best = std::min(next_best, cost);
+        }
+      }
+      e_tail = e->tail;
+      toks.Delete(e);
+    }
+
+    // Epsilon arcs, like ProcessNonemitting().
+    BaseFloat eps_cutoff = next_best + beam;
+    queue.clear();
+    for (const Elem *e = toks.GetList(); e != NULL; e = e->tail)
+      queue.push_back(e->key);
+    while (!queue.empty()) {
+      StateId state = queue.back();
+      queue.pop_back();
+      BaseFloat cur_cost = toks.Find(state)->val;
+      if (cur_cost >= eps_cutoff) continue;
+      for (fst::ArcIterator<fst::StdVectorFst> aiter(fst, state);
+           !aiter.Done(); aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        if (arc.ilabel != 0) continue;
+        BaseFloat cost = cur_cost + arc.weight.Value();
+        if (cost >= eps_cutoff) continue;
+        Elem *e_found = toks.Find(arc.nextstate);
+        if (e_found == NULL) {
+          toks.Insert(arc.nextstate, cost);
+          tok_count++;
+          queue.push_back(arc.nextstate);
+        } else if (cost < e_found->val) {
+          e_found->val = cost;
+          queue.push_back(arc.nextstate);
+        }
+      }
+    }
+  }
+  BaseFloat best_final = std::numeric_limits<BaseFloat>::infinity();
+  for (Elem *e = toks.Clear(), *e_tail; e != NULL; e = e_tail) {
+    best_final = std::min(best_final,
+                          e->val + fst.Final(e->key).Value());
+    e_tail = e->tail;
+    toks.Delete(e);
+  }
+  *num_tokens = tok_count;
+  return best_final;
+}
+
+template<class HashType>
+double TimeTokenPassing(const std::string &name,
+                        const fst::StdVectorFst &fst,
+                        const MatrixBase<BaseFloat> &loglikes,
+                        BaseFloat acoustic_scale, BaseFloat beam,
+                        int32 max_active, int32 num_repeats) {
+  int64 num_tokens = 0;
+  BaseFloat best_cost = 0.0;
+  Timer timer;
+  for (int32 n = 0; n < num_repeats; n++)
+    best_cost = TokenPassing<HashType>(fst, loglikes, acoustic_scale, beam,
+                                       max_active, &num_tokens);
+  double elapsed = timer.Elapsed() / num_repeats;
+  KALDI_LOG << name << ": " << elapsed << " seconds per utterance, "
+            << (1.0e+09 * elapsed / num_tokens) << " ns per token, "
+            << (num_tokens / loglikes.NumRows()) << " tokens per frame, "
+            << "best cost " << best_cost;
+  return elapsed;
+}
+
+// Times LatticeFasterDecoder with the graph in the representation 'FST'.
+template<class FST>
+void TimeLatticeFasterDecoder(const std::string &name, const FST &fst,
+                              const LatticeFasterDecoderConfig &config,
+                              const MatrixBase<BaseFloat> &loglikes,
+                              BaseFloat acoustic_scale, int32 num_repeats) {
+  LatticeFasterDecoderTpl<FST> decoder(fst, config);
+  Timer timer;
+  for (int32 n = 0; n < num_repeats; n++) {
+    DecodableMatrixScaled decodable(loglikes, acoustic_scale);
+    decoder.Decode(&decodable);
+  }
+  double elapsed = timer.Elapsed() / num_repeats;
+  Lattice lat;
+  decoder.GetBestPath(&lat);
+  LatticeWeight weight = LatticeWeight::Zero();
+  std::vector<int32> alignment, words;
+  fst::GetLinearSymbolSequence(lat, &alignment, &words, &weight);
+  KALDI_LOG << "LatticeFasterDecoder (" << name << "): " << elapsed
+            << " seconds per utterance (" << (1000.0 * elapsed /
+                                              loglikes.NumRows())
+            << " ms per frame), "
+            << (decoder.ReachedFinal() ? "reached" : "did not reach")
+            << " a final state, best cost "
+            << (weight.Value1() + weight.Value2());
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Benchmarks decoding on a synthetic HCLG-like graph with random\n"
+        "log-likelihoods.  It first times bare token passing with the old\n"
+        "chained hash (HashList) and the open-addressing hash used by the\n"
+        "decoders (FlatHashList), and then times FasterDecoder, and\n"
+        "LatticeFasterDecoder with the graph as VectorFst, ConstFst and\n"
+        "CompactGraphFst, on the same data.  If <fst-out> is given, the\n"
+        "synthetic graph is written there.\n"
+        "\n"
+        "Usage: decoder-benchmark [options] [<fst-out>]\n"
+        "e.g.: decoder-benchmark --num-states=500000 --beam=14\n";
+
+    ParseOptions po(usage);
+    SyntheticGraphOptions graph_opts;
+    int32 num_frames = 500, srand_seed = 0, num_repeats = 3,
+        max_active = 7000, num_expand_threads = 1;
+    BaseFloat beam = 13.0, lattice_beam = 6.0, acoustic_scale = 0.1;
+
+    graph_opts.Register(&po);
+    po.Register("num-frames", &num_frames, "Number of frames to decode.");
+    po.Register("beam", &beam, "Decoding beam.");
+    po.Register("max-active", &max_active, "Decoder max active states.");
+    po.Register("lattice-beam", &lattice_beam, "Lattice beam for "
+                "LatticeFasterDecoder.");
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for the "
+                "synthetic log-likelihoods.");
+    po.Register("num-repeats", &num_repeats, "Number of times to repeat each "
+                "measurement (times are averaged).");
+    po.Register("srand", &srand_seed, "Seed for the random number generator.");
+    po.Register("num-expand-threads", &num_expand_threads, "Number of "
+                "threads LatticeFasterDecoder uses to expand emitting arcs.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() > 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(num_frames > 0 && num_repeats > 0);
+    srand(srand_seed);
+
+    fst::StdVectorFst fst;
+    CreateSyntheticGraph(graph_opts, &fst);
+    KALDI_LOG << "Created synthetic graph with " << fst.NumStates()
+              << " states and " << fst::NumArcs(fst) << " arcs.";
+    if (po.NumArgs() == 1)
+      WriteFstKaldi(fst, po.GetArg(1));
+
+    Matrix<BaseFloat> loglikes(num_frames, graph_opts.num_pdfs);
+    loglikes.SetRandn();
+    loglikes.Scale(10.0);
+
+    double chained_time = TimeTokenPassing<HashList<int32, BaseFloat> >(
+        "HashList", fst, loglikes, acoustic_scale, beam, max_active,
+        num_repeats);
+    double flat_time = TimeTokenPassing<FlatHashList<int32, BaseFloat> >(
+        "FlatHashList", fst, loglikes, acoustic_scale, beam, max_active,
+        num_repeats);
+    KALDI_LOG << "Token passing with FlatHashList is "
+              << (chained_time / flat_time) << " times as fast as with "
+              << "HashList.";
+
+    {
+      FasterDecoderOptions opts;
+      opts.beam = beam;
+      opts.max_active = max_active;
+      FasterDecoder decoder(fst, opts);
+      Timer timer;
+      for (int32 n = 0; n < num_repeats; n++) {
+        DecodableMatrixScaled decodable(loglikes, acoustic_scale);
+        decoder.Decode(&decodable);
+      }
+      double elapsed = timer.Elapsed() / num_repeats;
+      KALDI_LOG << "FasterDecoder: " << elapsed << " seconds per utterance ("
+                << (1000.0 * elapsed / num_frames) << " ms per frame), "
+                << (decoder.ReachedFinal() ? "reached" : "did not reach")
+                << " a final state.";
+    }
+    {
+      LatticeFasterDecoderConfig config;
+      config.beam = beam;
+      config.max_active = max_active;
+      config.lattice_beam = lattice_beam;
+      config.num_expand_threads = num_expand_threads;
+      TimeLatticeFasterDecoder<fst::Fst<fst::StdArc> >(
+          "VectorFst", fst, config, loglikes, acoustic_scale, num_repeats);
+      fst::StdConstFst const_fst(fst);
+      TimeLatticeFasterDecoder(
+          "ConstFst", const_fst, config, loglikes, acoustic_scale, num_repeats);
+      float max_weight_error;
+      fst::CompactGraphFst compact_fst(fst, &max_weight_error);
+      KALDI_LOG << "CompactGraphFst takes " << compact_fst.MemorySize()
+                << " bytes; the largest weight quantization error is "
+                << max_weight_error;
+      TimeLatticeFasterDecoder(
+          "CompactGraphFst", compact_fst, config, loglikes, acoustic_scale,
+          num_repeats);
+    }
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
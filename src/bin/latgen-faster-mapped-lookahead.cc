@@ -0,0 +1,214 @@
+// bin/latgen-faster-mapped-lookahead.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "fstext/lookahead-compose.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::StdArc;
+    using fst::VectorFst;
+
+    const char *usage =
+        "Generate lattices, reading log-likelihoods as matrices, by decoding\n"
+        "with the lazy composition of HCL and G (with label lookahead) instead\n"
+        "of a precompiled HCLG.  HCL has word output labels (it is built like\n"
+        "HCLG.fst, but from L_disambig.fst instead of LG.fst, with self-loops\n"
+        "added and the transition-id disambiguation symbols removed); G should\n"
+        "have its disambiguation symbols replaced by epsilon.  <g-fst-in> may\n"
+        "be a table of per-utterance grammars, in which case it is read\n"
+        "in utterance order.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage: latgen-faster-mapped-lookahead [options] trans-model-in hcl-fst-in\n"
+        " (g-fst-in|g-fsts-rspecifier) loglikes-rspecifier lattice-wspecifier\n"
+        " [ words-wspecifier [alignments-wspecifier] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    BaseFloat acoustic_scale = 0.1;
+    int64 cache_size = 1 << 28;
+    LatticeFasterDecoderConfig config;
+
+    std::string word_syms_filename;
+    config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("cache-size", &cache_size, "Memory limit in bytes for the "
+                "states of the composed FST that have been expanded (they "
+                "are garbage collected when it is exceeded); 0 means no "
+                "limit.  The cache is freed after each utterance.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        hcl_in_filename = po.GetArg(2),
+        g_in_str = po.GetArg(3),
+        feature_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    if (config.num_expand_threads > 1) {
+      KALDI_WARN << "--num-expand-threads is ignored, the composed FST "
+                 << "cannot be shared between threads.";
+      config.num_expand_threads = 1;
+    }
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    fst::StdOLabelLookAheadConstFst *hcl_lookahead = NULL;
+    {
+      Fst<StdArc> *hcl = fst::ReadFstKaldiGeneric(hcl_in_filename);
+      hcl_lookahead = fst::CreateLookaheadFst(*hcl);
+      delete hcl;
+    }
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    if (ClassifyRspecifier(g_in_str, NULL, NULL) == kNoRspecifier) {
+      SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
+      VectorFst<StdArc> *g = fst::ReadFstKaldi(g_in_str);
+      fst::RelabelForLookahead(*hcl_lookahead, g);
+      timer.Reset();
+
+      for (; !loglike_reader.Done(); loglike_reader.Next()) {
+        std::string utt = loglike_reader.Key();
+        Matrix<BaseFloat> loglikes (loglike_reader.Value());
+        loglike_reader.FreeCurrent();
+        if (loglikes.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+        // We create the composed FST for each utterance so that the states
+        // it expanded are freed afterwards.
+        fst::ComposeFst<StdArc> *decode_fst =
+            fst::CreateLookaheadComposeFst(*hcl_lookahead, *g, cache_size);
+        {
+          LatticeFasterDecoder decoder(*decode_fst, config);
+          DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+          double like;
+          if (DecodeUtteranceLatticeFaster(
+                  decoder, decodable, trans_model, word_syms, utt,
+                  acoustic_scale, determinize, allow_partial, &alignment_writer,
+                  &words_writer, &compact_lattice_writer, &lattice_writer,
+                  &like)) {
+            tot_like += like;
+            frame_count += loglikes.NumRows();
+            num_success++;
+          } else num_fail++;
+        }
+        delete decode_fst;  // delete this only after decoder goes out of scope.
+      }
+      delete g;
+    } else {  // We have different grammars for different utterances.
+      SequentialTableReader<fst::VectorFstHolder> g_reader(g_in_str);
+      RandomAccessBaseFloatMatrixReader loglike_reader(feature_rspecifier);
+      for (; !g_reader.Done(); g_reader.Next()) {
+        std::string utt = g_reader.Key();
+        if (!loglike_reader.HasKey(utt)) {
+          KALDI_WARN << "Not decoding utterance " << utt
+                     << " because no loglikes available.";
+          num_fail++;
+          continue;
+        }
+        const Matrix<BaseFloat> &loglikes = loglike_reader.Value(utt);
+        if (loglikes.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+        VectorFst<StdArc> g(g_reader.Value());
+        fst::RelabelForLookahead(*hcl_lookahead, &g);
+        fst::ComposeFst<StdArc> *decode_fst =
+            fst::CreateLookaheadComposeFst(*hcl_lookahead, g, cache_size);
+        {
+          LatticeFasterDecoder decoder(*decode_fst, config);
+          DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+          double like;
+          if (DecodeUtteranceLatticeFaster(
+                  decoder, decodable, trans_model, word_syms, utt,
+                  acoustic_scale, determinize, allow_partial, &alignment_writer,
+                  &words_writer, &compact_lattice_writer, &lattice_writer,
+                  &like)) {
+            tot_like += like;
+            frame_count += loglikes.NumRows();
+            num_success++;
+          } else num_fail++;
+        }
+        delete decode_fst;
+      }
+    }
+    delete hcl_lookahead;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
+              << frame_count<<" frames.";
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -26,7 +26,9 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoder-search-stats.h"
 #include "decoder/decodable-matrix.h"
+#include "decoder/compact-graph-fst.h"
 #include "base/timer.h"
 
 
@@ -42,19 +44,29 @@ int main(int argc, char *argv[]) {
         "Generate lattices, reading log-likelihoods as matrices\n"
         " (model is needed only for the integer mappings in its transition-model)\n"
         "Usage: latgen-faster-mapped [options] trans-model-in (fst-in|fsts-rspecifier) loglikes-rspecifier"
-        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n";
+        " lattice-wspecifier [ words-wspecifier [alignments-wspecifier] ]\n"
+        "fst-in may also be a graph converted by make-compact-graph-fst.\n";
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wspecifier;
+    bool print_search_stats = false;
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("search-stats-wspecifier", &search_stats_wspecifier,
+                "If supplied, per-frame statistics about the search (numbers "
+                "of tokens and arcs, time and so on) are written to this table, "
+                "indexed by utterance, for tuning the beams.");
+    po.Register("print-search-stats", &print_search_stats, "If true, print a "
+                "summary of the search statistics for each utterance (a "
+                "summary over all utterances is printed whenever search "
+                "statistics are collected).");
 
     po.Read(argc, argv);
 
@@ -85,6 +97,12 @@ int main(int argc, char *argv[]) {
 
     Int32VectorWriter alignment_writer(alignment_wspecifier);
 
+    DecoderSearchStatsWriter search_stats_writer(search_stats_wspecifier);
+    bool collect_search_stats = (print_search_stats ||
+                                 !search_stats_wspecifier.empty());
+    DecoderSearchStats search_stats;
+    DecoderSearchStatsSummary search_stats_summary;
+
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_filename != "")
       if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
@@ -97,12 +115,28 @@ int main(int argc, char *argv[]) {
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
-      // Input FST is just one FST, not a table of FSTs.
-      Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+      // Input FST is just one FST, not a table of FSTs.  It may be in the
+      // format written by make-compact-graph-fst, in which case we decode with
+      // the version of the decoder that is specialized for it.
+      Fst<StdArc> *decode_fst = NULL;
+      fst::CompactGraphFst *compact_fst = NULL;
+      fst::ReadDecodingGraph(fst_in_str, &decode_fst, &compact_fst);
       timer.Reset();
 
       {
-        LatticeFasterDecoder decoder(*decode_fst, config);
+        LatticeFasterDecoder *decoder = NULL;
+        LatticeFasterDecoderTpl<fst::CompactGraphFst> *compact_decoder = NULL;
+        if (decode_fst != NULL)
+          decoder = new LatticeFasterDecoder(*decode_fst, config);
+        else
+          compact_decoder = new LatticeFasterDecoderTpl<fst::CompactGraphFst>(
+              *compact_fst, config);
+        if (collect_search_stats) {
+          if (decoder != NULL)
+            decoder->SetSearchStats(&search_stats);
+          else
+            compact_decoder->SetSearchStats(&search_stats);
+        }
 
         for (; !loglike_reader.Done(); loglike_reader.Next()) {
           std::string utt = loglike_reader.Key();
@@ -117,18 +151,46 @@ int main(int argc, char *argv[]) {
           DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
 
           double like;
-          if (DecodeUtteranceLatticeFaster(
-                  decoder, decodable, trans_model, word_syms, utt,
-                  acoustic_scale, determinize, allow_partial, &alignment_writer,
-                  &words_writer, &compact_lattice_writer, &lattice_writer,
-                  &like)) {
+          bool ok;
+          if (decoder != NULL)
+            ok = DecodeUtteranceLatticeFaster(
+                *decoder, decodable, trans_model, word_syms, utt,
+                acoustic_scale, determinize, allow_partial, &alignment_writer,
+                &words_writer, &compact_lattice_writer, &lattice_writer,
+                &like);
+          else
+            ok = DecodeUtteranceLatticeFaster(
+                *compact_decoder, decodable, trans_model, word_syms, utt,
+                acoustic_scale, determinize, allow_partial, &alignment_writer,
+                &words_writer, &compact_lattice_writer, &lattice_writer,
+                &like);
+          if (ok) {
             tot_like += like;
             frame_count += loglikes.NumRows();
             num_success++;
           } else num_fail++;
+          if (collect_search_stats) {
+            if (search_stats_writer.IsOpen())
+              search_stats_writer.Write(utt, search_stats);
+            if (print_search_stats) {
+              DecoderSearchStatsSummary utt_summary;
+              utt_summary.Add(search_stats);
+              utt_summary.Print(utt);
+            }
+            search_stats_summary.Add(search_stats);
+          }
+        }
+        if (config.adaptive_beam_opts.Enabled()) {
+          if (decoder != NULL)
+            decoder->GetAdaptiveBeamStats().Print();
+          else
+            compact_decoder->GetAdaptiveBeamStats().Print();
         }
+        delete decoder;
+        delete compact_decoder;
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
+      delete decode_fst; // delete these only after the decoder is deleted.
+      delete compact_fst;
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
       RandomAccessBaseFloatMatrixReader loglike_reader(feature_rspecifier);
@@ -147,6 +209,8 @@ int main(int argc, char *argv[]) {
           continue;
         }
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
+        if (collect_search_stats)
+          decoder.SetSearchStats(&search_stats);
         DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
         double like;
         if (DecodeUtteranceLatticeFaster(
@@ -157,9 +221,22 @@ int main(int argc, char *argv[]) {
           frame_count += loglikes.NumRows();
           num_success++;
         } else num_fail++;
+        if (collect_search_stats) {
+          if (search_stats_writer.IsOpen())
+            search_stats_writer.Write(utt, search_stats);
+          if (print_search_stats) {
+            DecoderSearchStatsSummary utt_summary;
+            utt_summary.Add(search_stats);
+            utt_summary.Print(utt);
+          }
+          search_stats_summary.Add(search_stats);
+        }
       }
     }
 
+    if (collect_search_stats)
+      search_stats_summary.Print("all utterances");
+
     double elapsed = timer.Elapsed();
     KALDI_LOG << "Time taken "<< elapsed
               << "s: real-time factor assuming 100 frames/sec is "
@@ -0,0 +1,216 @@
+// bin/latgen-lexicon-tree-mapped.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "lm/const-arpa-lm.h"
+#include "decoder/lexicon-tree-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices, reading log-likelihoods as matrices, using a\n"
+        "lexicon-tree graph from compile-lexicon-tree and applying the language\n"
+        "model on the fly (which needs much less memory than a full HCLG).\n"
+        "The language model must be the one given to compile-lexicon-tree; it\n"
+        "is in ConstArpaLm format, or G.fst if --lm-fst=true.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage: latgen-lexicon-tree-mapped [options] <trans-model-in> <graph-in> "
+        "<lm-in> <loglikes-rspecifier> <lattice-wspecifier> "
+        "[ <words-wspecifier> [<alignments-wspecifier>] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    BaseFloat acoustic_scale = 0.1;
+    bool lm_fst = false;
+    LatticeFasterDecoderConfig config;
+
+    std::string word_syms_filename;
+    config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
+                "acoustic likelihoods");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for "
+                "words [for debug output]");
+    po.Register("allow-partial", &allow_partial, "If true, produce output "
+                "even if end state was not reached.");
+    po.Register("lm-fst", &lm_fst, "If true, the language model is an FST "
+                "(G.fst) rather than in ConstArpaLm format.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        graph_rxfilename = po.GetArg(2),
+        lm_rxfilename = po.GetArg(3),
+        loglikes_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    Fst<StdArc> *graph = fst::ReadFstKaldiGeneric(graph_rxfilename);
+
+    // The unigram costs are needed for the words in the graph.
+    int32 max_word = 0;
+    for (fst::StateIterator<Fst<StdArc> > siter(*graph); !siter.Done();
+         siter.Next())
+      for (fst::ArcIterator<Fst<StdArc> > aiter(*graph, siter.Value());
+           !aiter.Done(); aiter.Next())
+        max_word = std::max(max_word, aiter.Value().olabel);
+
+    std::vector<BaseFloat> unigram_costs;
+    VectorFst<StdArc> *lm_fst_ptr = NULL;
+    ConstArpaLm const_arpa;
+    fst::DeterministicOnDemandFst<StdArc> *lm = NULL;
+    if (lm_fst) {
+      lm_fst_ptr = fst::ReadFstKaldi(lm_rxfilename);
+      GetUnigramCostsFromG(*lm_fst_ptr, &unigram_costs);
+      if (unigram_costs.size() <= static_cast<size_t>(max_word))
+        unigram_costs.resize(max_word + 1,
+                             std::numeric_limits<BaseFloat>::infinity());
+      fst::ArcSort(lm_fst_ptr, fst::ILabelCompare<StdArc>());
+      lm = new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_fst_ptr);
+    } else {
+      ReadKaldiObject(lm_rxfilename, &const_arpa);
+      GetUnigramCostsFromConstArpa(const_arpa, max_word, &unigram_costs);
+      lm = new ConstArpaLmDeterministicFst(const_arpa);
+    }
+
+    CompactLatticeWriter compact_lattice_writer(lattice_wspecifier);
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    LexiconTreeDecoder decoder(*graph, unigram_costs, lm, trans_model, config);
+
+    SequentialBaseFloatMatrixReader loglike_reader(loglikes_rspecifier);
+    for (; !loglike_reader.Done(); loglike_reader.Next()) {
+      std::string utt = loglike_reader.Key();
+      const Matrix<BaseFloat> &loglikes = loglike_reader.Value();
+      if (loglikes.NumRows() == 0) {
+        KALDI_WARN << "Zero-length utterance: " << utt;
+        num_fail++;
+        continue;
+      }
+      DecodableMatrixScaledMapped decodable(trans_model, loglikes,
+                                            acoustic_scale);
+      if (!decoder.Decode(&decodable)) {
+        KALDI_WARN << "Failed to decode utterance " << utt;
+        num_fail++;
+        continue;
+      }
+      if (!decoder.ReachedFinal()) {
+        if (allow_partial) {
+          KALDI_WARN << "Outputting partial output for utterance " << utt
+                     << " since no final-state reached";
+        } else {
+          KALDI_WARN << "Not producing output for utterance " << utt
+                     << " since no final-state reached and "
+                     << "--allow-partial=false.";
+          num_fail++;
+          continue;
+        }
+      }
+
+      Lattice best_path;
+      if (!decoder.GetBestPath(&best_path))
+        KALDI_ERR << "Failed to get traceback for utterance " << utt;
+      std::vector<int32> alignment, words;
+      LatticeWeight weight;
+      GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+      if (words_writer.IsOpen())
+        words_writer.Write(utt, words);
+      if (alignment_writer.IsOpen())
+        alignment_writer.Write(utt, alignment);
+      if (word_syms != NULL) {
+        std::cerr << utt << ' ';
+        for (size_t i = 0; i < words.size(); i++) {
+          std::string s = word_syms->Find(words[i]);
+          if (s == "")
+            KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+          std::cerr << s << ' ';
+        }
+        std::cerr << '\n';
+      }
+
+      CompactLattice clat;
+      if (!decoder.GetLattice(&clat))
+        KALDI_ERR << "Unexpected problem getting lattice for utterance "
+                  << utt;
+      // We'll write the lattice without acoustic scaling.
+      if (acoustic_scale != 0.0)
+        fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
+                          &clat);
+      compact_lattice_writer.Write(utt, clat);
+
+      double like = -(weight.Value1() + weight.Value2());
+      KALDI_LOG << "Log-like per frame for utterance " << utt << " is "
+                << (like / loglikes.NumRows()) << " over "
+                << loglikes.NumRows() << " frames.";
+      tot_like += like;
+      frame_count += loglikes.NumRows();
+      num_success++;
+    }
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like/frame_count) << " over "
+              << frame_count << " frames.";
+
+    delete word_syms;
+    delete lm;
+    delete lm_fst_ptr;
+    delete graph;
+    return (num_success != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
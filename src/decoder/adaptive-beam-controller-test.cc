@@ -0,0 +1,126 @@
+// decoder/adaptive-beam-controller-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/adaptive-beam-controller.h"
+
+namespace kaldi {
+
+// Calls Update() for a frame whose cost is 'load' times the budget, which is
+// in time or in tokens depending on the config.
+static void UpdateWithLoad(const AdaptiveBeamConfig &config, double load,
+                           int32 num_tokens,
+                           AdaptiveBeamController *controller) {
+  if (config.max_tokens > 0)
+    controller->Update(0.0, static_cast<size_t>(load * config.max_tokens));
+  else
+    controller->Update(load * config.target_rtf * config.frame_shift,
+                       num_tokens);
+}
+
+// Checks that while the load is over the target the controller narrows the
+// beam down to the minimum and then reduces max-active, and that while it is
+// under the target it restores max-active and then widens the beam back to
+// the configured ones.
+void TestAdaptiveBeamController() {
+  AdaptiveBeamConfig config;
+  if (RandInt(0, 1) == 0)
+    config.max_tokens = RandInt(1000, 5000);
+  else
+    config.target_rtf = 0.5 + 0.1 * RandInt(0, 10);
+  BaseFloat beam = 10.0 + RandInt(0, 6);
+  int32 max_active = RandInt(2000, 7000), min_active = 200;
+  AdaptiveBeamController controller(config);
+  controller.Reset(beam, max_active, min_active);
+  KALDI_ASSERT(controller.Enabled() && controller.Beam() == beam &&
+               controller.MaxActive() == max_active);
+
+  // Within the tolerance, nothing changes.
+  for (int32 t = 0; t < 100; t++) {
+    UpdateWithLoad(config, 1.0 + 0.9 * config.tolerance * RandUniform(),
+                   max_active, &controller);
+    KALDI_ASSERT(controller.Beam() == beam &&
+                 controller.MaxActive() == max_active);
+  }
+
+  // Over the target: the beam shrinks to --adaptive-min-beam, and only then
+  // max-active shrinks, down to --adaptive-min-max-active.
+  controller.Reset(beam, max_active, min_active);
+  BaseFloat prev_beam = beam;
+  int32 prev_max_active = max_active;
+  for (int32 t = 0; t < 1000; t++) {
+    UpdateWithLoad(config, 3.0, max_active, &controller);
+    KALDI_ASSERT(controller.Beam() <= prev_beam &&
+                 controller.MaxActive() <= prev_max_active);
+    if (controller.MaxActive() < max_active)
+      KALDI_ASSERT(controller.Beam() == config.min_beam);
+    prev_beam = controller.Beam();
+    prev_max_active = controller.MaxActive();
+  }
+  KALDI_ASSERT(controller.Beam() == config.min_beam &&
+               controller.MaxActive() == config.min_max_active);
+
+  // Under the target: max-active recovers, and only then the beam widens, up
+  // to the configured ones.
+  for (int32 t = 0; t < 1000; t++) {
+    UpdateWithLoad(config, 0.2, controller.MaxActive(), &controller);
+    if (controller.Beam() > prev_beam)
+      KALDI_ASSERT(controller.MaxActive() == max_active);
+    prev_beam = controller.Beam();
+  }
+  KALDI_ASSERT(controller.Beam() == beam &&
+               controller.MaxActive() == max_active);
+
+  const AdaptiveBeamStats &stats = controller.Stats();
+  KALDI_ASSERT(stats.num_frames == 2100 && stats.num_frames_over_budget > 0 &&
+               stats.num_frames_beam_reduced > 0 &&
+               stats.num_frames_max_active_reduced > 0 &&
+               stats.min_beam == config.min_beam &&
+               stats.min_max_active == config.min_max_active);
+
+  // Reset() goes back to the configured pruning at once, and keeps the stats.
+  for (int32 t = 0; t < 20; t++)
+    UpdateWithLoad(config, 3.0, max_active, &controller);
+  KALDI_ASSERT(controller.Beam() < beam);
+  controller.Reset(beam, max_active, min_active);
+  KALDI_ASSERT(controller.Beam() == beam &&
+               controller.MaxActive() == max_active &&
+               controller.Stats().num_frames == 2120);
+}
+
+// Checks that the controller does nothing unless a budget is set.
+void TestAdaptiveBeamControllerDisabled() {
+  AdaptiveBeamConfig config;
+  AdaptiveBeamController controller(config);
+  controller.Reset(13.0, 7000, 200);
+  KALDI_ASSERT(!controller.Enabled());
+  for (int32 t = 0; t < 100; t++)
+    controller.Update(1.0, 1000000);
+  KALDI_ASSERT(controller.Beam() == 13.0 && controller.MaxActive() == 7000 &&
+               controller.Stats().num_frames == 0);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestAdaptiveBeamController();
+  TestAdaptiveBeamControllerDisabled();
+  KALDI_LOG << "Tests succeeded.";
+}
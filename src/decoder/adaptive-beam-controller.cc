@@ -0,0 +1,137 @@
+// decoder/adaptive-beam-controller.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include "decoder/adaptive-beam-controller.h"
+
+namespace kaldi {
+
+AdaptiveBeamStats::AdaptiveBeamStats():
+    num_frames(0), num_frames_over_budget(0), num_frames_beam_reduced(0),
+    num_frames_max_active_reduced(0), tot_beam(0.0), tot_load(0.0),
+    min_beam(std::numeric_limits<BaseFloat>::infinity()),
+    min_max_active(std::numeric_limits<int32>::max()) { }
+
+void AdaptiveBeamStats::Add(const AdaptiveBeamStats &other) {
+  num_frames += other.num_frames;
+  num_frames_over_budget += other.num_frames_over_budget;
+  num_frames_beam_reduced += other.num_frames_beam_reduced;
+  num_frames_max_active_reduced += other.num_frames_max_active_reduced;
+  tot_beam += other.tot_beam;
+  tot_load += other.tot_load;
+  min_beam = std::min(min_beam, other.min_beam);
+  min_max_active = std::min(min_max_active, other.min_max_active);
+}
+
+void AdaptiveBeamStats::Print() const {
+  if (num_frames == 0) {
+    KALDI_LOG << "Adaptive beam: no frames decoded.";
+    return;
+  }
+  KALDI_LOG << "Adaptive beam: over " << num_frames << " frames, the load was "
+            << (tot_load / num_frames) << " of the target on average and over "
+            << "the target on " << (100.0 * num_frames_over_budget / num_frames)
+            << "% of frames.";
+  KALDI_LOG << "Adaptive beam: average beam was " << (tot_beam / num_frames)
+            << " (min " << min_beam << "); beam was reduced on "
+            << (100.0 * num_frames_beam_reduced / num_frames)
+            << "% and max-active on "
+            << (100.0 * num_frames_max_active_reduced / num_frames)
+            << "% of frames (min max-active " << min_max_active << ").";
+}
+
+AdaptiveBeamController::AdaptiveBeamController(
+    const AdaptiveBeamConfig &config):
+    config_(config), beam_limit_(0.0),
+    max_active_limit_(std::numeric_limits<int32>::max()), min_active_(0),
+    beam_(0.0), max_active_(std::numeric_limits<int32>::max()), load_(-1.0) {
+  config_.Check();
+}
+
+void AdaptiveBeamController::Reset(BaseFloat beam, int32 max_active,
+                                   int32 min_active) {
+  beam_limit_ = beam_ = beam;
+  max_active_limit_ = max_active_ = max_active;
+  min_active_ = min_active;
+  load_ = -1.0;
+}
+
+void AdaptiveBeamController::Update(double frame_time, size_t num_tokens) {
+  if (!config_.Enabled())
+    return;
+  // The cost of this frame relative to the budget; if we have budgets for
+  // both time and tokens, the one we are further over counts.
+  double load = 0.0;
+  if (config_.target_rtf > 0.0)
+    load = frame_time / (config_.target_rtf * config_.frame_shift);
+  if (config_.max_tokens > 0)
+    load = std::max(load, static_cast<double>(num_tokens) /
+                    config_.max_tokens);
+  if (load_ < 0.0)
+    load_ = load;
+  else
+    load_ += config_.smoothing * (load - load_);
+
+  int32 max_active_floor = std::max(config_.min_max_active, min_active_);
+  if (load_ > 1.0 + config_.tolerance) {
+    // Over budget: narrow the beam, and once it is as narrow as we allow,
+    // reduce max-active (starting from the number of tokens we actually have,
+    // since max-active may be much larger than that).
+    if (beam_ > config_.min_beam) {
+      beam_ = std::max(config_.min_beam, beam_ - config_.beam_step);
+    } else {
+      double max_active = std::min<double>(max_active_, num_tokens) *
+          (1.0 - config_.max_active_step);
+      max_active_ = std::max<int32>(max_active_floor, max_active);
+    }
+  } else if (load_ < 1.0 - config_.tolerance) {
+    // Under budget: undo the changes in the reverse order.
+    if (max_active_ < max_active_limit_) {
+      double max_active = max_active_ * (1.0 + config_.max_active_step) + 1.0;
+      // Once max-active is well above the number of tokens we have, it is
+      // no longer what limits the search.
+      if (max_active >= max_active_limit_ || max_active > 4.0 * num_tokens)
+        max_active_ = max_active_limit_;
+      else
+        max_active_ = static_cast<int32>(max_active);
+    } else {
+      beam_ = std::min(beam_limit_, beam_ + config_.beam_step);
+    }
+  }
+  // In case min-beam is larger than the configured beam.
+  beam_ = std::min(beam_, beam_limit_);
+  KALDI_VLOG(6) << "Adaptive beam: load is " << load_ << ", beam is " << beam_
+                << ", max-active is " << max_active_;
+
+  stats_.num_frames++;
+  if (load_ > 1.0)
+    stats_.num_frames_over_budget++;
+  if (beam_ < beam_limit_)
+    stats_.num_frames_beam_reduced++;
+  if (max_active_ < max_active_limit_)
+    stats_.num_frames_max_active_reduced++;
+  stats_.tot_beam += beam_;
+  stats_.tot_load += load_;
+  stats_.min_beam = std::min(stats_.min_beam, beam_);
+  stats_.min_max_active = std::min(stats_.min_max_active, max_active_);
+}
+
+
+}  // end namespace kaldi
@@ -0,0 +1,163 @@
+// decoder/adaptive-beam-controller.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_ADAPTIVE_BEAM_CONTROLLER_H_
+#define KALDI_DECODER_ADAPTIVE_BEAM_CONTROLLER_H_
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+
+namespace kaldi {
+
+
+/// Options for AdaptiveBeamController.  The controller is disabled unless
+/// --adaptive-target-rtf or --adaptive-max-tokens is set.
+struct AdaptiveBeamConfig {
+  BaseFloat target_rtf;
+  BaseFloat frame_shift;
+  int32 max_tokens;
+  BaseFloat min_beam;
+  int32 min_max_active;
+  BaseFloat beam_step;
+  BaseFloat max_active_step;
+  BaseFloat smoothing;
+  BaseFloat tolerance;
+
+  AdaptiveBeamConfig(): target_rtf(0.0), frame_shift(0.03), max_tokens(0),
+                        min_beam(6.0), min_max_active(500), beam_step(0.1),
+                        max_active_step(0.05), smoothing(0.1),
+                        tolerance(0.1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("adaptive-target-rtf", &target_rtf, "If >0, the decoder "
+                   "narrows the beam (and if necessary max-active) when the "
+                   "time taken per frame exceeds this real-time factor, and "
+                   "widens it again when it is below it.");
+    opts->Register("adaptive-frame-shift", &frame_shift, "Duration in seconds "
+                   "of a decoder frame, used with --adaptive-target-rtf (e.g. "
+                   "0.03 for models with a frame-subsampling-factor of 3).");
+    opts->Register("adaptive-max-tokens", &max_tokens, "If >0, the decoder "
+                   "narrows the beam (and if necessary max-active) when it "
+                   "expands more than this many tokens per frame on average.");
+    opts->Register("adaptive-min-beam", &min_beam, "The smallest beam that "
+                   "adaptive pruning will use.");
+    opts->Register("adaptive-min-max-active", &min_max_active, "The smallest "
+                   "max-active that adaptive pruning will use (it only reduces "
+                   "max-active once the beam is at --adaptive-min-beam).");
+    opts->Register("adaptive-beam-step", &beam_step, "Amount by which "
+                   "adaptive pruning changes the beam per frame.");
+    opts->Register("adaptive-max-active-step", &max_active_step, "Proportion "
+                   "by which adaptive pruning changes max-active per frame.");
+    opts->Register("adaptive-smoothing", &smoothing, "Constant of the moving "
+                   "average of the per-frame load used by adaptive pruning "
+                   "(larger reacts faster).");
+    opts->Register("adaptive-tolerance", &tolerance, "Adaptive pruning only "
+                   "changes the pruning when the load is more than this "
+                   "proportion above or below the target.");
+  }
+
+  void Check() const {
+    KALDI_ASSERT(target_rtf >= 0.0 && frame_shift > 0.0 && max_tokens >= 0 &&
+                 min_beam > 0.0 && min_max_active > 1 && beam_step > 0.0 &&
+                 max_active_step > 0.0 && max_active_step < 1.0 &&
+                 smoothing > 0.0 && smoothing <= 1.0 &&
+                 tolerance >= 0.0 && tolerance < 1.0);
+  }
+
+  bool Enabled() const { return target_rtf > 0.0 || max_tokens > 0; }
+};
+
+
+/// Statistics about what AdaptiveBeamController did, accumulated over frames
+/// (and possibly utterances or decoders, via Add()).
+struct AdaptiveBeamStats {
+  int64 num_frames;
+  // Number of frames on which the (smoothed) load was over the target.
+  int64 num_frames_over_budget;
+  // Number of frames decoded with a beam / max-active smaller than configured.
+  int64 num_frames_beam_reduced;
+  int64 num_frames_max_active_reduced;
+  double tot_beam;  // Sum of the beam over frames.
+  double tot_load;  // Sum of the smoothed load (relative to the target).
+  BaseFloat min_beam;  // Smallest beam used.
+  int32 min_max_active;  // Smallest max-active used.
+
+  AdaptiveBeamStats();
+
+  void Add(const AdaptiveBeamStats &other);
+
+  /// Prints the stats to the log.
+  void Print() const;
+};
+
+
+/**
+   AdaptiveBeamController adjusts the beam and max-active of a decoder (see
+   LatticeFasterDecoderTpl) so that it keeps to a budget of time or tokens per
+   frame, e.g. so that a server under load does not fall behind real time.
+   After each frame, the decoder calls Update() with the time that the frame
+   took and the number of tokens it expanded; the controller keeps a moving
+   average of these relative to the budget (the "load").  While the load is
+   too high, it narrows the beam by a small step each frame down to
+   --adaptive-min-beam, and after that reduces max-active; while the load is
+   too low it does the reverse, up to the configured beam and max-active.
+   There is a dead zone of +-(--adaptive-tolerance) around the target, so the
+   pruning does not oscillate.
+*/
+class AdaptiveBeamController {
+ public:
+  explicit AdaptiveBeamController(const AdaptiveBeamConfig &config);
+
+  /// Sets the largest beam and max-active to use (i.e. the configured ones),
+  /// and the min-active, and goes back to them.  The stats are kept.
+  void Reset(BaseFloat beam, int32 max_active, int32 min_active);
+
+  bool Enabled() const { return config_.Enabled(); }
+
+  /// Called after each frame with the time it took in seconds and the number of
+  /// tokens that were expanded.
+  void Update(double frame_time, size_t num_tokens);
+
+  /// The beam to use for the next frame.
+  BaseFloat Beam() const { return beam_; }
+
+  /// The max-active to use for the next frame.
+  int32 MaxActive() const { return max_active_; }
+
+  const AdaptiveBeamStats &Stats() const { return stats_; }
+
+ private:
+  const AdaptiveBeamConfig &config_;
+  BaseFloat beam_limit_;
+  int32 max_active_limit_;
+  int32 min_active_;
+
+  BaseFloat beam_;
+  int32 max_active_;
+  // Moving average of the per-frame cost divided by the budget; negative if
+  // not set yet.
+  double load_;
+
+  AdaptiveBeamStats stats_;
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_DECODER_ADAPTIVE_BEAM_CONTROLLER_H_
@@ -0,0 +1,131 @@
+// decoder/best-path-tracker-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <set>
+#include "decoder/best-path-tracker.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+typedef LatticeFasterOnlineDecoder::BestPathIterator BestPathIterator;
+
+// Traces back the best path from 'iter' to the start, and outputs the tokens
+// on it with their frames, from the start, and the number of words on the
+// path up to each of them.
+static void TraceBackTokens(const LatticeFasterOnlineDecoder &decoder,
+                            BestPathIterator iter,
+                            std::vector<std::pair<void*, int32> > *toks,
+                            std::vector<int32> *num_words) {
+  std::vector<int32> olabels;
+  toks->clear();
+  while (!iter.Done()) {
+    toks->push_back(std::pair<void*, int32>(iter.tok, iter.frame + 1));
+    LatticeArc arc;
+    iter = decoder.TraceBackBestPath(iter, &arc);
+    olabels.push_back(arc.olabel);
+  }
+  std::reverse(toks->begin(), toks->end());
+  std::reverse(olabels.begin(), olabels.end());
+  num_words->resize(olabels.size());
+  for (size_t i = 0; i < olabels.size(); i++)
+    (*num_words)[i] = (i == 0 ? 0 : (*num_words)[i - 1]) +
+        (olabels[i] != 0 ? 1 : 0);
+}
+
+// Checks the words and the number of stable words against what we get by
+// tracing back the best paths of all the active tokens from scratch.
+static void CheckBestPathTracker(const LatticeFasterOnlineDecoder &decoder,
+                                 const BestPathTracker &tracker) {
+  std::vector<std::pair<void*, int32> > best_toks;
+  std::vector<int32> best_num_words;
+  TraceBackTokens(decoder, decoder.BestPathEnd(false), &best_toks,
+                  &best_num_words);
+
+  Lattice best_path;
+  decoder.GetBestPath(&best_path, false);
+  std::vector<int32> alignment, words;
+  LatticeWeight weight;
+  GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+  KALDI_ASSERT(tracker.Words() == words);
+  KALDI_ASSERT(static_cast<int32>(words.size()) == best_num_words.back());
+
+  // The last token on the best path that is on the best paths of all the
+  // active tokens.
+  int32 stable_pos = best_toks.size() - 1;
+  std::vector<BestPathIterator> iters;
+  decoder.LastFrameTokens(&iters);
+  for (size_t i = 0; i < iters.size(); i++) {
+    std::vector<std::pair<void*, int32> > toks;
+    std::vector<int32> num_words;
+    TraceBackTokens(decoder, iters[i], &toks, &num_words);
+    std::set<std::pair<void*, int32> > tok_set(toks.begin(), toks.end());
+    while (tok_set.count(best_toks[stable_pos]) == 0)
+      stable_pos--;
+  }
+  KALDI_ASSERT(tracker.NumStableWords() == best_num_words[stable_pos]);
+}
+
+void TestBestPathTracker() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandDecodingGraph(*trans_model, 10, true);
+  Matrix<BaseFloat> loglikes;
+  int32 num_frames = 100 + Rand() % 100;
+  GenRandLoglikes(*trans_model, num_frames, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  // Small beams and frequent pruning, so that tokens are deleted and their
+  // memory reused while we track the best path.
+  LatticeFasterDecoderConfig config;
+  config.beam = 4.0 + Rand() % 10;
+  config.lattice_beam = 1.0 + Rand() % 5;
+  config.prune_interval = 1 + Rand() % 10;
+  LatticeFasterOnlineDecoder decoder(*graph, config);
+  BestPathTracker tracker(decoder);
+  decoder.InitDecoding();
+  tracker.Init();
+  std::vector<int32> stable_words;
+  while (decoder.NumFramesDecoded() < num_frames) {
+    decoder.AdvanceDecoding(&decodable, 1 + Rand() % 5);
+    tracker.Update();
+    CheckBestPathTracker(decoder, tracker);
+    // The stable words can only be added to.
+    KALDI_ASSERT(tracker.NumStableWords() >=
+                 static_cast<int32>(stable_words.size()) &&
+                 std::equal(stable_words.begin(), stable_words.end(),
+                            tracker.Words().begin()));
+    stable_words.assign(tracker.Words().begin(),
+                        tracker.Words().begin() + tracker.NumStableWords());
+  }
+
+  delete graph;
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestBestPathTracker();
+  KALDI_LOG << "Success.";
+}
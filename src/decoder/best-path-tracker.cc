@@ -0,0 +1,230 @@
+// decoder/best-path-tracker.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "decoder/best-path-tracker.h"
+
+namespace kaldi {
+
+// We don't call PruneJoins() while the joins take up fewer entries than this.
+static const size_t kMinPruneJoinsSize = 1000;
+
+template <typename FST>
+BestPathTrackerTpl<FST>::BestPathTrackerTpl(
+    const LatticeFasterOnlineDecoderTpl<FST> &decoder):
+    decoder_(decoder), prune_joins_size_(kMinPruneJoinsSize), stable_pos_(0),
+    num_stable_words_(0) { }
+
+template <typename FST>
+void BestPathTrackerTpl<FST>::Init() {
+  path_.clear();
+  positions_.clear();
+  words_.clear();
+  joins_.clear();
+  branch_join_pos_.clear();
+  prune_joins_size_ = kMinPruneJoinsSize;
+  stable_pos_ = 0;
+  num_stable_words_ = 0;
+}
+
+template <typename FST>
+bool BestPathTrackerTpl<FST>::Update(bool use_final_probs) {
+  if (decoder_.NumFramesDecoded() == 0)
+    return false;
+  BestPathIterator iter = decoder_.BestPathEnd(use_final_probs);
+  if (iter.Done())
+    return false;  // would have printed a warning.
+
+  // Trace back the new best path until it joins the old one.
+  std::vector<PathElement> new_elems;
+  std::vector<int32> new_olabels;
+  int32 join_pos = -1;
+  while (!iter.Done()) {
+    Token *tok = static_cast<Token*>(iter.tok);
+    // The frame of the token is one more than that of the iterator; see the
+    // comment for BestPathIterator.
+    int32 frame = iter.frame + 1;
+    typename unordered_map<Token*, int32>::const_iterator pos_iter =
+        positions_.find(tok);
+    if (pos_iter != positions_.end() &&
+        path_[pos_iter->second].frame == frame) {
+      join_pos = pos_iter->second;
+      break;
+    }
+    LatticeArc arc;
+    iter = decoder_.TraceBackBestPath(iter, &arc);
+    PathElement elem;
+    elem.tok = tok;
+    elem.frame = frame;
+    elem.num_words = 0;  // set below.
+    new_elems.push_back(elem);
+    new_olabels.push_back(arc.olabel);
+  }
+
+  // Remove the part of the old best path after the point where they join.
+  int32 old_path_size = path_.size(),
+      old_num_words = words_.size(),
+      old_num_stable_words = num_stable_words_,
+      num_kept_words = (join_pos >= 0 ? path_[join_pos].num_words : 0);
+  std::vector<int32> removed_words(words_.begin() + num_kept_words,
+                                   words_.end());
+  for (int32 i = join_pos + 1; i < static_cast<int32>(path_.size()); i++)
+    positions_.erase(path_[i].tok);
+  path_.resize(join_pos + 1);
+  words_.resize(num_kept_words);
+
+  // Add the new part.
+  for (int32 i = static_cast<int32>(new_elems.size()) - 1; i >= 0; i--) {
+    if (new_olabels[i] != 0)
+      words_.push_back(new_olabels[i]);
+    new_elems[i].num_words = words_.size();
+    positions_[new_elems[i].tok] = path_.size();
+    path_.push_back(new_elems[i]);
+  }
+  // The stable part of the path can't have changed, but be careful.
+  stable_pos_ = std::min(stable_pos_, std::max<int32>(join_pos, 0));
+  InvalidateJoins(join_pos, old_path_size, new_elems);
+
+  UpdateStablePrefix();
+
+  return (num_stable_words_ != old_num_stable_words ||
+          static_cast<int32>(words_.size()) != old_num_words ||
+          !std::equal(removed_words.begin(), removed_words.end(),
+                      words_.begin() + num_kept_words));
+}
+
+template <typename FST>
+void BestPathTrackerTpl<FST>::InvalidateJoins(
+    int32 join_pos, int32 old_path_size,
+    const std::vector<PathElement> &new_elems) {
+  // The tokens whose best paths joined the part of the old best path that was
+  // removed now join it further back, or join the new part.
+  if (join_pos + 1 < old_path_size) {
+    for (size_t b = 0; b < branch_join_pos_.size(); b++)
+      if (branch_join_pos_[b] > join_pos)
+        branch_join_pos_[b] = -1;
+  }
+  // If the new part of the best path goes through a branch, the tokens in that
+  // branch after it now join the best path there.
+  for (size_t i = 0; i < new_elems.size(); i++) {
+    typename unordered_map<Token*, TokenJoin>::iterator iter =
+        joins_.find(new_elems[i].tok);
+    if (iter != joins_.end() && iter->second.frame == new_elems[i].frame) {
+      branch_join_pos_[iter->second.branch] = -1;
+      joins_.erase(iter);
+    }
+  }
+}
+
+template <typename FST>
+void BestPathTrackerTpl<FST>::PruneJoins() {
+  // The best paths of all active tokens, and of all tokens that will be active
+  // later, go through path_[stable_pos_], so we won't trace back to any tokens
+  // before it.
+  int32 stable_frame = path_[stable_pos_].frame;
+  std::vector<int32> new_branch(branch_join_pos_.size(), -1);
+  std::vector<int32> new_branch_join_pos;
+  typename unordered_map<Token*, TokenJoin>::iterator iter = joins_.begin();
+  while (iter != joins_.end()) {
+    int32 branch = iter->second.branch;
+    if (iter->second.frame < stable_frame || branch_join_pos_[branch] < 0) {
+      iter = joins_.erase(iter);
+      continue;
+    }
+    if (new_branch[branch] < 0) {
+      new_branch[branch] = new_branch_join_pos.size();
+      new_branch_join_pos.push_back(branch_join_pos_[branch]);
+    }
+    iter->second.branch = new_branch[branch];
+    ++iter;
+  }
+  branch_join_pos_.swap(new_branch_join_pos);
+}
+
+template <typename FST>
+void BestPathTrackerTpl<FST>::UpdateStablePrefix() {
+  std::vector<BestPathIterator> iters;
+  decoder_.LastFrameTokens(&iters);
+  std::vector<PathElement> chain;
+  int32 min_pos = static_cast<int32>(path_.size()) - 1;
+  // Since the stable part of the path is shared by all tokens, we can stop
+  // once we get back to it.
+  for (size_t i = 0; i < iters.size() && min_pos > stable_pos_; i++) {
+    BestPathIterator iter = iters[i];
+    int32 pos = -1, branch = -1;
+    chain.clear();
+    // Trace back until we get to the best path or to a token whose join we
+    // know.  The best path of every token goes back to the start token, which
+    // is on the best path.
+    while (true) {
+      KALDI_ASSERT(!iter.Done());
+      Token *tok = static_cast<Token*>(iter.tok);
+      int32 frame = iter.frame + 1;
+      typename unordered_map<Token*, int32>::const_iterator pos_iter =
+          positions_.find(tok);
+      if (pos_iter != positions_.end() &&
+          path_[pos_iter->second].frame == frame) {
+        pos = pos_iter->second;
+        break;
+      }
+      typename unordered_map<Token*, TokenJoin>::const_iterator join_iter =
+          joins_.find(tok);
+      if (join_iter != joins_.end() && join_iter->second.frame == frame &&
+          branch_join_pos_[join_iter->second.branch] >= 0) {
+        branch = join_iter->second.branch;
+        pos = branch_join_pos_[branch];
+        break;
+      }
+      PathElement elem;
+      elem.tok = tok;
+      elem.frame = frame;
+      elem.num_words = 0;  // unused.
+      chain.push_back(elem);
+      LatticeArc arc;
+      iter = decoder_.TraceBackBestPath(iter, &arc);
+    }
+    if (!chain.empty()) {
+      if (branch < 0) {
+        branch = branch_join_pos_.size();
+        branch_join_pos_.push_back(pos);
+      }
+      for (size_t j = 0; j < chain.size(); j++) {
+        TokenJoin &join = joins_[chain[j].tok];
+        join.frame = chain[j].frame;
+        join.branch = branch;
+      }
+    }
+    min_pos = std::min(min_pos, pos);
+  }
+  stable_pos_ = std::max(stable_pos_, min_pos);
+  num_stable_words_ = path_[stable_pos_].num_words;
+
+  if (joins_.size() + branch_join_pos_.size() > prune_joins_size_) {
+    PruneJoins();
+    prune_joins_size_ = std::max(
+        kMinPruneJoinsSize, 2 * (joins_.size() + branch_join_pos_.size()));
+  }
+}
+
+// Instantiate the template for the FST types that we'll need.
+template class BestPathTrackerTpl<fst::Fst<fst::StdArc> >;
+template class BestPathTrackerTpl<fst::GrammarFst>;
+
+
+}  // end namespace kaldi
@@ -0,0 +1,148 @@
+// decoder/best-path-tracker.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_BEST_PATH_TRACKER_H_
+#define KALDI_DECODER_BEST_PATH_TRACKER_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/stl-utils.h"
+#include "decoder/lattice-faster-online-decoder.h"
+
+namespace kaldi {
+
+
+/**
+   BestPathTracker keeps track of the word sequence on the current best path
+   of a LatticeFasterOnlineDecoderTpl object, e.g. for displaying partial
+   results while decoding.  Calling GetBestPath() and getting the words from
+   it each time would trace back through the whole utterance; instead we
+   remember the best path from last time, and trace back the new best path
+   only until it joins the old one.  Usually that is within a few frames of the
+   end, so each call takes time proportional to the number of new frames.
+
+   It also works out how many of the words are "stable", meaning they are on
+   the best path through every token that is currently active, so they can't
+   change any more (the best paths through the tokens, as given by their
+   backpointers, all meet at some point; the words before that are stable).
+   For this we remember, between calls, where the best path of each token we
+   have traced back joins the current best path, so each token is normally
+   traced back only once; we only need to trace back again the tokens whose
+   join point may have changed because the best path changed.
+
+   Call Init() after the decoder's InitDecoding(), and Update() whenever you
+   want the current best path (e.g. after AdvanceDecoding()).
+*/
+template <typename FST>
+class BestPathTrackerTpl {
+ public:
+  typedef decoder::BackpointerToken Token;
+  typedef typename LatticeFasterOnlineDecoderTpl<FST>::BestPathIterator
+      BestPathIterator;
+
+  /// The decoder must outlive this object.
+  explicit BestPathTrackerTpl(
+      const LatticeFasterOnlineDecoderTpl<FST> &decoder);
+
+  /// Forgets the best path; call this after the decoder's InitDecoding().
+  void Init();
+
+  /// Updates the best path after the decoder has decoded more frames (it is
+  /// OK to call it when it has not).  "use_final_probs" is as for
+  /// LatticeFasterOnlineDecoderTpl::BestPathEnd().  Returns true if the word
+  /// sequence (or the number of stable words) changed since the last call.
+  bool Update(bool use_final_probs = false);
+
+  /// Returns the word sequence on the best path, as of the last call to
+  /// Update().
+  const std::vector<int32> &Words() const { return words_; }
+
+  /// Returns the number of words at the start of Words() that will not change
+  /// any more.
+  int32 NumStableWords() const { return num_stable_words_; }
+
+ private:
+  struct PathElement {
+    Token *tok;
+    // The frame the token is on.  We need this because the tokens on the old
+    // best path may have been deleted since, and a new token (on a later
+    // frame) may have been allocated at the same address.
+    int32 frame;
+    // The number of words on the path up to this token.
+    int32 num_words;
+  };
+
+  // Information about a token that is not on the best path, whose best path
+  // we have traced back.
+  struct TokenJoin {
+    // The frame the token is on (see PathElement::frame).
+    int32 frame;
+    // An index into branch_join_pos_.
+    int32 branch;
+  };
+
+  // Called from Update() when the best path has changed, after path_ is
+  // updated: forgets the joins that may be wrong now.  "join_pos" is the
+  // position in path_ where the old and new best paths join, "old_path_size"
+  // is the old size of path_, and "new_elems" are the elements added.
+  void InvalidateJoins(int32 join_pos, int32 old_path_size,
+                       const std::vector<PathElement> &new_elems);
+
+  // Forgets the joins of tokens that we will not see again: those before the
+  // stable part of the path, and those in invalidated branches.
+  void PruneJoins();
+
+  // Works out num_stable_words_ from the tokens on the last frame.
+  void UpdateStablePrefix();
+
+  const LatticeFasterOnlineDecoderTpl<FST> &decoder_;
+
+  // The tokens on the best path, from the start.
+  std::vector<PathElement> path_;
+  // Maps the tokens in path_ to their position.
+  unordered_map<Token*, int32> positions_;
+  std::vector<int32> words_;
+  // The tokens that are not on the best path whose best paths we have traced
+  // back, with the branch they are in.  A branch is a set of such tokens whose
+  // best paths join path_ at the same position, and it includes all the tokens
+  // between them and that position.  If the best path changes in a way that
+  // may change where a branch joins it (see InvalidateJoins()), the whole
+  // branch is invalidated and its tokens are traced back again when needed.
+  unordered_map<Token*, TokenJoin> joins_;
+  // For each branch, the position in path_ where its tokens' best paths join
+  // it, or -1 if the branch was invalidated.
+  std::vector<int32> branch_join_pos_;
+  // We call PruneJoins() when joins_.size() + branch_join_pos_.size() exceeds
+  // this.
+  size_t prune_joins_size_;
+
+  // The position in path_ of the last token that all the currently active
+  // tokens' best paths go through.
+  int32 stable_pos_;
+  int32 num_stable_words_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BestPathTrackerTpl);
+};
+
+typedef BestPathTrackerTpl<fst::StdFst> BestPathTracker;
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_DECODER_BEST_PATH_TRACKER_H_
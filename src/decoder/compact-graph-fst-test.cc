@@ -0,0 +1,212 @@
+// decoder/compact-graph-fst-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <sstream>
+#include "decoder/compact-graph-fst.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace fst {
+
+// Returns a random FST with 'num_states' states and 'num_arcs' arcs, with
+// input labels below 'max_ilabel', about half of the output labels epsilon,
+// and arc weights that are random multiples of 1 / 'num_weights' in [0, 10),
+// or fully random if 'num_weights' is 0.  The caller owns the result.
+static VectorFst<StdArc> *GenRandFst(int32 num_states, int32 num_arcs,
+                                     int32 max_ilabel, int32 num_weights) {
+  VectorFst<StdArc> *fst = new VectorFst<StdArc>();
+  for (int32 s = 0; s < num_states; s++) {
+    fst->AddState();
+    if (kaldi::Rand() % 5 == 0)
+      fst->SetFinal(s, TropicalWeight(10.0 * kaldi::RandUniform()));
+  }
+  fst->SetStart(kaldi::Rand() % num_states);
+  for (int32 i = 0; i < num_arcs; i++) {
+    float weight = (num_weights == 0 ? 10.0 * kaldi::RandUniform() :
+                    10.0 * (kaldi::Rand() % num_weights) / num_weights);
+    fst->AddArc(kaldi::Rand() % num_states,
+                StdArc(kaldi::Rand() % max_ilabel,
+                       (kaldi::Rand() % 2 == 0 ? 0 : 1 + kaldi::Rand() % 1000),
+                       TropicalWeight(weight), kaldi::Rand() % num_states));
+  }
+  return fst;
+}
+
+// Checks that 'compact_fst' has the same states, start state and final
+// weights as 'fst', and the same arcs except for the order (the input-epsilon
+// arcs of each state come first) and the weights, which may differ by up to
+// 'max_weight_error'.
+static void CheckCompactGraphFst(const VectorFst<StdArc> &fst,
+                                 const CompactGraphFst &compact_fst,
+                                 float max_weight_error) {
+  KALDI_ASSERT(compact_fst.NumStates() == fst.NumStates());
+  KALDI_ASSERT(compact_fst.Start() == fst.Start());
+  for (StdArc::StateId s = 0; s < fst.NumStates(); s++) {
+    KALDI_ASSERT(compact_fst.Final(s) == fst.Final(s));
+    std::vector<StdArc> arcs;
+    for (ArcIterator<VectorFst<StdArc> > aiter(fst, s); !aiter.Done();
+         aiter.Next())
+      arcs.push_back(aiter.Value());
+    std::stable_partition(arcs.begin(), arcs.end(),
+                          [](const StdArc &arc) { return arc.ilabel == 0; });
+    KALDI_ASSERT(compact_fst.NumArcs(s) == arcs.size());
+    KALDI_ASSERT(compact_fst.NumInputEpsilons(s) == fst.NumInputEpsilons(s));
+    size_t i = 0;
+    for (ArcIterator<CompactGraphFst> aiter(compact_fst, s); !aiter.Done();
+         aiter.Next(), i++) {
+      const StdArc &arc = aiter.Value();
+      KALDI_ASSERT(arc.ilabel == arcs[i].ilabel &&
+                   arc.olabel == arcs[i].olabel &&
+                   arc.nextstate == arcs[i].nextstate);
+      KALDI_ASSERT(std::abs(arc.weight.Value() - arcs[i].weight.Value()) <=
+                   max_weight_error);
+    }
+    KALDI_ASSERT(i == arcs.size());
+  }
+}
+
+// Checks that a random FST with few distinct weights is stored exactly, and
+// that it is the same after writing and reading it.
+void TestCompactGraphFstRoundTrip() {
+  int32 num_states = kaldi::RandInt(1, 200);
+  VectorFst<StdArc> *fst = GenRandFst(num_states,
+                                      kaldi::RandInt(0, 5 * num_states),
+                                      kaldi::RandInt(1, 5000),
+                                      kaldi::RandInt(1, 1000));
+  float max_weight_error;
+  CompactGraphFst compact_fst(*fst, &max_weight_error);
+  KALDI_ASSERT(max_weight_error == 0.0);
+  CheckCompactGraphFst(*fst, compact_fst, 0.0);
+
+  std::ostringstream os;
+  compact_fst.Write(os, true);
+  CompactGraphFst compact_fst2;
+  std::istringstream is(os.str());
+  compact_fst2.Read(is, true);
+  CheckCompactGraphFst(*fst, compact_fst2, 0.0);
+  KALDI_ASSERT(compact_fst2.MemorySize() == compact_fst.MemorySize());
+  delete fst;
+}
+
+// Checks the quantization of the weights to a uniform grid, which is used
+// when there are more than 65536 distinct weights, or fewer if the input
+// labels are so large that the weight index gets fewer than 16 bits: the
+// error must be at most half of the grid step.
+void TestCompactGraphFstQuantization() {
+  bool large_ilabels = (kaldi::Rand() % 2 == 0);
+  int32 num_arcs = (large_ilabels ? 10000 : 70000),
+      max_ilabel = (large_ilabels ? (1 << 20) : 100);
+  VectorFst<StdArc> *fst = GenRandFst(1000, num_arcs, max_ilabel, 0);
+  float min_weight = 10.0, max_weight = 0.0;
+  StdArc::Label max_arc_ilabel = 0;
+  for (StateIterator<VectorFst<StdArc> > siter(*fst); !siter.Done();
+       siter.Next()) {
+    for (ArcIterator<VectorFst<StdArc> > aiter(*fst, siter.Value());
+         !aiter.Done(); aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      min_weight = std::min(min_weight, arc.weight.Value());
+      max_weight = std::max(max_weight, arc.weight.Value());
+      max_arc_ilabel = std::max(max_arc_ilabel, arc.ilabel);
+    }
+  }
+  // The weight index gets the bits of the 32 that the ilabel does not need,
+  // up to 16.
+  int32 ilabel_bits = 1;
+  while ((1 << ilabel_bits) <= max_arc_ilabel)
+    ilabel_bits++;
+  int32 num_weights = std::min(65536, 1 << (32 - ilabel_bits));
+  float half_step = 0.5 * (max_weight - min_weight) / (num_weights - 1);
+
+  float max_weight_error;
+  CompactGraphFst compact_fst(*fst, &max_weight_error);
+  // We allow for roundoff in computing the grid.
+  KALDI_ASSERT(max_weight_error > 0.0 &&
+               max_weight_error <= half_step + 1.0e-05);
+  CheckCompactGraphFst(*fst, compact_fst, max_weight_error);
+  delete fst;
+}
+
+}  // namespace fst
+
+namespace kaldi {
+
+// Checks that decoding with a CompactGraphFst gives the same results as with
+// the ConstFst it was made from.
+void TestCompactGraphFstDecoding() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandDecodingGraph(*trans_model, 10, true);
+  fst::ConstFst<fst::StdArc> const_graph(*graph);
+  float max_weight_error;
+  fst::CompactGraphFst compact_graph(*graph, &max_weight_error);
+  KALDI_ASSERT(max_weight_error == 0.0);
+
+  Matrix<BaseFloat> loglikes;
+  GenRandLoglikes(*trans_model, 20 + Rand() % 80, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+  LatticeFasterDecoderConfig config;
+  config.beam = 8.0 + Rand() % 8;
+  config.lattice_beam = 2.0 + Rand() % 4;
+
+  LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc> > const_decoder(
+      const_graph, config);
+  LatticeFasterDecoderTpl<fst::CompactGraphFst> compact_decoder(
+      compact_graph, config);
+  KALDI_ASSERT(const_decoder.Decode(&decodable));
+  KALDI_ASSERT(compact_decoder.Decode(&decodable));
+  KALDI_ASSERT(const_decoder.NumFramesDecoded() ==
+               compact_decoder.NumFramesDecoded());
+
+  // The arcs are in a different order in the two graphs, so the lattices may
+  // have their states numbered differently.
+  Lattice const_best_path, compact_best_path;
+  const_decoder.GetBestPath(&const_best_path, true);
+  compact_decoder.GetBestPath(&compact_best_path, true);
+  std::vector<int32> const_ali, const_words, compact_ali, compact_words;
+  LatticeWeight const_weight, compact_weight;
+  GetLinearSymbolSequence(const_best_path, &const_ali, &const_words,
+                          &const_weight);
+  GetLinearSymbolSequence(compact_best_path, &compact_ali, &compact_words,
+                          &compact_weight);
+  KALDI_ASSERT(const_words == compact_words && const_ali == compact_ali);
+  KALDI_ASSERT(fst::ApproxEqual(const_weight, compact_weight));
+
+  CompactLattice const_clat, compact_clat;
+  KALDI_ASSERT(const_decoder.GetLattice(&const_clat, true));
+  KALDI_ASSERT(compact_decoder.GetLattice(&compact_clat, true));
+  KALDI_ASSERT(CompactLatticesEquivalent(const_clat, compact_clat));
+
+  delete graph;
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 20; i++)
+    fst::TestCompactGraphFstRoundTrip();
+  for (int32 i = 0; i < 4; i++)
+    fst::TestCompactGraphFstQuantization();
+  for (int32 i = 0; i < 10; i++)
+    kaldi::TestCompactGraphFstDecoding();
+  KALDI_LOG << "Tests succeeded.";
+}
@@ -0,0 +1,259 @@
+// decoder/compact-graph-fst.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+#include "decoder/compact-graph-fst.h"
+#include "fstext/kaldi-fst-io.h"
+#include "util/kaldi-io.h"
+
+namespace fst {
+
+// The maximum number of entries in the weight table.  Keeping it small keeps
+// the table in cache (65536 floats are 256KB).
+static const size_t kMaxNumWeights = 65536;
+
+CompactGraphFst::CompactGraphFst(const Fst<StdArc> &fst,
+                                 float *max_weight_error) {
+  using kaldi::int64;
+  // First pass: find the largest ilabel, and the distinct arc weights (as long
+  // as there are no more of them than we can store exactly).
+  Label max_ilabel = 0;
+  int64 num_states = 0, num_arcs = 0, num_olabels = 0;
+  float min_weight = std::numeric_limits<float>::infinity(),
+      max_weight = -min_weight;
+  std::unordered_set<float> distinct_weights;
+  bool weights_exact = true;
+  for (StateIterator<Fst<StdArc> > siter(fst); !siter.Done(); siter.Next()) {
+    StateId s = siter.Value();
+    num_states = std::max<int64>(num_states, s + 1);
+    for (ArcIterator<Fst<StdArc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      float weight = arc.weight.Value();
+      if (arc.ilabel < 0 || arc.olabel < 0 || !KALDI_ISFINITE(weight))
+        KALDI_ERR << "Can't convert FST with negative labels or non-finite "
+                  << "arc weights to CompactGraphFst.";
+      max_ilabel = std::max(max_ilabel, arc.ilabel);
+      min_weight = std::min(min_weight, weight);
+      max_weight = std::max(max_weight, weight);
+      if (weights_exact) {
+        distinct_weights.insert(weight);
+        if (distinct_weights.size() > kMaxNumWeights) {
+          weights_exact = false;
+          distinct_weights.clear();
+        }
+      }
+      num_arcs++;
+      if (arc.olabel != 0)
+        num_olabels++;
+    }
+  }
+  // We store 2 * nextstate + 1 in a uint32, and the arc and olabel offsets
+  // (including the one-past-the-end offset) in uint32's.
+  if (num_states >= (static_cast<int64>(1) << 31) ||
+      num_arcs >= (static_cast<int64>(1) << 32) ||
+      num_olabels >= (static_cast<int64>(1) << 32))
+    KALDI_ERR << "FST is too large for CompactGraphFst: " << num_states
+              << " states, " << num_arcs << " arcs.";
+
+  ilabel_bits_ = 1;
+  while ((static_cast<int64>(1) << ilabel_bits_) <= max_ilabel)
+    ilabel_bits_++;
+  ilabel_mask_ = (static_cast<uint32>(1) << ilabel_bits_) - 1;
+  // The weight index gets the remaining 32 - ilabel_bits_ bits.  We insist on
+  // at least 256 weights, which is quite coarse already.
+  if (ilabel_bits_ > 24)
+    KALDI_ERR << "Input labels are too large for CompactGraphFst: "
+              << max_ilabel;
+  size_t num_weights = std::min<size_t>(
+      kMaxNumWeights, static_cast<size_t>(1) << (32 - ilabel_bits_));
+  if (weights_exact && distinct_weights.size() > num_weights)
+    weights_exact = false;
+
+  float weight_step = 0.0;
+  if (weights_exact) {
+    weights_.assign(distinct_weights.begin(), distinct_weights.end());
+    std::sort(weights_.begin(), weights_.end());
+  } else {
+    weight_step = (max_weight - min_weight) / (num_weights - 1);
+    weights_.resize(num_weights);
+    for (size_t i = 0; i < num_weights; i++)
+      weights_[i] = min_weight + i * weight_step;
+  }
+
+  // Second pass: build the arrays.
+  float max_error = 0.0;
+  start_ = fst.Start();
+  states_.resize(num_states + 1);
+  arcs_.reserve(num_arcs);
+  olabels_.reserve(num_olabels);
+  std::vector<StdArc> state_arcs;
+  for (StateId s = 0; s < num_states; s++) {
+    states_[s].arc_start = arcs_.size();
+    states_[s].olabel_start = olabels_.size();
+    Weight final_weight = fst.Final(s);
+    if (final_weight != Weight::Zero()) {
+      FinalWeight f;
+      f.state = s;
+      f.weight = final_weight.Value();
+      finals_.push_back(f);
+    }
+    state_arcs.clear();
+    for (ArcIterator<Fst<StdArc> > aiter(fst, s); !aiter.Done(); aiter.Next())
+      state_arcs.push_back(aiter.Value());
+    // Put the input-epsilon arcs first; see NumInputEpsilons().
+    std::stable_partition(state_arcs.begin(), state_arcs.end(),
+                          [](const StdArc &arc) { return arc.ilabel == 0; });
+    for (size_t i = 0; i < state_arcs.size(); i++) {
+      const StdArc &arc = state_arcs[i];
+      float weight = arc.weight.Value();
+      size_t weight_index;
+      if (weights_exact) {
+        weight_index = std::lower_bound(weights_.begin(), weights_.end(),
+                                        weight) - weights_.begin();
+      } else {
+        weight_index = static_cast<size_t>(
+            (weight - min_weight) / weight_step + 0.5);
+        weight_index = std::min(weight_index, num_weights - 1);
+      }
+      max_error = std::max(max_error,
+                           std::abs(weights_[weight_index] - weight));
+      CompactArc compact_arc;
+      compact_arc.ilabel_weight = static_cast<uint32>(arc.ilabel) |
+          (static_cast<uint32>(weight_index) << ilabel_bits_);
+      compact_arc.nextstate_olabel = (static_cast<uint32>(arc.nextstate) << 1) |
+          (arc.olabel != 0 ? 1 : 0);
+      arcs_.push_back(compact_arc);
+      if (arc.olabel != 0)
+        olabels_.push_back(arc.olabel);
+    }
+  }
+  states_[num_states].arc_start = arcs_.size();
+  states_[num_states].olabel_start = olabels_.size();
+  if (max_weight_error != NULL)
+    *max_weight_error = max_error;
+}
+
+CompactGraphFst::Weight CompactGraphFst::Final(StateId s) const {
+  FinalWeight f;
+  f.state = s;
+  std::vector<FinalWeight>::const_iterator iter =
+      std::lower_bound(finals_.begin(), finals_.end(), f);
+  if (iter != finals_.end() && iter->state == s)
+    return Weight(iter->weight);
+  else
+    return Weight::Zero();
+}
+
+size_t CompactGraphFst::MemorySize() const {
+  return weights_.size() * sizeof(float) +
+      states_.size() * sizeof(CompactState) +
+      arcs_.size() * sizeof(CompactArc) +
+      olabels_.size() * sizeof(Label) +
+      finals_.size() * sizeof(FinalWeight);
+}
+
+// Writes the contents of a vector of a plain-old-data type to a binary stream.
+template <class T>
+static void WriteRawVector(std::ostream &os, const std::vector<T> &vec) {
+  kaldi::int64 size = vec.size();
+  kaldi::WriteBasicType(os, true, size);
+  if (size != 0)
+    os.write(reinterpret_cast<const char*>(vec.data()), size * sizeof(T));
+}
+
+template <class T>
+static void ReadRawVector(std::istream &is, std::vector<T> *vec) {
+  kaldi::int64 size;
+  kaldi::ReadBasicType(is, true, &size);
+  if (size < 0)
+    KALDI_ERR << "Invalid size " << size << " reading CompactGraphFst";
+  vec->resize(size);
+  if (size != 0)
+    is.read(reinterpret_cast<char*>(vec->data()), size * sizeof(T));
+  if (is.fail())
+    KALDI_ERR << "Error reading CompactGraphFst";
+}
+
+void CompactGraphFst::Write(std::ostream &os, bool binary) const {
+  using namespace kaldi;
+  if (!binary)
+    KALDI_ERR << "CompactGraphFst::Write only supports binary mode.";
+  int32 format = 1;
+  WriteToken(os, binary, "<CompactGraphFst>");
+  WriteBasicType(os, binary, format);
+  WriteBasicType(os, binary, start_);
+  WriteBasicType(os, binary, ilabel_bits_);
+  WriteRawVector(os, weights_);
+  WriteRawVector(os, states_);
+  WriteRawVector(os, arcs_);
+  WriteRawVector(os, olabels_);
+  WriteRawVector(os, finals_);
+  WriteToken(os, binary, "</CompactGraphFst>");
+}
+
+void CompactGraphFst::Read(std::istream &is, bool binary) {
+  using namespace kaldi;
+  if (!binary)
+    KALDI_ERR << "CompactGraphFst::Read only supports binary mode.";
+  int32 format;
+  ExpectToken(is, binary, "<CompactGraphFst>");
+  ReadBasicType(is, binary, &format);
+  if (format != 1)
+    KALDI_ERR << "This version of the code cannot read this CompactGraphFst, "
+        "update your code.";
+  ReadBasicType(is, binary, &start_);
+  ReadBasicType(is, binary, &ilabel_bits_);
+  if (ilabel_bits_ < 1 || ilabel_bits_ > 24)
+    KALDI_ERR << "Invalid CompactGraphFst (ilabel-bits = " << ilabel_bits_
+              << ")";
+  ilabel_mask_ = (static_cast<uint32>(1) << ilabel_bits_) - 1;
+  ReadRawVector(is, &weights_);
+  ReadRawVector(is, &states_);
+  ReadRawVector(is, &arcs_);
+  ReadRawVector(is, &olabels_);
+  ReadRawVector(is, &finals_);
+  ExpectToken(is, binary, "</CompactGraphFst>");
+  if (states_.empty() || states_.back().arc_start != arcs_.size() ||
+      states_.back().olabel_start != olabels_.size())
+    KALDI_ERR << "Invalid CompactGraphFst (arrays have inconsistent sizes).";
+}
+
+void ReadDecodingGraph(const std::string &rxfilename,
+                       Fst<StdArc> **fst,
+                       CompactGraphFst **compact_fst) {
+  *fst = NULL;
+  *compact_fst = NULL;
+  bool binary;
+  kaldi::Input ki(rxfilename, &binary);
+  // OpenFst files don't start with Kaldi's binary-mode header "\0B", which is
+  // how we tell them apart.
+  if (binary) {
+    *compact_fst = new CompactGraphFst();
+    (*compact_fst)->Read(ki.Stream(), binary);
+  } else {
+    *fst = ReadFstKaldiGeneric(ki.Stream(), rxfilename);
+  }
+}
+
+
+} // end namespace fst
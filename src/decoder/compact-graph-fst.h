@@ -0,0 +1,234 @@
+// decoder/compact-graph-fst.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_COMPACT_GRAPH_FST_H_
+#define KALDI_DECODER_COMPACT_GRAPH_FST_H_
+
+#include <string>
+#include <vector>
+#include "fst/fstlib.h"
+#include "base/kaldi-common.h"
+
+namespace fst {
+
+
+/**
+   CompactGraphFst is a read-only representation of a decoding graph (e.g.
+   HCLG.fst) that uses about half the memory of ConstFst<StdArc>, so more of
+   the graph fits in cache while decoding.  Like GrammarFst, it is not a "real"
+   FST (it does not inherit from class Fst); it has just enough of the
+   interface for the decoders, e.g. LatticeFasterDecoderTpl<CompactGraphFst>,
+   via the specialization of ArcIterator below.
+
+   ConstFst stores 16 bytes per arc and 16 per state.  Here:
+
+     - Each arc takes 8 bytes.  The first 32-bit word holds the ilabel in its
+       low-order bits and the index of the weight in a table of weights in the
+       remaining bits.  The second holds the destination state and a bit that
+       says whether the arc has an olabel.
+     - The weights are quantized to the table, which has at most 65536
+       entries.  If the graph has no more distinct weights than that (which is
+       common, since most weights come from the HMM transitions), the table is
+       exact and so is decoding; otherwise the table is a uniform grid over
+       the range of the weights (the error is reported when you build it).
+     - Since most arcs have epsilon olabels, the non-epsilon olabels are kept
+       in a separate array, in arc order.
+     - Each state takes 8 bytes: the positions of its first arc and first
+       olabel.  Final-probs are stored separately, for the (few) final states.
+     - The input-epsilon arcs of each state come first, so NumInputEpsilons()
+       does not have to look at all of a state's arcs.
+
+   See also the program make-compact-graph-fst, which converts an FST to this
+   format.
+*/
+class CompactGraphFst {
+ public:
+  typedef StdArc Arc;
+  typedef TropicalWeight Weight;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+
+  /// Constructor from a regular FST.  If 'max_weight_error' is not NULL, it
+  /// will be set to the largest absolute difference between an arc weight of
+  /// 'fst' and its quantized value (zero if the weight table is exact).
+  /// Will crash if 'fst' has too many states or arcs, or labels that are
+  /// too large, for this format (i.e. about 2^31 states, 2^32 arcs, or ilabels
+  /// of 2^24 or more).
+  explicit CompactGraphFst(const Fst<StdArc> &fst,
+                           float *max_weight_error = NULL);
+
+  /// This constructor should only be used prior to calling Read().
+  CompactGraphFst(): start_(kNoStateId), ilabel_bits_(0), ilabel_mask_(0) { }
+
+  // Only binary mode is supported; the option is there for compatibility with
+  // other Kaldi read/write functions (it will crash if binary == false).
+  void Write(std::ostream &os, bool binary) const;
+
+  void Read(std::istream &is, bool binary);
+
+  StateId Start() const { return start_; }
+
+  Weight Final(StateId s) const;
+
+  inline size_t NumInputEpsilons(StateId s) const {
+    // The input-epsilon arcs come first.
+    const CompactArc *arc = arcs_.data() + states_[s].arc_start,
+        *end = arc + NumArcs(s);
+    size_t ans = 0;
+    for (; arc != end && (arc->ilabel_weight & ilabel_mask_) == 0; ++arc)
+      ans++;
+    return ans;
+  }
+
+  inline size_t NumArcs(StateId s) const {
+    return states_[s + 1].arc_start - states_[s].arc_start;
+  }
+
+  StateId NumStates() const { return static_cast<StateId>(states_.size()) - 1; }
+
+  inline std::string Type() const { return "compact-graph"; }
+
+  /// Returns the approximate number of bytes of memory that this object uses.
+  size_t MemorySize() const;
+
+ private:
+  friend class ArcIterator<CompactGraphFst>;
+
+  struct CompactArc {
+    // The ilabel is in the low-order ilabel_bits_ bits, the index into
+    // weights_ in the rest.
+    uint32 ilabel_weight;
+    // The destination state times two, plus one if the arc has a nonzero
+    // olabel (which is the next one in olabels_).
+    uint32 nextstate_olabel;
+  };
+
+  struct CompactState {
+    uint32 arc_start;  // Index of the first arc of this state in arcs_.
+    uint32 olabel_start;  // Index of its first olabel in olabels_.
+  };
+
+  struct FinalWeight {
+    StateId state;
+    float weight;
+    bool operator < (const FinalWeight &other) const {
+      return state < other.state;
+    }
+  };
+
+  StateId start_;
+
+  // The number of bits used for the ilabel in CompactArc::ilabel_weight.
+  int32 ilabel_bits_;
+  uint32 ilabel_mask_;  // equals (1 << ilabel_bits_) - 1.
+
+  // The table of arc weights.
+  std::vector<float> weights_;
+
+  // Indexed by state; there is an extra element at the end, so that
+  // states_[s+1].arc_start - states_[s].arc_start is the number of arcs of s.
+  std::vector<CompactState> states_;
+
+  std::vector<CompactArc> arcs_;
+
+  // The nonzero olabels of the arcs, in arc order.
+  std::vector<Label> olabels_;
+
+  // The final-probs of the final states, sorted by state.
+  std::vector<FinalWeight> finals_;
+};
+
+
+/**
+   This is the specialization of ArcIterator for CompactGraphFst.  As with
+   ArcIterator<GrammarFst>, it only has the parts of the interface that the
+   decoders use.  It is safe to use several of these on the same
+   CompactGraphFst from different threads.
+ */
+template <>
+class ArcIterator<CompactGraphFst> {
+ public:
+  typedef CompactGraphFst::Arc Arc;
+  typedef Arc::StateId StateId;
+  typedef CompactGraphFst::CompactArc CompactArc;
+
+  inline ArcIterator(const CompactGraphFst &fst, StateId s):
+      arc_ptr_(fst.arcs_.data() + fst.states_[s].arc_start),
+      arc_end_(fst.arcs_.data() + fst.states_[s + 1].arc_start),
+      olabel_ptr_(fst.olabels_.data() + fst.states_[s].olabel_start),
+      weights_(fst.weights_.data()),
+      ilabel_mask_(fst.ilabel_mask_),
+      ilabel_bits_(fst.ilabel_bits_) { }
+
+  // As in ArcIterator<GrammarFst>, we decode the arc in Done() rather than in
+  // Next(), because Done() has to be called before Value() anyway and already
+  // checks that we have not reached the end.
+  inline bool Done() {
+    if (arc_ptr_ != arc_end_) {
+      DecodeArc();
+      return false;
+    } else {
+      return true;
+    }
+  }
+
+  inline void Next() {
+    olabel_ptr_ += (arc_ptr_->nextstate_olabel & 1);
+    ++arc_ptr_;
+  }
+
+  inline const Arc &Value() const { return arc_; }
+
+ private:
+  inline void DecodeArc() {
+    uint32 ilabel_weight = arc_ptr_->ilabel_weight,
+        nextstate_olabel = arc_ptr_->nextstate_olabel;
+    arc_.ilabel = ilabel_weight & ilabel_mask_;
+    arc_.weight = Arc::Weight(weights_[ilabel_weight >> ilabel_bits_]);
+    arc_.olabel = (nextstate_olabel & 1) ? *olabel_ptr_ : 0;
+    arc_.nextstate = nextstate_olabel >> 1;
+  }
+
+  const CompactArc *arc_ptr_;
+  const CompactArc *arc_end_;
+  const CompactGraphFst::Label *olabel_ptr_;  // The olabel of the current arc,
+                                              // if it has one.
+  const float *weights_;
+  uint32 ilabel_mask_;
+  int32 ilabel_bits_;
+  Arc arc_;  // The current arc, decoded.
+};
+
+
+/**
+   Reads a decoding graph that may be either an OpenFst-format FST (read with
+   ReadFstKaldiGeneric(), so it will be of type ConstFst or VectorFst) or a
+   CompactGraphFst, as written by make-compact-graph-fst.  Exactly one of
+   '*fst' and '*compact_fst' will be set to a newly allocated object, and the
+   other to NULL.  Throws on error.
+ */
+void ReadDecodingGraph(const std::string &rxfilename,
+                       Fst<StdArc> **fst,
+                       CompactGraphFst **compact_fst);
+
+
+} // end namespace fst
+
+
+#endif  // KALDI_DECODER_COMPACT_GRAPH_FST_H_
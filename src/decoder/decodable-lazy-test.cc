@@ -0,0 +1,71 @@
+// decoder/decodable-lazy-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-lazy.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+// Checks that DecodableLazyMapped gives exactly the same likelihoods as
+// DecodableMatrixScaledMapped, whether they are requested one at a time or in
+// batches, and that each pdf is only computed once per frame.
+void TestDecodableLazyMapped() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  Matrix<BaseFloat> loglikes;
+  int32 num_frames = 1 + Rand() % 10;
+  GenRandLoglikes(*trans_model, num_frames, &loglikes);
+  BaseFloat scale = 0.1 * (1 + Rand() % 10);
+  DecodableMatrixScaledMapped ref_decodable(*trans_model, loglikes, scale);
+  DecodableMatrixScaled pdf_decodable(loglikes, 1.0);
+  DecodableLazyMapped lazy_decodable(*trans_model, scale, &pdf_decodable);
+  KALDI_ASSERT(lazy_decodable.NumIndices() == ref_decodable.NumIndices() &&
+               lazy_decodable.NumFramesReady() == num_frames);
+
+  int32 num_tids = trans_model->NumTransitionIds();
+  for (int32 frame = 0; frame < num_frames; frame++) {
+    for (int32 n = 0; n < 3; n++) {
+      std::vector<int32> tids(Rand() % (2 * num_tids));
+      for (size_t i = 0; i < tids.size(); i++)
+        tids[i] = 1 + Rand() % num_tids;
+      std::vector<BaseFloat> log_likes;
+      lazy_decodable.LogLikelihoods(frame, tids, &log_likes);
+      KALDI_ASSERT(log_likes.size() == tids.size());
+      for (size_t i = 0; i < tids.size(); i++) {
+        BaseFloat ref_log_like = ref_decodable.LogLikelihood(frame, tids[i]);
+        KALDI_ASSERT(log_likes[i] == ref_log_like);
+        KALDI_ASSERT(lazy_decodable.LogLikelihood(frame, tids[i]) ==
+                     ref_log_like);
+      }
+    }
+  }
+  KALDI_ASSERT(lazy_decodable.NumPdfsComputed() <=
+               static_cast<int64>(num_frames) * trans_model->NumPdfs());
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestDecodableLazyMapped();
+  KALDI_LOG << "Success.";
+}
@@ -0,0 +1,90 @@
+// decoder/decodable-lazy.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-lazy.h"
+
+namespace kaldi {
+
+DecodableLazyMapped::DecodableLazyMapped(const TransitionModel &trans_model,
+                                         BaseFloat scale,
+                                         DecodableInterface *pdf_decodable):
+    trans_model_(trans_model), scale_(scale), pdf_decodable_(pdf_decodable),
+    frame_(-1), pdf_to_slot_(trans_model.NumPdfs(), -1),
+    num_pdfs_computed_(0) {
+  if (pdf_decodable->NumIndices() != trans_model.NumPdfs())
+    KALDI_ERR << "Mismatch, decodable object has "
+              << pdf_decodable->NumIndices()
+              << " indices but transition-model has "
+              << trans_model.NumPdfs() << " pdf-ids.";
+}
+
+void DecodableLazyMapped::SetFrame(int32 frame) {
+  if (frame == frame_)
+    return;
+  std::vector<int32>::const_iterator iter = cached_pdfs_.begin(),
+      end = cached_pdfs_.end();
+  for (; iter != end; ++iter)
+    pdf_to_slot_[*iter] = -1;
+  cached_pdfs_.clear();
+  cached_log_likes_.clear();
+  frame_ = frame;
+}
+
+BaseFloat DecodableLazyMapped::LogLikelihood(int32 frame, int32 tid) {
+  SetFrame(frame);
+  int32 pdf_id = trans_model_.TransitionIdToPdfFast(tid),
+      slot = pdf_to_slot_[pdf_id];
+  if (slot == -1) {
+    slot = cached_pdfs_.size();
+    AddToCache(pdf_id, pdf_decodable_->LogLikelihood(frame, pdf_id + 1));
+    num_pdfs_computed_++;
+  }
+  return cached_log_likes_[slot];
+}
+
+void DecodableLazyMapped::LogLikelihoods(int32 frame,
+                                         const std::vector<int32> &tids,
+                                         std::vector<BaseFloat> *log_likes) {
+  SetFrame(frame);
+  // Work out which pdfs we need to compute.  We temporarily mark them in
+  // pdf_to_slot_ with -2 so each only appears once.
+  pdf_indices_.clear();
+  std::vector<int32>::const_iterator iter = tids.begin(), end = tids.end();
+  for (; iter != end; ++iter) {
+    int32 pdf_id = trans_model_.TransitionIdToPdfFast(*iter);
+    if (pdf_to_slot_[pdf_id] == -1) {
+      pdf_to_slot_[pdf_id] = -2;
+      pdf_indices_.push_back(pdf_id + 1);
+    }
+  }
+  if (!pdf_indices_.empty()) {
+    pdf_decodable_->LogLikelihoods(frame, pdf_indices_, &pdf_log_likes_);
+    KALDI_ASSERT(pdf_log_likes_.size() == pdf_indices_.size());
+    for (size_t i = 0; i < pdf_indices_.size(); i++)
+      AddToCache(pdf_indices_[i] - 1, pdf_log_likes_[i]);
+    num_pdfs_computed_ += pdf_indices_.size();
+  }
+  log_likes->resize(tids.size());
+  for (size_t i = 0; i < tids.size(); i++)
+    (*log_likes)[i] = cached_log_likes_[
+        pdf_to_slot_[trans_model_.TransitionIdToPdfFast(tids[i])]];
+}
+
+
+}  // end namespace kaldi
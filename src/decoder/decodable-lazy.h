@@ -0,0 +1,113 @@
+// decoder/decodable-lazy.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODABLE_LAZY_H_
+#define KALDI_DECODER_DECODABLE_LAZY_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "itf/decodable-itf.h"
+
+namespace kaldi {
+
+
+/**
+   DecodableLazyMapped wraps a decodable object whose indices are pdf-ids plus
+   one (e.g. DecodableAmDiagGmmUnmapped), and provides scaled log-likelihoods
+   indexed by transition-id as the decoders need.  The likelihoods are only
+   computed for the pdfs that the decoder asks for, and each is computed once
+   per frame.  LogLikelihoods() computes all the pdfs that it needs and that
+   are not cached with a single call to the underlying object's
+   LogLikelihoods(), so with a decoder that asks for all of a frame's
+   likelihoods at once (e.g. LatticeFasterDecoder with --batch-likelihoods),
+   an acoustic model that can compute a batch of pdfs efficiently gets to do
+   so, and the per-arc work is just a lookup.
+
+   The cache only has entries for the pdfs used on the current frame, and
+   moving to a new frame takes time proportional to their number, not to the
+   number of pdfs, and does not reallocate anything.  It works best if the
+   frames are accessed in order, as the decoders do; going back to a previous
+   frame is allowed but means recomputing its likelihoods.
+*/
+class DecodableLazyMapped: public DecodableInterface {
+ public:
+  /// 'pdf_decodable' is not owned here.  Its log-likelihoods are multiplied
+  /// by 'scale' (the acoustic scale).
+  DecodableLazyMapped(const TransitionModel &trans_model, BaseFloat scale,
+                      DecodableInterface *pdf_decodable);
+
+  // Note, frames are numbered from zero but transition-ids from one.
+  virtual BaseFloat LogLikelihood(int32 frame, int32 tid);
+
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &tids,
+                              std::vector<BaseFloat> *log_likes);
+
+  virtual int32 NumFramesReady() const {
+    return pdf_decodable_->NumFramesReady();
+  }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    return pdf_decodable_->IsLastFrame(frame);
+  }
+
+  // Indices are one-based!  This is for compatibility with OpenFst.
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  /// The number of pdf log-likelihoods that have been computed so far (for
+  /// diagnostics).
+  int64 NumPdfsComputed() const { return num_pdfs_computed_; }
+
+ private:
+  // Empties the cache if it is not for frame 'frame'.
+  void SetFrame(int32 frame);
+
+  // Adds pdf 'pdf_id' to the cache with (unscaled) log-likelihood 'log_like'.
+  inline void AddToCache(int32 pdf_id, BaseFloat log_like) {
+    pdf_to_slot_[pdf_id] = cached_pdfs_.size();
+    cached_pdfs_.push_back(pdf_id);
+    cached_log_likes_.push_back(scale_ * log_like);
+  }
+
+  const TransitionModel &trans_model_;
+  BaseFloat scale_;
+  DecodableInterface *pdf_decodable_;
+
+  // The frame that the cache is for, or -1.
+  int32 frame_;
+  // Indexed by pdf-id; the position of the pdf in cached_pdfs_ and
+  // cached_log_likes_, or -1 if it is not cached.
+  std::vector<int32> pdf_to_slot_;
+  std::vector<int32> cached_pdfs_;
+  std::vector<BaseFloat> cached_log_likes_;
+
+  // Temporaries used in LogLikelihoods().
+  std::vector<int32> pdf_indices_;
+  std::vector<BaseFloat> pdf_log_likes_;
+
+  int64 num_pdfs_computed_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableLazyMapped);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODABLE_LAZY_H_
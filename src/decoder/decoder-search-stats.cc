@@ -0,0 +1,168 @@
+// decoder/decoder-search-stats.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <sstream>
+#include "decoder/decoder-search-stats.h"
+
+namespace kaldi {
+
+void DecoderFrameStats::Reset() {
+  num_tokens = 0;
+  num_expanded_tokens = 0;
+  num_emitting_arcs = 0;
+  num_emitting_links = 0;
+  num_epsilon_states = 0;
+  num_epsilon_links = 0;
+  num_live_tokens = 0;
+  num_hash_resizes = 0;
+  beam = 0.0;
+  time = 0.0;
+}
+
+void DecoderSearchStats::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<DecoderSearchStats>");
+  int32 num_frames = frames_.size();
+  WriteBasicType(os, binary, num_frames);
+  if (!binary) os << "\n";
+  // In text mode we write one line per frame.
+  for (int32 t = 0; t < num_frames; t++) {
+    const DecoderFrameStats &f = frames_[t];
+    WriteBasicType(os, binary, f.num_tokens);
+    WriteBasicType(os, binary, f.num_expanded_tokens);
+    WriteBasicType(os, binary, f.num_emitting_arcs);
+    WriteBasicType(os, binary, f.num_emitting_links);
+    WriteBasicType(os, binary, f.num_epsilon_states);
+    WriteBasicType(os, binary, f.num_epsilon_links);
+    WriteBasicType(os, binary, f.num_live_tokens);
+    WriteBasicType(os, binary, f.num_hash_resizes);
+    WriteBasicType(os, binary, f.beam);
+    WriteBasicType(os, binary, f.time);
+    if (!binary) os << "\n";
+  }
+  WriteToken(os, binary, "</DecoderSearchStats>");
+}
+
+void DecoderSearchStats::Read(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<DecoderSearchStats>");
+  int32 num_frames;
+  ReadBasicType(is, binary, &num_frames);
+  if (num_frames < 0)
+    KALDI_ERR << "Invalid number of frames " << num_frames;
+  frames_.resize(num_frames);
+  for (int32 t = 0; t < num_frames; t++) {
+    DecoderFrameStats &f = frames_[t];
+    ReadBasicType(is, binary, &f.num_tokens);
+    ReadBasicType(is, binary, &f.num_expanded_tokens);
+    ReadBasicType(is, binary, &f.num_emitting_arcs);
+    ReadBasicType(is, binary, &f.num_emitting_links);
+    ReadBasicType(is, binary, &f.num_epsilon_states);
+    ReadBasicType(is, binary, &f.num_epsilon_links);
+    ReadBasicType(is, binary, &f.num_live_tokens);
+    ReadBasicType(is, binary, &f.num_hash_resizes);
+    ReadBasicType(is, binary, &f.beam);
+    ReadBasicType(is, binary, &f.time);
+  }
+  ExpectToken(is, binary, "</DecoderSearchStats>");
+}
+
+DecoderSearchStatsSummary::DecoderSearchStatsSummary():
+    num_frames_(0), tot_tokens_(0.0), tot_expanded_tokens_(0.0),
+    tot_emitting_arcs_(0.0), tot_emitting_links_(0.0),
+    tot_epsilon_states_(0.0), tot_epsilon_links_(0.0), tot_beam_(0.0),
+    tot_time_(0.0), max_live_tokens_(0), num_hash_resizes_(0) { }
+
+void DecoderSearchStatsSummary::AddToHistogram(int32 value,
+                                               std::vector<int64> *hist) {
+  // Bin b contains the values v with 2^(b-1) <= v < 2^b, and bin 0 contains
+  // zero.
+  size_t bin = 0;
+  while (value > 0) {
+    bin++;
+    value >>= 1;
+  }
+  if (hist->size() <= bin)
+    hist->resize(bin + 1, 0);
+  (*hist)[bin]++;
+}
+
+void DecoderSearchStatsSummary::Add(const DecoderSearchStats &stats) {
+  const std::vector<DecoderFrameStats> &frames = stats.Frames();
+  for (size_t t = 0; t < frames.size(); t++) {
+    const DecoderFrameStats &f = frames[t];
+    num_frames_++;
+    tot_tokens_ += f.num_tokens;
+    tot_expanded_tokens_ += f.num_expanded_tokens;
+    tot_emitting_arcs_ += f.num_emitting_arcs;
+    tot_emitting_links_ += f.num_emitting_links;
+    tot_epsilon_states_ += f.num_epsilon_states;
+    tot_epsilon_links_ += f.num_epsilon_links;
+    tot_beam_ += f.beam;
+    tot_time_ += f.time;
+    max_live_tokens_ = std::max(max_live_tokens_, f.num_live_tokens);
+    num_hash_resizes_ += f.num_hash_resizes;
+    AddToHistogram(f.num_tokens, &tokens_hist_);
+    AddToHistogram(f.num_emitting_arcs, &emitting_arcs_hist_);
+    AddToHistogram(f.num_epsilon_states, &epsilon_states_hist_);
+    AddToHistogram(static_cast<int32>(f.time * 1.0e+04), &time_hist_);
+  }
+}
+
+// Formats a power-of-two histogram as e.g. "[0,1):3 [1,2):10 [2,4):7 ...",
+// leaving out empty bins.
+static std::string HistogramToString(const std::vector<int64> &hist) {
+  std::ostringstream os;
+  for (size_t b = 0; b < hist.size(); b++) {
+    if (hist[b] == 0) continue;
+    int64 lower = (b == 0 ? 0 : (static_cast<int64>(1) << (b - 1))),
+        upper = (static_cast<int64>(1) << b);
+    os << '[' << lower << ',' << upper << "):" << hist[b] << ' ';
+  }
+  return os.str();
+}
+
+void DecoderSearchStatsSummary::Print(const std::string &name) const {
+  if (num_frames_ == 0) {
+    KALDI_LOG << "Search stats for " << name << ": no frames.";
+    return;
+  }
+  double n = num_frames_;
+  KALDI_LOG << "Search stats for " << name << " over " << num_frames_
+            << " frames: per frame, on average, " << (tot_tokens_ / n)
+            << " active tokens, " << (tot_expanded_tokens_ / n)
+            << " expanded, " << (tot_emitting_arcs_ / n)
+            << " emitting arcs (" << (tot_emitting_links_ / n)
+            << " within the cutoff), " << (tot_epsilon_states_ / n)
+            << " states in the epsilon closure (" << (tot_epsilon_links_ / n)
+            << " epsilon links); beam " << (tot_beam_ / n) << ", time "
+            << (1000.0 * tot_time_ / n) << " ms.  Max live tokens was "
+            << max_live_tokens_ << ", the hash was resized "
+            << num_hash_resizes_ << " times.";
+  KALDI_LOG << "Histogram of active tokens per frame: "
+            << HistogramToString(tokens_hist_);
+  KALDI_LOG << "Histogram of emitting arcs per frame: "
+            << HistogramToString(emitting_arcs_hist_);
+  KALDI_LOG << "Histogram of epsilon-closure states per frame: "
+            << HistogramToString(epsilon_states_hist_);
+  KALDI_LOG << "Histogram of time per frame (in units of 0.1ms): "
+            << HistogramToString(time_hist_);
+}
+
+
+}  // end namespace kaldi
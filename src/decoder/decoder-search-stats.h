@@ -0,0 +1,134 @@
+// decoder/decoder-search-stats.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_SEARCH_STATS_H_
+#define KALDI_DECODER_DECODER_SEARCH_STATS_H_
+
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/kaldi-table.h"
+
+namespace kaldi {
+
+
+/// Statistics about the search on one frame; see DecoderSearchStats.
+struct DecoderFrameStats {
+  // The number of tokens that were active at the start of the frame.
+  int32 num_tokens;
+  // The number of those that were within the cutoff and were expanded.
+  int32 num_expanded_tokens;
+  // The number of emitting arcs out of the expanded tokens, and the number
+  // of those that were within the cutoff (i.e. that we created links for).
+  int32 num_emitting_arcs;
+  int32 num_emitting_links;
+  // The number of states we processed in the epsilon closure (a state may be
+  // processed more than once), and the number of epsilon links created.
+  int32 num_epsilon_states;
+  int32 num_epsilon_links;
+  // The number of tokens that exist (on all frames) after this frame.
+  int32 num_live_tokens;
+  // 1 if the decoder resized its hash on this frame, else 0.
+  int32 num_hash_resizes;
+  // The beam that was used (it is smaller than the configured beam when
+  // max-active was limiting).
+  BaseFloat beam;
+  // The time in seconds that this frame took, including computing the
+  // likelihoods.
+  BaseFloat time;
+
+  DecoderFrameStats() { Reset(); }
+  void Reset();
+};
+
+
+/**
+   DecoderSearchStats holds statistics about the search for each frame of an
+   utterance, to help with tuning the beams and so on; see
+   LatticeFasterDecoderTpl::SetSearchStats().  It can be written to and read
+   from tables (see DecoderSearchStatsWriter), and summarized with
+   DecoderSearchStatsSummary.
+*/
+class DecoderSearchStats {
+ public:
+  DecoderSearchStats() { }
+
+  void Clear() { frames_.clear(); }
+
+  void AddFrame(const DecoderFrameStats &frame_stats) {
+    frames_.push_back(frame_stats);
+  }
+
+  int32 NumFrames() const { return frames_.size(); }
+
+  const std::vector<DecoderFrameStats> &Frames() const { return frames_; }
+
+  void Write(std::ostream &os, bool binary) const;
+  void Read(std::istream &is, bool binary);
+
+ private:
+  std::vector<DecoderFrameStats> frames_;
+};
+
+typedef TableWriter<KaldiObjectHolder<DecoderSearchStats> >
+    DecoderSearchStatsWriter;
+typedef SequentialTableReader<KaldiObjectHolder<DecoderSearchStats> >
+    SequentialDecoderSearchStatsReader;
+
+
+/**
+   This class accumulates DecoderSearchStats over frames of one or more
+   utterances, and prints averages and histograms (with power-of-two bins; the
+   times are binned in units of 0.1 milliseconds).
+*/
+class DecoderSearchStatsSummary {
+ public:
+  DecoderSearchStatsSummary();
+
+  void Add(const DecoderSearchStats &stats);
+
+  /// Prints the summary to the log; 'name' says what it is for, e.g. an
+  /// utterance-id.
+  void Print(const std::string &name) const;
+
+ private:
+  // Adds 'value' to the power-of-two histogram 'hist'.
+  static void AddToHistogram(int32 value, std::vector<int64> *hist);
+
+  int64 num_frames_;
+  double tot_tokens_;
+  double tot_expanded_tokens_;
+  double tot_emitting_arcs_;
+  double tot_emitting_links_;
+  double tot_epsilon_states_;
+  double tot_epsilon_links_;
+  double tot_beam_;
+  double tot_time_;
+  int32 max_live_tokens_;
+  int64 num_hash_resizes_;
+  std::vector<int64> tokens_hist_;
+  std::vector<int64> emitting_arcs_hist_;
+  std::vector<int64> epsilon_states_hist_;
+  std::vector<int64> time_hist_;
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_DECODER_DECODER_SEARCH_STATS_H_
@@ -0,0 +1,86 @@
+// decoder/decoder-test-utils.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decoder-test-utils.h"
+
+namespace kaldi {
+
+fst::VectorFst<fst::StdArc> *GenRandDecodingGraph(
+    const TransitionModel &trans_model, int32 num_words, bool loop) {
+  typedef fst::StdArc Arc;
+  std::vector<int32> self_loops, forward;
+  for (int32 tid = 1; tid <= trans_model.NumTransitionIds(); tid++) {
+    if (trans_model.IsSelfLoop(tid))
+      self_loops.push_back(tid);
+    else
+      forward.push_back(tid);
+  }
+  if (self_loops.empty())
+    self_loops = forward;
+  KALDI_ASSERT(!forward.empty() && num_words > 0);
+
+  fst::VectorFst<Arc> *fst = new fst::VectorFst<Arc>();
+  int32 num_states = 3 + Rand() % 4;
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  fst->SetFinal(num_states - 1, RandUniform());
+  for (int32 s = 0; s < num_states; s++) {
+    fst->AddArc(s, Arc(self_loops[Rand() % self_loops.size()], 0,
+                       RandUniform(), s));
+    if (s + 1 == num_states)
+      break;
+    for (int32 i = 0; i < 2; i++) {
+      int32 word = (Rand() % 3 == 0 ? 0 : 1 + Rand() % num_words);
+      fst->AddArc(s, Arc(forward[Rand() % forward.size()], word,
+                         2.0 * RandUniform(), s + 1));
+    }
+  }
+  if (loop)
+    fst->AddArc(num_states - 1, Arc(forward[Rand() % forward.size()], 0,
+                                    RandUniform(), 0));
+  return fst;
+}
+
+void GenRandLoglikes(const TransitionModel &trans_model, int32 num_frames,
+                     Matrix<BaseFloat> *loglikes) {
+  loglikes->Resize(num_frames, trans_model.NumPdfs());
+  loglikes->SetRandn();
+  loglikes->Add(-2.0);
+}
+
+bool CompactLatticesEquivalent(const CompactLattice &clat1,
+                               const CompactLattice &clat2) {
+  fst::VectorFst<fst::StdArc> words1, words2;
+  {
+    Lattice lat1, lat2;
+    ConvertLattice(clat1, &lat1);
+    ConvertLattice(clat2, &lat2);
+    ConvertLattice(lat1, &words1);
+    ConvertLattice(lat2, &words2);
+  }
+  fst::Project(&words1, fst::PROJECT_OUTPUT);
+  fst::Project(&words2, fst::PROJECT_OUTPUT);
+  fst::RmEpsilon(&words1);
+  fst::RmEpsilon(&words2);
+  return fst::RandEquivalent(words1, words2, 5 /*num paths*/, 0.01 /*delta*/,
+                             Rand() /*seed*/, 100000 /*path length max*/);
+}
+
+}  // namespace kaldi
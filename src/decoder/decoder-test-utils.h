@@ -0,0 +1,58 @@
+// decoder/decoder-test-utils.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_TEST_UTILS_H_
+#define KALDI_DECODER_DECODER_TEST_UTILS_H_
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "matrix/kaldi-matrix.h"
+
+namespace kaldi {
+
+// Convenience functions for the decoder tests.
+
+/// Returns a small random decoding graph ("HCLG") with the transition-ids of
+/// 'trans_model' as input labels and words 1 through 'num_words' (or epsilon)
+/// as output labels.  It is a chain of states with self-loops (on self-loop
+/// transition-ids), with two alternative arcs from each state to the next.  If
+/// 'loop' is true the last state has an arc back to the start, so that any
+/// number of frames can be decoded; otherwise the number of word and phone
+/// sequences is small enough that the lattices can be determinized without
+/// pruning.  The caller owns the result.
+fst::VectorFst<fst::StdArc> *GenRandDecodingGraph(
+    const TransitionModel &trans_model, int32 num_words, bool loop);
+
+/// Sets 'loglikes' to random log-likelihoods for 'num_frames' frames, with
+/// the pdfs of 'trans_model' as the columns.
+void GenRandLoglikes(const TransitionModel &trans_model, int32 num_frames,
+                     Matrix<BaseFloat> *loglikes);
+
+/// Returns true if the two lattices assign the same best cost (graph plus
+/// acoustic) to each word sequence, checked with fst::RandEquivalent().  The
+/// alignments are not compared, since lattices that were determinized
+/// differently may keep different alignments for a word sequence.
+bool CompactLatticesEquivalent(const CompactLattice &clat1,
+                               const CompactLattice &clat2);
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODER_TEST_UTILS_H_
@@ -96,9 +96,9 @@ void ModifyGraphForCarefulAlignment(
 /// lattice_writer, else to compact_lattice_writer.  The writers for
 /// alignments and words will only be written to if they are open.
 ///
-/// Caution: this will only link correctly if FST is either fst::Fst<fst::StdArc>,
-/// or fst::GrammarFst, as the template function is defined in the .cc file and
-/// only instantiated for those two types.
+/// Caution: this will only link correctly if FST is fst::Fst<fst::StdArc>,
+/// fst::GrammarFst or fst::CompactGraphFst, as the template function is defined
+/// in the .cc file and only instantiated for those types.
 template <typename FST>
 bool DecodeUtteranceLatticeFaster(
     LatticeFasterDecoderTpl<FST> &decoder, // not const but is really an input.
@@ -23,7 +23,7 @@
 
 #include "util/stl-utils.h"
 #include "itf/options-itf.h"
-#include "util/hash-list.h"
+#include "util/flat-hash-list.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "lat/kaldi-lattice.h" // for CompactLatticeArc
@@ -147,7 +147,7 @@ class FasterDecoder {
 #endif
     }
   };
-  typedef HashList<StateId, Token*>::Elem Elem;
+  typedef FlatHashList<StateId, Token*>::Elem Elem;
 
 
   /// Gets the weight cutoff.  Also counts the active tokens.
@@ -164,10 +164,10 @@ class FasterDecoder {
   // TODO: first time we go through this, could avoid using the queue.
   void ProcessNonemitting(double cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
-  // more than one list (e.g. for current and previous frames), but only one of
-  // them at a time can be indexed by StateId.
-  HashList<StateId, Token*> toks_;
+  // FlatHashList defined in ../util/flat-hash-list.h.  It actually allows us
+  // to maintain more than one list (e.g. for current and previous frames), but
+  // only one of them at a time can be indexed by StateId.
+  FlatHashList<StateId, Token*> toks_;
   const fst::Fst<fst::StdArc> &fst_;
   FasterDecoderOptions config_;
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
@@ -0,0 +1,254 @@
+// decoder/grammar-fst-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/grammar-fst.h"
+#include "util/kaldi-thread.h"
+
+namespace fst {
+
+// Returns the ilabel that encodes the pair (nonterminal, left-context phone).
+static int32 NontermLabel(int32 nonterm_phones_offset, int32 nonterminal,
+                          int32 phone) {
+  return static_cast<int32>(kNontermBigNumber) +
+      nonterminal * GetEncodingMultiple(nonterm_phones_offset) + phone;
+}
+
+// Adds to 'fst' between 1 and 3 ordinary arcs from 'src' to a new state, and
+// returns the new state.
+static StdArc::StateId AddOrdinaryArcs(StdArc::StateId src,
+                                       VectorFst<StdArc> *fst) {
+  StdArc::StateId dest = fst->AddState();
+  int32 num_arcs = kaldi::RandInt(1, 3);
+  for (int32 i = 0; i < num_arcs; i++)
+    fst->AddArc(src, StdArc(kaldi::RandInt(1, 100), kaldi::RandInt(0, 10),
+                            TropicalWeight(kaldi::RandUniform()), dest));
+  return dest;
+}
+
+// Generates a small FST for use in GrammarFst, like a compiled HCLG would be
+// after PrepareForGrammarFst() (which we call here), with phones numbered
+// 1 through 'num_phones'.  If 'is_top' is true, it is the top-level FST;
+// otherwise it is for a nonterminal, and it has #nonterm_begin and
+// #nonterm_end arcs.  It invokes the nonterminals in 'invoked', in order.
+static ConstFst<StdArc> *GenRandGrammarComponent(
+    int32 nonterm_phones_offset, int32 num_phones, bool is_top,
+    const std::vector<int32> &invoked) {
+  typedef StdArc::StateId StateId;
+  int32 nonterm_begin = nonterm_phones_offset + kNontermBegin,
+      nonterm_end = nonterm_phones_offset + kNontermEnd,
+      nonterm_reenter = nonterm_phones_offset + kNontermReenter;
+  VectorFst<StdArc> fst;
+  StateId cur = fst.AddState();
+  fst.SetStart(cur);
+  if (!is_top) {
+    StateId next = fst.AddState();
+    for (int32 p = 1; p <= num_phones; p++)
+      fst.AddArc(cur, StdArc(NontermLabel(nonterm_phones_offset,
+                                          nonterm_begin, p), 0,
+                             TropicalWeight(kaldi::RandUniform()), next));
+    cur = next;
+  }
+  for (size_t i = 0; i < invoked.size(); i++) {
+    cur = AddOrdinaryArcs(cur, &fst);
+    StateId reenter = fst.AddState(), next = fst.AddState();
+    for (int32 p = 1; p <= num_phones; p++) {
+      fst.AddArc(cur, StdArc(NontermLabel(nonterm_phones_offset,
+                                          invoked[i], p), 0,
+                             TropicalWeight(kaldi::RandUniform()), reenter));
+      fst.AddArc(reenter, StdArc(NontermLabel(nonterm_phones_offset,
+                                              nonterm_reenter, p), 0,
+                                 TropicalWeight(kaldi::RandUniform()), next));
+    }
+    cur = next;
+  }
+  cur = AddOrdinaryArcs(cur, &fst);
+  if (is_top) {
+    fst.SetFinal(cur, TropicalWeight::One());
+  } else {
+    StateId final_state = fst.AddState();
+    fst.SetFinal(final_state, TropicalWeight::One());
+    int32 num_end_phones = kaldi::RandInt(1, num_phones);
+    for (int32 p = 1; p <= num_end_phones; p++)
+      fst.AddArc(cur, StdArc(NontermLabel(nonterm_phones_offset,
+                                          nonterm_end, p), 0,
+                             TropicalWeight(kaldi::RandUniform()),
+                             final_state));
+  }
+  PrepareForGrammarFst(nonterm_phones_offset, &fst);
+  return new ConstFst<StdArc>(fst);
+}
+
+// Generates the FSTs for a random GrammarFst.  Each nonterminal only invokes
+// higher-numbered ones, so there is no recursion.  The caller owns the FSTs.
+static void GenRandGrammar(
+    int32 nonterm_phones_offset,
+    ConstFst<StdArc> **top_fst,
+    std::vector<std::pair<int32, const ConstFst<StdArc> *> > *ifsts) {
+  int32 num_phones = kaldi::RandInt(1, 3),
+      num_nonterminals = kaldi::RandInt(1, 4),
+      first_nonterminal = nonterm_phones_offset + kNontermUserDefined;
+  ifsts->clear();
+  for (int32 n = 0; n < num_nonterminals; n++) {
+    std::vector<int32> invoked;
+    int32 num_invoked = (n + 1 < num_nonterminals ? kaldi::RandInt(0, 3) : 0);
+    for (int32 i = 0; i < num_invoked; i++)
+      invoked.push_back(first_nonterminal +
+                        kaldi::RandInt(n + 1, num_nonterminals - 1));
+    ifsts->push_back(std::pair<int32, const ConstFst<StdArc> *>(
+        first_nonterminal + n,
+        GenRandGrammarComponent(nonterm_phones_offset, num_phones, false,
+                                invoked)));
+  }
+  std::vector<int32> invoked;
+  int32 num_invoked = kaldi::RandInt(2, 5);
+  for (int32 i = 0; i < num_invoked; i++)
+    invoked.push_back(first_nonterminal +
+                      kaldi::RandInt(0, num_nonterminals - 1));
+  *top_fst = GenRandGrammarComponent(nonterm_phones_offset, num_phones, true,
+                                     invoked);
+}
+
+typedef std::unordered_map<GrammarFst::StateId, std::vector<GrammarFstArc> >
+    GrammarArcMap;
+
+// Visits all the states of 'fst' that can be reached from the start state, in
+// a random order, and records the arcs that leave them in 'arcs'.
+static void ExpandGrammarFst(const GrammarFst &fst,
+                             kaldi::RandomState *rand_state,
+                             GrammarArcMap *arcs) {
+  typedef GrammarFst::StateId StateId;
+  arcs->clear();
+  std::vector<StateId> queue(1, fst.Start());
+  (*arcs)[fst.Start()];
+  while (!queue.empty()) {
+    size_t i = kaldi::RandInt(0, queue.size() - 1, rand_state);
+    std::swap(queue[i], queue.back());
+    StateId s = queue.back();
+    queue.pop_back();
+    std::vector<GrammarFstArc> state_arcs;
+    for (ArcIterator<GrammarFst> aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      const GrammarFstArc &arc = aiter.Value();
+      state_arcs.push_back(arc);
+      if (arcs->count(arc.nextstate) == 0) {
+        (*arcs)[arc.nextstate];
+        queue.push_back(arc.nextstate);
+      }
+    }
+    (*arcs)[s].swap(state_arcs);
+  }
+}
+
+// Converts the arcs recorded by ExpandGrammarFst() to a VectorFst, numbering
+// the states as CopyToVectorFst() does.  The state-ids of the GrammarFst
+// depend on the order in which its FST instances were created, which differs
+// from one expansion to another, but this numbering does not.
+static void GrammarArcMapToVectorFst(const GrammarFst &fst,
+                                     const GrammarArcMap &arcs,
+                                     VectorFst<StdArc> *vector_fst) {
+  typedef GrammarFst::StateId GrammarStateId;
+  typedef StdArc::StateId StdStateId;
+  std::vector<std::pair<GrammarStateId, StdStateId> > queue;
+  std::unordered_map<GrammarStateId, StdStateId> state_map;
+  vector_fst->DeleteStates();
+  state_map[fst.Start()] = vector_fst->AddState();
+  vector_fst->SetStart(0);
+  queue.push_back(std::pair<GrammarStateId, StdStateId>(fst.Start(), 0));
+  while (!queue.empty()) {
+    std::pair<GrammarStateId, StdStateId> p = queue.back();
+    queue.pop_back();
+    vector_fst->SetFinal(p.second, fst.Final(p.first));
+    GrammarArcMap::const_iterator arcs_iter = arcs.find(p.first);
+    KALDI_ASSERT(arcs_iter != arcs.end());
+    const std::vector<GrammarFstArc> &state_arcs = arcs_iter->second;
+    for (size_t i = 0; i < state_arcs.size(); i++) {
+      const GrammarFstArc &arc = state_arcs[i];
+      StdStateId next_state;
+      std::unordered_map<GrammarStateId, StdStateId>::const_iterator
+          state_iter = state_map.find(arc.nextstate);
+      if (state_iter == state_map.end()) {
+        next_state = vector_fst->AddState();
+        state_map[arc.nextstate] = next_state;
+        queue.push_back(std::pair<GrammarStateId, StdStateId>(
+            arc.nextstate, next_state));
+      } else {
+        next_state = state_iter->second;
+      }
+      vector_fst->AddArc(p.second, StdArc(arc.ilabel, arc.olabel,
+                                          arc.weight, next_state));
+    }
+  }
+}
+
+// Expands the same GrammarFst in each thread, each in a different order.
+class GrammarFstExpander: public kaldi::MultiThreadable {
+ public:
+  GrammarFstExpander(const GrammarFst &fst, int32 seed,
+                     std::vector<GrammarArcMap> *arcs):
+      fst_(fst), seed_(seed), arcs_(arcs) { }
+  void operator() () {
+    kaldi::RandomState rand_state;
+    rand_state.seed = seed_ + thread_id_;
+    ExpandGrammarFst(fst_, &rand_state, &((*arcs_)[thread_id_]));
+  }
+ private:
+  const GrammarFst &fst_;
+  int32 seed_;
+  std::vector<GrammarArcMap> *arcs_;
+};
+
+// Checks that when several threads expand the same GrammarFst at the same
+// time, each of them sees the same arcs as a single thread does.
+void TestGrammarFstConcurrentExpansion() {
+  int32 nonterm_phones_offset = 10;
+  ConstFst<StdArc> *top_fst;
+  std::vector<std::pair<int32, const ConstFst<StdArc> *> > ifsts;
+  GenRandGrammar(nonterm_phones_offset, &top_fst, &ifsts);
+
+  VectorFst<StdArc> ref_fst;
+  {
+    GrammarFst grammar_fst(nonterm_phones_offset, *top_fst, ifsts);
+    CopyToVectorFst(&grammar_fst, &ref_fst);
+  }
+  KALDI_ASSERT(ref_fst.NumStates() > 0);
+
+  int32 num_threads = kaldi::RandInt(2, 8);
+  std::vector<GrammarArcMap> arcs(num_threads);
+  GrammarFst grammar_fst(nonterm_phones_offset, *top_fst, ifsts);
+  {
+    GrammarFstExpander expander(grammar_fst, kaldi::Rand(), &arcs);
+    kaldi::MultiThreader<GrammarFstExpander> m(num_threads, expander);
+  }
+  for (int32 t = 0; t < num_threads; t++) {
+    VectorFst<StdArc> fst;
+    GrammarArcMapToVectorFst(grammar_fst, arcs[t], &fst);
+    KALDI_ASSERT(Equal(fst, ref_fst));
+  }
+
+  delete top_fst;
+  for (size_t i = 0; i < ifsts.size(); i++)
+    delete ifsts[i].second;
+}
+
+}  // namespace fst
+
+int main() {
+  for (int32 i = 0; i < 20; i++)
+    fst::TestGrammarFstConcurrentExpansion();
+  KALDI_LOG << "Tests succeeded.";
+}
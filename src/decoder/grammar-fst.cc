@@ -19,6 +19,8 @@
 
 #include "decoder/grammar-fst.h"
 #include "fstext/grammar-context-fst.h"
+#include "fstext/kaldi-fst-io.h"
+#include "util/kaldi-io.h"
 
 namespace fst {
 
@@ -29,7 +31,8 @@ GrammarFst::GrammarFst(
     const std::vector<std::pair<Label, const ConstFst<StdArc> *> > &ifsts):
     nonterm_phones_offset_(nonterm_phones_offset),
     top_fst_(&top_fst),
-    ifsts_(ifsts) {
+    ifsts_(ifsts),
+    num_instances_(0) {
   Init();
 }
 
@@ -54,21 +57,20 @@ GrammarFst::~GrammarFst() {
 }
 
 void GrammarFst::Destroy() {
-  for (size_t i = 0; i < instances_.size(); i++) {
-    FstInstance &instance = instances_[i];
-    std::unordered_map<BaseStateId, ExpandedState*>::const_iterator
-        iter = instance.expanded_states.begin(),
-        end = instance.expanded_states.end();
-    for (; iter != end; ++iter) {
-      ExpandedState *e = iter->second;
-      delete e;
-    }
-  }
+  for (int32 i = 0; i < num_instances_; i++)
+    ClearInstance(&GetInstance(i));
+  for (size_t i = 0; i < instance_blocks_.size(); i++)
+    delete [] instance_blocks_[i];
+  instance_blocks_.clear();
+  num_instances_ = 0;
+  free_instances_.clear();
+  for (size_t i = 0; i < special_states_.size(); i++)
+    delete special_states_[i];
+  special_states_.clear();
   top_fst_ = NULL;
   ifsts_.clear();
   nonterminal_map_.clear();
   entry_arcs_.clear();
-  instances_.clear();
   // the following will only do something if we read this object from disk using
   // its Read() function.
   for (size_t i = 0; i < fsts_to_delete_.size(); i++)
@@ -124,12 +126,80 @@ void GrammarFst::InitEntryArcs(int32 i) {
 }
 
 void GrammarFst::InitInstances() {
-  KALDI_ASSERT(instances_.empty());
-  instances_.resize(1);
-  instances_[0].ifst_index = -1;
-  instances_[0].fst = top_fst_;
-  instances_[0].parent_instance = -1;
-  instances_[0].parent_state = -1;
+  KALDI_ASSERT(num_instances_ == 0);
+  instance_blocks_.resize(kMaxInstanceBlocks, NULL);
+  special_states_.resize(ifsts_.size() + 1, NULL);
+  int32 instance_id = NewInstance(-1);
+  KALDI_ASSERT(instance_id == 0);
+}
+
+// static
+void GrammarFst::InitSpecialStates(const ConstFst<StdArc> &fst,
+                                   std::vector<BaseStateId> *special_states) {
+  special_states->clear();
+  BaseStateId num_states = fst.NumStates();
+  for (BaseStateId s = 0; s < num_states; s++)
+    if (fst.Final(s).Value() == KALDI_GRAMMAR_FST_SPECIAL_WEIGHT)
+      special_states->push_back(s);
+}
+
+int32 GrammarFst::NewInstance(int32 ifst_index) {
+  int32 instance_id;
+  if (!free_instances_.empty()) {
+    instance_id = free_instances_.back();
+    free_instances_.pop_back();
+  } else {
+    instance_id = num_instances_;
+    int32 block = instance_id / kInstanceBlockSize;
+    if (block >= kMaxInstanceBlocks)
+      KALDI_ERR << "Too many FST instances in GrammarFst (is there unbounded "
+          "recursion in the grammar?)";
+    if (instance_blocks_[block] == NULL)
+      instance_blocks_[block] = new FstInstance[kInstanceBlockSize];
+    num_instances_++;
+  }
+  FstInstance &instance = GetInstance(instance_id);
+  instance.ifst_index = ifst_index;
+  instance.fst = (ifst_index < 0 ? top_fst_ : ifsts_[ifst_index].second);
+  std::vector<BaseStateId> *&special_states = special_states_[ifst_index + 1];
+  if (special_states == NULL) {
+    special_states = new std::vector<BaseStateId>();
+    InitSpecialStates(*(instance.fst), special_states);
+  }
+  instance.special_states = special_states;
+  size_t num_special_states = special_states->size();
+  // Allocate at least one element, to avoid corner cases.
+  instance.expanded_states =
+      new std::atomic<ExpandedState*>[num_special_states + 1];
+  for (size_t i = 0; i <= num_special_states; i++)
+    instance.expanded_states[i].store(NULL, std::memory_order_relaxed);
+  return instance_id;
+}
+
+void GrammarFst::ClearInstance(FstInstance *instance) {
+  if (instance->expanded_states != NULL) {
+    size_t num_special_states = instance->special_states->size();
+    for (size_t i = 0; i < num_special_states; i++)
+      delete instance->expanded_states[i].load(std::memory_order_relaxed);
+    delete [] instance->expanded_states;
+  }
+  *instance = FstInstance();
+}
+
+GrammarFst::ExpandedState *GrammarFst::GetExpandedStateLocked(
+    int32 instance_id, size_t index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FstInstance &instance = GetInstance(instance_id);
+  // Another thread may have expanded it while we were waiting for the lock.
+  ExpandedState *ans =
+      instance.expanded_states[index].load(std::memory_order_relaxed);
+  if (ans == NULL) {
+    ans = ExpandState(instance_id, (*instance.special_states)[index]);
+    // The release makes sure that other threads that see 'ans' also see its
+    // contents, and any FST instance that was created for it.
+    instance.expanded_states[index].store(ans, std::memory_order_release);
+  }
+  return ans;
 }
 
 void GrammarFst::InitEntryOrReentryArcs(
@@ -173,7 +243,7 @@ void GrammarFst::InitEntryOrReentryArcs(
 GrammarFst::ExpandedState *GrammarFst::ExpandState(
     int32 instance_id, BaseStateId state_id) {
   int32 big_number = kNontermBigNumber;
-  const ConstFst<StdArc> &fst = *(instances_[instance_id].fst);
+  const ConstFst<StdArc> &fst = *(GetInstance(instance_id).fst);
   ArcIterator<ConstFst<StdArc> > aiter(fst, state_id);
   KALDI_ASSERT(!aiter.Done() && aiter.Value().ilabel > big_number &&
                "Something is not right; did you call PrepareForGrammarFst()?");
@@ -223,10 +293,10 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateEnd(
     int32 instance_id, BaseStateId state_id) {
   if (instance_id == 0)
     KALDI_ERR << "Did not expect #nonterm_end symbol in FST-instance 0.";
-  const FstInstance &instance = instances_[instance_id];
+  const FstInstance &instance = GetInstance(instance_id);
   int32 parent_instance_id = instance.parent_instance;
   const ConstFst<StdArc> &fst = *(instance.fst);
-  const FstInstance &parent_instance = instances_[parent_instance_id];
+  const FstInstance &parent_instance = GetInstance(parent_instance_id);
   const ConstFst<StdArc> &parent_fst = *(parent_instance.fst);
 
   ExpandedState *ans = new ExpandedState;
@@ -239,7 +309,7 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateEnd(
                                               instance.parent_state);
 
   // for explanation of cost_correction, see documentation for CombineArcs().
-  float num_reentry_arcs = instances_[instance_id].parent_reentry_arcs.size(),
+  float num_reentry_arcs = instance.parent_reentry_arcs.size(),
       cost_correction = -log(num_reentry_arcs);
 
   ArcIterator<ConstFst<StdArc> > aiter(fst, state_id);
@@ -253,8 +323,8 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateEnd(
                  ">1 nonterminals from a state; did you use "
                  "PrepareForGrammarFst()?");
     std::unordered_map<int32, int32>::const_iterator reentry_iter =
-        instances_[instance_id].parent_reentry_arcs.find(left_context_phone),
-        reentry_end = instances_[instance_id].parent_reentry_arcs.end();
+        instance.parent_reentry_arcs.find(left_context_phone),
+        reentry_end = instance.parent_reentry_arcs.end();
     if (reentry_iter == reentry_end) {
       KALDI_ERR << "FST with index " << instance.ifst_index
                 << " ends with left-context-phone " << left_context_phone
@@ -283,27 +353,13 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateEnd(
 int32 GrammarFst::GetChildInstanceId(int32 instance_id, int32 nonterminal,
                                      int32 state) {
   int64 encoded_pair = (static_cast<int64>(nonterminal) << 32) + state;
-  // 'new_instance_id' is the instance-id we'd assign if we had to create a new one.
-  // We try to add it at once, to avoid having to do an extra map lookup in case
-  // it wasn't there and we did need to add it.
-  int32 child_instance_id = instances_.size();
-  {
-    std::pair<int64, int32> p(encoded_pair, child_instance_id);
-    std::pair<std::unordered_map<int64, int32>::const_iterator, bool> ans =
-        instances_[instance_id].child_instances.insert(p);
-    if (!ans.second) {
-      // The pair was not inserted, which means the key 'encoded_pair' did exist in the
-      // map.  Return the value in the map.
-      child_instance_id = ans.first->second;
-      return child_instance_id;
-    }
-  }
-  // If we reached this point, we did successfully insert 'child_instance_id' into
-  // the map, because the key didn't exist.  That means we have to actually create
-  // the instance.
-  instances_.resize(child_instance_id + 1);
-  const FstInstance &parent_instance = instances_[instance_id];
-  FstInstance &child_instance = instances_[child_instance_id];
+  FstInstance &parent_instance = GetInstance(instance_id);
+  std::unordered_map<int64, int32>::const_iterator child_iter =
+      parent_instance.child_instances.find(encoded_pair);
+  if (child_iter != parent_instance.child_instances.end())
+    return child_iter->second;
+  // If we reached this point, the key didn't exist, so we have to actually
+  // create the instance.
 
   // Work out the ifst_index for this nonterminal.
   std::unordered_map<int32, int32>::const_iterator iter =
@@ -313,8 +369,11 @@ int32 GrammarFst::GetChildInstanceId(int32 instance_id, int32 nonterminal,
         "there is no FST for it.";
   }
   int32 ifst_index = iter->second;
-  child_instance.ifst_index = ifst_index;
-  child_instance.fst = ifsts_[ifst_index].second;
+  // Note: the instances never move, so 'parent_instance' is still valid after
+  // this.
+  int32 child_instance_id = NewInstance(ifst_index);
+  parent_instance.child_instances[encoded_pair] = child_instance_id;
+  FstInstance &child_instance = GetInstance(child_instance_id);
   child_instance.parent_instance = instance_id;
   child_instance.parent_state = state;
   InitEntryOrReentryArcs(*(parent_instance.fst), state,
@@ -325,7 +384,7 @@ int32 GrammarFst::GetChildInstanceId(int32 instance_id, int32 nonterminal,
 
 GrammarFst::ExpandedState *GrammarFst::ExpandStateUserDefined(
     int32 instance_id, BaseStateId state_id) {
-  const ConstFst<StdArc> &fst = *(instances_[instance_id].fst);
+  const ConstFst<StdArc> &fst = *(GetInstance(instance_id).fst);
   ArcIterator<ConstFst<StdArc> > aiter(fst, state_id);
 
   ExpandedState *ans = new ExpandedState;
@@ -346,7 +405,7 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateUserDefined(
       KALDI_ERR << "Same state leaves to different FST instances "
           "(Did you use PrepareForGrammarFst()?)";
     }
-    const FstInstance &child_instance = instances_[child_instance_id];
+    const FstInstance &child_instance = GetInstance(child_instance_id);
     const ConstFst<StdArc> &child_fst = *(child_instance.fst);
     int32 child_ifst_index = child_instance.ifst_index;
     std::unordered_map<int32, int32> &entry_arcs = entry_arcs_[child_ifst_index];
@@ -377,8 +436,107 @@ GrammarFst::ExpandedState *GrammarFst::ExpandStateUserDefined(
   return ans;
 }
 
+void GrammarFst::SetNonterminalFst(int32 nonterminal,
+                                   const ConstFst<StdArc> *fst) {
+  KALDI_ASSERT(top_fst_ != NULL && fst != NULL);
+  if (nonterminal < GetPhoneSymbolFor(kNontermUserDefined))
+    KALDI_ERR << "Nonterminal symbol " << nonterminal
+              << " was expected to be >= "
+              << GetPhoneSymbolFor(kNontermUserDefined);
+  std::unordered_map<int32, int32>::const_iterator map_iter =
+      nonterminal_map_.find(nonterminal);
+  if (map_iter == nonterminal_map_.end()) {
+    // A new nonterminal.  Nothing can have been expanded that uses it (that
+    // would have been an error), so there is nothing to discard.
+    int32 ifst_index = ifsts_.size();
+    ifsts_.push_back(std::pair<int32, const ConstFst<StdArc>*>(nonterminal,
+                                                              fst));
+    nonterminal_map_[nonterminal] = ifst_index;
+    entry_arcs_.resize(ifsts_.size());
+    special_states_.resize(ifsts_.size() + 1, NULL);
+    // As in Init(), this is so that problems are detected early.
+    InitEntryArcs(ifst_index);
+    return;
+  }
+  int32 ifst_index = map_iter->second;
+
+  // Work out which instances to discard: those of the old FST, and all
+  // instances that they invoked, directly or indirectly.
+  std::vector<bool> discard(num_instances_, false);
+  std::vector<int32> queue;
+  for (int32 i = 0; i < num_instances_; i++) {
+    const FstInstance &instance = GetInstance(i);
+    if (instance.fst != NULL && instance.ifst_index == ifst_index) {
+      discard[i] = true;
+      queue.push_back(i);
+    }
+  }
+  while (!queue.empty()) {
+    int32 i = queue.back();
+    queue.pop_back();
+    const std::unordered_map<int64, int32> &child_instances =
+        GetInstance(i).child_instances;
+    std::unordered_map<int64, int32>::const_iterator
+        iter = child_instances.begin(), end = child_instances.end();
+    for (; iter != end; ++iter) {
+      if (!discard[iter->second]) {
+        discard[iter->second] = true;
+        queue.push_back(iter->second);
+      }
+    }
+  }
+
+  // In the instances that we keep, forget the expanded states and child
+  // instances that lead to discarded instances; they will be expanded again
+  // with the new FST when they are next needed.  (Expanded states that lead to
+  // a parent instance are not affected, as parents of kept instances are
+  // kept.)
+  int32 num_discarded = 0;
+  for (int32 i = 0; i < num_instances_; i++) {
+    FstInstance &instance = GetInstance(i);
+    if (instance.fst == NULL) continue;  // An unused instance.
+    if (discard[i]) {
+      ClearInstance(&instance);
+      free_instances_.push_back(i);
+      num_discarded++;
+      continue;
+    }
+    size_t num_special_states = instance.special_states->size();
+    for (size_t j = 0; j < num_special_states; j++) {
+      ExpandedState *e =
+          instance.expanded_states[j].load(std::memory_order_relaxed);
+      if (e != NULL && discard[e->dest_fst_instance]) {
+        delete e;
+        instance.expanded_states[j].store(NULL, std::memory_order_relaxed);
+      }
+    }
+    std::unordered_map<int64, int32>::iterator
+        iter = instance.child_instances.begin();
+    while (iter != instance.child_instances.end()) {
+      if (discard[iter->second])
+        iter = instance.child_instances.erase(iter);
+      else
+        ++iter;
+    }
+  }
+
+  const ConstFst<StdArc> *old_fst = ifsts_[ifst_index].second;
+  std::vector<const ConstFst<StdArc> *>::iterator delete_iter =
+      std::find(fsts_to_delete_.begin(), fsts_to_delete_.end(), old_fst);
+  if (delete_iter != fsts_to_delete_.end() && old_fst != fst) {
+    delete old_fst;
+    fsts_to_delete_.erase(delete_iter);
+  }
+  ifsts_[ifst_index].second = fst;
+  delete special_states_[ifst_index + 1];
+  special_states_[ifst_index + 1] = NULL;
+  InitEntryArcs(ifst_index);
+  KALDI_VLOG(2) << "Replaced the FST for nonterminal " << nonterminal
+                << ", discarding " << num_discarded << " FST instances.";
+}
+
 
-void GrammarFst::Write(std::ostream &os, bool binary) const {
+void GrammarFst::Write(std::ostream &os, bool binary, bool align) const {
   using namespace kaldi;
   if (!binary)
     KALDI_ERR << "GrammarFst::Write only supports binary mode.";
@@ -391,22 +549,31 @@ void GrammarFst::Write(std::ostream &os, bool binary) const {
 
   std::string stream_name("unknown");
   FstWriteOptions wopts(stream_name);
-  top_fst_->Write(os, wopts);
+  wopts.align = align;
+  if (!top_fst_->Write(os, wopts))
+    KALDI_ERR << "Error writing top-level FST of GrammarFst";
 
   for (int32 i = 0; i < num_ifsts; i++) {
     int32 nonterminal = ifsts_[i].first;
     WriteBasicType(os, binary, nonterminal);
-    ifsts_[i].second->Write(os, wopts);
+    if (!ifsts_[i].second->Write(os, wopts))
+      KALDI_ERR << "Error writing FST for nonterminal " << nonterminal
+                << " of GrammarFst";
   }
   WriteToken(os, binary, "</GrammarFst>");
 }
 
-static ConstFst<StdArc> *ReadConstFstFromStream(std::istream &is) {
+// 'rxfilename' is the file that 'is' was opened from, if known, and is only
+// used to memory-map the FST (see SetMemoryMapReadOptions()).
+static ConstFst<StdArc> *ReadConstFstFromStream(std::istream &is,
+                                                const std::string &rxfilename) {
   fst::FstHeader hdr;
   std::string stream_name("unknown");
   if (!hdr.Read(is, stream_name))
     KALDI_ERR << "Reading FST: error reading FST header";
   FstReadOptions ropts("<unspecified>", &hdr);
+  if (!rxfilename.empty())
+    SetMemoryMapReadOptions(rxfilename, hdr, &ropts);
   ConstFst<StdArc> *ans = ConstFst<StdArc>::Read(is, ropts);
   if (!ans)
     KALDI_ERR << "Could not read ConstFst from stream.";
@@ -415,7 +582,8 @@ static ConstFst<StdArc> *ReadConstFstFromStream(std::istream &is) {
 
 
 
-void GrammarFst::Read(std::istream &is, bool binary) {
+void GrammarFst::Read(std::istream &is, bool binary,
+                      const std::string &rxfilename) {
   using namespace kaldi;
   if (!binary)
     KALDI_ERR << "GrammarFst::Read only supports binary mode.";
@@ -429,12 +597,12 @@ void GrammarFst::Read(std::istream &is, bool binary) {
         "update your code.";
   ReadBasicType(is, binary, &num_ifsts);
   ReadBasicType(is, binary, &nonterm_phones_offset_);
-  top_fst_ = ReadConstFstFromStream(is);
+  top_fst_ = ReadConstFstFromStream(is, rxfilename);
   fsts_to_delete_.push_back(top_fst_);
   for (int32 i = 0; i < num_ifsts; i++) {
     int32 nonterminal;
     ReadBasicType(is, binary, &nonterminal);
-    ConstFst<StdArc> *this_fst =  ReadConstFstFromStream(is);
+    ConstFst<StdArc> *this_fst =  ReadConstFstFromStream(is, rxfilename);
     fsts_to_delete_.push_back(this_fst);
     ifsts_.push_back(std::pair<int32, const ConstFst<StdArc>* >(nonterminal,
                                                                 this_fst));
@@ -443,6 +611,13 @@ void GrammarFst::Read(std::istream &is, bool binary) {
 }
 
 
+void ReadGrammarFst(std::string rxfilename, GrammarFst *fst) {
+  bool binary_in;
+  kaldi::Input ki(rxfilename, &binary_in);
+  fst->Read(ki.Stream(), binary_in, rxfilename);
+}
+
+
 // This class contains the implementation of the function
 // PrepareForGrammarFst(), which is declared in grammar-fst.h.
 class GrammarFstPreparer {
@@ -32,6 +32,9 @@
 
 
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include "fst/fstlib.h"
 #include "fstext/grammar-context-fst.h"
 
@@ -88,8 +91,14 @@ template<> class ArcIterator<GrammarFst>;
    points whenever we invoke a nonterminal.  For more information
    see \ref grammar (i.e. ../doc/grammar.dox).
 
-   Caution: this class is not thread safe, i.e. you shouldn't access the same
-   GrammarFst from multiple threads.  We can fix this later if needed.
+   Several decoders, in different threads, may use the same GrammarFst at the
+   same time (apart from SetNonterminalFst(), and Read()).  The states that need
+   expanding are expanded on demand by whichever thread gets to them first,
+   holding a mutex; looking up states that were already expanded, which is what
+   happens almost all of the time, does not lock anything.  So, for instance, a
+   server can keep a single GrammarFst and decode all requests with it, and the
+   work of expanding it is shared between them rather than repeated for each
+   decoder or utterance.
  */
 class GrammarFst {
  public:
@@ -145,16 +154,23 @@ class GrammarFst {
       const std::vector<std::pair<int32, const ConstFst<StdArc> *> > &ifsts);
 
   ///  This constructor should only be used prior to calling Read().
-  GrammarFst(): top_fst_(NULL) { }
+  GrammarFst(): top_fst_(NULL), num_instances_(0) { }
 
   // This Write function allows you to dump a GrammarFst to disk as a single
   // object.  It only supports binary mode, but the option is allowed for
   // compatibility with other Kaldi read/write functions (it will crash if
   // binary == false).
-  void Write(std::ostream &os, bool binary) const;
+  // If align == true, the component FSTs are written in the memory-mappable
+  // layout (see WriteFstKaldiMappable() in fstext/kaldi-fst-io.h); this
+  // requires 'os' to be a seekable stream, i.e. a file.
+  void Write(std::ostream &os, bool binary, bool align = false) const;
 
   // Reads the format that Write() outputs.  Will crash if binary == false.
-  void Read(std::istream &os, bool binary);
+  // If 'rxfilename' is the ordinary file that 'is' was opened from and the
+  // object was written with align == true, the component FSTs are
+  // memory-mapped from it instead of being read; see ReadGrammarFst().
+  void Read(std::istream &os, bool binary,
+            const std::string &rxfilename = "");
 
   StateId Start() const {
     // the top 32 bits of the 64-bit state-id will be zero, because the
@@ -185,7 +201,7 @@ class GrammarFst {
     // Compare with the constructor of ArcIterator.
     int32 instance_id = s >> 32;
     BaseStateId base_state = static_cast<int32>(s);
-    const GrammarFst::FstInstance &instance = instances_[instance_id];
+    const GrammarFst::FstInstance &instance = GetInstance(instance_id);
     const ConstFst<StdArc> *base_fst = instance.fst;
     if (base_fst->Final(base_state).Value() != KALDI_GRAMMAR_FST_SPECIAL_WEIGHT) {
       return base_fst->NumInputEpsilons(base_state);
@@ -196,10 +212,26 @@ class GrammarFst {
 
   inline std::string Type() const { return "grammar"; }
 
+  /**
+     Sets the FST for the user-defined nonterminal 'nonterminal' (e.g. the
+     integer id of #nonterm:contact_list in phones.txt), replacing the FST it
+     had, or adding it if it had none.  This lets you change part of the
+     grammar (e.g. a per-user list of names) without rebuilding anything else.
+     'fst' must have been prepared as for the constructor; this object does not
+     take ownership of it, but if the FST it replaces was read by Read(), that
+     one is deleted.  The parts of the expanded graph that came from the old
+     FST are discarded; the rest is kept.
+
+     Caution: this must not be called while any decoder is using this object
+     (e.g. call it between utterances).
+   */
+  void SetNonterminalFst(int32 nonterminal, const ConstFst<StdArc> *fst);
+
   ~GrammarFst();
  private:
 
   struct ExpandedState;
+  struct FstInstance;
 
   friend class ArcIterator<GrammarFst>;
 
@@ -213,9 +245,28 @@ class GrammarFst {
   // like to avoid that if possible.
   void InitEntryArcs(int32 i);
 
-  // sets up instances_ with the top-level instance.
+  // sets up the top-level FST instance.
   void InitInstances();
 
+  // Creates a new FST instance (or reuses one that SetNonterminalFst()
+  // discarded) for the FST with index 'ifst_index' in ifsts_, or for top_fst_
+  // if ifst_index == -1, and returns its instance-id.  The caller must set
+  // up its parent_instance, parent_state and parent_reentry_arcs.
+  int32 NewInstance(int32 ifst_index);
+
+  // Frees the expanded states of 'instance' and resets it to unused.
+  void ClearInstance(FstInstance *instance);
+
+  // Returns the instance with this instance-id.
+  inline const FstInstance &GetInstance(int32 instance_id) const {
+    return instance_blocks_[instance_id / kInstanceBlockSize]
+        [instance_id % kInstanceBlockSize];
+  }
+  inline FstInstance &GetInstance(int32 instance_id) {
+    return instance_blocks_[instance_id / kInstanceBlockSize]
+        [instance_id % kInstanceBlockSize];
+  }
+
   // Does the initialization tasks after nonterm_phones_offset_,
   // top_fsts_ and ifsts_ have been set up
   void Init();
@@ -290,7 +341,7 @@ class GrammarFst {
 
   // Called from ExpandStateUserDefined(), this function attempts to look up the
   // pair (nonterminal, state) in the map
-  // instances_[instance_id].child_instances.  If it exists (because this
+  // GetInstance(instance_id).child_instances.  If it exists (because this
   // return-state has been expanded before), it returns the value it found;
   // otherwise it creates the child-instance and returns its newly created
   // instance-id.
@@ -336,27 +387,35 @@ class GrammarFst {
   /** Called from the ArcIterator constructor when we encounter an FST state with
       nonzero final-prob, this function first looks up this state_id in
       'expanded_states' member of the corresponding FstInstance, and returns it
-      if already present; otherwise it populates the 'expanded_states' map with
-      something for this state_id and returns the value.
+      if already present; otherwise it calls GetExpandedStateLocked().  This
+      does not lock anything unless the state needs to be expanded.
   */
   inline ExpandedState *GetExpandedState(int32 instance_id,
                                          BaseStateId state_id) {
-    std::unordered_map<BaseStateId, ExpandedState*> &expanded_states =
-        instances_[instance_id].expanded_states;
-
-    std::unordered_map<BaseStateId, ExpandedState*>::iterator iter =
-        expanded_states.find(state_id);
-    if (iter != expanded_states.end()) {
-      return iter->second;
-    } else {
-      ExpandedState *ans = ExpandState(instance_id, state_id);
-      // Don't use the reference 'expanded_states'; it could have been
-      // invalidated.
-      instances_[instance_id].expanded_states[state_id] = ans;
+    FstInstance &instance = GetInstance(instance_id);
+    const std::vector<BaseStateId> &special_states = *(instance.special_states);
+    std::vector<BaseStateId>::const_iterator iter =
+        std::lower_bound(special_states.begin(), special_states.end(),
+                         state_id);
+    KALDI_ASSERT(iter != special_states.end() && *iter == state_id);
+    size_t index = iter - special_states.begin();
+    ExpandedState *ans =
+        instance.expanded_states[index].load(std::memory_order_acquire);
+    if (ans != NULL)
       return ans;
-    }
+    else
+      return GetExpandedStateLocked(instance_id, index);
   }
 
+  // Expands the state (*special_states)[index] of this instance if no other
+  // thread has done it yet, holding mutex_, and returns it.
+  ExpandedState *GetExpandedStateLocked(int32 instance_id, size_t index);
+
+  // Sets 'special_states' to the sorted list of states in 'fst' that need to
+  // be expanded (see ExpandedState).
+  static void InitSpecialStates(const ConstFst<StdArc> &fst,
+                                std::vector<BaseStateId> *special_states);
+
   /**
      Represents an expanded state in an FstInstance.  We expand states whenever
      we encounter states with a final-cost equal to
@@ -392,15 +451,23 @@ class GrammarFst {
     int32 ifst_index;
 
     // Pointer to the FST corresponding to this instance: it will equal top_fst_
-    // if ifst_index == -1, or ifsts_[ifst_index].second otherwise.
+    // if ifst_index == -1, or ifsts_[ifst_index].second otherwise.  NULL if
+    // this instance is unused.
     const ConstFst<StdArc> *fst;
 
-    // 'expanded_states', which will be populated on demand as states in this
-    // FST instance are accessed, will only contain entries for states in this
-    // FST that the final-prob's value equal to
+    // The sorted list of states in 'fst' whose final-prob's value equals
     // KALDI_GRAMMAR_FST_SPECIAL_WEIGHT.  (That final-prob value is used as a
-    // kind of signal to this code that the state needs expansion).
-    std::unordered_map<BaseStateId, ExpandedState*> expanded_states;
+    // kind of signal to this code that the state needs expansion).  This is
+    // shared by all instances of the same FST; it points into special_states_.
+    const std::vector<BaseStateId> *special_states;
+
+    // 'expanded_states', which will be populated on demand as states in this
+    // FST instance are accessed, is an array with the same dimension as
+    // *special_states; expanded_states[i] is the expanded version of state
+    // (*special_states)[i], or NULL if it has not been expanded yet.  They are
+    // read without locking, and only set while holding mutex_, hence the
+    // atomics.
+    std::atomic<ExpandedState*> *expanded_states;
 
     // 'child_instances', which is populated on demand as states in this FST
     // instance are accessed, is logically a map from pair (nonterminal_index,
@@ -440,6 +507,10 @@ class GrammarFst {
     // leading to final-states, which signal a return to the parent
     // FST-instance.
     std::unordered_map<int32, int32> parent_reentry_arcs;
+
+    FstInstance(): ifst_index(-1), fst(NULL), special_states(NULL),
+                   expanded_states(NULL), parent_instance(-1),
+                   parent_state(-1) { }
   };
 
   // The integer id of the symbol #nonterm_bos in phones.txt.
@@ -469,10 +540,30 @@ class GrammarFst {
   // nontrivial in the case where there are a lot of nonterminals.
   std::vector<std::unordered_map<int32, int32> > entry_arcs_;
 
-  // The FST instances.  Initially it is a vector with just one element
-  // representing top_fst_, and it will be populated with more elements on
-  // demand.  An instance_id refers to an index into this vector.
-  std::vector<FstInstance> instances_;
+  // special_states_[i + 1] is the 'special_states' list (see FstInstance) of
+  // the FST with ifst_index i (or of top_fst_, for i == -1), or NULL if no
+  // instance of it has been created yet.
+  std::vector<std::vector<BaseStateId>*> special_states_;
+
+  // The FST instances.  Initially there is just one, representing top_fst_,
+  // and more are created on demand.  We store them in blocks which never move
+  // once allocated, so that other threads can use instances while we create
+  // new ones; instance_blocks_ has dimension kMaxInstanceBlocks, with NULLs
+  // for blocks not allocated yet.  The instance with instance_id i is element
+  // i % kInstanceBlockSize of block i / kInstanceBlockSize (see
+  // GetInstance()).
+  static const int32 kInstanceBlockSize = 1024;
+  static const int32 kMaxInstanceBlocks = 4096;
+  std::vector<FstInstance*> instance_blocks_;
+  // The number of instance-ids that have been used.
+  int32 num_instances_;
+  // The instance-ids of instances that were discarded by SetNonterminalFst(),
+  // which we can reuse.
+  std::vector<int32> free_instances_;
+
+  // Held while expanding states and creating instances (i.e. whenever we
+  // change anything apart from in SetNonterminalFst() and Read()).
+  std::mutex mutex_;
 
   // A list of FSTs that are to be deleted when this object is destroyed.  This
   // will only be nonempty if we have read this object from the disk using
@@ -506,7 +597,7 @@ class ArcIterator<GrammarFst> {
     // explicitly say int32 below, not BaseStateId == int, which might on some
     // compilers be a 64-bit type.
     BaseStateId base_state = static_cast<int32>(s);
-    const GrammarFst::FstInstance &instance = fst.instances_[instance_id];
+    const GrammarFst::FstInstance &instance = fst.GetInstance(instance_id);
     const ConstFst<StdArc> *base_fst = instance.fst;
     if (base_fst->Final(base_state).Value() != KALDI_GRAMMAR_FST_SPECIAL_WEIGHT) {
       // A normal state
@@ -633,6 +724,15 @@ void CopyToVectorFst(GrammarFst *grammar_fst,
 void PrepareForGrammarFst(int32 nonterm_phones_offset,
                           VectorFst<StdArc> *fst);
 
+/**
+   Reads a GrammarFst from 'rxfilename', which may be any Kaldi rxfilename.  If
+   it is an ordinary file that was written with GrammarFst::Write() with
+   align == true (e.g. by make-mappable-fst), the component FSTs are
+   memory-mapped, so they are paged in lazily and processes that decode with
+   the same file share the memory.
+ */
+void ReadGrammarFst(std::string rxfilename, GrammarFst *fst);
+
 
 } // end namespace fst
 
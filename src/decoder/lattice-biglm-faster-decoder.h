@@ -23,7 +23,7 @@
 
 
 #include "util/stl-utils.h"
-#include "util/hash-list.h"
+#include "util/flat-hash-list.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -297,7 +297,7 @@ class LatticeBiglmFasterDecoder {
                  must_prune_tokens(true) { }
   };
 
-  typedef HashList<PairId, Token*>::Elem Elem;
+  typedef FlatHashList<PairId, Token*>::Elem Elem;
   
   void PossiblyResizeHash(size_t num_toks) {
     size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
@@ -828,10 +828,10 @@ class LatticeBiglmFasterDecoder {
   }
 
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
-  // more than one list (e.g. for current and previous frames), but only one of
-  // them at a time can be indexed by StateId.
-  HashList<PairId, Token*> toks_;
+  // FlatHashList defined in ../util/flat-hash-list.h.  It actually allows us
+  // to maintain more than one list (e.g. for current and previous frames), but
+  // only one of them at a time can be indexed by StateId.
+  FlatHashList<PairId, Token*> toks_;
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
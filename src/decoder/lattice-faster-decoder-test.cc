@@ -0,0 +1,251 @@
+// decoder/lattice-faster-decoder-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+// Checks that if we write the decoder state part way through the utterance,
+// read it into another decoder and continue decoding with that, we get the
+// same best path as when decoding the whole utterance in one go; and the same
+// lattice if the lattice beam is so wide that the pruning of the state before
+// writing it can make no difference.
+void TestWriteReadState() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandDecodingGraph(*trans_model, 10, true);
+  Matrix<BaseFloat> loglikes;
+  int32 num_frames = 20 + Rand() % 80;
+  GenRandLoglikes(*trans_model, num_frames, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 8.0 + Rand() % 8;
+  bool wide_lattice_beam = (Rand() % 2 == 0);
+  config.lattice_beam = (wide_lattice_beam ? 1000.0 : 1.0 + Rand() % 4);
+  config.prune_interval = 5 + Rand() % 20;
+
+  LatticeFasterDecoder ref_decoder(*graph, config);
+  KALDI_ASSERT(ref_decoder.Decode(&decodable));
+  Lattice ref_lat, ref_best_path;
+  KALDI_ASSERT(ref_decoder.GetRawLattice(&ref_lat, true));
+  KALDI_ASSERT(ref_decoder.GetBestPath(&ref_best_path, true));
+
+  LatticeFasterDecoder decoder1(*graph, config);
+  decoder1.InitDecoding();
+  decoder1.AdvanceDecoding(&decodable, 1 + Rand() % (num_frames - 1));
+  std::ostringstream os;
+  decoder1.WriteState(os, true);
+
+  LatticeFasterDecoder decoder2(*graph, config);
+  {
+    std::istringstream is(os.str());
+    decoder2.ReadState(is, true);
+  }
+  KALDI_ASSERT(decoder2.NumFramesDecoded() == decoder1.NumFramesDecoded());
+
+  // In text mode the costs are rounded, so we only check that the state is
+  // read back as it was written.
+  std::ostringstream text_os;
+  decoder2.WriteState(text_os, false);
+  LatticeFasterDecoder decoder3(*graph, config);
+  {
+    std::istringstream is(text_os.str());
+    decoder3.ReadState(is, false);
+  }
+  std::ostringstream text_os2;
+  decoder3.WriteState(text_os2, false);
+  KALDI_ASSERT(text_os.str() == text_os2.str());
+
+  // Writing the state must not have changed decoder1, so it should give the
+  // reference lattice; decoder2 started from the pruned state.
+  LatticeFasterDecoder *decoders[2] = { &decoder1, &decoder2 };
+  for (int32 i = 0; i < 2; i++) {
+    decoders[i]->AdvanceDecoding(&decodable);
+    decoders[i]->FinalizeDecoding();
+    Lattice lat, best_path;
+    KALDI_ASSERT(decoders[i]->GetRawLattice(&lat, true));
+    KALDI_ASSERT(decoders[i]->GetBestPath(&best_path, true));
+    KALDI_ASSERT(fst::Equal(best_path, ref_best_path));
+    if (i == 0 || wide_lattice_beam)
+      KALDI_ASSERT(fst::Equal(lat, ref_lat));
+  }
+
+  delete graph;
+  delete trans_model;
+}
+
+// Returns a graph with "num_states" states and random arcs between them, so
+// that with a wide beam there are enough tokens on each frame for the arcs to
+// be expanded in parallel.  The caller owns the result.
+fst::VectorFst<fst::StdArc> *GenRandWideDecodingGraph(
+    const TransitionModel &trans_model, int32 num_states) {
+  typedef fst::StdArc Arc;
+  fst::VectorFst<Arc> *fst = new fst::VectorFst<Arc>();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    if (Rand() % 10 == 0)
+      fst->SetFinal(s, RandUniform());
+    for (int32 i = 0; i < 4; i++) {
+      int32 ilabel = 1 + Rand() % trans_model.NumTransitionIds(),
+          olabel = (Rand() % 3 == 0 ? 1 + Rand() % 10 : 0);
+      fst->AddArc(s, Arc(ilabel, olabel, 2.0 * RandUniform(),
+                         Rand() % num_states));
+    }
+  }
+  return fst;
+}
+
+// Checks that expanding the emitting arcs with several threads gives the same
+// lattice as doing it in one thread.
+void TestParallelExpansion() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  int32 num_threads = 2 + Rand() % 3;
+  // There must be at least 500 tokens per thread on a frame for the
+  // parallel code to be used.
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandWideDecodingGraph(*trans_model, 1000 * num_threads);
+  Matrix<BaseFloat> loglikes;
+  int32 num_frames = 10 + Rand() % 20;
+  GenRandLoglikes(*trans_model, num_frames, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 1000.0;
+  config.lattice_beam = 1.0 + Rand() % 4;
+  config.prune_interval = 5 + Rand() % 20;
+  config.batch_likelihoods = (Rand() % 2 == 0);
+
+  Lattice lat1, lat2;
+  {
+    LatticeFasterDecoder decoder(*graph, config);
+    KALDI_ASSERT(decoder.Decode(&decodable));
+    KALDI_ASSERT(decoder.GetRawLattice(&lat1, true));
+  }
+  config.num_expand_threads = num_threads;
+  {
+    LatticeFasterDecoder decoder(*graph, config);
+    DecoderSearchStats stats;
+    decoder.SetSearchStats(&stats);
+    // Decode twice, to check that the threads can be reused.
+    for (int32 i = 0; i < 2; i++) {
+      KALDI_ASSERT(decoder.Decode(&decodable));
+      KALDI_ASSERT(decoder.GetRawLattice(&lat2, true));
+      KALDI_ASSERT(fst::Equal(lat1, lat2));
+    }
+    // Check that the threads were used on some frames.
+    int32 num_parallel_frames = 0;
+    for (int32 t = 0; t < stats.NumFrames(); t++)
+      if (stats.Frames()[t].num_tokens >= 500 * num_threads)
+        num_parallel_frames++;
+    KALDI_ASSERT(num_parallel_frames > 0);
+  }
+
+  delete graph;
+  delete trans_model;
+}
+
+// Checks that GetWordConfidences() gives the words on the decoder's best path
+// whatever acoustic scale the confidences are computed with.
+void TestWordConfidences() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandDecodingGraph(*trans_model, 10, true);
+  Matrix<BaseFloat> loglikes;
+  int32 num_frames = 20 + Rand() % 80;
+  GenRandLoglikes(*trans_model, num_frames, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 8.0 + Rand() % 8;
+  config.lattice_beam = 2.0 + Rand() % 6;
+  LatticeFasterDecoder decoder(*graph, config);
+  KALDI_ASSERT(decoder.Decode(&decodable));
+  Lattice best_path;
+  KALDI_ASSERT(decoder.GetBestPath(&best_path, true));
+  std::vector<int32> alignment, words;
+  LatticeWeight weight;
+  GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+
+  BaseFloat acoustic_scales[] = { 0.1, 1.0, 10.0 };
+  for (int32 i = 0; i < 3; i++) {
+    std::vector<WordConfidence> confidences;
+    KALDI_ASSERT(decoder.GetWordConfidences(true, acoustic_scales[i],
+                                            &confidences));
+    KALDI_ASSERT(confidences.size() == words.size());
+    for (size_t w = 0; w < words.size(); w++) {
+      KALDI_ASSERT(confidences[w].word == words[w]);
+      KALDI_ASSERT(confidences[w].confidence >= 0.0 &&
+                   confidences[w].confidence <= 1.0);
+    }
+  }
+
+  delete graph;
+  delete trans_model;
+}
+
+// Checks that adaptive pruning narrows the beam when the decoder expands more
+// tokens than the budget, and that InitDecoding() undoes this, so that a
+// decoder that is reused gives the same lattice for the same utterance.
+void TestAdaptiveBeamReset() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandDecodingGraph(*trans_model, 10, true);
+  Matrix<BaseFloat> loglikes;
+  GenRandLoglikes(*trans_model, 50 + Rand() % 50, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 12.0 + Rand() % 4;
+  config.lattice_beam = 2.0 + Rand() % 4;
+  config.adaptive_beam_opts.max_tokens = 10;
+  config.adaptive_beam_opts.min_beam = 4.0;
+  config.adaptive_beam_opts.beam_step = 1.0;
+  LatticeFasterDecoder decoder(*graph, config);
+  CompactLattice clat1, clat2;
+  KALDI_ASSERT(decoder.Decode(&decodable));
+  KALDI_ASSERT(decoder.GetLattice(&clat1, true));
+  KALDI_ASSERT(decoder.GetAdaptiveBeamStats().num_frames_beam_reduced > 0);
+  KALDI_ASSERT(decoder.Decode(&decodable));
+  KALDI_ASSERT(decoder.GetLattice(&clat2, true));
+  KALDI_ASSERT(fst::Equal(clat1, clat2));
+
+  delete graph;
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestWriteReadState();
+  for (int32 i = 0; i < 3; i++)
+    TestParallelExpansion();
+  for (int32 i = 0; i < 10; i++)
+    TestWordConfidences();
+  for (int32 i = 0; i < 5; i++)
+    TestAdaptiveBeamReset();
+  KALDI_LOG << "Success.";
+}
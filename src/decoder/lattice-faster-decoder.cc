@@ -30,25 +30,58 @@ template <typename FST, typename Token>
 LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
     const FST &fst,
     const LatticeFasterDecoderConfig &config):
-    fst_(&fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(&fst), delete_fst_(false), config_(config), num_toks_(0),
+    num_frames_pruned_(0), token_allocator_(config.use_slab_allocator),
+    link_allocator_(config.use_slab_allocator),
+    expand_threads_(NULL), beam_controller_(config_.adaptive_beam_opts),
+    num_toks_expanded_(0), search_stats_(NULL) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+  beam_controller_.Reset(config_.beam, config_.max_active, config_.min_active);
+  num_expand_threads_ = NumUsableExpandThreads();
 }
 
 
 template <typename FST, typename Token>
 LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
     const LatticeFasterDecoderConfig &config, FST *fst):
-    fst_(fst), delete_fst_(true), config_(config), num_toks_(0) {
+    fst_(fst), delete_fst_(true), config_(config), num_toks_(0),
+    num_frames_pruned_(0), token_allocator_(config.use_slab_allocator),
+    link_allocator_(config.use_slab_allocator),
+    expand_threads_(NULL), beam_controller_(config_.adaptive_beam_opts),
+    num_toks_expanded_(0), search_stats_(NULL) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+  beam_controller_.Reset(config_.beam, config_.max_active, config_.min_active);
+  num_expand_threads_ = NumUsableExpandThreads();
 }
 
 
+// Returns true if FSTs of this type may be read from several threads at once.
+// Lazily expanded FSTs such as ComposeFst cache the states they visit without
+// any locking, so we only allow the types whose arcs are all in memory, and
+// GrammarFst, which locks when it expands a state.
+static bool FstTypeIsThreadSafe(const std::string &type) {
+  return type == "const" || type == "vector" || type == "compact-graph" ||
+      type == "grammar";
+}
+
+template <typename FST, typename Token>
+int32 LatticeFasterDecoderTpl<FST, Token>::NumUsableExpandThreads() const {
+  if (config_.num_expand_threads > 1 && !FstTypeIsThreadSafe(fst_->Type())) {
+    KALDI_WARN << "Ignoring --num-expand-threads=" << config_.num_expand_threads
+               << ", FSTs of type " << fst_->Type()
+               << " cannot be read from several threads at once.";
+    return 1;
+  }
+  return config_.num_expand_threads;
+}
+
 template <typename FST, typename Token>
 LatticeFasterDecoderTpl<FST, Token>::~LatticeFasterDecoderTpl() {
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
+  delete expand_threads_;
   if (delete_fst_) delete fst_;
 }
 
@@ -58,20 +91,285 @@ void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
+  // the options may have been changed by SetOptions().
+  token_allocator_.SetEnabled(config_.use_slab_allocator);
+  link_allocator_.SetEnabled(config_.use_slab_allocator);
+  // frame indexes restart from zero, so forget the cached acoustic costs.
+  std::fill(ac_costs_frame_.begin(), ac_costs_frame_.end(), -1);
   warned_ = false;
   num_toks_ = 0;
+  num_frames_pruned_ = 0;
   decoding_finalized_ = false;
+  if (search_stats_ != NULL)
+    search_stats_->Clear();
   final_costs_.clear();
+  beam_controller_.Reset(config_.beam, config_.max_active, config_.min_active);
   StateId start_state = fst_->Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = new (token_allocator_.Allocate()) Token(0.0, 0.0, NULL,
+                                                           NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
   ProcessNonemitting(config_.beam);
 }
 
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::WriteState(std::ostream &os,
+                                                     bool binary) const {
+  KALDI_ASSERT(!active_toks_.empty() && !decoding_finalized_ &&
+               "WriteState() must be called while decoding.");
+  // We write the tokens and links as PruneActiveTokens() would leave them,
+  // so that the state is no bigger than it needs to be.  The pruning is done
+  // on a copy of the extra costs and of the flags, because pruning this
+  // object here would change the lattice we get if we keep decoding with it.
+  int32 num_frames = active_toks_.size();
+  BaseFloat delta = config_.lattice_beam * config_.prune_scale;
+  unordered_map<Token*, BaseFloat> extra_cost;
+  unordered_set<ForwardLinkT*> pruned_links;
+  std::vector<char> must_prune_forward_links(num_frames);
+  for (int32 f = 0; f < num_frames; f++) {
+    must_prune_forward_links[f] = active_toks_[f].must_prune_forward_links;
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next)
+      extra_cost[tok] = tok->extra_cost;
+  }
+  for (int32 f = num_frames - 2; f >= 0; f--) {
+    if (!must_prune_forward_links[f])
+      continue;
+    // As PruneForwardLinks(), except that pruned links are recorded in
+    // pruned_links, and pruned tokens are left with infinite extra cost.
+    bool extra_costs_changed = false, changed = true;
+    while (changed) {
+      changed = false;
+      for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+        BaseFloat tok_extra_cost = std::numeric_limits<BaseFloat>::infinity();
+        for (ForwardLinkT *link = tok->links; link != NULL;
+             link = link->next) {
+          if (pruned_links.count(link) != 0)
+            continue;
+          Token *next_tok = link->next_tok;
+          BaseFloat link_extra_cost = extra_cost[next_tok] +
+              ((tok->tot_cost + link->acoustic_cost + link->graph_cost)
+               - next_tok->tot_cost);
+          if (link_extra_cost > config_.lattice_beam) {
+            pruned_links.insert(link);
+          } else {
+            if (link_extra_cost < 0.0)
+              link_extra_cost = 0.0;
+            if (link_extra_cost < tok_extra_cost)
+              tok_extra_cost = link_extra_cost;
+          }
+        }
+        if (fabs(tok_extra_cost - extra_cost[tok]) > delta)
+          changed = true;
+        extra_cost[tok] = tok_extra_cost;
+      }
+      if (changed)
+        extra_costs_changed = true;
+    }
+    if (extra_costs_changed && f > 0)
+      must_prune_forward_links[f - 1] = true;
+    must_prune_forward_links[f] = false;
+  }
+  // We leave out all the tokens before the last frame that have infinite
+  // extra cost, not just those on the frames PruneActiveTokens() would
+  // prune: they can have no part in the lattice, and infinite costs cannot
+  // be read back in text mode.  So only the last frame may still need its
+  // tokens pruned.
+
+  // Number the remaining tokens, frame by frame, in the order of the lists;
+  // links and backpointers are written as these numbers.
+  int32 num_toks = 0;
+  unordered_map<Token*, int32> tok_index;
+  std::vector<int32> frame_num_toks(num_frames, 0);
+  for (int32 f = 0; f < num_frames; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      if (f + 1 == num_frames ||
+          extra_cost[tok] != std::numeric_limits<BaseFloat>::infinity()) {
+        tok_index[tok] = num_toks++;
+        frame_num_toks[f]++;
+      }
+    }
+  }
+
+  WriteToken(os, binary, "<LatticeFasterDecoderState>");
+  WriteToken(os, binary, "<NumFrames>");
+  WriteBasicType(os, binary, num_frames);
+  WriteToken(os, binary, "<CostOffsets>");
+  WriteBasicType(os, binary, static_cast<int32>(cost_offsets_.size()));
+  for (size_t i = 0; i < cost_offsets_.size(); i++)
+    WriteBasicType(os, binary, cost_offsets_[i]);
+  WriteToken(os, binary, "<HashSize>");
+  WriteBasicType(os, binary, static_cast<int64>(toks_.Size()));
+  WriteToken(os, binary, "<Warned>");
+  WriteBasicType(os, binary, warned_);
+  WriteToken(os, binary, "<NumFramesPruned>");
+  WriteBasicType(os, binary, num_frames - 1);  // as PruneActiveTokens().
+  for (int32 f = 0; f < num_frames; f++) {
+    WriteToken(os, binary, "<Frame>");
+    WriteBasicType(os, binary, frame_num_toks[f]);
+    WriteBasicType(os, binary, must_prune_forward_links[f] != 0);
+    WriteBasicType(os, binary, f + 1 == num_frames &&
+                   active_toks_[f].must_prune_tokens);
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      if (tok_index.count(tok) == 0)
+        continue;
+      WriteBasicType(os, binary, tok->tot_cost);
+      WriteBasicType(os, binary, extra_cost[tok]);
+      int32 backpointer = -1;
+      if (tok->GetBackpointer() != NULL) {
+        // If the token that the backpointer points to has been pruned away
+        // (which can only happen through roundoff, since the best path into a
+        // token that survived pruning survives too), we write it as NULL.
+        typename unordered_map<Token*, int32>::const_iterator iter =
+            tok_index.find(tok->GetBackpointer());
+        if (iter != tok_index.end())
+          backpointer = iter->second;
+      }
+      WriteBasicType(os, binary, backpointer);
+      int32 num_links = 0;
+      for (ForwardLinkT *link = tok->links; link != NULL; link = link->next)
+        if (pruned_links.count(link) == 0 &&
+            tok_index.count(link->next_tok) != 0)
+          num_links++;
+      WriteBasicType(os, binary, num_links);
+      for (ForwardLinkT *link = tok->links; link != NULL; link = link->next) {
+        if (pruned_links.count(link) != 0 ||
+            tok_index.count(link->next_tok) == 0)
+          continue;
+        WriteBasicType(os, binary, tok_index.at(link->next_tok));
+        WriteBasicType(os, binary, link->ilabel);
+        WriteBasicType(os, binary, link->olabel);
+        WriteBasicType(os, binary, link->graph_cost);
+        WriteBasicType(os, binary, link->acoustic_cost);
+      }
+    }
+  }
+  // The graph states of the tokens on the last frame, in the order of toks_,
+  // which affects the order in which they are expanded.
+  int32 num_elems = 0;
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+    num_elems++;
+  WriteToken(os, binary, "<States>");
+  WriteBasicType(os, binary, num_elems);
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+    WriteBasicType(os, binary, static_cast<int64>(e->key));
+    WriteBasicType(os, binary, tok_index.at(e->val));
+  }
+  WriteToken(os, binary, "</LatticeFasterDecoderState>");
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::ReadState(std::istream &is,
+                                                    bool binary) {
+  // clean up, as in InitDecoding().
+  DeleteElems(toks_.Clear());
+  cost_offsets_.clear();
+  ClearActiveTokens();
+  token_allocator_.SetEnabled(config_.use_slab_allocator);
+  link_allocator_.SetEnabled(config_.use_slab_allocator);
+  std::fill(ac_costs_frame_.begin(), ac_costs_frame_.end(), -1);
+  num_toks_ = 0;
+  decoding_finalized_ = false;
+  if (search_stats_ != NULL)
+    search_stats_->Clear();
+  final_costs_.clear();
+  beam_controller_.Reset(config_.beam, config_.max_active, config_.min_active);
+
+  ExpectToken(is, binary, "<LatticeFasterDecoderState>");
+  int32 num_frames, num_offsets;
+  ExpectToken(is, binary, "<NumFrames>");
+  ReadBasicType(is, binary, &num_frames);
+  ExpectToken(is, binary, "<CostOffsets>");
+  ReadBasicType(is, binary, &num_offsets);
+  if (num_frames <= 0 || num_offsets < 0 || num_offsets > num_frames)
+    KALDI_ERR << "Invalid decoder state (" << num_frames << " frames).";
+  cost_offsets_.resize(num_offsets);
+  for (int32 i = 0; i < num_offsets; i++)
+    ReadBasicType(is, binary, &(cost_offsets_[i]));
+  int64 hash_size;
+  ExpectToken(is, binary, "<HashSize>");
+  ReadBasicType(is, binary, &hash_size);
+  ExpectToken(is, binary, "<Warned>");
+  ReadBasicType(is, binary, &warned_);
+  ExpectToken(is, binary, "<NumFramesPruned>");
+  ReadBasicType(is, binary, &num_frames_pruned_);
+
+  // Links and backpointers may refer to tokens we have not read yet, so we
+  // fill them in at the end.
+  std::vector<Token*> toks;
+  std::vector<std::pair<Token*, int32> > backpointers;
+  std::vector<std::pair<ForwardLinkT*, int32> > links;
+  active_toks_.resize(num_frames);
+  for (int32 f = 0; f < num_frames; f++) {
+    int32 frame_num_toks;
+    ExpectToken(is, binary, "<Frame>");
+    ReadBasicType(is, binary, &frame_num_toks);
+    ReadBasicType(is, binary, &(active_toks_[f].must_prune_forward_links));
+    ReadBasicType(is, binary, &(active_toks_[f].must_prune_tokens));
+    Token **tok_tail = &(active_toks_[f].toks);
+    for (int32 i = 0; i < frame_num_toks; i++) {
+      BaseFloat tot_cost, extra_cost;
+      int32 backpointer, num_links;
+      ReadBasicType(is, binary, &tot_cost);
+      ReadBasicType(is, binary, &extra_cost);
+      ReadBasicType(is, binary, &backpointer);
+      Token *tok = new (token_allocator_.Allocate()) Token(
+          tot_cost, extra_cost, NULL, NULL, NULL);
+      *tok_tail = tok;
+      tok_tail = &(tok->next);
+      toks.push_back(tok);
+      num_toks_++;
+      if (backpointer >= 0)
+        backpointers.push_back(std::make_pair(tok, backpointer));
+      ReadBasicType(is, binary, &num_links);
+      ForwardLinkT **link_tail = &(tok->links);
+      for (int32 j = 0; j < num_links; j++) {
+        int32 next_tok;
+        Label ilabel, olabel;
+        BaseFloat graph_cost, acoustic_cost;
+        ReadBasicType(is, binary, &next_tok);
+        ReadBasicType(is, binary, &ilabel);
+        ReadBasicType(is, binary, &olabel);
+        ReadBasicType(is, binary, &graph_cost);
+        ReadBasicType(is, binary, &acoustic_cost);
+        ForwardLinkT *link = new (link_allocator_.Allocate()) ForwardLinkT(
+            NULL, ilabel, olabel, graph_cost, acoustic_cost, NULL);
+        *link_tail = link;
+        link_tail = &(link->next);
+        links.push_back(std::make_pair(link, next_tok));
+      }
+    }
+  }
+  int32 num_toks = toks.size();
+  for (size_t i = 0; i < backpointers.size(); i++) {
+    if (backpointers[i].second >= num_toks)
+      KALDI_ERR << "Invalid decoder state (bad backpointer).";
+    backpointers[i].first->SetBackpointer(toks[backpointers[i].second]);
+  }
+  for (size_t i = 0; i < links.size(); i++) {
+    if (links[i].second < 0 || links[i].second >= num_toks)
+      KALDI_ERR << "Invalid decoder state (bad link).";
+    links[i].first->next_tok = toks[links[i].second];
+  }
+
+  int32 num_elems;
+  ExpectToken(is, binary, "<States>");
+  ReadBasicType(is, binary, &num_elems);
+  toks_.SetSize(hash_size);
+  for (int32 i = 0; i < num_elems; i++) {
+    int64 state;
+    int32 tok;
+    ReadBasicType(is, binary, &state);
+    ReadBasicType(is, binary, &tok);
+    if (tok < 0 || tok >= num_toks)
+      KALDI_ERR << "Invalid decoder state (bad token for state).";
+    toks_.Insert(static_cast<StateId>(state), toks[tok]);
+  }
+  ExpectToken(is, binary, "</LatticeFasterDecoderState>");
+}
+
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
 // an unusual search error.
@@ -86,8 +384,16 @@ bool LatticeFasterDecoderTpl<FST, Token>::Decode(DecodableInterface *decodable)
   while (!decodable->IsLastFrame(NumFramesDecoded() - 1)) {
     if (NumFramesDecoded() % config_.prune_interval == 0)
       PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+    Timer timer;
     BaseFloat cost_cutoff = ProcessEmitting(decodable);
     ProcessNonemitting(cost_cutoff);
+    if (beam_controller_.Enabled())
+      beam_controller_.Update(timer.Elapsed(), num_toks_expanded_);
+    if (search_stats_ != NULL) {
+      frame_stats_.num_live_tokens = num_toks_;
+      frame_stats_.time = timer.Elapsed();
+      search_stats_->AddFrame(frame_stats_);
+    }
   }
   FinalizeDecoding();
 
@@ -195,6 +501,255 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
   return (ofst->NumStates() > 0);
 }
 
+template <typename FST, typename Token>
+bool LatticeFasterDecoderTpl<FST, Token>::GetWordConfidences(
+    bool use_final_probs, BaseFloat acoustic_scale,
+    std::vector<WordConfidence> *words) const {
+  words->clear();
+  if (decoding_finalized_ && !use_final_probs)
+    KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
+              << "GetWordConfidences() with use_final_probs == false";
+
+  unordered_map<Token*, BaseFloat> final_costs_local;
+  const unordered_map<Token*, BaseFloat> &final_costs =
+      (decoding_finalized_ ? final_costs_ : final_costs_local);
+  if (!decoding_finalized_ && use_final_probs)
+    ComputeFinalCosts(&final_costs_local, NULL, NULL);
+
+  // Number the tokens in topological order (as in GetRawLattice()).
+  int32 num_frames = active_toks_.size() - 1;
+  KALDI_ASSERT(num_frames >= 0);
+  unordered_map<Token*, int32> tok_map(num_toks_ / 2 + 3);
+  std::vector<Token*> tokens, token_list;
+  std::vector<int32> tok_frame;
+  for (int32 f = 0; f <= num_frames; f++) {
+    if (active_toks_[f].toks == NULL) {
+      KALDI_WARN << "GetWordConfidences: no tokens active on frame " << f;
+      return false;
+    }
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++) {
+      if (token_list[i] != NULL) {
+        tok_map[token_list[i]] = tokens.size();
+        tokens.push_back(token_list[i]);
+        tok_frame.push_back(f);
+      }
+    }
+  }
+  int32 num_toks = tokens.size();
+
+  // Forward pass.  alpha[i] is the total log-probability of the paths to
+  // token i, with the acoustic costs scaled by acoustic_scale; viterbi_cost[i]
+  // and back_link[i] give the best path to it with the costs the decoder
+  // used, so that the best path is the decoder's best path whatever
+  // acoustic_scale is.  The cost offsets on the acoustic costs are the same
+  // for all paths, so we don't need to remove them.
+  double neg_inf = -std::numeric_limits<double>::infinity();
+  std::vector<double> alpha(num_toks, neg_inf),
+      viterbi_cost(num_toks, -neg_inf);
+  std::vector<std::pair<int32, const ForwardLinkT*> > back_link(
+      num_toks, std::pair<int32, const ForwardLinkT*>(-1, NULL));
+  alpha[0] = 0.0;
+  viterbi_cost[0] = 0.0;
+  for (int32 i = 0; i < num_toks; i++) {
+    if (alpha[i] == neg_inf) continue;
+    for (const ForwardLinkT *l = tokens[i]->links; l != NULL; l = l->next) {
+      int32 j = tok_map[l->next_tok];
+      KALDI_ASSERT(j > i);
+      double cost = l->graph_cost + acoustic_scale * l->acoustic_cost,
+          unscaled_cost = l->graph_cost + l->acoustic_cost;
+      alpha[j] = LogAdd(alpha[j], alpha[i] - cost);
+      if (viterbi_cost[i] + unscaled_cost < viterbi_cost[j]) {
+        viterbi_cost[j] = viterbi_cost[i] + unscaled_cost;
+        back_link[j] = std::pair<int32, const ForwardLinkT*>(i, l);
+      }
+    }
+  }
+
+  // beta[i] is the total log-probability of the paths from token i to the
+  // end, including the final-prob.
+  std::vector<double> beta(num_toks, neg_inf);
+  double tot_log_prob = neg_inf, best_cost = -neg_inf;
+  int32 best_tok = -1;
+  for (int32 i = num_toks - 1; i >= 0 && tok_frame[i] == num_frames; i--) {
+    double final_cost = 0.0;
+    if (use_final_probs && !final_costs.empty()) {
+      typename unordered_map<Token*, BaseFloat>::const_iterator
+          iter = final_costs.find(tokens[i]);
+      if (iter == final_costs.end()) continue;
+      final_cost = iter->second;
+    }
+    beta[i] = -final_cost;
+    tot_log_prob = LogAdd(tot_log_prob, alpha[i] - final_cost);
+    if (viterbi_cost[i] + final_cost < best_cost) {
+      best_cost = viterbi_cost[i] + final_cost;
+      best_tok = i;
+    }
+  }
+  if (best_tok == -1 || tot_log_prob == neg_inf) {
+    KALDI_WARN << "GetWordConfidences: no path through the lattice.";
+    return false;
+  }
+
+  // Backward pass; we also collect the posteriors of the links that have
+  // words on them, as (frame, word, posterior).
+  struct WordArc {
+    int32 frame;
+    int32 word;
+    BaseFloat post;
+  };
+  std::vector<WordArc> word_arcs;
+  for (int32 i = num_toks - 1; i >= 0; i--) {
+    for (const ForwardLinkT *l = tokens[i]->links; l != NULL; l = l->next) {
+      int32 j = tok_map[l->next_tok];
+      if (beta[j] == neg_inf) continue;
+      double cost = l->graph_cost + acoustic_scale * l->acoustic_cost;
+      beta[i] = LogAdd(beta[i], beta[j] - cost);
+      if (l->olabel != 0 && alpha[i] != neg_inf) {
+        WordArc arc;
+        arc.frame = tok_frame[i];
+        arc.word = l->olabel;
+        arc.post = Exp(alpha[i] - cost + beta[j] - tot_log_prob);
+        word_arcs.push_back(arc);
+      }
+    }
+  }
+
+  // Trace back the best path.
+  for (int32 i = best_tok; back_link[i].first != -1;
+       i = back_link[i].first) {
+    const ForwardLinkT *l = back_link[i].second;
+    if (l->olabel != 0) {
+      WordConfidence word;
+      word.word = l->olabel;
+      word.start_frame = tok_frame[back_link[i].first];
+      word.confidence = 0.0;
+      words->push_back(word);
+    }
+  }
+  std::reverse(words->begin(), words->end());
+  int32 num_words = words->size();
+  for (int32 w = 0; w < num_words; w++) {
+    int32 end_frame = (w + 1 < num_words ? (*words)[w + 1].start_frame :
+                       num_frames);
+    (*words)[w].num_frames = end_frame - (*words)[w].start_frame;
+  }
+  if (num_words == 0)
+    return true;
+
+  // Give the posterior of each word arc to the word on the best path whose
+  // time span it is in, if it is the same word; otherwise to the word before
+  // or after that, if it is the same word (the word arcs of different paths
+  // may not be at exactly the same time).
+  std::vector<int32> word_at_frame(num_frames + 1);
+  for (int32 w = 0, f = 0; f <= num_frames; f++) {
+    while (w + 1 < num_words && (*words)[w + 1].start_frame <= f) w++;
+    word_at_frame[f] = w;
+  }
+  for (size_t a = 0; a < word_arcs.size(); a++) {
+    const WordArc &arc = word_arcs[a];
+    int32 w = word_at_frame[arc.frame];
+    if ((*words)[w].word != arc.word) {
+      if (w > 0 && (*words)[w - 1].word == arc.word) w--;
+      else if (w + 1 < num_words && (*words)[w + 1].word == arc.word) w++;
+      else continue;
+    }
+    (*words)[w].confidence += arc.post;
+  }
+  for (int32 w = 0; w < num_words; w++)
+    (*words)[w].confidence = std::min<BaseFloat>((*words)[w].confidence, 1.0);
+  return true;
+}
+
+template <typename FST, typename Token>
+bool LatticeFasterDecoderTpl<FST, Token>::GetRawLatticeChunk(
+    int32 begin_frame, int32 end_frame, bool use_final_probs,
+    Lattice *ofst,
+    std::vector<std::pair<Token*, LatticeArc::StateId> > *begin_states,
+    std::vector<std::pair<Token*, LatticeArc::StateId> > *end_states) const {
+  typedef LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  int32 num_frames = NumFramesDecoded();
+  bool is_last_chunk = (end_frame == num_frames);
+  KALDI_ASSERT(begin_frame >= 0 && end_frame <= num_frames &&
+               (begin_frame < end_frame ||
+                (begin_frame == end_frame && is_last_chunk)));
+  if (decoding_finalized_ && !use_final_probs && is_last_chunk)
+    KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
+              << "GetRawLatticeChunk() with use_final_probs == false";
+
+  unordered_map<Token*, BaseFloat> final_costs_local;
+  const unordered_map<Token*, BaseFloat> &final_costs =
+      (decoding_finalized_ ? final_costs_ : final_costs_local);
+  if (!decoding_finalized_ && use_final_probs && is_last_chunk)
+    ComputeFinalCosts(&final_costs_local, NULL, NULL);
+
+  ofst->DeleteStates();
+  begin_states->clear();
+  end_states->clear();
+  unordered_map<Token*, StateId> tok_map;
+  // First create all states.
+  std::vector<Token*> token_list;
+  for (int32 f = begin_frame; f <= end_frame; f++) {
+    if (active_toks_[f].toks == NULL) {
+      KALDI_WARN << "GetRawLatticeChunk: no tokens active on frame " << f
+                 << ": not producing lattice.\n";
+      return false;
+    }
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++) {
+      Token *tok = token_list[i];
+      if (tok == NULL)
+        continue;
+      StateId state = ofst->AddState();
+      tok_map[tok] = state;
+      if (f == begin_frame)
+        begin_states->push_back(std::make_pair(tok, state));
+      if (f == end_frame)
+        end_states->push_back(std::make_pair(tok, state));
+    }
+  }
+  // As in GetRawLattice(), the tokens are topologically sorted so state zero
+  // is the start state if we start at the beginning.
+  if (begin_frame == 0)
+    ofst->SetStart(0);
+
+  // Now create the arcs.
+  int32 last_frame_with_links = (is_last_chunk ? end_frame : end_frame - 1);
+  for (int32 f = begin_frame; f <= last_frame_with_links; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      StateId cur_state = tok_map[tok];
+      for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
+        typename unordered_map<Token*, StateId>::const_iterator
+            iter = tok_map.find(l->next_tok);
+        KALDI_ASSERT(iter != tok_map.end());
+        BaseFloat cost_offset = 0.0;
+        if (l->ilabel != 0) {  // emitting..
+          KALDI_ASSERT(f >= 0 && f < cost_offsets_.size());
+          cost_offset = cost_offsets_[f];
+        }
+        Arc arc(l->ilabel, l->olabel,
+                Weight(l->graph_cost, l->acoustic_cost - cost_offset),
+                iter->second);
+        ofst->AddArc(cur_state, arc);
+      }
+      if (f == num_frames) {
+        if (use_final_probs && !final_costs.empty()) {
+          typename unordered_map<Token*, BaseFloat>::const_iterator
+              iter = final_costs.find(tok);
+          if (iter != final_costs.end())
+            ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
+        } else {
+          ofst->SetFinal(cur_state, LatticeWeight::One());
+        }
+      }
+    }
+  }
+  return (ofst->NumStates() > 0);
+}
+
 
 // This function is now deprecated, since now we do determinization from outside
 // the LatticeFasterDecoder class.  Outputs an FST corresponding to the
@@ -228,6 +783,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PossiblyResizeHash(size_t num_toks) {
                                       * config_.hash_ratio);
   if (new_sz > toks_.Size()) {
     toks_.SetSize(new_sz);
+    frame_stats_.num_hash_resizes++;
   }
 }
 
@@ -276,7 +832,8 @@ inline Token* LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = new (token_allocator_.Allocate()) Token(tot_cost,
+        extra_cost, NULL, toks, backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -353,7 +910,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_allocator_.Deallocate(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -441,7 +998,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_allocator_.Deallocate(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -502,7 +1059,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_o
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_allocator_.Deallocate(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -541,6 +1098,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneActiveTokens(BaseFloat delta) {
       active_toks_[f+1].must_prune_tokens = false;
     }
   }
+  num_frames_pruned_ = cur_frame_plus_one;
   KALDI_VLOG(4) << "PruneActiveTokens: pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
 }
@@ -626,8 +1184,16 @@ void LatticeFasterDecoderTpl<FST, Token>::AdvanceDecoding(DecodableInterface *de
     if (NumFramesDecoded() % config_.prune_interval == 0) {
       PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
     }
+    Timer timer;
     BaseFloat cost_cutoff = ProcessEmitting(decodable);
     ProcessNonemitting(cost_cutoff);
+    if (beam_controller_.Enabled())
+      beam_controller_.Update(timer.Elapsed(), num_toks_expanded_);
+    if (search_stats_ != NULL) {
+      frame_stats_.num_live_tokens = num_toks_;
+      frame_stats_.time = timer.Elapsed();
+      search_stats_->AddFrame(frame_stats_);
+    }
   }
 }
 
@@ -648,6 +1214,7 @@ void LatticeFasterDecoderTpl<FST, Token>::FinalizeDecoding() {
     PruneTokensForFrame(f + 1);
   }
   PruneTokensForFrame(0);
+  num_frames_pruned_ = final_frame_plus_one + 1;
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
 }
@@ -659,7 +1226,11 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
-  if (config_.max_active == std::numeric_limits<int32>::max() &&
+  // These are normally config_.beam and config_.max_active, but may be
+  // smaller if adaptive pruning is enabled.
+  BaseFloat beam = beam_controller_.Beam();
+  int32 max_active = beam_controller_.MaxActive();
+  if (max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = static_cast<BaseFloat>(e->val->tot_cost);
@@ -669,8 +1240,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       }
     }
     if (tok_count != NULL) *tok_count = count;
-    if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
-    return best_weight + config_.beam;
+    if (adaptive_beam != NULL) *adaptive_beam = beam;
+    return best_weight + beam;
   } else {
     tmp_array_.clear();
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -683,18 +1254,18 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
     }
     if (tok_count != NULL) *tok_count = count;
 
-    BaseFloat beam_cutoff = best_weight + config_.beam,
+    BaseFloat beam_cutoff = best_weight + beam,
         min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
         max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
 
     KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
                   << " is " << tmp_array_.size();
 
-    if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
+    if (tmp_array_.size() > static_cast<size_t>(max_active)) {
       std::nth_element(tmp_array_.begin(),
-                       tmp_array_.begin() + config_.max_active,
+                       tmp_array_.begin() + max_active,
                        tmp_array_.end());
-      max_active_cutoff = tmp_array_[config_.max_active];
+      max_active_cutoff = tmp_array_[max_active];
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
       if (adaptive_beam)
@@ -706,8 +1277,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       else {
         std::nth_element(tmp_array_.begin(),
                          tmp_array_.begin() + config_.min_active,
-                         tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
-                         tmp_array_.begin() + config_.max_active :
+                         tmp_array_.size() > static_cast<size_t>(max_active) ?
+                         tmp_array_.begin() + max_active :
                          tmp_array_.end());
         min_active_cutoff = tmp_array_[config_.min_active];
       }
@@ -717,7 +1288,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
         *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
       return min_active_cutoff;
     } else {
-      *adaptive_beam = config_.beam;
+      *adaptive_beam = beam;
       return beam_cutoff;
     }
   }
@@ -731,6 +1302,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
                                          // (zero-based) used to get likelihoods
                                          // from the decodable object.
   active_toks_.resize(active_toks_.size() + 1);
+  frame_stats_.Reset();
 
   Elem *final_toks = toks_.Clear(); // analogous to swapping prev_toks_ / cur_toks_
                                    // in simple-decoder.h.   Removes the Elems from
@@ -739,6 +1311,9 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   BaseFloat adaptive_beam;
   size_t tok_cnt;
   BaseFloat cur_cutoff = GetCutoff(final_toks, &tok_cnt, &adaptive_beam, &best_elem);
+  num_toks_expanded_ = tok_cnt;
+  frame_stats_.num_tokens = tok_cnt;
+  frame_stats_.beam = adaptive_beam;
   KALDI_VLOG(6) << "Adaptive beam on frame " << NumFramesDecoded() << " is "
                 << adaptive_beam;
 
@@ -777,6 +1352,20 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
 
+  // Expanding in parallel only pays off when there are enough tokens to
+  // share out between the threads.
+  bool parallel = (num_expand_threads_ > 1 &&
+                   tok_cnt >= 500 * static_cast<size_t>(num_expand_threads_));
+  if (parallel || config_.batch_likelihoods) {
+    next_cutoff = ExpandEmittingParallel(
+        decodable, frame, final_toks, cur_cutoff, next_cutoff, adaptive_beam,
+        cost_offset, parallel ? num_expand_threads_ : 0);
+    DeleteElems(final_toks);
+    return next_cutoff;
+  }
+
+  // These are for the search statistics.
+  int32 num_expanded = 0, num_arcs = 0, num_links = 0;
   // the tokens are now owned here, in final_toks, and the hash is empty.
   // 'owned' is a complex thing here; the point is we need to call DeleteElem
   // on each elem 'e' to let toks_ know we're done with them.
@@ -785,11 +1374,13 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
     StateId state = e->key;
     Token *tok = e->val;
     if (tok->tot_cost <= cur_cutoff) {
+      num_expanded++;
       for (fst::ArcIterator<FST> aiter(*fst_, state);
            !aiter.Done();
            aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
+          num_arcs++;
           BaseFloat ac_cost = cost_offset -
               decodable->LogLikelihood(frame, arc.ilabel),
               graph_cost = arc.weight.Value(),
@@ -805,24 +1396,195 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLinkT(next_tok, arc.ilabel, arc.olabel,
-                                        graph_cost, ac_cost, tok->links);
+          tok->links = new (link_allocator_.Allocate()) ForwardLinkT(
+              next_tok, arc.ilabel, arc.olabel, graph_cost, ac_cost,
+              tok->links);
+          num_links++;
         }
       } // for all arcs
     }
     e_tail = e->tail;
     toks_.Delete(e); // delete Elem
   }
+  frame_stats_.num_expanded_tokens = num_expanded;
+  frame_stats_.num_emitting_arcs = num_arcs;
+  frame_stats_.num_emitting_links = num_links;
+  return next_cutoff;
+}
+
+
+template <typename FST, typename Token>
+class LatticeFasterDecoderTpl<FST, Token>::EmittingExpander:
+      public MultiThreadable {
+ public:
+  // If "collect_labels" is true, this just makes a list of the input labels on
+  // the emitting arcs, so that their acoustic costs can be computed in
+  // advance (the decodable object is not thread-safe); otherwise it does the
+  // arc expansion and pruning of ProcessEmitting(), writing the surviving arcs
+  // to decoder->expand_arcs_.  Each thread processes a contiguous part of
+  // decoder->expand_elems_.
+  EmittingExpander(LatticeFasterDecoderTpl<FST, Token> *decoder,
+                   bool collect_labels, BaseFloat next_cutoff,
+                   BaseFloat adaptive_beam):
+      decoder_(decoder), collect_labels_(collect_labels),
+      next_cutoff_(next_cutoff), adaptive_beam_(adaptive_beam) { }
+
+  // Use the default copy constructor.
+
+  void operator () () {
+    const std::vector<Elem*> &elems = decoder_->expand_elems_;
+    size_t num_elems = elems.size(),
+        begin = (num_elems * thread_id_) / num_threads_,
+        end = (num_elems * (thread_id_ + 1)) / num_threads_;
+    const FST &fst = *(decoder_->fst_);
+    if (collect_labels_) {
+      std::vector<Label> &labels = decoder_->expand_labels_[thread_id_];
+      std::vector<char> &seen = decoder_->expand_label_seen_[thread_id_];
+      labels.clear();
+      for (size_t i = begin; i < end; i++) {
+        for (fst::ArcIterator<FST> aiter(fst, elems[i]->key);
+             !aiter.Done();
+             aiter.Next()) {
+          Label ilabel = aiter.Value().ilabel;
+          if (ilabel == 0) continue;
+          if (static_cast<size_t>(ilabel) >= seen.size())
+            seen.resize(ilabel + 1, 0);
+          if (!seen[ilabel]) {
+            seen[ilabel] = 1;
+            labels.push_back(ilabel);
+          }
+        }
+      }
+      for (size_t i = 0; i < labels.size(); i++)
+        seen[labels[i]] = 0;
+    } else {
+      std::vector<EmittingArc> &arcs = decoder_->expand_arcs_[thread_id_];
+      const std::vector<BaseFloat> &ac_costs = decoder_->ac_costs_;
+      arcs.clear();
+      int32 num_arcs = 0;
+      BaseFloat next_cutoff = next_cutoff_;
+      for (size_t i = begin; i < end; i++) {
+        Token *tok = elems[i]->val;
+        for (fst::ArcIterator<FST> aiter(fst, elems[i]->key);
+             !aiter.Done();
+             aiter.Next()) {
+          const Arc &arc = aiter.Value();
+          if (arc.ilabel != 0) {
+            num_arcs++;
+            // This must be computed exactly as in ProcessEmitting().
+            BaseFloat ac_cost = ac_costs[arc.ilabel],
+                graph_cost = arc.weight.Value(),
+                cur_cost = tok->tot_cost,
+                tot_cost = cur_cost + ac_cost + graph_cost;
+            if (tot_cost > next_cutoff) continue;
+            else if (tot_cost + adaptive_beam_ < next_cutoff)
+              next_cutoff = tot_cost + adaptive_beam_;
+            EmittingArc emitting_arc;
+            emitting_arc.source = tok;
+            emitting_arc.nextstate = arc.nextstate;
+            emitting_arc.ilabel = arc.ilabel;
+            emitting_arc.olabel = arc.olabel;
+            emitting_arc.graph_cost = graph_cost;
+            emitting_arc.ac_cost = ac_cost;
+            emitting_arc.tot_cost = tot_cost;
+            arcs.push_back(emitting_arc);
+          }
+        }
+      }
+      decoder_->expand_num_arcs_[thread_id_] = num_arcs;
+    }
+  }
+
+ private:
+  LatticeFasterDecoderTpl<FST, Token> *decoder_;
+  bool collect_labels_;
+  BaseFloat next_cutoff_;
+  BaseFloat adaptive_beam_;
+};
+
+
+template <typename FST, typename Token>
+BaseFloat LatticeFasterDecoderTpl<FST, Token>::ExpandEmittingParallel(
+    DecodableInterface *decodable, int32 frame, Elem *final_toks,
+    BaseFloat cur_cutoff, BaseFloat next_cutoff, BaseFloat adaptive_beam,
+    BaseFloat cost_offset, int32 num_threads) {
+  int32 num_parts = std::max<int32>(num_threads, 1);
+  if (expand_threads_ == NULL || expand_threads_->NumThreads() != num_parts) {
+    delete expand_threads_;
+    expand_threads_ = new WorkerThreads(num_parts);
+  }
+  expand_elems_.clear();
+  for (Elem *e = final_toks; e != NULL; e = e->tail)
+    if (e->val->tot_cost <= cur_cutoff)
+      expand_elems_.push_back(e);
+  expand_labels_.resize(num_parts);
+  expand_label_seen_.resize(num_parts);
+  expand_arcs_.resize(num_parts);
+  expand_num_arcs_.resize(num_parts);
+
+  {  // Find out which input labels we need.
+    EmittingExpander collector(this, true, next_cutoff, adaptive_beam);
+    expand_threads_->Run(collector);
+  }
+  batch_labels_.clear();
+  for (int32 t = 0; t < num_parts; t++) {
+    const std::vector<Label> &labels = expand_labels_[t];
+    for (size_t i = 0; i < labels.size(); i++) {
+      Label ilabel = labels[i];
+      if (static_cast<size_t>(ilabel) >= ac_costs_.size()) {
+        ac_costs_.resize(ilabel + 1, 0.0);
+        ac_costs_frame_.resize(ilabel + 1, -1);
+      }
+      if (ac_costs_frame_[ilabel] != frame) {
+        ac_costs_frame_[ilabel] = frame;
+        batch_labels_.push_back(ilabel);
+      }
+    }
+  }
+  decodable->LogLikelihoods(frame, batch_labels_, &batch_log_likes_);
+  for (size_t i = 0; i < batch_labels_.size(); i++)
+    ac_costs_[batch_labels_[i]] = cost_offset - batch_log_likes_[i];
+
+  {  // Expand the arcs.
+    EmittingExpander expander(this, false, next_cutoff, adaptive_beam);
+    expand_threads_->Run(expander);
+  }
+
+  frame_stats_.num_expanded_tokens = expand_elems_.size();
+  for (int32 t = 0; t < num_parts; t++)
+    frame_stats_.num_emitting_arcs += expand_num_arcs_[t];
+
+  // Now create the tokens and links in the same order as ProcessEmitting()
+  // would, applying its pruning.  Each thread only knew about its own arcs,
+  // so its cutoff was never tighter than the one we have at the same point
+  // here, and nothing that ProcessEmitting() would have kept is missing.
+  for (int32 t = 0; t < num_parts; t++) {
+    typename std::vector<EmittingArc>::const_iterator
+        iter = expand_arcs_[t].begin(), end = expand_arcs_[t].end();
+    for (; iter != end; ++iter) {
+      BaseFloat tot_cost = iter->tot_cost;
+      if (tot_cost > next_cutoff) continue;
+      else if (tot_cost + adaptive_beam < next_cutoff)
+        next_cutoff = tot_cost + adaptive_beam;
+      Token *tok = iter->source,
+          *next_tok = FindOrAddToken(iter->nextstate, frame + 1, tot_cost,
+                                     tok, NULL);
+      tok->links = new (link_allocator_.Allocate()) ForwardLinkT(
+          next_tok, iter->ilabel, iter->olabel, iter->graph_cost,
+          iter->ac_cost, tok->links);
+      frame_stats_.num_emitting_links++;
+    }
+  }
   return next_cutoff;
 }
 
-// static inline
+// inline
 template <typename FST, typename Token>
 void LatticeFasterDecoderTpl<FST, Token>::DeleteForwardLinks(Token *tok) {
   ForwardLinkT *l = tok->links, *m;
   while (l != NULL) {
     m = l->next;
-    delete l;
+    link_allocator_.Deallocate(l);
     l = m;
   }
   tok->links = NULL;
@@ -866,6 +1628,7 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
     BaseFloat cur_cost = tok->tot_cost;
     if (cur_cost > cutoff) // Don't bother processing successors.
       continue;
+    frame_stats_.num_epsilon_states++;
     // If "tok" has any existing forward links, delete them,
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
@@ -885,8 +1648,9 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLinkT(new_tok, 0, arc.olabel,
-                                        graph_cost, 0, tok->links);
+          tok->links = new (link_allocator_.Allocate()) ForwardLinkT(
+              new_tok, 0, arc.olabel, graph_cost, 0, tok->links);
+          frame_stats_.num_epsilon_links++;
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -915,7 +1679,7 @@ void LatticeFasterDecoderTpl<FST, Token>::ClearActiveTokens() { // a cleanup rou
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
       DeleteForwardLinks(tok);
       Token *next_tok = tok->next;
-      delete tok;
+      token_allocator_.Deallocate(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -1009,11 +1773,13 @@ template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc>, decoder::StdToken>
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::StdToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::StdToken >;
 template class LatticeFasterDecoderTpl<fst::GrammarFst, decoder::StdToken>;
+template class LatticeFasterDecoderTpl<fst::CompactGraphFst, decoder::StdToken>;
 
 template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc> , decoder::BackpointerToken>;
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::GrammarFst, decoder::BackpointerToken>;
+template class LatticeFasterDecoderTpl<fst::CompactGraphFst, decoder::BackpointerToken>;
 
 
 } // end namespace kaldi.
@@ -25,13 +25,18 @@
 
 
 #include "util/stl-utils.h"
-#include "util/hash-list.h"
+#include "util/flat-hash-list.h"
+#include "util/slab-allocator.h"
+#include "util/kaldi-thread.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
 #include "decoder/grammar-fst.h"
+#include "decoder/compact-graph-fst.h"
+#include "decoder/adaptive-beam-controller.h"
+#include "decoder/decoder-search-stats.h"
 
 namespace kaldi {
 
@@ -48,10 +53,21 @@ struct LatticeFasterDecoderConfig {
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
+  bool use_slab_allocator; // If true, Tokens and ForwardLinks are allocated
+                           // from per-decoder slabs and recycled, instead of
+                           // with new/delete.
+  int32 num_expand_threads; // If > 1, the emitting arcs of each frame are
+                            // expanded by this many threads.
+  bool batch_likelihoods; // If true, the likelihoods needed on each frame are
+                          // obtained with one call to
+                          // DecodableInterface::LogLikelihoods().
   // Most of the options inside det_opts are not actually queried by the
   // LatticeFasterDecoder class itself, but by the code that calls it, for
   // example in the function DecodeUtteranceLatticeFaster.
   fst::DeterminizeLatticePhonePrunedOptions det_opts;
+  // Options for adjusting the beam and max-active to keep to a time or token
+  // budget; see AdaptiveBeamController.
+  AdaptiveBeamConfig adaptive_beam_opts;
 
   LatticeFasterDecoderConfig(): beam(16.0),
                                 max_active(std::numeric_limits<int32>::max()),
@@ -61,9 +77,13 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
-                                prune_scale(0.1) { }
+                                prune_scale(0.1),
+                                use_slab_allocator(true),
+                                num_expand_threads(1),
+                                batch_likelihoods(false) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
+    adaptive_beam_opts.Register(opts);
     opts->Register("beam", &beam, "Decoding beam.  Larger->slower, more accurate.");
     opts->Register("max-active", &max_active, "Decoder max active states.  Larger->slower; "
                    "more accurate");
@@ -80,15 +100,44 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("use-slab-allocator", &use_slab_allocator, "If true, "
+                   "allocate tokens and lattice arcs in blocks and recycle "
+                   "them, instead of calling new/delete for each one.  Only "
+                   "affects speed and memory use.");
+    opts->Register("num-expand-threads", &num_expand_threads, "If >1, use "
+                   "this many threads to expand the emitting arcs of each "
+                   "frame (helps latency with large graphs and wide beams; "
+                   "the output is unchanged).  Only used with graphs of type "
+                   "const, vector, compact-graph or grammar, which are safe "
+                   "to read from several threads.");
+    opts->Register("batch-likelihoods", &batch_likelihoods, "If true, find "
+                   "the input labels of all the emitting arcs to be expanded "
+                   "on each frame first, and get their likelihoods from the "
+                   "acoustic model together; faster with acoustic models that "
+                   "compute likelihoods lazily and can do them in batches.  "
+                   "The output is unchanged, up to the rounding of the "
+                   "likelihoods.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && min_active <= max_active
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
-                 && prune_scale > 0.0 && prune_scale < 1.0);
+                 && prune_scale > 0.0 && prune_scale < 1.0
+                 && num_expand_threads > 0);
+    adaptive_beam_opts.Check();
   }
 };
 
+/// A word on the best path, with its time and confidence; see
+/// LatticeFasterDecoderTpl::GetWordConfidences().
+struct WordConfidence {
+  int32 word;
+  int32 start_frame;  // The frame on which the word's arc is (after any
+                      // frame subsampling).
+  int32 num_frames;  // The number of frames until the next word (or the end).
+  BaseFloat confidence;  // An approximate posterior probability, in [0, 1].
+};
+
 namespace decoder {
 // We will template the decoder on the token type as well as the FST type; this
 // is a mechanism so that we can use the same underlying decoder code for
@@ -151,6 +200,9 @@ struct StdToken {
   // for LatticeFasterOnlineDecoder that supports fast traceback.
   inline void SetBackpointer (Token *backpointer) { }
 
+  // Returns NULL, as we don't store the backpointer; see SetBackpointer().
+  inline Token *GetBackpointer() const { return NULL; }
+
   // This constructor just ignores the 'backpointer' argument.  That argument is
   // needed so that we can use the same decoder code for LatticeFasterDecoderTpl
   // and LatticeFasterOnlineDecoderTpl (which needs backpointers to support a
@@ -199,6 +251,8 @@ struct BackpointerToken {
     this->backpointer = backpointer;
   }
 
+  inline Token *GetBackpointer() const { return backpointer; }
+
   inline BackpointerToken(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLinkT *links,
                           Token *next, Token *backpointer):
       tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
@@ -217,8 +271,8 @@ struct BackpointerToken {
    quick lookup of the current best path (see lattice-faster-online-decoder.h)
 
    The FST you invoke this decoder with is expected to equal
-   Fst::Fst<fst::StdArc>, a.k.a. StdFst, or GrammarFst.  If you invoke it with
-   FST == StdFst and it notices that the actual FST type is
+   Fst::Fst<fst::StdArc>, a.k.a. StdFst, GrammarFst or CompactGraphFst.  If
+   you invoke it with FST == StdFst and it notices that the actual FST type is
    fst::VectorFst<fst::StdArc> or fst::ConstFst<fst::StdArc>, the decoder object
    will internally cast itself to one that is templated on those more specific
    types; this is an optimization for speed.
@@ -245,6 +299,8 @@ class LatticeFasterDecoderTpl {
 
   void SetOptions(const LatticeFasterDecoderConfig &config) {
     config_ = config;
+    beam_controller_.Reset(config_.beam, config_.max_active,
+                           config_.min_active);
   }
 
   const LatticeFasterDecoderConfig &GetOptions() const {
@@ -253,6 +309,19 @@ class LatticeFasterDecoderTpl {
 
   ~LatticeFasterDecoderTpl();
 
+  /// Returns the statistics of the adaptive pruning (see
+  /// LatticeFasterDecoderConfig::adaptive_beam_opts), accumulated since this
+  /// object was created.  They are empty if it is not enabled.
+  const AdaptiveBeamStats &GetAdaptiveBeamStats() const {
+    return beam_controller_.Stats();
+  }
+
+  /// If 'stats' is non-NULL, the decoder will record statistics about the
+  /// search on each frame it decodes (tokens, arcs, time and so on) in it, for
+  /// tuning purposes; InitDecoding() clears it.  Set it to NULL to stop.  The
+  /// object is not owned here.  This costs very little time.
+  void SetSearchStats(DecoderSearchStats *stats) { search_stats_ = stats; }
+
   /// Decodes until there are no more frames left in the "decodable" object..
   /// note, this may block waiting for input if the "decodable" object blocks.
   /// Returns true if any kind of traceback is available (not necessarily from a
@@ -288,6 +357,42 @@ class LatticeFasterDecoderTpl {
   /// We could put that here in future needed.
   bool GetRawLattice(Lattice *ofst, bool use_final_probs = true) const;
 
+  /// Outputs the words on the best path with approximate confidences, which
+  /// are computed by forward-backward over the current token lattice, so
+  /// there is no need to create, determinize and MBR-decode a lattice as
+  /// lattice-to-ctm-conf does.  The confidence of a word is the total
+  /// posterior of the arcs in the lattice that have the same word on them
+  /// and are within its time span (or, failing that, the time span of the
+  /// word before or after it), capped at one.  A word's time span goes from
+  /// its arc on the best path up to the arc of the next word, so it includes
+  /// any silence after it.  The best path is found with the decoder's own
+  /// costs; the acoustic costs are multiplied by "acoustic_scale" only when
+  /// computing the posteriors (note: they are already scaled by the acoustic
+  /// scale that was used in decoding).
+  /// "use_final_probs" is as for GetRawLattice().  Returns false if there was
+  /// a problem, e.g. no tokens survived on some frame.
+  bool GetWordConfidences(bool use_final_probs, BaseFloat acoustic_scale,
+                          std::vector<WordConfidence> *words) const;
+
+  /// Outputs part of the raw lattice: the states for the tokens on frames
+  /// begin_frame through end_frame, and the arcs for the links out of the
+  /// tokens on frames begin_frame through end_frame - 1.  If end_frame ==
+  /// NumFramesDecoded() it also has the (epsilon) links out of the tokens on
+  /// end_frame, and the final-probs are set as for GetRawLattice(); otherwise
+  /// no state is final, and the epsilon links within end_frame are left for
+  /// the chunk that starts there, so consecutive chunks don't overlap (only
+  /// the last chunk may have begin_frame == end_frame).  The
+  /// start state is set only if begin_frame == 0.  'begin_states' and
+  /// 'end_states' are set to the tokens on begin_frame and end_frame and their
+  /// states in 'ofst'.  This is used for incremental lattice determinization
+  /// (see lattice-incremental-determinizer.h).  Returns false if some frame
+  /// had no tokens.
+  bool GetRawLatticeChunk(
+      int32 begin_frame, int32 end_frame, bool use_final_probs,
+      Lattice *ofst,
+      std::vector<std::pair<Token*, LatticeArc::StateId> > *begin_states,
+      std::vector<std::pair<Token*, LatticeArc::StateId> > *end_states) const;
+
 
 
   /// [Deprecated, users should now use GetRawLattice and determinize it
@@ -342,13 +447,40 @@ class LatticeFasterDecoderTpl {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// Returns the number of frames whose tokens have had their extra_cost set
+  /// by pruning (which happens every prune-interval frames); the extra_costs
+  /// of the tokens on later frames are not meaningful yet.
+  int32 NumFramesPruned() const { return num_frames_pruned_; }
+
+  /// Writes the state of the search, so that decoding can be resumed later
+  /// (possibly in another process) by calling ReadState() on a decoder with
+  /// the same graph and options, and then AdvanceDecoding().  This is for
+  /// checkpointing and migrating online decoding sessions.  It must be called
+  /// between InitDecoding() and FinalizeDecoding().  It does not change this
+  /// object: the tokens and links are pruned to the lattice beam on a copy,
+  /// as PruneActiveTokens() would prune them, and only what survives is
+  /// written (with the graph states of the tokens on the last frame).  The
+  /// resumed decoding gives the same best path as if it had not been
+  /// interrupted, and the same lattice up to the pruning being done at a
+  /// different time, unless adaptive pruning (--adaptive-target-rtf or
+  /// --adaptive-max-tokens) is in use, since that depends on timing.  It does
+  /// not write the options, the search stats or the state of the adaptive
+  /// pruning.
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState(); call this instead of
+  /// InitDecoding().  The decoder must have the same graph (or a GrammarFst
+  /// with the same FSTs) as the one that wrote it, or the results will be
+  /// meaningless.
+  void ReadState(std::istream &is, bool binary);
+
  protected:
   // we make things protected instead of private, as code in
   // LatticeFasterOnlineDecoderTpl, which inherits from this, also uses the
   // internals.
 
   // Deletes the elements of the singly linked list tok->links.
-  inline static void DeleteForwardLinks(Token *tok);
+  inline void DeleteForwardLinks(Token *tok);
 
   // head of per-frame list of Tokens (list is in topological order),
   // and something saying whether we ever pruned it using PruneForwardLinks.
@@ -360,7 +492,7 @@ class LatticeFasterDecoderTpl {
                  must_prune_tokens(true) { }
   };
 
-  using Elem = typename HashList<StateId, Token*>::Elem;
+  using Elem = typename FlatHashList<StateId, Token*>::Elem;
   // Equivalent to:
   //  struct Elem {
   //    StateId key;
@@ -438,6 +570,11 @@ class LatticeFasterDecoderTpl {
   // less far.
   void PruneActiveTokens(BaseFloat delta);
 
+  /// Returns config_.num_expand_threads, or 1 (with a warning) if the type of
+  /// fst_ is not one that we know can be read from several threads at once.
+  /// Called from the constructors.
+  int32 NumUsableExpandThreads() const;
+
   /// Gets the weight cutoff.  Also counts the active tokens.
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
@@ -447,19 +584,55 @@ class LatticeFasterDecoderTpl {
   /// use.
   BaseFloat ProcessEmitting(DecodableInterface *decodable);
 
+  /// This is called from ProcessEmitting() when num_expand_threads_ > 1 and
+  /// there are enough tokens, or when config_.batch_likelihoods is true.
+  /// It does the part of ProcessEmitting() that loops over the tokens
+  /// in "final_toks", with the same result.  First the input labels of the
+  /// emitting arcs are collected and their likelihoods are obtained with one
+  /// call to decodable->LogLikelihoods(); then the arc iteration and pruning
+  /// are done by "num_threads" threads (by this thread alone if it is 0 or
+  /// 1; the others are kept in expand_threads_), each on a contiguous part of
+  /// the token list, and the tokens and links are then created in the
+  /// original order by this thread.  It does not delete the
+  /// Elems.  Returns the next cutoff.  If num_threads > 0, the FST must allow
+  /// concurrent arc iteration, which is true of VectorFst and ConstFst but not
+  /// of lazy FSTs.
+  BaseFloat ExpandEmittingParallel(DecodableInterface *decodable,
+                                   int32 frame, Elem *final_toks,
+                                   BaseFloat cur_cutoff,
+                                   BaseFloat next_cutoff,
+                                   BaseFloat adaptive_beam,
+                                   BaseFloat cost_offset,
+                                   int32 num_threads);
+
+  /// The threads used in ExpandEmittingParallel() run this; see the .cc file.
+  class EmittingExpander;
+
+  /// An arc that survived the pruning in a thread in ExpandEmittingParallel().
+  struct EmittingArc {
+    Token *source;
+    StateId nextstate;
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+    BaseFloat ac_cost;
+    BaseFloat tot_cost;
+  };
+
   /// Processes nonemitting (epsilon) arcs for one frame.  Called after
   /// ProcessEmitting() on each frame.  The cost cutoff is computed by the
   /// preceding ProcessEmitting().
   void ProcessNonemitting(BaseFloat cost_cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
-  // more than one list (e.g. for current and previous frames), but only one of
-  // them at a time can be indexed by StateId.  It is indexed by frame-index
-  // plus one, where the frame-index is zero-based, as used in decodable object.
+  // FlatHashList defined in ../util/flat-hash-list.h.  It actually allows us
+  // to maintain more than one list (e.g. for current and previous frames), but
+  // only one of them at a time can be indexed by StateId.  It is indexed by
+  // frame-index plus one, where the frame-index is zero-based, as used in
+  // decodable object.
   // That is, the emitting probs of frame t are accounted for in tokens at
   // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
   // the graph.
-  HashList<StateId, Token*> toks_;
+  FlatHashList<StateId, Token*> toks_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
@@ -467,6 +640,25 @@ class LatticeFasterDecoderTpl {
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
 
+  // The following are used in ExpandEmittingParallel().
+  std::vector<Elem*> expand_elems_;  // tokens within the cutoff.
+  // expand_labels_[t] is the list of input labels seen by thread t, and
+  // expand_label_seen_[t] is a temporary array indexed by label.
+  std::vector<std::vector<Label> > expand_labels_;
+  std::vector<std::vector<char> > expand_label_seen_;
+  // expand_arcs_[t] contains the arcs that survived pruning in thread t.
+  std::vector<std::vector<EmittingArc> > expand_arcs_;
+  // expand_num_arcs_[t] is the number of emitting arcs thread t looked at.
+  std::vector<int32> expand_num_arcs_;
+  // ac_costs_[l] is the acoustic cost (with the cost offset) of input label l
+  // on frame ac_costs_frame_[l].
+  std::vector<BaseFloat> ac_costs_;
+  std::vector<int32> ac_costs_frame_;
+  // The input labels whose likelihoods we need on the current frame, and
+  // their log-likelihoods.
+  std::vector<int32> batch_labels_;
+  std::vector<BaseFloat> batch_log_likes_;
+
   // fst_ is a pointer to the FST we are decoding from.
   const FST *fst_;
   // delete_fst_ is true if the pointer fst_ needs to be deleted when this
@@ -479,8 +671,37 @@ class LatticeFasterDecoderTpl {
   // zero, to reduce roundoff errors.
   LatticeFasterDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
+  // See NumFramesPruned().
+  int32 num_frames_pruned_;
+  // Tokens and ForwardLinks are allocated from these, so that the memory is
+  // reused from frame to frame and from utterance to utterance.  If
+  // config_.use_slab_allocator is false they just call new and delete.
+  SlabAllocator<Token> token_allocator_;
+  SlabAllocator<ForwardLinkT> link_allocator_;
   bool warned_;
 
+  // The number of threads to expand the emitting arcs with: as
+  // config_.num_expand_threads, or 1 if fst_ is not of a type that is known
+  // to be safe to read from several threads (see NumUsableExpandThreads()).
+  int32 num_expand_threads_;
+  // The threads used in ExpandEmittingParallel(); created when first needed
+  // and kept for later frames and utterances.  Owned here.
+  WorkerThreads *expand_threads_;
+
+  // If adaptive pruning is enabled, this decides the beam and max-active used
+  // in GetCutoff() (otherwise they are those in config_).  It is reset by
+  // InitDecoding() and ReadState(), so each utterance starts with the
+  // configured beam and max-active; its stats are kept.
+  AdaptiveBeamController beam_controller_;
+  // The number of tokens that ProcessEmitting() expanded on the last frame;
+  // used for adaptive pruning.
+  size_t num_toks_expanded_;
+
+  // See SetSearchStats(); may be NULL.  The stats of the current frame are
+  // collected in frame_stats_.
+  DecoderSearchStats *search_stats_;
+  DecoderFrameStats frame_stats_;
+
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
   /// calling this is optional].  If true, it's forbidden to decode more.  Also,
   /// if this is set, then the output of ComputeFinalCosts() is in the next
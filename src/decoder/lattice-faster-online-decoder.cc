@@ -164,6 +164,17 @@ typename LatticeFasterOnlineDecoderTpl<FST>::BestPathIterator LatticeFasterOnlin
   return BestPathIterator(tok->backpointer, ret_t);
 }
 
+template <typename FST>
+void LatticeFasterOnlineDecoderTpl<FST>::LastFrameTokens(
+    std::vector<BestPathIterator> *iters) const {
+  KALDI_ASSERT(this->NumFramesDecoded() > 0);
+  iters->clear();
+  int32 frame = this->NumFramesDecoded() - 1;
+  for (Token *tok = this->active_toks_.back().toks;
+       tok != NULL; tok = tok->next)
+    iters->push_back(BestPathIterator(tok, frame));
+}
+
 template <typename FST>
 bool LatticeFasterOnlineDecoderTpl<FST>::GetRawLatticePruned(
     Lattice *ofst,
@@ -271,6 +282,7 @@ template class LatticeFasterOnlineDecoderTpl<fst::Fst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::VectorFst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::ConstFst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::GrammarFst>;
+template class LatticeFasterOnlineDecoderTpl<fst::CompactGraphFst>;
 
 
 } // end namespace kaldi.
@@ -126,6 +126,12 @@ class LatticeFasterOnlineDecoderTpl:
   BestPathIterator TraceBackBestPath(
       BestPathIterator iter, LatticeArc *arc) const;
 
+  /// Outputs iterators (as from BestPathEnd()) for all the tokens that are
+  /// active on the most recently decoded frame, in no particular order.  This
+  /// is used by class BestPathTracker to work out which part of the best path
+  /// can no longer change.  Requires that NumFramesDecoded() > 0.
+  void LastFrameTokens(std::vector<BestPathIterator> *iters) const;
+
 
   /// Behaves the same as GetRawLattice but only processes tokens whose
   /// extra_cost is smaller than the best-cost plus the specified beam.
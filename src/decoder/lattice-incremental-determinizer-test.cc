@@ -0,0 +1,81 @@
+// decoder/lattice-incremental-determinizer-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-incremental-determinizer.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "hmm/hmm-test-utils.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+// Checks that the incrementally determinized lattice is equivalent to the one
+// we get by determinizing the whole raw lattice at the end.  The beams are
+// large so that neither lattice is pruned; the chunks are pruned separately
+// and would otherwise keep a few more paths than the whole lattice does.
+void TestIncrementalDeterminization() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  fst::VectorFst<fst::StdArc> *graph =
+      GenRandDecodingGraph(*trans_model, 10, false);
+  Matrix<BaseFloat> loglikes;
+  int32 num_frames = 60 + Rand() % 40;
+  GenRandLoglikes(*trans_model, num_frames, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  LatticeFasterDecoderConfig decoder_config;
+  decoder_config.beam = 1000.0;
+  decoder_config.lattice_beam = 1000.0;
+  decoder_config.prune_interval = 5 + Rand() % 20;
+  LatticeIncrementalDeterminizerConfig det_config;
+  det_config.determinize_delay = 5 + Rand() % 20;
+  det_config.determinize_period = 5 + Rand() % 20;
+
+  LatticeFasterDecoder decoder(*graph, decoder_config);
+  LatticeIncrementalDeterminizer determinizer(det_config, *trans_model,
+                                              decoder);
+  decoder.InitDecoding();
+  determinizer.Init();
+  while (decoder.NumFramesDecoded() < num_frames) {
+    decoder.AdvanceDecoding(&decodable, 1 + Rand() % 10);
+    determinizer.AdvanceDeterminization();
+  }
+  KALDI_ASSERT(determinizer.NumFramesDeterminized() > 0);
+  decoder.FinalizeDecoding();
+
+  CompactLattice incremental_clat, clat;
+  KALDI_ASSERT(determinizer.GetLattice(true, &incremental_clat));
+  Lattice raw_lat;
+  KALDI_ASSERT(decoder.GetRawLattice(&raw_lat, true));
+  fst::DeterminizeLatticePhonePrunedWrapper(*trans_model, &raw_lat,
+                                            decoder_config.lattice_beam,
+                                            &clat);
+  KALDI_ASSERT(CompactLatticesEquivalent(incremental_clat, clat));
+
+  delete graph;
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestIncrementalDeterminization();
+  KALDI_LOG << "Success.";
+}
@@ -0,0 +1,282 @@
+// decoder/lattice-incremental-determinizer.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include "decoder/lattice-incremental-determinizer.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+template <typename FST, typename Token>
+LatticeIncrementalDeterminizerTpl<FST, Token>::LatticeIncrementalDeterminizerTpl(
+    const LatticeIncrementalDeterminizerConfig &config,
+    const TransitionModel &trans_model,
+    const LatticeFasterDecoderTpl<FST, Token> &decoder):
+    config_(config), trans_model_(trans_model), decoder_(decoder),
+    num_frames_determinized_(0) {
+  config_.Check();
+}
+
+template <typename FST, typename Token>
+void LatticeIncrementalDeterminizerTpl<FST, Token>::Init() {
+  clat_.DeleteStates();
+  num_frames_determinized_ = 0;
+  exit_arcs_.clear();
+  token_labels_.clear();
+}
+
+template <typename FST, typename Token>
+void LatticeIncrementalDeterminizerTpl<FST, Token>::AdvanceDeterminization() {
+  // The exit arcs of the chunk need the extra_costs of the tokens on
+  // end_frame, which are only set once the decoder has pruned that frame.
+  int32 end_frame = std::min(
+      decoder_.NumFramesDecoded() - config_.determinize_delay,
+      decoder_.NumFramesPruned() - 1);
+  if (end_frame - num_frames_determinized_ < config_.determinize_period)
+    return;
+  int32 begin_frame = num_frames_determinized_;
+  CompactLattice chunk;
+  std::vector<BaseFloat> entry_costs, exit_costs;
+  unordered_map<Token*, Label> exit_labels;
+  DeterminizeChunk(begin_frame, end_frame, false, false, &chunk,
+                   &entry_costs, &exit_labels, &exit_costs);
+  AppendChunk(chunk, begin_frame > 0, false, entry_costs, exit_costs,
+              &clat_, &exit_arcs_);
+  token_labels_.swap(exit_labels);
+  num_frames_determinized_ = end_frame;
+  KALDI_VLOG(3) << "Determinized frames " << begin_frame << " to "
+                << end_frame << "; lattice has " << clat_.NumStates()
+                << " states.";
+}
+
+template <typename FST, typename Token>
+bool LatticeIncrementalDeterminizerTpl<FST, Token>::GetLattice(
+    bool use_final_probs, CompactLattice *clat) const {
+  int32 num_frames = decoder_.NumFramesDecoded();
+  if (num_frames == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  KALDI_ASSERT(num_frames >= num_frames_determinized_);
+  CompactLattice chunk;
+  std::vector<BaseFloat> entry_costs, exit_costs;
+  DeterminizeChunk(num_frames_determinized_, num_frames, true,
+                   use_final_probs, &chunk, &entry_costs, NULL, NULL);
+  // We copy the stored lattice, which takes time linear in its size; but
+  // unlike determinizing it, this is cheap.
+  *clat = clat_;
+  std::vector<ExitArc> exit_arcs(exit_arcs_);
+  AppendChunk(chunk, num_frames_determinized_ > 0, true, entry_costs,
+              exit_costs, clat, &exit_arcs);
+  Connect(clat);
+  return (clat->NumStates() > 0);
+}
+
+template <typename FST, typename Token>
+void LatticeIncrementalDeterminizerTpl<FST, Token>::DeterminizeChunk(
+    int32 begin_frame, int32 end_frame, bool is_last, bool use_final_probs,
+    CompactLattice *chunk, std::vector<BaseFloat> *entry_costs,
+    unordered_map<Token*, Label> *exit_labels,
+    std::vector<BaseFloat> *exit_costs) const {
+  typedef LatticeArc::StateId RawStateId;
+  Lattice raw_lat;
+  std::vector<std::pair<Token*, RawStateId> > begin_states, end_states;
+  chunk->DeleteStates();
+  entry_costs->clear();
+  if (!decoder_.GetRawLatticeChunk(begin_frame, end_frame, use_final_probs,
+                                   &raw_lat, &begin_states, &end_states)) {
+    KALDI_WARN << "Empty lattice for frames " << begin_frame << " to "
+               << end_frame;
+    return;
+  }
+
+  if (begin_frame > 0) {
+    // Add a start state with arcs to the tokens on begin_frame, labeled with
+    // the labels we gave them as part of the previous chunk.  Their costs are
+    // the tokens' forward costs (relative to the best one), so that pruned
+    // determinization prunes about the same as for the whole lattice.
+    BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity();
+    for (size_t i = 0; i < begin_states.size(); i++)
+      best_cost = std::min(best_cost, begin_states[i].first->tot_cost);
+    entry_costs->resize(token_labels_.size(),
+                        std::numeric_limits<BaseFloat>::infinity());
+    RawStateId start_state = raw_lat.AddState();
+    raw_lat.SetStart(start_state);
+    int32 num_unlabeled = 0;
+    for (size_t i = 0; i < begin_states.size(); i++) {
+      Token *tok = begin_states[i].first;
+      typename unordered_map<Token*, Label>::const_iterator iter =
+          token_labels_.find(tok);
+      if (iter == token_labels_.end()) {
+        num_unlabeled++;
+        continue;
+      }
+      BaseFloat cost = tok->tot_cost - best_cost;
+      (*entry_costs)[iter->second - kTokenLabelOffset] = cost;
+      raw_lat.AddArc(start_state,
+                     LatticeArc(0, iter->second, LatticeWeight(cost, 0),
+                                begin_states[i].second));
+    }
+    // This should not happen: no tokens are added to a frame once it is
+    // determinize_delay frames behind.
+    if (num_unlabeled != 0)
+      KALDI_WARN << num_unlabeled << " tokens on frame " << begin_frame
+                 << " have no label; your determinize-delay may be too small.";
+  }
+
+  if (!is_last) {
+    // Add a final state with arcs from the tokens on end_frame.  Their cost is
+    // the token's backward cost relative to the best token on the frame: its
+    // extra_cost (from the last time the decoder pruned end_frame), which is
+    // how much worse the best path through the token is than the best path
+    // overall, minus its forward cost relative to the best token, which the
+    // entry arcs of the next chunk will carry.
+    BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity();
+    for (size_t i = 0; i < end_states.size(); i++)
+      best_cost = std::min(best_cost, end_states[i].first->tot_cost);
+    exit_labels->clear();
+    exit_costs->resize(end_states.size());
+    RawStateId final_state = raw_lat.AddState();
+    raw_lat.SetFinal(final_state, LatticeWeight::One());
+    for (size_t i = 0; i < end_states.size(); i++) {
+      Token *tok = end_states[i].first;
+      Label label = kTokenLabelOffset + i;
+      BaseFloat cost = tok->extra_cost - (tok->tot_cost - best_cost);
+      (*exit_labels)[tok] = label;
+      (*exit_costs)[i] = 0.0;
+      if (!KALDI_ISFINITE(cost))
+        continue;  // No path through the token survived pruning.
+      (*exit_costs)[i] = cost;
+      raw_lat.AddArc(end_states[i].second,
+                     LatticeArc(0, label, LatticeWeight(cost, 0),
+                                final_state));
+    }
+  }
+
+  const LatticeFasterDecoderConfig &opts = decoder_.GetOptions();
+  if (!DeterminizeLatticePhonePrunedWrapper(trans_model_, &raw_lat,
+                                            opts.lattice_beam, chunk,
+                                            opts.det_opts))
+    KALDI_WARN << "Determinization finished earlier than the beam for frames "
+               << begin_frame << " to " << end_frame;
+}
+
+template <typename FST, typename Token>
+void LatticeIncrementalDeterminizerTpl<FST, Token>::AppendChunk(
+    const CompactLattice &chunk, bool has_entry_arcs, bool is_last,
+    const std::vector<BaseFloat> &entry_costs,
+    const std::vector<BaseFloat> &exit_costs,
+    CompactLattice *clat,
+    std::vector<ExitArc> *exit_arcs) {
+  StateId chunk_start = chunk.Start();
+  if (chunk_start == fst::kNoStateId) {
+    // Nothing survived; all paths in 'clat' are now dead.
+    KALDI_WARN << "Determinized chunk of the lattice is empty, so the lattice "
+               << "will be empty.";
+    exit_arcs->clear();
+    return;
+  }
+  StateId offset = clat->NumStates();
+  if (offset == 0 && has_entry_arcs) {
+    // An earlier chunk was empty, so there is nothing to append to (and
+    // appending a chunk that doesn't start at frame zero would give the words
+    // the wrong times).
+    KALDI_WARN << "An earlier chunk of the lattice was empty; discarding the "
+               << "later chunks.";
+    exit_arcs->clear();
+    return;
+  }
+  for (StateId s = 0; s < chunk.NumStates(); s++)
+    clat->AddState();
+  if (offset == 0)
+    clat->SetStart(chunk_start);
+
+  if (has_entry_arcs) {
+    // Join the exit arcs of 'clat' to the entry arcs of the chunk with the
+    // same label, removing the costs we put on the entry arcs.  The exit arcs
+    // already include the final-probs and the costs we put on them have been
+    // removed (see below).  Exit arcs with no matching entry arc (e.g. because
+    // the token was pruned) stay where they are, in a dead end.
+    unordered_map<Label, CompactLatticeArc> entry_arcs;
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, chunk_start);
+         !aiter.Done(); aiter.Next())
+      entry_arcs[aiter.Value().ilabel] = aiter.Value();
+    for (size_t i = 0; i < exit_arcs->size(); i++) {
+      const ExitArc &exit_arc = (*exit_arcs)[i];
+      fst::MutableArcIterator<CompactLattice> aiter(clat, exit_arc.state);
+      aiter.Seek(exit_arc.arc_index);
+      CompactLatticeArc arc = aiter.Value();
+      typename unordered_map<Label, CompactLatticeArc>::const_iterator iter =
+          entry_arcs.find(arc.ilabel);
+      if (iter == entry_arcs.end())
+        continue;
+      const CompactLatticeArc &entry_arc = iter->second;
+      KALDI_ASSERT(entry_arc.ilabel >= kTokenLabelOffset);
+      BaseFloat entry_cost = entry_costs[entry_arc.ilabel - kTokenLabelOffset];
+      CompactLatticeWeight weight = Times(arc.weight, entry_arc.weight);
+      weight.SetWeight(Times(weight.Weight(), LatticeWeight(-entry_cost, 0)));
+      arc.ilabel = arc.olabel = 0;
+      arc.weight = weight;
+      arc.nextstate = entry_arc.nextstate + offset;
+      aiter.SetValue(arc);
+    }
+  }
+
+  exit_arcs->clear();
+  for (StateId s = 0; s < chunk.NumStates(); s++) {
+    if (has_entry_arcs && s == chunk_start)
+      continue;  // The start state of the chunk is left without arcs.
+    StateId state = s + offset;
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, s); !aiter.Done();
+         aiter.Next()) {
+      CompactLatticeArc arc = aiter.Value();
+      CompactLatticeWeight final_weight = chunk.Final(arc.nextstate);
+      if (!is_last && final_weight != CompactLatticeWeight::Zero()) {
+        // This is an exit arc (the only final state in the chunk is the one
+        // we added).  Fold the final-prob into it and remove the cost we put
+        // on it.
+        KALDI_ASSERT(arc.ilabel >= kTokenLabelOffset);
+        BaseFloat exit_cost = exit_costs[arc.ilabel - kTokenLabelOffset];
+        arc.weight = Times(arc.weight, final_weight);
+        arc.weight.SetWeight(Times(arc.weight.Weight(),
+                                   LatticeWeight(-exit_cost, 0)));
+        ExitArc exit_arc;
+        exit_arc.state = state;
+        exit_arc.arc_index = clat->NumArcs(state);
+        exit_arcs->push_back(exit_arc);
+      }
+      arc.nextstate += offset;
+      clat->AddArc(state, arc);
+    }
+    if (is_last)
+      clat->SetFinal(state, chunk.Final(s));
+  }
+}
+
+// Instantiate the template for the decoders that we'll need.
+template class LatticeIncrementalDeterminizerTpl<fst::Fst<fst::StdArc>,
+                                                 decoder::StdToken>;
+template class LatticeIncrementalDeterminizerTpl<fst::GrammarFst,
+                                                 decoder::StdToken>;
+template class LatticeIncrementalDeterminizerTpl<fst::Fst<fst::StdArc>,
+                                                 decoder::BackpointerToken>;
+template class LatticeIncrementalDeterminizerTpl<fst::GrammarFst,
+                                                 decoder::BackpointerToken>;
+
+
+}  // end namespace kaldi
@@ -0,0 +1,189 @@
+// decoder/lattice-incremental-determinizer.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LATTICE_INCREMENTAL_DETERMINIZER_H_
+#define KALDI_DECODER_LATTICE_INCREMENTAL_DETERMINIZER_H_
+
+#include <vector>
+#include "itf/options-itf.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+
+struct LatticeIncrementalDeterminizerConfig {
+  // Frames that are less than this many frames behind the most recently
+  // decoded frame are not determinized yet, because the tokens on them may
+  // still be pruned away or get new links.
+  int32 determinize_delay;
+  // We determinize at least this many new frames at a time.
+  int32 determinize_period;
+
+  LatticeIncrementalDeterminizerConfig(): determinize_delay(25),
+                                          determinize_period(20) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("determinize-delay", &determinize_delay,
+                   "Delay (in frames) with which lattices are incrementally "
+                   "determinized; frames more recent than this are only "
+                   "determinized when the lattice is requested.");
+    opts->Register("determinize-period", &determinize_period,
+                   "Number of frames we wait for before determinizing the "
+                   "next chunk of the lattice.");
+  }
+  void Check() const {
+    KALDI_ASSERT(determinize_delay >= 1 && determinize_period > 0);
+  }
+};
+
+
+/**
+   This class determinizes the lattice of a LatticeFasterDecoderTpl object
+   incrementally while decoding is in progress, so that getting the lattice
+   of a long utterance (e.g. for interim results in a streaming setting) does
+   not require determinizing the whole of it each time.
+
+   Every determinize_period frames, the frames from the last frame that was
+   determinized up to determinize_delay frames before the most recent one are
+   taken out of the decoder as a chunk of raw lattice (see
+   LatticeFasterDecoderTpl::GetRawLatticeChunk()), determinized with
+   DeterminizeLatticePhonePrunedWrapper() and appended to the determinized
+   lattice we have so far.  GetLattice() just has to determinize the frames
+   after that.
+
+   To connect the chunks we give each token on the frame where two chunks
+   meet a special label (>= kTokenLabelOffset).  In the earlier chunk, the
+   paths that end at that token go to a super-final state via an arc with that
+   label; in the later chunk, the paths starting from that token come from a
+   super-initial state via an arc with that label.  Since the labels are part
+   of the "word" sequence they survive determinization, and after
+   determinizing the later chunk we join each arc with a given label at the
+   end of the determinized lattice to the arc with the same label at the
+   start of the chunk.  The entry arcs carry the forward cost of the token
+   and the exit arcs its backward cost (both relative to the best token on the
+   frame), which gives the determinization of each chunk about the same
+   pruning behavior as determinizing the whole lattice; these are subtracted
+   again when we join the chunks, so the scores of the paths are exactly the
+   same as in the raw lattice.  The backward costs come from the extra_costs
+   that the decoder computes when it prunes the tokens, so we only determinize
+   frames that it has pruned (see LatticeFasterDecoderTpl::NumFramesPruned()).
+
+   The result is equivalent to what you would get by determinizing the whole
+   lattice (up to pruning, and the fact that it is only determinized within
+   the chunks, i.e. it is not necessarily deterministic across the chunk
+   boundaries).
+
+   Init() must be called after the decoder's InitDecoding(), and
+   AdvanceDeterminization() after (some calls to) its AdvanceDecoding().
+*/
+template <typename FST, typename Token = decoder::StdToken>
+class LatticeIncrementalDeterminizerTpl {
+ public:
+  typedef CompactLatticeArc::StateId StateId;
+  typedef CompactLatticeArc::Label Label;
+
+  // The labels we give to tokens on the chunk boundaries start at this value;
+  // they must be larger than any word-id.
+  static const Label kTokenLabelOffset = 200000000;
+
+  /// The config, trans_model and decoder must outlive this object.
+  LatticeIncrementalDeterminizerTpl(
+      const LatticeIncrementalDeterminizerConfig &config,
+      const TransitionModel &trans_model,
+      const LatticeFasterDecoderTpl<FST, Token> &decoder);
+
+  /// Clears the determinized lattice; call this after InitDecoding() on the
+  /// decoder.
+  void Init();
+
+  /// Determinizes the next chunk of the lattice if enough frames have been
+  /// decoded since the last time; call this after AdvanceDecoding().  It is
+  /// fine to call it often.
+  void AdvanceDeterminization();
+
+  /// Outputs the determinized lattice for all frames decoded so far.  This
+  /// only determinizes the frames that have not been determinized already
+  /// (without remembering the result).  If "use_final_probs" is true AND we
+  /// reached the final-state of the graph then it will include those as
+  /// final-probs, else it will treat all final-probs as one.  Returns false if
+  /// the lattice was empty.
+  bool GetLattice(bool use_final_probs, CompactLattice *clat) const;
+
+  /// Returns the number of frames of the lattice that have been determinized
+  /// and stored.
+  int32 NumFramesDeterminized() const { return num_frames_determinized_; }
+
+ private:
+  // An arc at the end of the stored lattice that leads to a token on the
+  // frame num_frames_determinized_; its label identifies the token.
+  struct ExitArc {
+    StateId state;
+    size_t arc_index;
+  };
+
+  // Gets the raw lattice for frames begin_frame to end_frame with the extra
+  // start state and entry arcs (if begin_frame > 0), and, if !is_last, the
+  // extra final state and exit arcs; and determinizes it.  'entry_costs' is
+  // set to the costs on the entry arcs, indexed by label minus
+  // kTokenLabelOffset.  If !is_last, 'exit_labels' is set to the labels of the
+  // tokens on end_frame and 'exit_costs' to the costs on the exit arcs.
+  void DeterminizeChunk(int32 begin_frame, int32 end_frame, bool is_last,
+                        bool use_final_probs, CompactLattice *chunk,
+                        std::vector<BaseFloat> *entry_costs,
+                        unordered_map<Token*, Label> *exit_labels,
+                        std::vector<BaseFloat> *exit_costs) const;
+
+  // Appends the determinized chunk 'chunk' to 'clat', joining the arcs in
+  // 'exit_arcs' to the entry arcs of the chunk (if 'has_entry_arcs').  If
+  // !is_last, 'exit_arcs' is then set to the exit arcs of the chunk,
+  // otherwise the final-probs of the chunk are copied.
+  static void AppendChunk(const CompactLattice &chunk, bool has_entry_arcs,
+                          bool is_last,
+                          const std::vector<BaseFloat> &entry_costs,
+                          const std::vector<BaseFloat> &exit_costs,
+                          CompactLattice *clat,
+                          std::vector<ExitArc> *exit_arcs);
+
+  const LatticeIncrementalDeterminizerConfig &config_;
+  const TransitionModel &trans_model_;
+  const LatticeFasterDecoderTpl<FST, Token> &decoder_;
+
+  // The determinized lattice for frames 0 through num_frames_determinized_.
+  // It has no final-probs; its paths end with the arcs in exit_arcs_.  Note:
+  // we don't call Connect() on it (which would make each chunk cost time
+  // proportional to the length of the utterance), so it may contain dead
+  // states.
+  CompactLattice clat_;
+  int32 num_frames_determinized_;
+  std::vector<ExitArc> exit_arcs_;
+  // The labels of the tokens on frame num_frames_determinized_.
+  unordered_map<Token*, Label> token_labels_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeIncrementalDeterminizerTpl);
+};
+
+typedef LatticeIncrementalDeterminizerTpl<fst::Fst<fst::StdArc>,
+                                          decoder::StdToken>
+    LatticeIncrementalDeterminizer;
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_DECODER_LATTICE_INCREMENTAL_DETERMINIZER_H_
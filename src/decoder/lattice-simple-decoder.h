@@ -24,6 +24,7 @@
 
 
 #include "util/stl-utils.h"
+#include "util/slab-allocator.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -45,6 +46,8 @@ struct LatticeSimpleDecoderConfig {
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
+  bool use_slab_allocator; // If true, Tokens and ForwardLinks are allocated
+                           // from per-decoder slabs and recycled.
   fst::DeterminizeLatticePhonePrunedOptions det_opts;
 
   LatticeSimpleDecoderConfig(): beam(16.0),
@@ -52,7 +55,8 @@ struct LatticeSimpleDecoderConfig {
                                 prune_interval(25),
                                 determinize_lattice(true),
                                 beam_ratio(0.9),
-                                prune_scale(0.1) { }
+                                prune_scale(0.1),
+                                use_slab_allocator(true) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
     opts->Register("beam", &beam, "Decoding beam.");
@@ -62,6 +66,10 @@ struct LatticeSimpleDecoderConfig {
     opts->Register("determinize-lattice", &determinize_lattice, "If true, "
                    "determinize the lattice (in a special sense, keeping only "
                    "best pdf-sequence for each word-sequence).");
+    opts->Register("use-slab-allocator", &use_slab_allocator, "If true, "
+                   "allocate tokens and lattice arcs in blocks and recycle "
+                   "them, instead of calling new/delete for each one.  Only "
+                   "affects speed and memory use.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && lattice_beam > 0.0 && prune_interval > 0);
@@ -82,7 +90,9 @@ class LatticeSimpleDecoder {
   // instantiate this class onece for each thing you have to decode.
   LatticeSimpleDecoder(const fst::Fst<fst::StdArc> &fst,
                        const LatticeSimpleDecoderConfig &config):
-      fst_(fst), config_(config), num_toks_(0) { config.Check(); }
+      fst_(fst), config_(config), num_toks_(0),
+      token_allocator_(config.use_slab_allocator),
+      link_allocator_(config.use_slab_allocator) { config.Check(); }
   
   ~LatticeSimpleDecoder() { ClearActiveTokens(); }
 
@@ -199,15 +209,6 @@ class LatticeSimpleDecoder {
           Token *next): tot_cost(tot_cost), extra_cost(extra_cost), links(links),
                         next(next) { }
     Token() {}
-    void DeleteForwardLinks() {
-      ForwardLink *l = links, *m; 
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
   
   // head and tail of per-frame list of Tokens (list is in topological order),
@@ -263,6 +264,9 @@ class LatticeSimpleDecoder {
 
   void ClearActiveTokens(); // a cleanup routine, at utt end/begin
 
+  // Deletes the elements of the singly linked list tok->links.
+  inline void DeleteForwardLinks(Token *tok);
+
   // This function computes the final-costs for tokens active on the final
   // frame.  It outputs to final-costs, if non-NULL, a map from the Token*
   // pointer to the final-prob of the corresponding state, or zero for all states if
@@ -293,6 +297,10 @@ class LatticeSimpleDecoder {
   const fst::Fst<fst::StdArc> &fst_;
   LatticeSimpleDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
+  // Tokens and ForwardLinks are allocated from these; see
+  // config_.use_slab_allocator.
+  SlabAllocator<Token> token_allocator_;
+  SlabAllocator<ForwardLink> link_allocator_;
   bool warned_;
 
 
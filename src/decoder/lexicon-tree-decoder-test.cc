@@ -0,0 +1,148 @@
+// decoder/lexicon-tree-decoder-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lexicon-tree-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+// Makes a small bigram language model in the form that arpa2fst creates:
+// state 0 is the start state, state 1 the unigram (empty-history) state, and
+// state 1 + w the state for history w.  Each explicit bigram costs less than
+// backing off, so that the best path through the FST (in which the backoff
+// arcs are just epsilons) is the same as with proper backoff semantics.
+fst::VectorFst<fst::StdArc> *GenRandBigramLm(int32 num_words) {
+  typedef fst::StdArc Arc;
+  fst::VectorFst<Arc> *lm = new fst::VectorFst<Arc>();
+  for (int32 s = 0; s < num_words + 2; s++)
+    lm->AddState();
+  lm->SetStart(0);
+  std::vector<BaseFloat> unigram_costs(num_words + 1);
+  for (int32 w = 1; w <= num_words; w++) {
+    unigram_costs[w] = 1.0 + 2.0 * RandUniform();
+    lm->AddArc(1, Arc(w, w, unigram_costs[w], 1 + w));
+  }
+  for (int32 s = 0; s < num_words + 2; s++) {
+    if (s == 1)
+      continue;
+    BaseFloat backoff_cost = 0.5 + RandUniform();
+    lm->AddArc(s, Arc(0, 0, backoff_cost, 1));
+    for (int32 w = 1; w <= num_words; w++) {
+      if (s != 0 && Rand() % 2 == 0)
+        continue;
+      BaseFloat cost = unigram_costs[w] + backoff_cost * RandUniform();
+      lm->AddArc(s, Arc(w, w, cost, 1 + w));
+    }
+    if (s != 0)
+      lm->SetFinal(s, RandUniform());
+  }
+  fst::ArcSort(lm, fst::ILabelCompare<Arc>());
+  return lm;
+}
+
+// Checks that LexiconTreeDecoder, which applies the language model on the fly
+// and takes off the unigram lookahead of the tree, finds the same best path as
+// LatticeFasterDecoder with the full graph, i.e. the lexicon tree without
+// lookahead composed with the language model.  The beams are large so that
+// neither search prunes the best path.
+void TestLexiconTreeDecoder() {
+  ContextDependency *ctx_dep = NULL;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  const std::vector<int32> &phones = trans_model->GetPhones();
+
+  int32 num_words = 2 + Rand() % 3;
+  std::vector<std::vector<int32> > lexicon;
+  for (int32 w = 1; w <= num_words; w++) {
+    int32 num_prons = 1 + Rand() % 2;
+    for (int32 p = 0; p < num_prons; p++) {
+      std::vector<int32> entry(1, w);
+      int32 num_phones = 1 + Rand() % 2;
+      for (int32 i = 0; i < num_phones; i++)
+        entry.push_back(phones[Rand() % phones.size()]);
+      lexicon.push_back(entry);
+    }
+  }
+  fst::VectorFst<fst::StdArc> *lm_fst = GenRandBigramLm(num_words);
+  std::vector<BaseFloat> unigram_costs,
+      zero_costs(num_words + 1, 0.0);
+  GetUnigramCostsFromG(*lm_fst, &unigram_costs);
+  KALDI_ASSERT(unigram_costs.size() == static_cast<size_t>(num_words + 1));
+
+  LexiconTreeOptions tree_opts;
+  int32 silence_phone = 0;
+  fst::VectorFst<fst::StdArc> *tree = CompileLexiconTree(
+      lexicon, unigram_costs, silence_phone, *ctx_dep, *trans_model,
+      tree_opts),
+      *tree_no_lookahead = CompileLexiconTree(
+          lexicon, zero_costs, silence_phone, *ctx_dep, *trans_model,
+          tree_opts);
+  fst::VectorFst<fst::StdArc> full_graph;
+  fst::ArcSort(tree_no_lookahead, fst::OLabelCompare<fst::StdArc>());
+  fst::Compose(*tree_no_lookahead, *lm_fst, &full_graph);
+
+  Matrix<BaseFloat> loglikes;
+  GenRandLoglikes(*trans_model, 30 + Rand() % 30, &loglikes);
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 0.1);
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 1000.0;
+  config.lattice_beam = 1.0;
+
+  LatticeFasterDecoder full_decoder(full_graph, config);
+  KALDI_ASSERT(full_decoder.Decode(&decodable));
+  fst::BackoffDeterministicOnDemandFst<fst::StdArc> lm(*lm_fst);
+  LexiconTreeDecoder tree_decoder(*tree, unigram_costs, &lm, *trans_model,
+                                  config);
+  KALDI_ASSERT(tree_decoder.Decode(&decodable));
+  KALDI_ASSERT(full_decoder.ReachedFinal() == tree_decoder.ReachedFinal());
+
+  Lattice full_best_path, tree_best_path;
+  KALDI_ASSERT(full_decoder.GetBestPath(&full_best_path) &&
+               tree_decoder.GetBestPath(&tree_best_path));
+  std::vector<int32> full_ali, full_words, tree_ali, tree_words;
+  LatticeWeight full_weight, tree_weight;
+  fst::GetLinearSymbolSequence(full_best_path, &full_ali, &full_words,
+                               &full_weight);
+  fst::GetLinearSymbolSequence(tree_best_path, &tree_ali, &tree_words,
+                               &tree_weight);
+  KALDI_LOG << "Best path has " << full_words.size() << " words, cost "
+            << (full_weight.Value1() + full_weight.Value2()) << " vs. "
+            << (tree_weight.Value1() + tree_weight.Value2());
+  AssertEqual(full_weight.Value1() + full_weight.Value2(),
+              tree_weight.Value1() + tree_weight.Value2(), 0.001);
+  KALDI_ASSERT(full_words == tree_words);
+
+  delete tree;
+  delete tree_no_lookahead;
+  delete lm_fst;
+  delete ctx_dep;
+  delete trans_model;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++)
+    TestLexiconTreeDecoder();
+  KALDI_LOG << "Success.";
+}
@@ -0,0 +1,347 @@
+// decoder/lexicon-tree-decoder.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+
+#include "decoder/lexicon-tree-decoder.h"
+#include "hmm/hmm-utils.h"
+#include "util/stl-utils.h"
+#include "util/text-utils.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+void ReadLexiconInt(std::istream &is,
+                    std::vector<std::vector<int32> > *lexicon) {
+  lexicon->clear();
+  std::string line;
+  int32 line_number = 0;
+  while (std::getline(is, line)) {
+    line_number++;
+    std::vector<int32> entry;
+    if (!SplitStringToIntegers(line, " \t\r", true, &entry) ||
+        entry.size() < 2)
+      KALDI_ERR << "Bad line " << line_number << " in lexicon: "
+                << "expected <word-id> <phone-id1> <phone-id2> ..., got: "
+                << line;
+    for (size_t i = 0; i < entry.size(); i++)
+      if (entry[i] <= 0)
+        KALDI_ERR << "Bad line " << line_number << " in lexicon (ids must "
+                  << "be positive): " << line;
+    lexicon->push_back(entry);
+  }
+  if (lexicon->empty())
+    KALDI_ERR << "Empty lexicon.";
+}
+
+
+// Creates the lexicon FST (like L_disambig.fst) for CompileLexiconTree(),
+// with the unigram costs on the word arcs.  Pronunciations that are the same
+// as, or a prefix of, another pronunciation have a disambiguation symbol added
+// (as in utils/add_lex_disambig.pl); these are numbered from first_disambig,
+// and output to "disambig_syms".
+static void MakeLexiconFst(const std::vector<std::vector<int32> > &lexicon,
+                           const std::vector<BaseFloat> &unigram_costs,
+                           int32 silence_phone,
+                           BaseFloat silence_prob,
+                           int32 first_disambig,
+                           fst::VectorFst<fst::StdArc> *lex_fst,
+                           std::vector<int32> *disambig_syms) {
+  typedef fst::StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  std::map<std::vector<int32>, int32> pron_count;
+  std::set<std::vector<int32> > prefixes;
+  for (size_t i = 0; i < lexicon.size(); i++) {
+    std::vector<int32> pron(lexicon[i].begin() + 1, lexicon[i].end());
+    pron_count[pron]++;
+    for (size_t len = 1; len < pron.size(); len++)
+      prefixes.insert(std::vector<int32>(pron.begin(), pron.begin() + len));
+  }
+
+  bool use_silence = (silence_phone > 0 && silence_prob > 0.0);
+  Weight no_sil_weight(use_silence ? -Log(1.0 - silence_prob) : 0.0),
+      sil_weight(use_silence ? -Log(silence_prob) : 0.0);
+
+  lex_fst->DeleteStates();
+  StateId start_state = lex_fst->AddState(), loop_state = start_state,
+      sil_state = fst::kNoStateId;
+  if (use_silence) {
+    loop_state = lex_fst->AddState();
+    sil_state = lex_fst->AddState();
+    lex_fst->AddArc(start_state, Arc(0, 0, no_sil_weight, loop_state));
+    lex_fst->AddArc(start_state, Arc(0, 0, sil_weight, sil_state));
+    lex_fst->AddArc(sil_state, Arc(silence_phone, 0, Weight::One(),
+                                   loop_state));
+  }
+  lex_fst->SetStart(start_state);
+  lex_fst->SetFinal(loop_state, Weight::One());
+
+  std::map<std::vector<int32>, int32> num_disambig_used;
+  int32 num_disambig = 0, num_skipped = 0;
+  for (size_t i = 0; i < lexicon.size(); i++) {
+    int32 word = lexicon[i][0];
+    if (static_cast<size_t>(word) >= unigram_costs.size())
+      KALDI_ERR << "No unigram cost given for word " << word;
+    BaseFloat unigram_cost = unigram_costs[word];
+    if (unigram_cost == std::numeric_limits<BaseFloat>::infinity()) {
+      num_skipped++;  // The language model can't produce this word.
+      continue;
+    }
+    std::vector<int32> labels(lexicon[i].begin() + 1, lexicon[i].end());
+    if (pron_count[labels] > 1 || prefixes.count(labels) != 0) {
+      int32 n = ++num_disambig_used[labels];
+      num_disambig = std::max(num_disambig, n);
+      labels.push_back(first_disambig + n - 1);
+    }
+    StateId cur_state = loop_state;
+    for (size_t j = 0; j < labels.size(); j++) {
+      int32 olabel = (j == 0 ? word : 0);
+      Weight weight(j == 0 ? unigram_cost : 0.0);
+      if (j + 1 < labels.size()) {
+        StateId next_state = lex_fst->AddState();
+        lex_fst->AddArc(cur_state, Arc(labels[j], olabel, weight, next_state));
+        cur_state = next_state;
+      } else {
+        lex_fst->AddArc(cur_state, Arc(labels[j], olabel,
+                                       Times(weight, no_sil_weight),
+                                       loop_state));
+        if (use_silence)
+          lex_fst->AddArc(cur_state, Arc(labels[j], olabel,
+                                         Times(weight, sil_weight),
+                                         sil_state));
+      }
+    }
+  }
+  if (num_skipped != 0)
+    KALDI_WARN << "Skipped " << num_skipped << " lexicon entries whose words "
+               << "have infinite unigram cost.";
+  disambig_syms->clear();
+  for (int32 n = 0; n < num_disambig; n++)
+    disambig_syms->push_back(first_disambig + n);
+}
+
+
+fst::VectorFst<fst::StdArc> *CompileLexiconTree(
+    const std::vector<std::vector<int32> > &lexicon,
+    const std::vector<BaseFloat> &unigram_costs,
+    int32 silence_phone,
+    const ContextDependency &ctx_dep,
+    const TransitionModel &trans_model,
+    const LexiconTreeOptions &opts) {
+  using namespace fst;
+  KALDI_ASSERT(opts.silence_prob >= 0.0 && opts.silence_prob < 1.0);
+  const std::vector<int32> &phone_syms = trans_model.GetPhones();
+  KALDI_ASSERT(!phone_syms.empty() && IsSortedAndUniq(phone_syms));
+  for (size_t i = 0; i < lexicon.size(); i++) {
+    KALDI_ASSERT(lexicon[i].size() >= 2);
+    for (size_t j = 1; j < lexicon[i].size(); j++)
+      if (!std::binary_search(phone_syms.begin(), phone_syms.end(),
+                              lexicon[i][j]))
+        KALDI_ERR << "Phone " << lexicon[i][j] << " in the lexicon entry for "
+                  << "word " << lexicon[i][0] << " is not in the model.";
+  }
+  if (silence_phone > 0 &&
+      !std::binary_search(phone_syms.begin(), phone_syms.end(), silence_phone))
+    KALDI_ERR << "Silence phone " << silence_phone << " is not in the model.";
+
+  VectorFst<StdArc> lex_fst;
+  std::vector<int32> disambig_syms;
+  MakeLexiconFst(lexicon, unigram_costs, silence_phone, opts.silence_prob,
+                 phone_syms.back() + 1, &lex_fst, &disambig_syms);
+
+  int32 subsequential_symbol = phone_syms.back() + 1 + disambig_syms.size(),
+      N = ctx_dep.ContextWidth(),
+      P = ctx_dep.CentralPosition();
+  if (P != N - 1)
+    AddSubsequentialLoop(subsequential_symbol, &lex_fst);
+
+  InverseContextFst inv_cfst(subsequential_symbol, phone_syms, disambig_syms,
+                             N, P);
+  VectorFst<StdArc> ctx2word_fst;
+  ComposeDeterministicOnDemandInverse(lex_fst, &inv_cfst, &ctx2word_fst);
+  KALDI_ASSERT(ctx2word_fst.Start() != kNoStateId);
+  lex_fst.DeleteStates();
+
+  HTransducerConfig h_cfg;
+  h_cfg.transition_scale = opts.transition_scale;
+  std::vector<int32> disambig_syms_h;
+  VectorFst<StdArc> *H = GetHTransducer(inv_cfst.IlabelInfo(), ctx_dep,
+                                        trans_model, h_cfg,
+                                        &disambig_syms_h);
+
+  VectorFst<StdArc> *tree = new VectorFst<StdArc>;
+  TableCompose(*H, ctx2word_fst, tree);
+  delete H;
+  ctx2word_fst.DeleteStates();
+  KALDI_ASSERT(tree->Start() != kNoStateId);
+
+  // Determinizing makes it a tree (apart from the loop back to the root).
+  DeterminizeStarInLog(tree);
+  if (!disambig_syms_h.empty()) {
+    RemoveSomeInputSymbols(disambig_syms_h, tree);
+    RemoveEpsLocal(tree);
+  }
+  MinimizeEncoded(tree);
+
+  // This moves the unigram costs (and the transition costs) as far towards
+  // the root as possible, which gives the language-model lookahead.
+  Push<StdArc>(tree, REWEIGHT_TO_INITIAL);
+
+  std::vector<int32> disambig;
+  bool check_no_self_loops = true;
+  AddSelfLoops(trans_model, disambig, opts.self_loop_scale, opts.reorder,
+               check_no_self_loops, tree);
+  return tree;
+}
+
+
+void GetUnigramCostsFromG(const fst::Fst<fst::StdArc> &lm_fst,
+                          std::vector<BaseFloat> *unigram_costs) {
+  typedef fst::StdArc Arc;
+  Arc::StateId state = lm_fst.Start();
+  if (state == fst::kNoStateId)
+    KALDI_ERR << "Language model FST is empty.";
+  for (fst::ArcIterator<fst::Fst<Arc> > aiter(lm_fst, state);
+       !aiter.Done(); aiter.Next()) {
+    if (aiter.Value().ilabel == 0) {  // The backoff arc.
+      state = aiter.Value().nextstate;
+      break;
+    }
+  }
+  for (fst::ArcIterator<fst::Fst<Arc> > aiter(lm_fst, state);
+       !aiter.Done(); aiter.Next()) {
+    const Arc &arc = aiter.Value();
+    if (arc.ilabel == 0) continue;
+    if (static_cast<size_t>(arc.ilabel) >= unigram_costs->size())
+      unigram_costs->resize(arc.ilabel + 1,
+                            std::numeric_limits<BaseFloat>::infinity());
+    (*unigram_costs)[arc.ilabel] = arc.weight.Value();
+  }
+}
+
+
+void GetUnigramCostsFromConstArpa(const ConstArpaLm &lm, int32 max_word,
+                                  std::vector<BaseFloat> *unigram_costs) {
+  unigram_costs->clear();
+  unigram_costs->resize(max_word + 1,
+                        std::numeric_limits<BaseFloat>::infinity());
+  std::vector<int32> empty_history;
+  int32 num_oov = 0;
+  for (int32 w = 1; w <= max_word; w++) {
+    float logprob = lm.GetNgramLogprob(w, empty_history);
+    // GetNgramLogprob() returns this (positive) value for words it doesn't
+    // know.
+    if (logprob == std::numeric_limits<float>::min())
+      num_oov++;
+    else
+      (*unigram_costs)[w] = -logprob;
+  }
+  if (num_oov > 0)
+    KALDI_WARN << num_oov << " of the " << max_word << " words are not in "
+               << "the language model; they will not be recognized.";
+}
+
+
+// Makes the one-state FST that LexiconTreeDecoder uses to remove the unigram
+// costs.
+static fst::VectorFst<fst::StdArc> MakeUnigramFst(
+    const std::vector<BaseFloat> &unigram_costs) {
+  typedef fst::StdArc Arc;
+  fst::VectorFst<Arc> ans;
+  Arc::StateId s = ans.AddState();
+  ans.SetStart(s);
+  ans.SetFinal(s, Arc::Weight::One());
+  for (size_t w = 1; w < unigram_costs.size(); w++)
+    if (unigram_costs[w] != std::numeric_limits<BaseFloat>::infinity())
+      ans.AddArc(s, Arc(w, w, unigram_costs[w], s));
+  return ans;  // It is ilabel-sorted.
+}
+
+
+LexiconTreeDecoder::LexiconTreeDecoder(
+    const fst::Fst<fst::StdArc> &tree,
+    const std::vector<BaseFloat> &unigram_costs,
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm,
+    const TransitionModel &trans_model,
+    const LatticeFasterDecoderConfig &config):
+    tree_(tree), lm_(lm), trans_model_(trans_model), config_(config),
+    unigram_fst_(MakeUnigramFst(unigram_costs)),
+    unigram_dfst_(unigram_fst_), neg_unigram_dfst_(-1.0, &unigram_dfst_),
+    lm_diff_fst_(NULL), cache_fst_(NULL), decoder_(NULL) {
+  config_.Check();
+}
+
+void LexiconTreeDecoder::DeleteDecoder() {
+  delete decoder_;
+  delete cache_fst_;
+  delete lm_diff_fst_;
+  decoder_ = NULL;
+  cache_fst_ = NULL;
+  lm_diff_fst_ = NULL;
+}
+
+LexiconTreeDecoder::~LexiconTreeDecoder() {
+  DeleteDecoder();
+}
+
+bool LexiconTreeDecoder::Decode(DecodableInterface *decodable) {
+  DeleteDecoder();
+  lm_diff_fst_ = new fst::ComposeDeterministicOnDemandFst<fst::StdArc>(
+      &neg_unigram_dfst_, lm_);
+  cache_fst_ = new fst::CacheDeterministicOnDemandFst<fst::StdArc>(
+      lm_diff_fst_);
+  decoder_ = new LatticeBiglmFasterDecoder(tree_, config_, cache_fst_);
+  return decoder_->Decode(decodable);
+}
+
+bool LexiconTreeDecoder::ReachedFinal() const {
+  return decoder_ != NULL && decoder_->ReachedFinal();
+}
+
+bool LexiconTreeDecoder::GetBestPath(Lattice *best_path) const {
+  if (decoder_ == NULL)
+    KALDI_ERR << "GetBestPath() called before Decode()";
+  return decoder_->GetBestPath(best_path);
+}
+
+bool LexiconTreeDecoder::GetLattice(CompactLattice *clat) const {
+  if (decoder_ == NULL)
+    KALDI_ERR << "GetLattice() called before Decode()";
+  Lattice lat;
+  if (!decoder_->GetRawLattice(&lat))
+    return false;
+  fst::Connect(&lat);
+  if (config_.determinize_lattice) {
+    if (!DeterminizeLatticePhonePrunedWrapper(trans_model_, &lat,
+                                              config_.lattice_beam, clat,
+                                              config_.det_opts))
+      KALDI_WARN << "Determinization finished earlier than the beam";
+  } else {
+    ConvertLattice(lat, clat);
+  }
+  return clat->NumStates() > 0;
+}
+
+
+}  // end namespace kaldi
@@ -0,0 +1,193 @@
+// decoder/lexicon-tree-decoder.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LEXICON_TREE_DECODER_H_
+#define KALDI_DECODER_LEXICON_TREE_DECODER_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "itf/decodable-itf.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/transition-model.h"
+#include "tree/context-dep.h"
+#include "lat/kaldi-lattice.h"
+#include "lm/const-arpa-lm.h"
+#include "decoder/lattice-biglm-faster-decoder.h"
+
+namespace kaldi {
+
+
+struct LexiconTreeOptions {
+  BaseFloat transition_scale;
+  BaseFloat self_loop_scale;
+  bool reorder;
+  BaseFloat silence_prob;
+
+  LexiconTreeOptions(): transition_scale(1.0), self_loop_scale(0.1),
+                        reorder(true), silence_prob(0.5) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("transition-scale", &transition_scale, "Scale of "
+                   "transition probabilities (excluding self-loops)");
+    opts->Register("self-loop-scale", &self_loop_scale, "Scale of "
+                   "self-loop vs. non-self-loop probability mass");
+    opts->Register("reorder", &reorder, "Reorder transition ids for greater "
+                   "decoding efficiency.");
+    opts->Register("silence-prob", &silence_prob, "Probability of optional "
+                   "silence between words (only relevant if a silence phone "
+                   "is given).");
+  }
+};
+
+
+/**
+   Reads a lexicon in integer form, with lines of the form
+     <word-id> <phone-id1> <phone-id2> ...
+   (e.g. data/local/dict/lexicon.txt mapped with utils/sym2int.pl using
+   words.txt and phones.txt).  A word may have several lines, for different
+   pronunciations.  Throws on error.
+*/
+void ReadLexiconInt(std::istream &is,
+                    std::vector<std::vector<int32> > *lexicon);
+
+
+/**
+   Compiles the graph for LexiconTreeDecoder: this is like HCLG where G is a
+   unigram language model, i.e. it is the closure of the lexicon, with context
+   dependency and HMMs, determinized, which makes it a prefix tree over the
+   pronunciations (with cross-word context).  Its size is proportional to the size of the lexicon,
+   not of the language model, so it is small; the actual language model is
+   applied while decoding (see LexiconTreeDecoder).
+
+   The word's unigram cost "unigram_costs[word]" (a negated natural-log
+   probability; words with infinite cost are left out, and it is an error for
+   a word to be outside the vector) is put on the word, and the
+   weights are pushed towards the start, so that each state of the tree has
+   the cost of the most likely word it can lead to; this is the language-model
+   lookahead.  LexiconTreeDecoder takes the unigram costs off again when it
+   applies the real language model, so "unigram_costs" must be the same for
+   both.
+
+   "lexicon" is as from ReadLexiconInt(): lexicon[i][0] is the word and the
+   rest are the phones.  If silence_phone > 0, optional silence is allowed
+   between words, with probability opts.silence_prob.
+*/
+fst::VectorFst<fst::StdArc> *CompileLexiconTree(
+    const std::vector<std::vector<int32> > &lexicon,
+    const std::vector<BaseFloat> &unigram_costs,
+    int32 silence_phone,
+    const ContextDependency &ctx_dep,
+    const TransitionModel &trans_model,
+    const LexiconTreeOptions &opts);
+
+
+/**
+   Gets the unigram costs of the words from a backoff language model in FST
+   form (G.fst, as created by arpa2fst): these are the weights of the arcs
+   leaving the unigram (empty-history) state, which is found by following the
+   backoff arc from the start state if there is one.  unigram_costs[w] is
+   set for each word w on those arcs; the vector is resized as needed.
+*/
+void GetUnigramCostsFromG(const fst::Fst<fst::StdArc> &lm_fst,
+                          std::vector<BaseFloat> *unigram_costs);
+
+/**
+   Gets the unigram costs of the words 1 through max_word from a ConstArpaLm;
+   unigram_costs is resized to max_word + 1.  Words that the language model
+   doesn't have (and can't map to <unk>) get an infinite cost, so that
+   CompileLexiconTree() leaves them out.
+*/
+void GetUnigramCostsFromConstArpa(const ConstArpaLm &lm, int32 max_word,
+                                  std::vector<BaseFloat> *unigram_costs);
+
+
+/**
+   LexiconTreeDecoder is a decoder for low-memory setups: instead of a
+   precompiled HCLG, which can be very large for a big language model, it
+   decodes with the small graph from CompileLexiconTree() and applies the
+   language model (e.g. a ConstArpaLm via ConstArpaLmDeterministicFst, or a
+   small G via fst::BackoffDeterministicOnDemandFst) on the fly, composing
+   them as it goes.  The unigram lookahead of the tree is removed at each word
+   and replaced by the real language-model score.  The search is done by
+   LatticeBiglmFasterDecoder, which keeps track of (graph state, LM state)
+   pairs.
+
+   Usage is like the other decoders: call Decode() with a DecodableInterface,
+   then GetLattice().
+*/
+class LexiconTreeDecoder {
+ public:
+  /// None of the arguments are owned here, and they must outlive this object.
+  /// "tree" and "unigram_costs" must be as given to CompileLexiconTree().
+  LexiconTreeDecoder(const fst::Fst<fst::StdArc> &tree,
+                     const std::vector<BaseFloat> &unigram_costs,
+                     fst::DeterministicOnDemandFst<fst::StdArc> *lm,
+                     const TransitionModel &trans_model,
+                     const LatticeFasterDecoderConfig &config);
+
+  /// Decodes the whole utterance.  Returns true if any kind of traceback is
+  /// available (not necessarily from a final state).
+  bool Decode(DecodableInterface *decodable);
+
+  /// Returns true if the best path reached a final state (i.e. the end of a
+  /// word, with the language model's end-of-sentence probability).
+  bool ReachedFinal() const;
+
+  /// Gets the best path as a linear lattice.
+  bool GetBestPath(Lattice *best_path) const;
+
+  /// Gets the lattice; if config.determinize_lattice is true it is
+  /// determinized as by DecodeUtteranceLatticeFaster(), otherwise it is the
+  /// raw state-level lattice (converted to CompactLattice).  Returns false on
+  /// failure.  The acoustic scores are as from the decodable object (i.e.
+  /// not un-scaled).
+  bool GetLattice(CompactLattice *clat) const;
+
+  ~LexiconTreeDecoder();
+
+ private:
+  // Frees the objects that are created for each utterance.
+  void DeleteDecoder();
+
+  const fst::Fst<fst::StdArc> &tree_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_;
+  const TransitionModel &trans_model_;
+  LatticeFasterDecoderConfig config_;
+
+  // A one-state FST with the unigram costs on its arcs, and the objects that
+  // subtract it from the language model.
+  fst::VectorFst<fst::StdArc> unigram_fst_;
+  fst::BackoffDeterministicOnDemandFst<fst::StdArc> unigram_dfst_;
+  fst::ScaleDeterministicOnDemandFst neg_unigram_dfst_;
+
+  // These are created for each utterance, since the composed FST remembers
+  // all the state pairs it has seen.
+  fst::ComposeDeterministicOnDemandFst<fst::StdArc> *lm_diff_fst_;
+  fst::CacheDeterministicOnDemandFst<fst::StdArc> *cache_fst_;
+  LatticeBiglmFasterDecoder *decoder_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LexiconTreeDecoder);
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_DECODER_LEXICON_TREE_DECODER_H_
@@ -22,6 +22,7 @@
 #define KALDI_FEAT_FEATURE_FBANK_H_
 
 #include <map>
+#include <memory>
 #include <string>
 
 #include "feat/feature-common.h"
@@ -134,7 +135,10 @@ class FbankComputer {
 
   FbankOptions opts_;
   BaseFloat log_energy_floor_;
-  std::map<BaseFloat, MelBanks*> mel_banks_;  // BaseFloat is VTLN coefficient.
+  // BaseFloat is VTLN coefficient.  The MelBanks objects are shared with the
+  // cache in GetSharedMelBanks(); this map just avoids locking
+  // that cache for every frame.
+  std::map<BaseFloat, std::shared_ptr<const MelBanks> > mel_banks_;
   SplitRadixRealFft<BaseFloat> *srfft_;
   // Disallow assignment.
   FbankComputer &operator =(const FbankComputer &other);
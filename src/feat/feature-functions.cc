@@ -247,15 +247,36 @@ void SlidingWindowCmnOptions::Check() const {
 }
 
 // Internal version of SlidingWindowCmn with double-precision arguments.
+// This works from cumulative sums of the input (and of its square, if
+// normalizing the variance), so the sum over any window is the difference of
+// two rows; this does all the frames in one pass, and the inner loops over the
+// feature dimension are simple enough for the compiler to vectorize.
 void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
                               const MatrixBase<double> &input,
                               MatrixBase<double> *output) {
   opts.Check();
   int32 num_frames = input.NumRows(), dim = input.NumCols(),
-        last_window_start = -1, last_window_end = -1,
         warning_count = 0;
-  Vector<double> cur_sum(dim), cur_sumsq(dim);
 
+  // Row t of "cum_sum" is the sum of input frames 0 ... t-1, and likewise for
+  // "cum_sumsq" with the squared input.
+  Matrix<double> cum_sum(num_frames + 1, dim), cum_sumsq;
+  if (opts.normalize_variance)
+    cum_sumsq.Resize(num_frames + 1, dim);
+  for (int32 t = 0; t < num_frames; t++) {
+    const double *in = input.RowData(t), *prev_sum = cum_sum.RowData(t);
+    double *sum = cum_sum.RowData(t + 1);
+    for (int32 d = 0; d < dim; d++)
+      sum[d] = prev_sum[d] + in[d];
+    if (opts.normalize_variance) {
+      const double *prev_sumsq = cum_sumsq.RowData(t);
+      double *sumsq = cum_sumsq.RowData(t + 1);
+      for (int32 d = 0; d < dim; d++)
+        sumsq[d] = prev_sumsq[d] + in[d] * in[d];
+    }
+  }
+
+  Vector<double> variance(opts.normalize_variance ? dim : 0);
   for (int32 t = 0; t < num_frames; t++) {
     int32 window_start, window_end; // note: window_end will be one
     // past the end of the window we use for normalization.
@@ -279,50 +300,31 @@ void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
       window_end = num_frames;
       if (window_start < 0) window_start = 0;
     }
-    if (last_window_start == -1) {
-      SubMatrix<double> input_part(input,
-                                      window_start, window_end - window_start,
-                                      0, dim);
-      cur_sum.AddRowSumMat(1.0, input_part , 0.0);
-      if (opts.normalize_variance)
-        cur_sumsq.AddDiagMat2(1.0, input_part, kTrans, 0.0);
-    } else {
-      if (window_start > last_window_start) {
-        KALDI_ASSERT(window_start == last_window_start + 1);
-        SubVector<double> frame_to_remove(input, last_window_start);
-        cur_sum.AddVec(-1.0, frame_to_remove);
-        if (opts.normalize_variance)
-          cur_sumsq.AddVec2(-1.0, frame_to_remove);
-      }
-      if (window_end > last_window_end) {
-        KALDI_ASSERT(window_end == last_window_end + 1);
-        SubVector<double> frame_to_add(input, last_window_end);
-        cur_sum.AddVec(1.0, frame_to_add);
-        if (opts.normalize_variance)
-          cur_sumsq.AddVec2(1.0, frame_to_add);
-      }
-    }
     int32 window_frames = window_end - window_start;
-    last_window_start = window_start;
-    last_window_end = window_end;
-
     KALDI_ASSERT(window_frames > 0);
-    SubVector<double> input_frame(input, t),
-        output_frame(*output, t);
-    output_frame.CopyFromVec(input_frame);
-    output_frame.AddVec(-1.0 / window_frames, cur_sum);
+
+    const double *in = input.RowData(t),
+        *start_sum = cum_sum.RowData(window_start),
+        *end_sum = cum_sum.RowData(window_end);
+    double *out = output->RowData(t), scale = 1.0 / window_frames;
+    for (int32 d = 0; d < dim; d++)
+      out[d] = in[d] - scale * (end_sum[d] - start_sum[d]);
 
     if (opts.normalize_variance) {
       if (window_frames == 1) {
-        output_frame.Set(0.0);
+        output->Row(t).Set(0.0);
       } else {
-        Vector<double> variance(cur_sumsq);
-        variance.Scale(1.0 / window_frames);
-        variance.AddVec2(-1.0 / (window_frames * window_frames), cur_sum);
+        const double *start_sumsq = cum_sumsq.RowData(window_start),
+            *end_sumsq = cum_sumsq.RowData(window_end);
+        double *var = variance.Data();
+        for (int32 d = 0; d < dim; d++) {
+          double mean = scale * (end_sum[d] - start_sum[d]);
+          var[d] = scale * (end_sumsq[d] - start_sumsq[d]) - mean * mean;
+        }
         // now "variance" is the variance of the features in the window,
         // around their own mean.
         int32 num_floored;
-	variance.ApplyFloor(1.0e-10, &num_floored);
+        variance.ApplyFloor(1.0e-10, &num_floored);
         if (num_floored > 0 && num_frames > 1) {
           if (opts.max_warnings == warning_count) {
             KALDI_WARN << "Suppressing the remaining variance flooring "
@@ -339,8 +341,8 @@ void SlidingWindowCmnInternal(const SlidingWindowCmnOptions &opts,
           }
           warning_count++;
         }
-        variance.ApplyPow(-0.5); // get inverse standard deviation.
-        output_frame.MulElements(variance);
+        for (int32 d = 0; d < dim; d++)  // divide by the standard deviation.
+          out[d] /= std::sqrt(var[d]);
       }
     }
   }
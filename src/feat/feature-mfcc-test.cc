@@ -653,8 +653,72 @@ void UnitTestVtln() {
   }
 }
 
+void UnitTestSharedMelBanks() {
+  // Test that GetSharedMelBanks() returns the same object for the same options
+  // while it is in use, that it gives the same answers as a MelBanks object
+  // of our own, and that the cache does not keep unused objects forever.
+  MelBanksOptions mel_opts(10 + Rand() % 30);
+  FrameExtractionOptions frame_opts;
+  frame_opts.samp_freq = (Rand() % 2 == 0 ? 8000 : 16000);
+  frame_opts.round_to_power_of_two = (Rand() % 2 == 0);
+  BaseFloat vtln_warp = 0.9 + RandUniform() * 0.2;
+  std::shared_ptr<const MelBanks> mel_banks =
+      GetSharedMelBanks(mel_opts, frame_opts, vtln_warp);
+  KALDI_ASSERT(mel_banks == GetSharedMelBanks(mel_opts, frame_opts,
+                                              vtln_warp));
+  KALDI_ASSERT(mel_banks->NumBins() == mel_opts.num_bins);
+
+  MelBanks own_mel_banks(mel_opts, frame_opts, vtln_warp);
+  int32 num_fft_bins = frame_opts.PaddedWindowSize() / 2 + 1;
+  Vector<BaseFloat> power(num_fft_bins), mel_shared(mel_opts.num_bins),
+      mel_own(mel_opts.num_bins);
+  power.SetRandn();
+  power.ApplyPowAbs(2.0);
+  mel_banks->Compute(power, &mel_shared);
+  own_mel_banks.Compute(power, &mel_own);
+  AssertEqual(mel_shared, mel_own);
+
+  // Fill the cache with objects for other warp factors that nobody uses; the
+  // one we hold on to must survive that.
+  std::weak_ptr<const MelBanks> unused =
+      GetSharedMelBanks(mel_opts, frame_opts, vtln_warp + 0.2);
+  for (int32 i = 1; i <= kMaxSharedMelBanks; i++)
+    GetSharedMelBanks(mel_opts, frame_opts, vtln_warp + 0.2 + 0.001 * i);
+  KALDI_ASSERT(unused.expired());
+  KALDI_ASSERT(mel_banks == GetSharedMelBanks(mel_opts, frame_opts,
+                                              vtln_warp));
+}
+
+void UnitTestMelBanksBatch() {
+  // Test that MelBanks::ComputeBatch() agrees with MelBanks::Compute().
+  MelBanksOptions mel_opts(10 + Rand() % 30);
+  mel_opts.htk_mode = (Rand() % 2 == 0);
+  mel_opts.low_freq = (Rand() % 2 == 0 ? 0.0 : 64.0);
+  FrameExtractionOptions frame_opts;
+  frame_opts.samp_freq = (Rand() % 2 == 0 ? 8000 : 16000);
+  frame_opts.round_to_power_of_two = (Rand() % 2 == 0);
+  MelBanks mel_banks(mel_opts, frame_opts, 0.9 + RandUniform() * 0.2);
+
+  int32 num_frames = 1 + Rand() % 20,
+      num_fft_bins = frame_opts.PaddedWindowSize() / 2 + 1;
+  Matrix<BaseFloat> power(num_frames, num_fft_bins),
+      mel_batch(num_frames, mel_opts.num_bins),
+      mel_frames(num_frames, mel_opts.num_bins);
+  power.SetRandn();
+  power.ApplyPowAbs(2.0);
+  mel_banks.ComputeBatch(power, &mel_batch);
+  for (int32 t = 0; t < num_frames; t++) {
+    SubVector<BaseFloat> mel_frame(mel_frames, t);
+    mel_banks.Compute(power.Row(t), &mel_frame);
+  }
+  AssertEqual(mel_batch, mel_frames);
+}
+
 static void UnitTestFeat() {
   UnitTestVtln();
+  UnitTestSharedMelBanks();
+  for (int32 i = 0; i < 10; i++)
+    UnitTestMelBanksBatch();
   UnitTestReadWave();
   UnitTestSimple();
   UnitTestHTKCompare1();
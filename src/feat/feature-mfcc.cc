@@ -121,9 +121,6 @@ MfccComputer::MfccComputer(const MfccComputer &other):
     mel_banks_(other.mel_banks_),
     srfft_(NULL),
     mel_energies_(other.mel_energies_.Dim(), kUndefined) {
-  for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
-       iter != mel_banks_.end(); ++iter)
-    iter->second = new MelBanks(*(iter->second));
   if (other.srfft_ != NULL)
     srfft_ = new SplitRadixRealFft<BaseFloat>(*(other.srfft_));
 }
@@ -131,25 +128,19 @@ MfccComputer::MfccComputer(const MfccComputer &other):
 
 
 MfccComputer::~MfccComputer() {
-  for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
-      iter != mel_banks_.end();
-      ++iter)
-    delete iter->second;
   delete srfft_;
 }
 
 const MelBanks *MfccComputer::GetMelBanks(BaseFloat vtln_warp) {
-  MelBanks *this_mel_banks = NULL;
-  std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.find(vtln_warp);
+  std::map<BaseFloat, std::shared_ptr<const MelBanks> >::iterator iter =
+      mel_banks_.find(vtln_warp);
   if (iter == mel_banks_.end()) {
-    this_mel_banks = new MelBanks(opts_.mel_opts,
-                                  opts_.frame_opts,
-                                  vtln_warp);
+    std::shared_ptr<const MelBanks> this_mel_banks =
+        GetSharedMelBanks(opts_.mel_opts, opts_.frame_opts, vtln_warp);
     mel_banks_[vtln_warp] = this_mel_banks;
-  } else {
-    this_mel_banks = iter->second;
+    return this_mel_banks.get();
   }
-  return this_mel_banks;
+  return iter->second.get();
 }
 
 
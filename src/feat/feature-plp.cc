@@ -58,9 +58,6 @@ PlpComputer::PlpComputer(const PlpComputer &other):
     autocorr_coeffs_(opts_.lpc_order + 1, kUndefined),
     lpc_coeffs_(opts_.lpc_order, kUndefined),
     raw_cepstrum_(opts_.lpc_order, kUndefined) {
-  for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
-       iter != mel_banks_.end(); ++iter)
-    iter->second = new MelBanks(*(iter->second));
   for (std::map<BaseFloat, Vector<BaseFloat>*>::iterator
            iter = equal_loudness_.begin();
        iter != equal_loudness_.end(); ++iter)
@@ -70,9 +67,6 @@ PlpComputer::PlpComputer(const PlpComputer &other):
 }
 
 PlpComputer::~PlpComputer() {
-  for (std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.begin();
-      iter != mel_banks_.end(); ++iter)
-    delete iter->second;
   for (std::map<BaseFloat, Vector<BaseFloat>* >::iterator
            iter = equal_loudness_.begin();
        iter != equal_loudness_.end(); ++iter)
@@ -81,17 +75,15 @@ PlpComputer::~PlpComputer() {
 }
 
 const MelBanks *PlpComputer::GetMelBanks(BaseFloat vtln_warp) {
-  MelBanks *this_mel_banks = NULL;
-  std::map<BaseFloat, MelBanks*>::iterator iter = mel_banks_.find(vtln_warp);
+  std::map<BaseFloat, std::shared_ptr<const MelBanks> >::iterator iter =
+      mel_banks_.find(vtln_warp);
   if (iter == mel_banks_.end()) {
-    this_mel_banks = new MelBanks(opts_.mel_opts,
-                                  opts_.frame_opts,
-                                  vtln_warp);
+    std::shared_ptr<const MelBanks> this_mel_banks =
+        GetSharedMelBanks(opts_.mel_opts, opts_.frame_opts, vtln_warp);
     mel_banks_[vtln_warp] = this_mel_banks;
-  } else {
-    this_mel_banks = iter->second;
+    return this_mel_banks.get();
   }
-  return this_mel_banks;
+  return iter->second.get();
 }
 
 const Vector<BaseFloat> *PlpComputer::GetEqualLoudness(BaseFloat vtln_warp) {
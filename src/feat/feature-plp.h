@@ -21,6 +21,7 @@
 #define KALDI_FEAT_FEATURE_PLP_H_
 
 #include <map>
+#include <memory>
 #include <string>
 
 #include "feat/feature-common.h"
@@ -149,7 +150,10 @@ class PlpComputer {
   Vector<BaseFloat> lifter_coeffs_;
   Matrix<BaseFloat> idft_bases_;
   BaseFloat log_energy_floor_;
-  std::map<BaseFloat, MelBanks*> mel_banks_;  // BaseFloat is VTLN coefficient.
+  // BaseFloat is VTLN coefficient.  The MelBanks objects are shared with the
+  // cache in GetSharedMelBanks(); this map just avoids locking
+  // that cache for every frame.
+  std::map<BaseFloat, std::shared_ptr<const MelBanks> > mel_banks_;
   std::map<BaseFloat, Vector<BaseFloat>* > equal_loudness_;
   SplitRadixRealFft<BaseFloat> *srfft_;
 
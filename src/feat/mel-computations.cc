@@ -22,6 +22,9 @@
 #include <float.h>
 #include <algorithm>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 #include "feat/feature-functions.h"
 #include "feat/feature-window.h"
@@ -83,8 +86,12 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
               << "low-freq " << low_freq << " and high-freq "
               << high_freq;
 
-  bins_.resize(num_bins);
+  first_index_.resize(num_bins);
+  weight_offset_.resize(num_bins + 1);
+  weight_offset_[0] = 0;
   center_freqs_.Resize(num_bins);
+  // The weights of all the bins, concatenated; copied to weights_ at the end.
+  std::vector<BaseFloat> packed_weights;
 
   for (int32 bin = 0; bin < num_bins; bin++) {
     BaseFloat left_mel = mel_low_freq + bin * mel_freq_delta,
@@ -123,27 +130,36 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
     KALDI_ASSERT(first_index != -1 && last_index >= first_index
                  && "You may have set --num-mel-bins too large.");
 
-    bins_[bin].first = first_index;
+    first_index_[bin] = first_index;
     int32 size = last_index + 1 - first_index;
-    bins_[bin].second.Resize(size);
-    bins_[bin].second.CopyFromVec(this_bin.Range(first_index, size));
+    weight_offset_[bin + 1] = weight_offset_[bin] + size;
+    packed_weights.insert(packed_weights.end(),
+                          this_bin.Data() + first_index,
+                          this_bin.Data() + first_index + size);
 
     // Replicate a bug in HTK, for testing purposes.
     if (opts.htk_mode && bin == 0 && mel_low_freq != 0.0)
-      bins_[bin].second(0) = 0.0;
+      packed_weights[weight_offset_[bin]] = 0.0;
 
   }
+  weights_.Resize(packed_weights.size(), kUndefined);
+  std::copy(packed_weights.begin(), packed_weights.end(), weights_.Data());
+
   if (debug_) {
-    for (size_t i = 0; i < bins_.size(); i++) {
-      KALDI_LOG << "bin " << i << ", offset = " << bins_[i].first
-                << ", vec = " << bins_[i].second;
+    for (int32 i = 0; i < num_bins; i++) {
+      KALDI_LOG << "bin " << i << ", offset = " << first_index_[i]
+                << ", vec = " << SubVector<BaseFloat>(
+                    weights_, weight_offset_[i],
+                    weight_offset_[i + 1] - weight_offset_[i]);
     }
   }
 }
 
 MelBanks::MelBanks(const MelBanks &other):
     center_freqs_(other.center_freqs_),
-    bins_(other.bins_),
+    first_index_(other.first_index_),
+    weight_offset_(other.weight_offset_),
+    weights_(other.weights_),
     debug_(other.debug_),
     htk_mode_(other.htk_mode_) { }
 
@@ -225,13 +241,14 @@ BaseFloat MelBanks::VtlnWarpMelFreq(BaseFloat vtln_low_cutoff,  // upper+lower f
 // "power_spectrum" contains fft energies.
 void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
                        VectorBase<BaseFloat> *mel_energies_out) const {
-  int32 num_bins = bins_.size();
+  int32 num_bins = NumBins();
   KALDI_ASSERT(mel_energies_out->Dim() == num_bins);
 
   for (int32 i = 0; i < num_bins; i++) {
-    int32 offset = bins_[i].first;
-    const Vector<BaseFloat> &v(bins_[i].second);
-    BaseFloat energy = VecVec(v, power_spectrum.Range(offset, v.Dim()));
+    int32 offset = first_index_[i], size = weight_offset_[i + 1] -
+        weight_offset_[i];
+    SubVector<BaseFloat> v(weights_, weight_offset_[i], size);
+    BaseFloat energy = VecVec(v, power_spectrum.Range(offset, size));
     // HTK-like flooring- for testing purposes (we prefer dither)
     if (htk_mode_ && energy < 1.0) energy = 1.0;
     (*mel_energies_out)(i) = energy;
@@ -250,6 +267,69 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::ComputeBatch(const MatrixBase<BaseFloat> &power_spectra,
+                            MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_bins = NumBins(), num_frames = power_spectra.NumRows();
+  KALDI_ASSERT(mel_energies_out->NumRows() == num_frames &&
+               mel_energies_out->NumCols() == num_bins);
+  if (num_frames == 0)
+    return;
+
+  // Each bin is applied to all the frames with one matrix-vector product over
+  // the band of fft-bins it covers.  This does about 1/10 of the work of
+  // multiplying by the whole filterbank as a dense matrix.
+  Vector<BaseFloat> bin_energies(num_frames, kUndefined);
+  for (int32 i = 0; i < num_bins; i++) {
+    int32 offset = first_index_[i], size = weight_offset_[i + 1] -
+        weight_offset_[i];
+    SubVector<BaseFloat> v(weights_, weight_offset_[i], size);
+    SubMatrix<BaseFloat> band(power_spectra, 0, num_frames, offset, size);
+    bin_energies.AddMatVec(1.0, band, kNoTrans, v, 0.0);
+    mel_energies_out->CopyColFromVec(bin_energies, i);
+  }
+  // HTK-like flooring- for testing purposes (we prefer dither)
+  if (htk_mode_)
+    mel_energies_out->ApplyFloor(1.0);
+
+  // See the comment in Compute() about this assert.
+  KALDI_ASSERT(!KALDI_ISNAN(mel_energies_out->Sum()));
+}
+
+std::shared_ptr<const MelBanks> GetSharedMelBanks(
+    const MelBanksOptions &opts,
+    const FrameExtractionOptions &frame_opts,
+    BaseFloat vtln_warp_factor) {
+  // The key includes everything that the MelBanks constructor reads from the
+  // options.
+  typedef std::tuple<int32, BaseFloat, BaseFloat, BaseFloat, BaseFloat, bool,
+                     bool, BaseFloat, int32, BaseFloat> Key;
+  typedef std::map<Key, std::shared_ptr<const MelBanks> > Cache;
+  static std::mutex mutex;
+  static Cache cache;
+
+  Key key(opts.num_bins, opts.low_freq, opts.high_freq, opts.vtln_low,
+          opts.vtln_high, opts.debug_mel, opts.htk_mode, frame_opts.samp_freq,
+          frame_opts.PaddedWindowSize(), vtln_warp_factor);
+  std::lock_guard<std::mutex> lock(mutex);
+  Cache::iterator iter = cache.find(key);
+  if (iter != cache.end())
+    return iter->second;
+  if (cache.size() >= static_cast<size_t>(kMaxSharedMelBanks)) {
+    // Drop the objects that only the cache refers to.
+    for (iter = cache.begin(); iter != cache.end(); ) {
+      if (iter->second.use_count() == 1)
+        cache.erase(iter++);
+      else
+        ++iter;
+    }
+  }
+  std::shared_ptr<const MelBanks> ans(
+      new MelBanks(opts, frame_opts, vtln_warp_factor));
+  cache[key] = ans;
+  return ans;
+}
+
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
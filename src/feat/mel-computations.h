@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <complex>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -111,7 +112,16 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                VectorBase<BaseFloat> *mel_energies_out) const;
 
-  int32 NumBins() const { return bins_.size(); }
+  /// Batched version of Compute(), for a block of frames: row t of
+  /// "fft_energies" is the FFT energies of frame t, and row t of
+  /// "mel_energies_out" (which must have NumBins() columns) is set to its Mel
+  /// energies.  Each bin is applied to all the frames at once with a single
+  /// matrix-vector product, which is faster than calling Compute() on each
+  /// frame.
+  void ComputeBatch(const MatrixBase<BaseFloat> &fft_energies,
+                    MatrixBase<BaseFloat> *mel_energies_out) const;
+
+  int32 NumBins() const { return first_index_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
   const Vector<BaseFloat> &GetCenterFreqs() const { return center_freqs_; }
@@ -126,15 +136,34 @@ class MelBanks {
   // Needed by GetCenterFreqs().
   Vector<BaseFloat> center_freqs_;
 
-  // the "bins_" vector is a vector, one for each bin, of a pair:
-  // (the first nonzero fft-bin), (the vector of weights).
-  std::vector<std::pair<int32, Vector<BaseFloat> > > bins_;
+  // The filterbank is stored as a packed band matrix.  Bin i is nonzero only
+  // for the fft-bins first_index_[i] ... first_index_[i] + n - 1, where
+  // n = weight_offset_[i+1] - weight_offset_[i], and its weights for those
+  // fft-bins are stored contiguously in "weights_" starting at
+  // weight_offset_[i].  weight_offset_ has NumBins() + 1 elements.
+  std::vector<int32> first_index_;
+  std::vector<int32> weight_offset_;
+  Vector<BaseFloat> weights_;
 
   bool debug_;
   bool htk_mode_;
 };
 
 
+/// Returns a MelBanks object for these options and VTLN warp factor, from a
+/// process-wide cache, creating it the first time it is needed.  MelBanks
+/// objects are not modified after construction, so the same object may be
+/// used by any number of feature computers and threads at once; this function
+/// is thread-safe.  The cache holds at most kMaxSharedMelBanks objects that
+/// nobody else is using (there is one per VTLN warp factor, so there may be
+/// many); beyond that, unused ones are dropped.  Everything is freed at exit.
+const int32 kMaxSharedMelBanks = 100;
+std::shared_ptr<const MelBanks> GetSharedMelBanks(
+    const MelBanksOptions &opts,
+    const FrameExtractionOptions &frame_opts,
+    BaseFloat vtln_warp_factor);
+
+
 // Compute liftering coefficients (scaling on cepstral coeffs)
 // coeffs are numbered slightly differently from HTK: the zeroth
 // index is C0, which is not affected.
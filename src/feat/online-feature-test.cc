@@ -375,6 +375,46 @@ void TestOnlineAppendFeature() {
   }
 }
 
+void TestOnlineFeatureState() {
+  std::ifstream is("../feat/test_data/test.wav", std::ios_base::binary);
+  WaveData wave;
+  wave.Read(is);
+  KALDI_ASSERT(wave.Data().NumRows() == 1);
+  SubVector<BaseFloat> waveform(wave.Data(), 0);
+
+  FbankOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.samp_freq = wave.SampFreq();
+  if (RandInt(0, 1) == 0)
+    op.frame_opts.snip_edges = false;
+
+  OnlineFbank online_fbank(op);
+  online_fbank.AcceptWaveform(wave.SampFreq(), waveform);
+  online_fbank.InputFinished();
+  Matrix<BaseFloat> fbank_feats;
+  GetOutput(&online_fbank, &fbank_feats);
+
+  // Stop part way through, save the state and resume from it in a new object.
+  int32 split = RandInt(0, waveform.Dim());
+  OnlineFbank fbank1(op);
+  fbank1.AcceptWaveform(wave.SampFreq(), waveform.Range(0, split));
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  fbank1.WriteState(os, binary);
+
+  OnlineFbank fbank2(op);
+  std::istringstream is2(os.str());
+  fbank2.ReadState(is2, binary);
+  KALDI_ASSERT(fbank2.NumFramesReady() == fbank1.NumFramesReady());
+  fbank2.AcceptWaveform(wave.SampFreq(),
+                        waveform.Range(split, waveform.Dim() - split));
+  fbank2.InputFinished();
+  Matrix<BaseFloat> resumed_feats;
+  GetOutput(&fbank2, &resumed_feats);
+
+  AssertEqual(fbank_feats, resumed_feats);
+}
+
 }  // end namespace kaldi
 
 int main() {
@@ -387,6 +427,7 @@ int main() {
     TestOnlinePlp();
     TestOnlineTransform();
     TestOnlineAppendFeature();
+    TestOnlineFeatureState();
   }
   std::cout << "Test OK.\n";
 }
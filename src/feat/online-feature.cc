@@ -105,6 +105,48 @@ void OnlineGenericBaseFeature<C>::ComputeFeatures() {
   }
 }
 
+template<class C>
+void OnlineGenericBaseFeature<C>::WriteState(std::ostream &os,
+                                             bool binary) const {
+  WriteToken(os, binary, "<OnlineBaseFeatureState>");
+  WriteToken(os, binary, "<Features>");
+  Matrix<BaseFloat> features(features_.size(), computer_.Dim(), kUndefined);
+  for (size_t i = 0; i < features_.size(); i++)
+    features.Row(i).CopyFromVec(*(features_[i]));
+  features.Write(os, binary);
+  WriteToken(os, binary, "<InputFinished>");
+  WriteBasicType(os, binary, input_finished_);
+  WriteToken(os, binary, "<WaveformOffset>");
+  WriteBasicType(os, binary, waveform_offset_);
+  WriteToken(os, binary, "<WaveformRemainder>");
+  waveform_remainder_.Write(os, binary);
+  WriteToken(os, binary, "</OnlineBaseFeatureState>");
+}
+
+template<class C>
+void OnlineGenericBaseFeature<C>::ReadState(std::istream &is, bool binary) {
+  if (!features_.empty() || waveform_offset_ != 0 ||
+      waveform_remainder_.Dim() != 0)
+    KALDI_ERR << "ReadState() called after AcceptWaveform().";
+  ExpectToken(is, binary, "<OnlineBaseFeatureState>");
+  ExpectToken(is, binary, "<Features>");
+  Matrix<BaseFloat> features;
+  features.Read(is, binary);
+  if (features.NumRows() != 0 && features.NumCols() != computer_.Dim())
+    KALDI_ERR << "Feature dimension mismatch in ReadState(): "
+              << features.NumCols() << " vs. " << computer_.Dim();
+  features_.resize(features.NumRows());
+  for (size_t i = 0; i < features_.size(); i++)
+    features_[i] = new Vector<BaseFloat>(features.Row(i));
+  ExpectToken(is, binary, "<InputFinished>");
+  ReadBasicType(is, binary, &input_finished_);
+  ExpectToken(is, binary, "<WaveformOffset>");
+  ReadBasicType(is, binary, &waveform_offset_);
+  ExpectToken(is, binary, "<WaveformRemainder>");
+  waveform_remainder_.Read(is, binary);
+  ExpectToken(is, binary, "</OnlineBaseFeatureState>");
+}
+
 // instantiate the templates defined here for MFCC, PLP and filterbank classes.
 template class OnlineGenericBaseFeature<MfccComputer>;
 template class OnlineGenericBaseFeature<PlpComputer>;
@@ -88,6 +88,16 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
     ComputeFeatures();
   }
 
+  /// Writes the state of the feature extraction (the features computed so
+  /// far and the part of the waveform not yet used), so that it can be
+  /// resumed later, possibly in another process; see ReadState().
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState().  This object must have the same
+  /// options as the one that wrote it, and must not have been given any
+  /// waveform yet.
+  void ReadState(std::istream &is, bool binary);
+
   ~OnlineGenericBaseFeature() {
     DeletePointers(&features_);
   }
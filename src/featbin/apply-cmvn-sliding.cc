@@ -21,6 +21,40 @@
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
 #include "feat/feature-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Applies sliding-window CMVN to one utterance; used with TaskSequencer so
+// that utterances can be processed in parallel.  The output is written in the
+// destructor, which TaskSequencer calls in the order the tasks were given.
+class SlidingWindowCmnTask {
+ public:
+  // Takes ownership of "feat".
+  SlidingWindowCmnTask(const SlidingWindowCmnOptions &opts,
+                       const std::string &utt,
+                       Matrix<BaseFloat> *feat,
+                       BaseFloatMatrixWriter *feat_writer):
+      opts_(opts), utt_(utt), feat_(feat), feat_writer_(feat_writer) { }
+
+  void operator () () {
+    cmvn_feat_.Resize(feat_->NumRows(), feat_->NumCols(), kUndefined);
+    SlidingWindowCmn(opts_, *feat_, &cmvn_feat_);
+    delete feat_;  // no longer needed.
+    feat_ = NULL;
+  }
+  ~SlidingWindowCmnTask() {
+    feat_writer_->Write(utt_, cmvn_feat_);
+  }
+ private:
+  const SlidingWindowCmnOptions &opts_;
+  std::string utt_;
+  Matrix<BaseFloat> *feat_;
+  Matrix<BaseFloat> cmvn_feat_;
+  BaseFloatMatrixWriter *feat_writer_;
+};
+
+}  // namespace kaldi
 
 
 int main(int argc, char *argv[]) {
@@ -38,7 +72,9 @@ int main(int argc, char *argv[]) {
     
     ParseOptions po(usage);
     SlidingWindowCmnOptions opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
     opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -54,23 +90,23 @@ int main(int argc, char *argv[]) {
 
     SequentialBaseFloatMatrixReader feat_reader(feat_rspecifier);
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+    TaskSequencer<SlidingWindowCmnTask> sequencer(sequencer_config);
     
     for (;!feat_reader.Done(); feat_reader.Next()) {
       std::string utt = feat_reader.Key();
-      Matrix<BaseFloat> feat(feat_reader.Value());
+      const Matrix<BaseFloat> &feat = feat_reader.Value();
       if (feat.NumRows() == 0) {
         KALDI_WARN << "Empty feature matrix for utterance " << utt;
         num_err++;
         continue;
       }
-      Matrix<BaseFloat> cmvn_feat(feat.NumRows(),
-                                  feat.NumCols(), kUndefined);
-
-      SlidingWindowCmn(opts, feat, &cmvn_feat);
-      
-      feat_writer.Write(utt, cmvn_feat);
+      // the task takes ownership of the copy of the features.
+      sequencer.Run(new SlidingWindowCmnTask(opts, utt,
+                                             new Matrix<BaseFloat>(feat),
+                                             &feat_writer));
       num_done++;
     }
+    sequencer.Wait();
 
     KALDI_LOG << "Applied sliding-window cepstral mean "
               << (opts.normalize_variance ? "and variance " : "")
@@ -0,0 +1,332 @@
+// featbin/compute-and-process-feats.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/feature-fbank.h"
+#include "feat/feature-mfcc.h"
+#include "feat/feature-plp.h"
+#include "feat/feature-functions.h"
+#include "feat/wave-reader.h"
+#include "transform/cmvn.h"
+
+namespace kaldi {
+
+// Applies the (linear or affine) transform "trans" to "feats", writing to
+// "feats_out"; this is the same as what transform-feats does.  Returns false
+// if the dimensions do not match.
+bool ApplyFeatureTransform(const MatrixBase<BaseFloat> &trans,
+                           const MatrixBase<BaseFloat> &feats,
+                           Matrix<BaseFloat> *feats_out) {
+  int32 transform_rows = trans.NumRows(),
+      transform_cols = trans.NumCols(),
+      feat_dim = feats.NumCols();
+  if (transform_cols == feat_dim) {
+    feats_out->Resize(feats.NumRows(), transform_rows, kUndefined);
+    feats_out->AddMatMat(1.0, feats, kNoTrans, trans, kTrans, 0.0);
+  } else if (transform_cols == feat_dim + 1) {
+    // append the implicit 1.0 to the input features.
+    feats_out->Resize(feats.NumRows(), transform_rows, kUndefined);
+    SubMatrix<BaseFloat> linear_part(trans, 0, transform_rows, 0, feat_dim);
+    feats_out->AddMatMat(1.0, feats, kNoTrans, linear_part, kTrans, 0.0);
+    Vector<BaseFloat> offset(transform_rows);
+    offset.CopyColFromMat(trans, feat_dim);
+    feats_out->AddVecToRows(1.0, offset);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    const char *usage =
+        "Compute MFCC, filterbank or PLP features from wav input and, in the\n"
+        "same process, apply CMVN, frame splicing and a linear or affine\n"
+        "transform (e.g. LDA+MLLT).  Equivalent to\n"
+        " compute-{mfcc,fbank,plp}-feats | apply-cmvn | splice-feats | transform-feats\n"
+        "except that each utterance goes straight from the waveform to the output\n"
+        "archive without being written out and re-read between the stages.\n"
+        "Each stage is optional: CMVN is only done if --cmvn-stats or --utt-cmvn\n"
+        "is given, splicing only if the context is nonzero and the transform only\n"
+        "if --transform is given.\n"
+        "\n"
+        "Usage: compute-and-process-feats [options...] <wav-rspecifier> <feats-wspecifier>\n"
+        "e.g.\n"
+        " compute-and-process-feats --feature-type=mfcc --mfcc-config=conf/mfcc.conf \\\n"
+        "   --utt2spk=ark:data/train/utt2spk --cmvn-stats=scp:data/train/cmvn.scp \\\n"
+        "   --left-context=3 --right-context=3 --transform=exp/tri2b/final.mat \\\n"
+        "   scp:data/train/wav.scp ark:-\n"
+        "See also: compute-mfcc-feats, apply-cmvn, splice-feats, transform-feats\n";
+
+    ParseOptions po(usage);
+    std::string feature_type = "mfcc", mfcc_config, fbank_config, plp_config;
+    BaseFloat vtln_warp = 1.0;
+    std::string vtln_map_rspecifier;
+    std::string utt2spk_rspecifier;
+    int32 channel = -1;
+    BaseFloat min_duration = 0.0;
+    std::string cmvn_rspecifier_or_rxfilename;
+    bool utt_cmvn = false, norm_vars = false;
+    int32 left_context = 0, right_context = 0;
+    std::string transform_rspecifier_or_rxfilename;
+
+    po.Register("feature-type", &feature_type,
+                "Base feature type [mfcc, fbank, plp]");
+    po.Register("mfcc-config", &mfcc_config, "Configuration file for "
+                "MFCC features (e.g. conf/mfcc.conf)");
+    po.Register("fbank-config", &fbank_config, "Configuration file for "
+                "filterbank features (e.g. conf/fbank.conf)");
+    po.Register("plp-config", &plp_config, "Configuration file for "
+                "PLP features (e.g. conf/plp.conf)");
+    po.Register("vtln-warp", &vtln_warp, "Vtln warp factor (only applicable "
+                "if vtln-map not specified)");
+    po.Register("vtln-map", &vtln_map_rspecifier, "Map from utterance or "
+                "speaker-id to vtln warp factor (rspecifier)");
+    po.Register("utt2spk", &utt2spk_rspecifier, "rspecifier for utterance "
+                "to speaker map; applies to --vtln-map, --cmvn-stats and "
+                "--transform if they are tables.");
+    po.Register("channel", &channel, "Channel to extract (-1 -> expect mono, "
+                "0 -> left, 1 -> right)");
+    po.Register("min-duration", &min_duration, "Minimum duration of segments "
+                "to process (in seconds).");
+    po.Register("cmvn-stats", &cmvn_rspecifier_or_rxfilename, "CMVN stats, "
+                "as an rspecifier (per utterance, or per speaker with "
+                "--utt2spk) or a global rxfilename, as for apply-cmvn.");
+    po.Register("utt-cmvn", &utt_cmvn, "If true, and --cmvn-stats is not "
+                "given, apply CMVN using stats computed from each utterance.");
+    po.Register("norm-vars", &norm_vars, "If true, normalize variances.");
+    po.Register("left-context", &left_context, "Number of frames of left "
+                "context to splice");
+    po.Register("right-context", &right_context, "Number of frames of right "
+                "context to splice");
+    po.Register("transform", &transform_rspecifier_or_rxfilename,
+                "Transform to apply after splicing, as an rspecifier (per "
+                "utterance, or per speaker with --utt2spk) or a global "
+                "rxfilename, as for transform-feats.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string wav_rspecifier = po.GetArg(1),
+        feat_wspecifier = po.GetArg(2);
+
+    MfccOptions mfcc_opts;
+    FbankOptions fbank_opts;
+    PlpOptions plp_opts;
+    if (mfcc_config != "") ReadConfigFromFile(mfcc_config, &mfcc_opts);
+    if (fbank_config != "") ReadConfigFromFile(fbank_config, &fbank_opts);
+    if (plp_config != "") ReadConfigFromFile(plp_config, &plp_opts);
+
+    // Only one of these will be used.
+    Mfcc *mfcc = NULL;
+    Fbank *fbank = NULL;
+    Plp *plp = NULL;
+    if (feature_type == "mfcc") {
+      mfcc = new Mfcc(mfcc_opts);
+    } else if (feature_type == "fbank") {
+      fbank = new Fbank(fbank_opts);
+    } else if (feature_type == "plp") {
+      plp = new Plp(plp_opts);
+    } else {
+      KALDI_ERR << "Invalid feature type: " << feature_type << ". "
+                << "Supported feature types: mfcc, fbank, plp.";
+    }
+
+    if (left_context < 0 || right_context < 0)
+      KALDI_ERR << "Invalid splicing context " << left_context << ", "
+                << right_context;
+
+    // The VTLN map, CMVN stats and transforms may each be per-utterance or,
+    // via --utt2spk, per-speaker.
+    RandomAccessBaseFloatReaderMapped vtln_map_reader(vtln_map_rspecifier,
+                                                      utt2spk_rspecifier);
+
+    bool do_cmvn = (cmvn_rspecifier_or_rxfilename != "" || utt_cmvn),
+        global_cmvn = false;
+    Matrix<double> global_cmvn_stats;
+    RandomAccessDoubleMatrixReaderMapped cmvn_reader;
+    if (cmvn_rspecifier_or_rxfilename != "") {
+      if (utt_cmvn)
+        KALDI_WARN << "--utt-cmvn has no effect since --cmvn-stats was given.";
+      if (ClassifyRspecifier(cmvn_rspecifier_or_rxfilename, NULL, NULL)
+          == kNoRspecifier) {
+        global_cmvn = true;
+        ReadKaldiObject(cmvn_rspecifier_or_rxfilename, &global_cmvn_stats);
+      } else if (!cmvn_reader.Open(cmvn_rspecifier_or_rxfilename,
+                                   utt2spk_rspecifier)) {
+        KALDI_ERR << "Problem opening CMVN stats with rspecifier "
+                  << '"' << cmvn_rspecifier_or_rxfilename << '"';
+      }
+    }
+
+    bool do_transform = (transform_rspecifier_or_rxfilename != ""),
+        global_transform = false;
+    Matrix<BaseFloat> global_transform_mat;
+    RandomAccessBaseFloatMatrixReaderMapped transform_reader;
+    if (do_transform) {
+      if (ClassifyRspecifier(transform_rspecifier_or_rxfilename, NULL, NULL)
+          == kNoRspecifier) {
+        global_transform = true;
+        ReadKaldiObject(transform_rspecifier_or_rxfilename,
+                        &global_transform_mat);
+      } else if (!transform_reader.Open(transform_rspecifier_or_rxfilename,
+                                        utt2spk_rspecifier)) {
+        KALDI_ERR << "Problem opening transforms with rspecifier "
+                  << '"' << transform_rspecifier_or_rxfilename << '"';
+      }
+    }
+
+    SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+
+    int32 num_utts = 0, num_done = 0, num_err = 0;
+    for (; !wav_reader.Done(); wav_reader.Next()) {
+      num_utts++;
+      std::string utt = wav_reader.Key();
+      const WaveData &wave_data = wav_reader.Value();
+      if (wave_data.Duration() < min_duration) {
+        KALDI_WARN << "File: " << utt << " is too short ("
+                   << wave_data.Duration() << " sec): producing no output.";
+        num_err++;
+        continue;
+      }
+      int32 num_chan = wave_data.Data().NumRows(), this_chan = channel;
+      {  // This block works out the channel (0=left, 1=right...)
+        KALDI_ASSERT(num_chan > 0);  // should have been caught in
+        // reading code if no channels.
+        if (channel == -1) {
+          this_chan = 0;
+          if (num_chan != 1)
+            KALDI_WARN << "Channel not specified but you have data with "
+                       << num_chan  << " channels; defaulting to zero";
+        } else {
+          if (this_chan >= num_chan) {
+            KALDI_WARN << "File with id " << utt << " has "
+                       << num_chan << " channels but you specified channel "
+                       << channel << ", producing no output.";
+            num_err++;
+            continue;
+          }
+        }
+      }
+      BaseFloat vtln_warp_local;  // Work out VTLN warp factor.
+      if (vtln_map_rspecifier != "") {
+        if (!vtln_map_reader.HasKey(utt)) {
+          KALDI_WARN << "No vtln-map entry for utterance-id (or speaker-id) "
+                     << utt;
+          num_err++;
+          continue;
+        }
+        vtln_warp_local = vtln_map_reader.Value(utt);
+      } else {
+        vtln_warp_local = vtln_warp;
+      }
+      if (do_cmvn && !global_cmvn && !utt_cmvn && !cmvn_reader.HasKey(utt)) {
+        KALDI_WARN << "No normalization statistics available for key "
+                   << utt << ", producing no output for this utterance";
+        num_err++;
+        continue;
+      }
+      if (do_transform && !global_transform && !transform_reader.HasKey(utt)) {
+        KALDI_WARN << "No transform available for utterance "
+                   << utt << ", producing no output for this utterance";
+        num_err++;
+        continue;
+      }
+
+      SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
+      Matrix<BaseFloat> features;
+      try {
+        if (mfcc != NULL)
+          mfcc->ComputeFeatures(waveform, wave_data.SampFreq(),
+                                vtln_warp_local, &features);
+        else if (fbank != NULL)
+          fbank->ComputeFeatures(waveform, wave_data.SampFreq(),
+                                 vtln_warp_local, &features);
+        else
+          plp->ComputeFeatures(waveform, wave_data.SampFreq(),
+                               vtln_warp_local, &features);
+      } catch (...) {
+        KALDI_WARN << "Failed to compute features for utterance "
+                   << utt;
+        num_err++;
+        continue;
+      }
+
+      if (do_cmvn) {  // CMVN is done in place.
+        if (global_cmvn) {
+          ApplyCmvn(global_cmvn_stats, norm_vars, &features);
+        } else if (cmvn_rspecifier_or_rxfilename != "") {
+          ApplyCmvn(cmvn_reader.Value(utt), norm_vars, &features);
+        } else {
+          Matrix<double> utt_stats;
+          InitCmvnStats(features.NumCols(), &utt_stats);
+          AccCmvnStats(features, NULL, &utt_stats);
+          ApplyCmvn(utt_stats, norm_vars, &features);
+        }
+      }
+
+      if (left_context != 0 || right_context != 0) {
+        Matrix<BaseFloat> spliced;
+        SpliceFrames(features, left_context, right_context, &spliced);
+        features.Swap(&spliced);
+      }
+
+      if (do_transform) {
+        const Matrix<BaseFloat> &trans =
+            (global_transform ? global_transform_mat :
+             transform_reader.Value(utt));
+        Matrix<BaseFloat> transformed;
+        if (!ApplyFeatureTransform(trans, features, &transformed)) {
+          KALDI_WARN << "Transform matrix for utterance " << utt
+                     << " has bad dimension " << trans.NumRows() << "x"
+                     << trans.NumCols() << " versus feat dim "
+                     << features.NumCols();
+          num_err++;
+          continue;
+        }
+        features.Swap(&transformed);
+      }
+
+      feat_writer.Write(utt, features);
+      if (num_utts % 10 == 0)
+        KALDI_LOG << "Processed " << num_utts << " utterances";
+      KALDI_VLOG(2) << "Processed features for key " << utt;
+      num_done++;
+    }
+    delete mfcc;
+    delete fbank;
+    delete plp;
+    KALDI_LOG << "Done " << num_done << " out of " << num_utts
+              << " utterances, " << num_err << " with errors.";
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,82 @@
+// fstbin/make-compact-graph-fst.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fst/fstlib.h"
+#include "fstext/kaldi-fst-io.h"
+#include "decoder/compact-graph-fst.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+    using kaldi::int32;
+
+    const char *usage =
+        "Convert a decoding graph (e.g. HCLG.fst) to the compact format\n"
+        "CompactGraphFst, which takes about half the memory of ConstFst.\n"
+        "Arc weights are stored exactly if the graph has at most 65536\n"
+        "distinct ones, and are quantized otherwise; the largest error is\n"
+        "printed.  The output can be given to latgen-faster-mapped instead of\n"
+        "HCLG.fst, but it can't be read by OpenFst's tools.\n"
+        "\n"
+        "Usage: make-compact-graph-fst [options] <fst-in> <compact-fst-out>\n"
+        "e.g.: make-compact-graph-fst exp/tri3/graph/HCLG.fst HCLG.compact\n";
+
+    ParseOptions po(usage);
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fst_in_str = po.GetArg(1),
+        fst_out_str = po.GetArg(2);
+
+    Fst<StdArc> *fst = ReadFstKaldiGeneric(fst_in_str);
+    float max_weight_error;
+    CompactGraphFst compact_fst(*fst, &max_weight_error);
+
+    delete fst;
+
+    // This is what the same graph takes as ConstFst<StdArc>, which stores a
+    // StdArc per arc and a weight and three integers per state.
+    size_t const_fst_size = 0;
+    for (StdArc::StateId s = 0; s < compact_fst.NumStates(); s++)
+      const_fst_size += sizeof(float) + 3 * sizeof(uint32) +
+          compact_fst.NumArcs(s) * sizeof(StdArc);
+
+    bool binary = true;  // CompactGraphFst does not support non-binary write.
+    WriteKaldiObject(compact_fst, fst_out_str, binary);
+
+    KALDI_LOG << "Wrote compact graph with " << compact_fst.NumStates()
+              << " states to " << PrintableWxfilename(fst_out_str)
+              << "; it takes " << compact_fst.MemorySize() << " bytes versus "
+              << const_fst_size << " for ConstFst.  The largest quantization "
+              << "error of an arc weight is " << max_weight_error;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,91 @@
+// fstbin/make-mappable-fst.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fst/fstlib.h"
+#include "fstext/kaldi-fst-io.h"
+#include "decoder/grammar-fst.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+    using kaldi::int32;
+
+    const char *usage =
+        "Convert a decoding graph (e.g. HCLG.fst) to ConstFst in the layout\n"
+        "that can be memory-mapped, or rewrite a GrammarFst (as written by\n"
+        "make-grammar-fst) so that its component FSTs can be memory-mapped.\n"
+        "Decoding programs map such graphs automatically when they are read\n"
+        "from an ordinary file: they are paged in as they are used, and\n"
+        "processes decoding with the same file share its memory.  The output\n"
+        "is still a valid FST for OpenFst's tools, but it must be written to,\n"
+        "and read from, a file (not a pipe).  Note: don't overwrite a graph\n"
+        "while processes are decoding with it; write a new file and rename it.\n"
+        "\n"
+        "Usage: make-mappable-fst [options] <fst-in> <fst-out>\n"
+        "e.g.: make-mappable-fst exp/tri3/graph/HCLG.fst HCLG_mapped.fst\n"
+        "      make-mappable-fst --grammar-fst=true HCLG_grammar.fst \\\n"
+        "                        HCLG_grammar_mapped.fst\n";
+
+    bool grammar_fst = false;
+
+    ParseOptions po(usage);
+    po.Register("grammar-fst", &grammar_fst, "If true, the input is a "
+                "GrammarFst as written by make-grammar-fst, rather than an "
+                "FST.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fst_in_str = po.GetArg(1),
+        fst_out_str = po.GetArg(2);
+
+    if (grammar_fst) {
+      if (ClassifyWxfilename(fst_out_str) != kFileOutput)
+        KALDI_ERR << "Memory-mappable FSTs must be written to a file, not "
+                  << PrintableWxfilename(fst_out_str);
+      GrammarFst fst;
+      ReadKaldiObject(fst_in_str, &fst);
+      bool binary = true;  // GrammarFst does not support non-binary write.
+      Output ko(fst_out_str, binary);
+      bool align = true;
+      fst.Write(ko.Stream(), binary, align);
+      ko.Close();
+    } else {
+      Fst<StdArc> *fst = ReadFstKaldiGeneric(fst_in_str);
+      WriteFstKaldiMappable(*fst, fst_out_str);
+      delete fst;
+    }
+
+    KALDI_LOG << "Wrote memory-mappable FST to "
+              << PrintableWxfilename(fst_out_str);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -62,7 +62,7 @@ template<class IntType> class LatticeStringRepository {
                      // replace the element we inserted, which resides on the
                      // stack, with one from the heap.
       const Entry *ans = new_entry_;
-      new_entry_ = new Entry();
+      new_entry_ = NewEntry();
       return ans;
     } else { // Was not inserted because an equivalent Entry already
              // existed.
@@ -166,19 +166,16 @@ template<class IntType> class LatticeStringRepository {
     return e;
   }
 
-  LatticeStringRepository() { new_entry_ = new Entry; }
+  LatticeStringRepository(): free_list_(NULL) { new_entry_ = NewEntry(); }
 
   void Destroy() {
-    for (typename SetType::iterator iter = set_.begin();
-         iter != set_.end();
-         ++iter)
-      delete *iter;
     SetType tmp;
     tmp.swap(set_);
-    if (new_entry_) {
-      delete new_entry_;
-      new_entry_ = NULL;
-    }
+    for (size_t i = 0; i < entry_blocks_.size(); i++)
+      delete [] entry_blocks_[i];
+    entry_blocks_.clear();
+    free_list_ = NULL;
+    new_entry_ = NULL;
   }
 
   // Rebuild will rebuild this object, guaranteeing only
@@ -195,17 +192,43 @@ template<class IntType> class LatticeStringRepository {
     for (typename SetType::iterator iter = set_.begin();
          iter != set_.end(); ++iter) {
       if (tmp_set.count(*iter) == 0)
-        delete (*iter); // delete the Entry; not needed.
+        FreeEntry(*iter); // the Entry is not needed.
     }
     set_.swap(tmp_set);
   }
 
   ~LatticeStringRepository() { Destroy(); }
-  int32 MemSize() const {
-    return set_.size() * sizeof(Entry) * 2; // this is a lower bound
-    // on the size this structure might take.
+  // Returns the memory used by the strings in the repository, in bytes.  The
+  // entries freed by Rebuild() are kept for reuse, but are not counted.
+  int64 MemSize() const {
+    return static_cast<int64>(set_.size()) * sizeof(Entry) * 2; // this is a
+    // lower bound on the size this structure might take.
   }
  private:
+  // Entries are allocated in blocks of this many, and those that Rebuild()
+  // frees are put on a free list to be reused, so we don't do a new and a
+  // delete for each one.
+  static const size_t kEntryBlockSize = 1024;
+
+  Entry *NewEntry() {
+    if (free_list_ == NULL) {
+      Entry *block = new Entry[kEntryBlockSize];
+      entry_blocks_.push_back(block);
+      for (size_t i = 0; i < kEntryBlockSize; i++)
+        FreeEntry(block + i);
+    }
+    Entry *ans = free_list_;
+    // While an Entry is on the free list, its "parent" is the next one.
+    free_list_ = const_cast<Entry*>(ans->parent);
+    return ans;
+  }
+
+  void FreeEntry(const Entry *entry) {
+    Entry *e = const_cast<Entry*>(entry);
+    e->parent = free_list_;
+    free_list_ = e;
+  }
+
   class EntryKey { // Hash function object.
    public:
     inline size_t operator()(const Entry *entry) const {
@@ -239,7 +262,134 @@ template<class IntType> class LatticeStringRepository {
   Entry *new_entry_; // We always have a pre-allocated Entry ready to use,
                      // to avoid unnecessary news and deletes.
   SetType set_;
+  std::vector<Entry*> entry_blocks_;  // Owns all the Entries.
+  Entry *free_list_;  // Entries not in use (linked through "parent").
+};
+
 
+// LatticeSubsetArena stores the subsets of states (sorted vectors of
+// elements) that the lattice determinizers (LatticeDeterminizer and
+// LatticeDeterminizerPruned) use as the keys of their hashes.  Instead of
+// allocating a vector for each subset, it copies the elements into large
+// blocks, which are all freed at once.  It stores the hash value of each
+// subset with it, so that it is computed only once rather than every time a
+// hash is resized, and so that subsets that are not equal can nearly always
+// be told apart without comparing their elements.
+// "Element" must have members "state", "string" and "weight", like the
+// Element structs of the determinizers.
+template<class Element> class LatticeSubsetArena {
+ public:
+  // A subset stored in the arena or, for lookups, in a vector.  The elements
+  // are in sorted order on state id, without repeated states.
+  struct Subset {
+    const Element *elems;
+    size_t size;
+    size_t hash;
+    const Element *begin() const { return elems; }
+    const Element *end() const { return elems + size; }
+  };
+
+  // The hash function of the subsets.  It is order-dependent, which is OK
+  // because the elements are sorted.  The weights are not included: we hash
+  // subsets that differ only in weight to the same key.  This is not optimal in
+  // terms of the O(N) performance but typically if we have a lot of determinized
+  // states that differ only in weight then the input probably was pathological
+  // in some way, or even non-determinizable.
+  class SubsetKey {
+   public:
+    size_t operator ()(const Subset &subset) const { return subset.hash; }
+  };
+
+  // This is the equality operator on subsets.  It checks for exact match on
+  // state-id and string, and approximate match on weights (we don't quantize
+  // the weights, in order to avoid inexactness in simple cases).
+  class SubsetEqual {
+   public:
+    bool operator ()(const Subset &s1, const Subset &s2) const {
+      if (s1.hash != s2.hash || s1.size != s2.size) return false;
+      const Element *iter1 = s1.begin(), *iter1_end = s1.end(),
+          *iter2 = s2.begin();
+      for (; iter1 < iter1_end; ++iter1, ++iter2) {
+        if (iter1->state != iter2->state ||
+            iter1->string != iter2->string ||
+            ! ApproxEqual(iter1->weight, iter2->weight, delta_)) return false;
+      }
+      return true;
+    }
+    float delta_;
+    SubsetEqual(float delta): delta_(delta) {}
+    SubsetEqual(): delta_(kDelta) {}
+  };
+
+  LatticeSubsetArena(): cur_block_used_(0), cur_block_size_(0), mem_size_(0) { }
+
+  // Returns a Subset that refers to the elements of "vec"; it is only valid
+  // while "vec" is not changed.  This is used to look subsets up.
+  static Subset Wrap(const std::vector<Element> &vec) {
+    Subset ans;
+    ans.elems = (vec.empty() ? NULL : &(vec[0]));
+    ans.size = vec.size();
+    size_t hash = 0, factor = 1;
+    for (size_t i = 0; i < ans.size; i++) {
+      hash *= factor;
+      hash += ans.elems[i].state + reinterpret_cast<size_t>(ans.elems[i].string);
+      factor *= 23531;  // these numbers are primes.
+    }
+    ans.hash = hash;
+    return ans;
+  }
+
+  // Returns a copy of "subset" whose elements are stored in the arena.  It is
+  // valid until Clear() is called.
+  Subset Copy(const Subset &subset) {
+    Subset ans(subset);
+    if (subset.size != 0) {
+      Element *elems = Allocate(subset.size);
+      std::copy(subset.begin(), subset.end(), elems);
+      ans.elems = elems;
+    }
+    return ans;
+  }
+
+  // Returns the memory allocated for the elements, in bytes.
+  int64 MemSize() const { return mem_size_; }
+
+  // Frees all the subsets.
+  void Clear() {
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+    blocks_.clear();
+    cur_block_used_ = 0;
+    cur_block_size_ = 0;
+    mem_size_ = 0;
+  }
+
+  ~LatticeSubsetArena() { Clear(); }
+
+ private:
+  static const size_t kBlockSize = 4096;  // In elements.
+
+  Element *Allocate(size_t n) {
+    if (cur_block_used_ + n > cur_block_size_) {
+      // Start a new block; the rest of the current one is wasted, but that is
+      // small on average as subsets are much smaller than blocks.
+      size_t block_size = (n > kBlockSize ? n : kBlockSize);
+      blocks_.push_back(new Element[block_size]);
+      cur_block_size_ = block_size;
+      cur_block_used_ = 0;
+      mem_size_ += block_size * sizeof(Element);
+    }
+    Element *ans = blocks_.back() + cur_block_used_;
+    cur_block_used_ += n;
+    return ans;
+  }
+
+  std::vector<Element*> blocks_;
+  size_t cur_block_used_;  // Number of elements used in blocks_.back().
+  size_t cur_block_size_;  // Size of blocks_.back().
+  int64 mem_size_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeSubsetArena);
 };
 
 
@@ -399,7 +549,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   // keeping a reference or pointer to ifst_.
   LatticeDeterminizer(const Fst<Arc> &ifst,
                       DeterminizeLatticeOptions opts):
-      num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), opts_(opts),
+      num_arcs_(0), ifst_(ifst.Copy()), opts_(opts),
       equal_(opts_.delta), determinized_(false),
       minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
@@ -413,16 +563,11 @@ template<class Weight, class IntType> class LatticeDeterminizer {
       delete ifst_;
       ifst_ = NULL;
     }
-    for (typename MinimalSubsetHash::iterator iter = minimal_hash_.begin();
-        iter != minimal_hash_.end(); ++iter)
-      delete iter->first;
     { MinimalSubsetHash tmp; tmp.swap(minimal_hash_); }
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-        iter != initial_hash_.end(); ++iter)
-      delete iter->first;
     { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
-    { vector<vector<Element>* > output_states_tmp;
+    { vector<Subset> output_states_tmp;
       output_states_tmp.swap(output_states_); }
+    subset_arena_.Clear();
     { vector<char> tmp;  tmp.swap(isymbol_or_final_); }
     { vector<OutputStateId> tmp; tmp.swap(queue_); }
     { vector<pair<Label, Element> > tmp; tmp.swap(all_elems_tmp_); }
@@ -444,17 +589,18 @@ template<class Weight, class IntType> class LatticeDeterminizer {
     // the following loop covers strings present in minimal_hash_
     // which are also accessible via output_states_.
     for (size_t i = 0; i < output_states_.size(); i++)
-      for (size_t j = 0; j < output_states_[i]->size(); j++)
-        needed_strings.push_back((*(output_states_[i]))[j].string);
+      for (const Element *iter = output_states_[i].begin();
+           iter != output_states_[i].end(); ++iter)
+        needed_strings.push_back(iter->string);
 
     // the following loop covers strings present in initial_hash_.
     for (typename InitialSubsetHash::const_iterator
              iter = initial_hash_.begin();
          iter != initial_hash_.end(); ++iter) {
-      const vector<Element> &vec = *(iter->first);
+      const Subset &subset = iter->first;
       Element elem = iter->second;
-      for (size_t i = 0; i < vec.size(); i++)
-        needed_strings.push_back(vec[i].string);
+      for (const Element *e = subset.begin(); e != subset.end(); ++e)
+        needed_strings.push_back(e->string);
       needed_strings.push_back(elem.string);
     }
 
@@ -466,21 +612,23 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   }
 
   bool CheckMemoryUsage() {
-    int32 repo_size = repository_.MemSize(),
-        arcs_size = num_arcs_ * sizeof(TempArc),
-        elems_size = num_elems_ * sizeof(Element),
+    // These are computed in 64 bits, as they can be more than 2^31 for large
+    // lattices.
+    int64 repo_size = repository_.MemSize(),
+        arcs_size = static_cast<int64>(num_arcs_) * sizeof(TempArc),
+        elems_size = subset_arena_.MemSize(),
         total_size = repo_size + arcs_size + elems_size;
     if (opts_.max_mem > 0 && total_size > opts_.max_mem) { // We passed the memory threshold.
       // This is usually due to the repository getting large, so we
       // clean this out.
       RebuildRepository();
-      int32 new_repo_size = repository_.MemSize(),
+      int64 new_repo_size = repository_.MemSize(),
           new_total_size = new_repo_size + arcs_size + elems_size;
 
       KALDI_VLOG(2) << "Rebuilt repository in determinize-lattice: repository shrank from "
                     << repo_size << " to " << new_repo_size << " bytes (approximately)";
 
-      if (new_total_size > static_cast<int32>(opts_.max_mem * 0.8)) {
+      if (new_total_size > static_cast<int64>(opts_.max_mem * 0.8)) {
         // Rebuilding didn't help enough-- we need a margin to stop
         // having to rebuild too often.
         KALDI_WARN << "Failure in determinize-lattice: size exceeds maximum "
@@ -511,9 +659,9 @@ template<class Weight, class IntType> class LatticeDeterminizer {
       }
       return (determinized_ = true);
     } catch (std::bad_alloc) {
-      int32 repo_size = repository_.MemSize(),
-          arcs_size = num_arcs_ * sizeof(TempArc),
-          elems_size = num_elems_ * sizeof(Element),
+      int64 repo_size = repository_.MemSize(),
+          arcs_size = static_cast<int64>(num_arcs_) * sizeof(TempArc),
+          elems_size = subset_arena_.MemSize(),
           total_size = repo_size + arcs_size + elems_size;
       KALDI_WARN << "Memory allocation error doing lattice determinization; using "
           << total_size << " bytes (max = " << opts_.max_mem
@@ -562,74 +710,16 @@ template<class Weight, class IntType> class LatticeDeterminizer {
     Weight weight;
   };
 
-  // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
-  // The Elements are in sorted order on state id, and without repeated states.
-  // Because the order of Elements is fixed, we can use a hashing function that is
-  // order-dependent.  However the weights are not included in the hashing function--
-  // we hash subsets that differ only in weight to the same key.  This is not optimal
-  // in terms of the O(N) performance but typically if we have a lot of determinized
-  // states that differ only in weight then the input probably was pathological in some way,
-  // or even non-determinizable.
-  //   We don't quantize the weights, in order to avoid inexactness in simple cases.
-  // Instead we apply the delta when comparing subsets for equality, and allow a small
-  // difference.
-
-  class SubsetKey {
-   public:
-    size_t operator ()(const vector<Element> * subset) const {  // hashes only the state and string.
-      size_t hash = 0, factor = 1;
-      for (typename vector<Element>::const_iterator iter= subset->begin(); iter != subset->end(); ++iter) {
-        hash *= factor;
-        hash += iter->state + reinterpret_cast<size_t>(iter->string);
-        factor *= 23531;  // these numbers are primes.
-      }
-      return hash;
-    }
-  };
-
-  // This is the equality operator on subsets.  It checks for exact match on state-id
-  // and string, and approximate match on weights.
-  class SubsetEqual {
-   public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      assert(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
-      for (; iter1 < iter1_end; ++iter1, ++iter2) {
-        if (iter1->state != iter2->state ||
-           iter1->string != iter2->string ||
-            ! ApproxEqual(iter1->weight, iter2->weight, delta_)) return false;
-      }
-      return true;
-    }
-    float delta_;
-    SubsetEqual(float delta): delta_(delta) {}
-    SubsetEqual(): delta_(kDelta) {}
-  };
-
-  // Operator that says whether two Elements have the same states.
-  // Used only for debug.
-  class SubsetEqualStates {
-   public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      assert(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
-      for (; iter1 < iter1_end; ++iter1, ++iter2) {
-        if (iter1->state != iter2->state) return false;
-      }
-      return true;
-    }
-  };
+  // The subsets of states that are the keys of the hashes are stored in
+  // subset_arena_; see LatticeSubsetArena for the hash and equality functions.
+  typedef LatticeSubsetArena<Element> SubsetArena;
+  typedef typename SubsetArena::Subset Subset;
+  typedef typename SubsetArena::SubsetKey SubsetKey;
+  typedef typename SubsetArena::SubsetEqual SubsetEqual;
 
   // Define the hash type we use to map subsets (in minimal
   // representation) to OutputStateId.
-  typedef unordered_map<const vector<Element>*, OutputStateId,
+  typedef unordered_map<Subset, OutputStateId,
                         SubsetKey, SubsetEqual> MinimalSubsetHash;
 
   // Define the hash type we use to map subsets (in initial
@@ -637,7 +727,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   // extra weight. [note: we interpret the Element.state in here
   // as an OutputStateId even though it's declared as InputStateId;
   // these types are the same anyway].
-  typedef unordered_map<const vector<Element>*, Element,
+  typedef unordered_map<Subset, Element,
                         SubsetKey, SubsetEqual> InitialSubsetHash;
 
 
@@ -662,16 +752,16 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   // Involves a hash lookup, and possibly adding a new OutputStateId.
   // If it creates a new OutputStateId, it adds it to the queue.
   OutputStateId MinimalToStateId(const vector<Element> &subset) {
+    Subset key = SubsetArena::Wrap(subset);
     typename MinimalSubsetHash::const_iterator iter
-        = minimal_hash_.find(&subset);
+        = minimal_hash_.find(key);
     if (iter != minimal_hash_.end()) // Found a matching subset.
       return iter->second;
     OutputStateId ans = static_cast<OutputStateId>(output_arcs_.size());
-    vector<Element> *subset_ptr = new vector<Element>(subset);
-    output_states_.push_back(subset_ptr);
-    num_elems_ += subset_ptr->size();
+    key = subset_arena_.Copy(key);
+    output_states_.push_back(key);
     output_arcs_.push_back(vector<TempArc>());
-    minimal_hash_[subset_ptr] = ans;
+    minimal_hash_[key] = ans;
     queue_.push_back(ans);
     return ans;
   }
@@ -682,8 +772,9 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   OutputStateId InitialToStateId(const vector<Element> &subset_in,
                                  Weight *remaining_weight,
                                  StringId *common_prefix) {
+    Subset key = SubsetArena::Wrap(subset_in);
     typename InitialSubsetHash::const_iterator iter
-        = initial_hash_.find(&subset_in);
+        = initial_hash_.find(key);
     if (iter != initial_hash_.end()) { // Found a matching subset.
       const Element &elem = iter->second;
       *remaining_weight = elem.weight;
@@ -716,10 +807,8 @@ template<class Weight, class IntType> class LatticeDeterminizer {
     // Before returning "ans", add the initial subset to the hash,
     // so that we can bypass the epsilon-closure etc., next time
     // we process the same initial subset.
-    vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
     elem.state = ans;
-    initial_hash_[initial_subset_ptr] = elem;
-    num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
+    initial_hash_[subset_arena_.Copy(key)] = elem;
     return ans;
   }
 
@@ -850,7 +939,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   // Has no side effects except on the variable repository_, and output_arcs_.
 
   void ProcessFinal(OutputStateId output_state) {
-    const vector<Element> &minimal_subset = *(output_states_[output_state]);
+    Subset minimal_subset = output_states_[output_state];
     // processes final-weights for this subset.
 
     // minimal_subset may be empty if the graphs is not connected/trimmed, I think,
@@ -858,7 +947,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
     bool is_final = false;
     StringId final_string = NULL;  // = NULL to keep compiler happy.
     Weight final_weight = Weight::Zero();
-    typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+    const Element *iter = minimal_subset.begin(), *end = minimal_subset.end();
     for (; iter != end; ++iter) {
       const Element &elem = *iter;
       Weight this_final_weight = Times(elem.weight, ifst_->Final(elem.state));
@@ -1016,7 +1105,8 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   // and output_arcs_.
 
   void ProcessTransitions(OutputStateId output_state) {
-    const vector<Element> &minimal_subset = *(output_states_[output_state]);
+    // Note: this is a copy, as output_states_ may be resized below.
+    Subset minimal_subset = output_states_[output_state];
     // it's possible that minimal_subset could be empty if there are
     // unreachable parts of the graph, so don't check that it's nonempty.
     vector<pair<Label, Element> > &all_elems(all_elems_tmp_); // use class member
@@ -1024,7 +1114,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
     {
       // Push back into "all_elems", elements corresponding to all
       // non-epsilon-input transitions out of all states in "minimal_subset".
-      typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+      const Element *iter = minimal_subset.begin(), *end = minimal_subset.end();
       for (;iter != end; ++iter) {
         const Element &elem = *iter;
         for (ArcIterator<Fst<Arc> > aiter(*ifst_, elem.state); ! aiter.Done(); aiter.Next()) {
@@ -1199,13 +1289,13 @@ template<class Weight, class IntType> class LatticeDeterminizer {
       EpsilonClosure(&subset); // follow through epsilon-inputs links
       ConvertToMinimal(&subset); // remove all but final states and
       // states with input-labels on arcs out of them.
-      vector<Element> *subset_ptr = new vector<Element>(subset);
+      Subset key = subset_arena_.Copy(SubsetArena::Wrap(subset));
       assert(output_arcs_.empty() && output_states_.empty());
       // add the new state...
-      output_states_.push_back(subset_ptr);
+      output_states_.push_back(key);
       output_arcs_.push_back(vector<TempArc>());
       OutputStateId initial_state = 0;
-      minimal_hash_[subset_ptr] = initial_state;
+      minimal_hash_[key] = initial_state;
       queue_.push_back(initial_state);
     }
   }
@@ -1213,14 +1303,14 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeDeterminizer);
 
 
-  vector<vector<Element>* > output_states_; // maps from output state to
-                                            // minimal representation [normalized].
-                                            // View pointers as owned in
-                                            // minimal_hash_.
+  vector<Subset> output_states_; // maps from output state to
+                                 // minimal representation [normalized].
+                                 // The elements are in subset_arena_.
+  SubsetArena subset_arena_;  // Stores the elements of the subsets in
+                              // output_states_ and the keys of the hashes.
   vector<vector<TempArc> > output_arcs_;  // essentially an FST in our format.
 
   int num_arcs_; // keep track of memory usage: number of arcs in output_arcs_
-  int num_elems_; // keep track of memory usage: number of elems in output_states_
 
   const Fst<Arc> *ifst_;
   DeterminizeLatticeOptions opts_;
@@ -1230,8 +1320,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
   // sure this object is used correctly.
   MinimalSubsetHash minimal_hash_;  // hash from Subset to OutputStateId.  Subset is "minimal
                                     // representation" (only include final and states and states with
-                                    // nonzero ilabel on arc out of them.  Owns the pointers
-                                    // in its keys.
+                                    // nonzero ilabel on arc out of them.
   InitialSubsetHash initial_hash_;   // hash from Subset to Element, which
                                      // represents the OutputStateId together
                                      // with an extra weight and string.  Subset
@@ -1239,8 +1328,7 @@ template<class Weight, class IntType> class LatticeDeterminizer {
                                      // weight and string is needed because after
                                      // we convert to minimal representation and
                                      // normalize, there may be an extra weight
-                                     // and string.  Owns the pointers
-                                    // in its keys.
+                                     // and string.
   vector<OutputStateId> queue_; // Queue of output-states to process.  Starts with
   // state 0, and increases and then (hopefully) decreases in length during
   // determinization.  LIFO queue (queue discipline doesn't really matter).
@@ -46,9 +46,15 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   if (rxfilename == "") rxfilename = "-"; // interpret "" as stdin,
   // for compatibility with OpenFst conventions.
   kaldi::Input ki(rxfilename);
+  return ReadFstKaldiGeneric(ki.Stream(), rxfilename, throw_on_err);
+}
+
+Fst<StdArc> *ReadFstKaldiGeneric(std::istream &is,
+                                 const std::string &rxfilename,
+                                 bool throw_on_err) {
   fst::FstHeader hdr;
   // Read FstHeader which contains the type of FST
-  if (!hdr.Read(ki.Stream(), rxfilename)) {
+  if (!hdr.Read(is, rxfilename)) {
     if(throw_on_err) {
       KALDI_ERR << "Reading FST: error reading FST header from "
                 << kaldi::PrintableRxfilename(rxfilename);
@@ -72,10 +78,13 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   // Read the FST
   FstReadOptions ropts("<unspecified>", &hdr);
   Fst<StdArc> *fst = NULL;
+  if (SetMemoryMapReadOptions(rxfilename, hdr, &ropts))
+    KALDI_VLOG(1) << "Memory-mapping FST from "
+                  << kaldi::PrintableRxfilename(rxfilename);
   if (hdr.FstType() == "const") {
-    fst = ConstFst<StdArc>::Read(ki.Stream(), ropts);
+    fst = ConstFst<StdArc>::Read(is, ropts);
   } else if (hdr.FstType() == "vector") {
-    fst = VectorFst<StdArc>::Read(ki.Stream(), ropts);
+    fst = VectorFst<StdArc>::Read(is, ropts);
   }
   if (!fst) {
     if(throw_on_err) {
@@ -91,6 +100,42 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   return fst;
 }
 
+bool SetMemoryMapReadOptions(const std::string &rxfilename,
+                             const FstHeader &hdr,
+                             FstReadOptions *ropts) {
+  // OpenFst only maps arrays that start at an aligned offset, and if the FST
+  // was not written with alignment it would silently fall back to reading,
+  // so we only ask for it when the header says the file is aligned.
+  if (hdr.FstType() != "const" ||
+      (hdr.GetFlags() & FstHeader::IS_ALIGNED) == 0 ||
+      kaldi::ClassifyRxfilename(rxfilename) != kaldi::kFileInput)
+    return false;
+  ropts->mode = FstReadOptions::MAP;
+  ropts->source = rxfilename;
+  return true;
+}
+
+void WriteFstKaldiMappable(const Fst<StdArc> &fst,
+                           std::string wxfilename) {
+  if (kaldi::ClassifyWxfilename(wxfilename) != kaldi::kFileOutput)
+    KALDI_ERR << "Memory-mappable FSTs must be written to a file, not "
+              << kaldi::PrintableWxfilename(wxfilename);
+  bool write_binary = true, write_header = false;
+  kaldi::Output ko(wxfilename, write_binary, write_header);
+  FstWriteOptions wopts(kaldi::PrintableWxfilename(wxfilename));
+  wopts.align = true;
+  bool ok;
+  if (fst.Type() == "const") {
+    ok = fst.Write(ko.Stream(), wopts);
+  } else {
+    ConstFst<StdArc> const_fst(fst);
+    ok = const_fst.Write(ko.Stream(), wopts);
+  }
+  if (!ok || !ko.Close())
+    KALDI_ERR << "Error writing FST to "
+              << kaldi::PrintableWxfilename(wxfilename);
+}
+
 VectorFst<StdArc> *CastOrConvertToVectorFst(Fst<StdArc> *fst) {
   // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
   std::string real_type = fst->Type();
@@ -47,9 +47,39 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 // doesn't support the text-mode option that we generally like to support.
 // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
 // (const-fst can give better performance for decoding).
+// If the FST is a ConstFst in the memory-mappable layout (see
+// WriteFstKaldiMappable()) and rxfilename is an ordinary file, its arrays are
+// memory-mapped rather than read, so they are paged in lazily and processes
+// that read the same file share the physical memory.
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
                                  bool throw_on_err = true);
 
+// As ReadFstKaldiGeneric() above, but reads from 'is', which must have been
+// opened from 'rxfilename' and be at the start of the FST; 'rxfilename' is
+// used in messages and to decide whether the FST can be memory-mapped.
+Fst<StdArc> *ReadFstKaldiGeneric(std::istream &is,
+                                 const std::string &rxfilename,
+                                 bool throw_on_err = true);
+
+// If 'hdr' is the header of a ConstFst that was written in the
+// memory-mappable layout and 'rxfilename' is an ordinary file (not a pipe,
+// stdin or an offset into a file), sets 'ropts' up so that
+// ConstFst<StdArc>::Read() will memory-map the FST from that file, and returns
+// true; otherwise leaves 'ropts' unchanged and returns false.  The stream must
+// be positioned just after the header, as it is when you have called
+// hdr.Read() on a stream opened with kaldi::Input.
+bool SetMemoryMapReadOptions(const std::string &rxfilename,
+                             const FstHeader &hdr,
+                             FstReadOptions *ropts);
+
+// Writes "fst" as a ConstFst<StdArc> in the memory-mappable layout, i.e.
+// with its arrays aligned within the file, so that ReadFstKaldiGeneric() can
+// memory-map it.  The file is still readable by OpenFst's tools.  Because
+// reading this layout requires a seekable stream, 'wxfilename' must be an
+// ordinary file, and the result can't be read back through a pipe.
+void WriteFstKaldiMappable(const Fst<StdArc> &fst,
+                           std::string wxfilename);
+
 // This function attempts to dynamic_cast the pointer 'fst' (which will likely
 // have been returned by ReadFstGeneric()), to the more derived
 // type VectorFst<StdArc>. If this succeeds, it returns the same pointer;
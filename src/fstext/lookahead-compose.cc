@@ -0,0 +1,60 @@
+// fstext/lookahead-compose.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/lookahead-compose.h"
+
+namespace fst {
+
+const char kaldi_olabel_lookahead_fst_type[] = "kaldi_olabel_lookahead";
+
+
+StdOLabelLookAheadConstFst *CreateLookaheadFst(const Fst<StdArc> &hcl) {
+  if (hcl.Properties(kOLabelSorted, true) == 0)
+    KALDI_WARN << "HCL is not sorted on output label; the lookahead "
+               << "matcher may be slow.";
+  // The MatcherFst constructor converts to ConstFst, computes the
+  // reachability information, and relabels the output side.
+  StdOLabelLookAheadConstFst *ans = new StdOLabelLookAheadConstFst(hcl);
+  if (ans->Start() == kNoStateId)
+    KALDI_ERR << "Creating lookahead FST: HCL is empty.";
+  return ans;
+}
+
+
+void RelabelForLookahead(const StdOLabelLookAheadConstFst &hcl_lookahead,
+                         MutableFst<StdArc> *g) {
+  LabelLookAheadRelabeler<StdArc>::Relabel(g, hcl_lookahead, true);
+  ArcSort(g, ILabelCompare<StdArc>());
+}
+
+
+ComposeFst<StdArc> *CreateLookaheadComposeFst(
+    const StdOLabelLookAheadConstFst &hcl_lookahead,
+    const Fst<StdArc> &g,
+    size_t cache_size) {
+  if (g.Properties(kILabelSorted, true) == 0)
+    KALDI_ERR << "G must be sorted on input label (call "
+              << "RelabelForLookahead()).";
+  CacheOptions cache_opts(cache_size != 0, cache_size);
+  // ComposeFst notices that hcl_lookahead has a lookahead matcher and uses
+  // the lookahead composition filter.
+  return new ComposeFst<StdArc>(hcl_lookahead, g, cache_opts);
+}
+
+}  // namespace fst
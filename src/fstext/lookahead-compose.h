@@ -0,0 +1,101 @@
+// fstext/lookahead-compose.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_LOOKAHEAD_COMPOSE_H_
+#define KALDI_FSTEXT_LOOKAHEAD_COMPOSE_H_
+
+#include <fst/fstlib.h>
+#include <fst/lookahead-matcher.h>
+#include <fst/matcher-fst.h>
+#include "base/kaldi-common.h"
+
+/*
+  This header contains utilities for decoding with the lazy composition of a
+  small HCL graph with a grammar G, instead of with a precompiled HCLG.  This
+  is much smaller in memory (the HCLG for a large LM can be orders of
+  magnitude larger than HCL and G together), and the G can be changed without
+  recompiling anything.
+
+  To keep the pruning effective the composition uses OpenFst's label
+  lookahead: when it is about to enter a state of HCL, it looks ahead at the
+  words reachable from there and adds the best LM weight among them
+  (the lookahead weight is pushed toward the start of the word), so the
+  decoder does not have to wait for the word label to learn the LM cost.  This
+  requires the output labels of HCL to be renumbered so that the words
+  reachable from each state form intervals, and G's input labels have to be
+  renumbered in the same way; see CreateLookaheadFst() and
+  RelabelForLookahead().
+
+  The HCL should be constructed as for mkgraph.sh but without G, i.e. from
+  L_disambig.fst instead of LG.fst, with the self-loops added and the
+  transition-id disambiguation symbols removed; its output labels are words.
+  G should have its disambiguation symbols (e.g. #0 on backoff arcs) replaced
+  by epsilon.  The composed FST's input labels are transition-ids and its
+  output labels are words, like HCLG.
+*/
+
+namespace fst {
+
+/// The type name for StdOLabelLookAheadConstFst.  We use our own, rather than
+/// OpenFst's "olabel_lookahead", so that we don't depend on OpenFst's
+/// lookahead extension library, which is not built by default.
+extern const char kaldi_olabel_lookahead_fst_type[];
+
+/// The same flags as OpenFst's olabel_lookahead_flags.
+const uint32 kKaldiOLabelLookAheadFlags = kOutputLookAheadMatcher |
+    kLookAheadWeight | kLookAheadPrefix | kLookAheadEpsilons |
+    kLookAheadNonEpsilonPrefix;
+
+/// This is the same as OpenFst's StdOLabelLookAheadFst except for the type
+/// name: a ConstFst with an output-label lookahead matcher attached.
+typedef MatcherFst<ConstFst<StdArc>,
+                   LabelLookAheadMatcher<SortedMatcher<ConstFst<StdArc> >,
+                                         kKaldiOLabelLookAheadFlags,
+                                         FastLogAccumulator<StdArc> >,
+                   kaldi_olabel_lookahead_fst_type,
+                   LabelLookAheadRelabeler<StdArc> >
+    StdOLabelLookAheadConstFst;
+
+/// Creates the lookahead version of "hcl".  This computes which words are
+/// reachable from each state and renumbers the output labels of the result
+/// accordingly, so G must be relabeled with RelabelForLookahead() before it is
+/// composed with it.  The caller owns the returned pointer.
+StdOLabelLookAheadConstFst *CreateLookaheadFst(const Fst<StdArc> &hcl);
+
+/// Renumbers the input labels of "g" to match the output labels of
+/// "hcl_lookahead", and sorts its arcs on input label as composition requires.
+/// You can do this to any number of grammars; each of them can then be
+/// composed with the same "hcl_lookahead".
+void RelabelForLookahead(const StdOLabelLookAheadConstFst &hcl_lookahead,
+                         MutableFst<StdArc> *g);
+
+/// Returns the lazy composition of "hcl_lookahead" and "g" (which must have
+/// been prepared with RelabelForLookahead()), using the lookahead matcher and
+/// composition filter.  States are expanded as the decoder visits them, and
+/// if "cache_size" (in bytes) is nonzero the expanded states are garbage
+/// collected once their memory exceeds it.  The inputs must outlive the
+/// result, which the caller owns.  The result is not thread-safe.
+ComposeFst<StdArc> *CreateLookaheadComposeFst(
+    const StdOLabelLookAheadConstFst &hcl_lookahead,
+    const Fst<StdArc> &g,
+    size_t cache_size);
+
+}  // namespace fst
+
+#endif  // KALDI_FSTEXT_LOOKAHEAD_COMPOSE_H_
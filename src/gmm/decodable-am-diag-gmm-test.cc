@@ -0,0 +1,80 @@
+// gmm/decodable-am-diag-gmm-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmm/decodable-am-diag-gmm.h"
+#include "gmm/model-test-common.h"
+
+namespace kaldi {
+
+// Checks that LogLikelihoods() gives the same answers as LogLikelihood(), for
+// batches small enough to be done one pdf at a time and large enough to be
+// done with one matrix-vector product, with repeated and already-cached
+// indices.  The stacked parameters are either made by the decodable or shared
+// with another one.
+void TestDecodableAmDiagGmmBatch() {
+  int32 dim = 1 + Rand() % 10, num_pdfs = 1 + Rand() % 20,
+      num_frames = 1 + Rand() % 10;
+  AmDiagGmm am_gmm;
+  for (int32 i = 0; i < num_pdfs; i++) {
+    DiagGmm gmm;
+    unittest::InitRandDiagGmm(dim, 1 + Rand() % 5, &gmm);
+    am_gmm.AddPdf(gmm);
+  }
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+
+  AmDiagGmmStackedParams stacked_params(am_gmm);
+  KALDI_ASSERT(stacked_params.Dim() == dim &&
+               stacked_params.NumPdfs() == num_pdfs &&
+               stacked_params.NumGauss() == am_gmm.NumGauss());
+  bool shared = (Rand() % 2 == 0);
+  DecodableAmDiagGmmUnmapped batch_decodable(
+      am_gmm, feats, -1.0, (shared ? &stacked_params : NULL)),
+      other_batch_decodable(am_gmm, feats, -1.0, &stacked_params),
+      decodable(am_gmm, feats);
+  for (int32 frame = 0; frame < num_frames; frame++) {
+    for (int32 n = 0; n < 3; n++) {
+      std::vector<int32> indices(Rand() % (2 * num_pdfs));
+      for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = 1 + Rand() % num_pdfs;
+      std::vector<BaseFloat> log_likes;
+      batch_decodable.LogLikelihoods(frame, indices, &log_likes);
+      KALDI_ASSERT(log_likes.size() == indices.size());
+      std::vector<BaseFloat> other_log_likes;
+      other_batch_decodable.LogLikelihoods(frame, indices, &other_log_likes);
+      KALDI_ASSERT(other_log_likes == log_likes);
+      for (size_t i = 0; i < indices.size(); i++) {
+        BaseFloat log_like = decodable.LogLikelihood(frame, indices[i]);
+        AssertEqual(log_likes[i], log_like, 1.0e-04);
+        // The per-index function should return the cached batch value.
+        KALDI_ASSERT(batch_decodable.LogLikelihood(frame, indices[i]) ==
+                     log_likes[i]);
+      }
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestDecodableAmDiagGmmBatch();
+  KALDI_LOG << "Success.";
+}
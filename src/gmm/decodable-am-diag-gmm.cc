@@ -55,7 +55,11 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
         "before computing likelihood.";
   }
 
-  Vector<BaseFloat> loglikes(pdf.gconsts());  // need to recreate for each pdf
+  int32 num_gauss = pdf.NumGauss();
+  if (gauss_loglikes_.Dim() < num_gauss)
+    gauss_loglikes_.Resize(num_gauss, kUndefined);
+  SubVector<BaseFloat> loglikes(gauss_loglikes_, 0, num_gauss);
+  loglikes.CopyFromVec(pdf.gconsts());
   // loglikes +=  means * inv(vars) * data.
   loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
   // loglikes += -0.5 * inv(vars) * data_sq.
@@ -71,6 +75,148 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   return log_sum;
 }
 
+AmDiagGmmStackedParams::AmDiagGmmStackedParams(const AmDiagGmm &am) {
+  int32 num_pdfs = am.NumPdfs(), dim = am.Dim();
+  gauss_offsets_.resize(num_pdfs + 1);
+  gauss_offsets_[0] = 0;
+  for (int32 pdf_id = 0; pdf_id < num_pdfs; pdf_id++) {
+    const DiagGmm &pdf = am.GetPdf(pdf_id);
+    KALDI_ASSERT(pdf.Dim() == dim);
+    if (!pdf.valid_gconsts()) {
+      KALDI_ERR << "State "  << pdf_id  << ": Must call ComputeGconsts() "
+          "before computing likelihood.";
+    }
+    gauss_offsets_[pdf_id + 1] = gauss_offsets_[pdf_id] + pdf.NumGauss();
+  }
+  params_.Resize(gauss_offsets_[num_pdfs], 2 * dim, kUndefined);
+  gconsts_.Resize(gauss_offsets_[num_pdfs], kUndefined);
+  for (int32 pdf_id = 0; pdf_id < num_pdfs; pdf_id++) {
+    const DiagGmm &pdf = am.GetPdf(pdf_id);
+    int32 offset = gauss_offsets_[pdf_id], num_gauss = pdf.NumGauss();
+    params_.Range(offset, num_gauss, 0, dim).CopyFromMat(pdf.means_invvars());
+    params_.Range(offset, num_gauss, dim, dim).CopyFromMat(pdf.inv_vars());
+    gconsts_.Range(offset, num_gauss).CopyFromVec(pdf.gconsts());
+  }
+}
+
+const AmDiagGmmStackedParams &DecodableAmDiagGmmUnmapped::StackedParams() {
+  if (stacked_params_ == NULL) {
+    own_stacked_params_ = new AmDiagGmmStackedParams(acoustic_model_);
+    stacked_params_ = own_stacked_params_;
+  }
+  if (stacked_params_->NumPdfs() != acoustic_model_.NumPdfs())
+    KALDI_ERR << "The stacked parameters are for a different model.";
+  int32 dim = feature_matrix_.NumCols();
+  if (stacked_params_->Dim() != dim) {
+    KALDI_ERR << "Dim mismatch: data dim = "  << dim
+              << " vs. model dim = " << stacked_params_->Dim();
+  }
+  return *stacked_params_;
+}
+
+void DecodableAmDiagGmmUnmapped::LogLikelihoodsZeroBased(
+    int32 frame, const std::vector<int32> &states,
+    std::vector<BaseFloat> *log_likes) {
+  KALDI_ASSERT(static_cast<size_t>(frame) <
+               static_cast<size_t>(NumFramesReady()));
+  const AmDiagGmmStackedParams &stacked_params = StackedParams();
+  const Matrix<BaseFloat> &params = stacked_params.Params();
+  const Vector<BaseFloat> &gconsts = stacked_params.Gconsts();
+
+  // Work out which pdfs are not cached yet.  We set their hit_time straight
+  // away so each is only computed once; their log_like is set below.
+  pending_states_.clear();
+  int32 num_pending_gauss = 0;
+  std::vector<int32>::const_iterator iter = states.begin(),
+      end = states.end();
+  for (; iter != end; ++iter) {
+    int32 state = *iter;
+    KALDI_ASSERT(static_cast<size_t>(state) <
+                 static_cast<size_t>(acoustic_model_.NumPdfs()) &&
+                 "Likely graph/model mismatch, e.g. using wrong HCLG.fst");
+    if (log_like_cache_[state].hit_time != frame) {
+      log_like_cache_[state].hit_time = frame;
+      pending_states_.push_back(state);
+      num_pending_gauss += stacked_params.GaussOffset(state + 1) -
+          stacked_params.GaussOffset(state);
+    }
+  }
+
+  if (!pending_states_.empty()) {
+    int32 dim = feature_matrix_.NumCols(),
+        total_gauss = stacked_params.NumGauss();
+    if (stacked_data_.Dim() != 2 * dim)
+      stacked_data_.Resize(2 * dim, kUndefined);
+    if (frame != previous_stacked_frame_) {
+      SubVector<BaseFloat> data(stacked_data_, 0, dim),
+          minus_half_data_sq(stacked_data_, dim, dim);
+      data.CopyFromVec(feature_matrix_.Row(frame));
+      minus_half_data_sq.CopyFromVec(data);
+      minus_half_data_sq.ApplyPow(2.0);
+      minus_half_data_sq.Scale(-0.5);
+      previous_stacked_frame_ = frame;
+    }
+    if (gauss_loglikes_.Dim() < total_gauss)
+      gauss_loglikes_.Resize(total_gauss, kUndefined);
+    bool all_gauss = (2 * num_pending_gauss >= total_gauss);
+    if (all_gauss) {
+      // It is faster to do all the Gaussians in one product than to do just
+      // the ones we need, one pdf at a time.
+      SubVector<BaseFloat> loglikes(gauss_loglikes_, 0, total_gauss);
+      loglikes.CopyFromVec(gconsts);
+      loglikes.AddMatVec(1.0, params, kNoTrans, stacked_data_, 1.0);
+    }
+    for (size_t i = 0; i < pending_states_.size(); i++) {
+      int32 state = pending_states_[i],
+          offset = stacked_params.GaussOffset(state),
+          num_gauss = stacked_params.GaussOffset(state + 1) - offset;
+      SubVector<BaseFloat> loglikes(gauss_loglikes_, offset, num_gauss);
+      if (!all_gauss) {
+        loglikes.CopyFromVec(gconsts.Range(offset, num_gauss));
+        loglikes.AddMatVec(1.0, params.RowRange(offset, num_gauss),
+                           kNoTrans, stacked_data_, 1.0);
+      }
+      BaseFloat log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
+      if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
+        KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+      log_like_cache_[state].log_like = log_sum;
+    }
+  }
+
+  log_likes->resize(states.size());
+  for (size_t i = 0; i < states.size(); i++)
+    (*log_likes)[i] = log_like_cache_[states[i]].log_like;
+}
+
+void DecodableAmDiagGmmUnmapped::LogLikelihoods(
+    int32 frame, const std::vector<int32> &indices,
+    std::vector<BaseFloat> *log_likes) {
+  states_.resize(indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    states_[i] = indices[i] - 1;
+  LogLikelihoodsZeroBased(frame, states_, log_likes);
+}
+
+void DecodableAmDiagGmm::LogLikelihoods(int32 frame,
+                                        const std::vector<int32> &tids,
+                                        std::vector<BaseFloat> *log_likes) {
+  pdfs_.resize(tids.size());
+  for (size_t i = 0; i < tids.size(); i++)
+    pdfs_[i] = trans_model_.TransitionIdToPdf(tids[i]);
+  LogLikelihoodsZeroBased(frame, pdfs_, log_likes);
+}
+
+void DecodableAmDiagGmmScaled::LogLikelihoods(
+    int32 frame, const std::vector<int32> &tids,
+    std::vector<BaseFloat> *log_likes) {
+  pdfs_.resize(tids.size());
+  for (size_t i = 0; i < tids.size(); i++)
+    pdfs_[i] = trans_model_.TransitionIdToPdf(tids[i]);
+  LogLikelihoodsZeroBased(frame, pdfs_, log_likes);
+  for (size_t i = 0; i < log_likes->size(); i++)
+    (*log_likes)[i] *= scale_;
+}
+
 void DecodableAmDiagGmmUnmapped::ResetLogLikeCache() {
   if (static_cast<int32>(log_like_cache_.size()) != acoustic_model_.NumPdfs()) {
     log_like_cache_.resize(acoustic_model_.NumPdfs());
@@ -34,6 +34,38 @@
 
 namespace kaldi {
 
+/// The parameters of all the Gaussians of an AmDiagGmm, stacked into one
+/// matrix for DecodableAmDiagGmmUnmapped::LogLikelihoods().  Stacking them
+/// copies the model, so if you decode many utterances, make one of these for
+/// the model and give it to all the decodables.  It is not updated if the
+/// model changes.
+class AmDiagGmmStackedParams {
+ public:
+  /// Requires that the gconsts of all the pdfs are valid.
+  explicit AmDiagGmmStackedParams(const AmDiagGmm &am);
+
+  int32 Dim() const { return params_.NumCols() / 2; }
+  int32 NumPdfs() const { return gauss_offsets_.size() - 1; }
+  int32 NumGauss() const { return params_.NumRows(); }
+
+  /// Row g is [ means_invvars, inv_vars ] for Gaussian g, so that its
+  /// log-likelihood is its gconst plus the product of the row with
+  /// [ data, -0.5 * data^2 ].
+  const Matrix<BaseFloat> &Params() const { return params_; }
+  const Vector<BaseFloat> &Gconsts() const { return gconsts_; }
+  /// The first row of pdf 'pdf' in Params(); GaussOffset(NumPdfs()) is
+  /// NumGauss().
+  int32 GaussOffset(int32 pdf) const { return gauss_offsets_[pdf]; }
+
+ private:
+  Matrix<BaseFloat> params_;
+  Vector<BaseFloat> gconsts_;
+  std::vector<int32> gauss_offsets_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AmDiagGmmStackedParams);
+};
+
+
 /// DecodableAmDiagGmmUnmapped is a decodable object that
 /// takes indices that correspond to pdf-id's plus one.
 /// This may be used in future in a decoder that doesn't need
@@ -48,15 +80,22 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
   /// in the LogSumExp operation (larger = more exact); I suggest 5.
   /// This is advisable if it's spending a long time doing exp 
   /// operations. 
-  DecodableAmDiagGmmUnmapped(const AmDiagGmm &am,
-                             const Matrix<BaseFloat> &feats,
-                             BaseFloat log_sum_exp_prune = -1.0):
+  /// If 'stacked_params' is not NULL, LogLikelihoods() uses it (it must be
+  /// for 'am' and must outlive this object); otherwise this object stacks
+  /// the parameters itself the first time LogLikelihoods() is called.
+  DecodableAmDiagGmmUnmapped(
+      const AmDiagGmm &am, const Matrix<BaseFloat> &feats,
+      BaseFloat log_sum_exp_prune = -1.0,
+      const AmDiagGmmStackedParams *stacked_params = NULL):
     acoustic_model_(am), feature_matrix_(feats),
     previous_frame_(-1), log_sum_exp_prune_(log_sum_exp_prune), 
-    data_squared_(feats.NumCols()) {
+    data_squared_(feats.NumCols()), stacked_params_(stacked_params),
+    own_stacked_params_(NULL), previous_stacked_frame_(-1) {
     ResetLogLikeCache();
   }
 
+  virtual ~DecodableAmDiagGmmUnmapped() { delete own_stacked_params_; }
+
   // Note, frames are numbered from zero.  But state_index is numbered
   // from one (this routine is called by FSTs).
   virtual BaseFloat LogLikelihood(int32 frame, int32 state_index) {
@@ -72,10 +111,26 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
     return (frame == NumFramesReady() - 1);
   }
 
+  /// Computes the log-likelihoods of several states (pdf-ids plus one) on the
+  /// same frame; see LogLikelihoodsZeroBased().
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &indices,
+                              std::vector<BaseFloat> *log_likes);
+
  protected:
   void ResetLogLikeCache();
   virtual BaseFloat LogLikelihoodZeroBased(int32 frame, int32 state_index);
 
+  /// Computes the log-likelihoods of the pdfs 'states' (zero-based) on frame
+  /// 'frame', using the parameters of all the Gaussians of the model stacked
+  /// into one matrix (see AmDiagGmmStackedParams).  The
+  /// per-Gaussian log-likelihoods of all the pdfs that are not cached are
+  /// computed with a single matrix-vector product if they have at least half
+  /// of the Gaussians, and otherwise with one product per pdf (instead of the
+  /// two that LogLikelihoodZeroBased() does).  The results agree with
+  /// LogLikelihoodZeroBased() up to floating-point rounding.
+  void LogLikelihoodsZeroBased(int32 frame, const std::vector<int32> &states,
+                               std::vector<BaseFloat> *log_likes);
+
   const AmDiagGmm &acoustic_model_;
   const Matrix<BaseFloat> &feature_matrix_;
   int32 previous_frame_;
@@ -89,6 +144,25 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
   std::vector<LikelihoodCacheRecord> log_like_cache_;
  private:
   Vector<BaseFloat> data_squared_;  ///< Cache for fast likelihood calculation
+  /// Space for the per-Gaussian log-likelihoods of a pdf, so we don't
+  /// allocate it for each pdf.
+  Vector<BaseFloat> gauss_loglikes_;
+
+  // Returns the stacked parameters of the model, making them if the
+  // constructor was not given them.
+  const AmDiagGmmStackedParams &StackedParams();
+
+  /// The stacked parameters used in LogLikelihoodsZeroBased(); either given
+  /// to the constructor or equal to own_stacked_params_, which is NULL until
+  /// first used.
+  const AmDiagGmmStackedParams *stacked_params_;
+  AmDiagGmmStackedParams *own_stacked_params_;
+  /// [ data, -0.5 * data^2 ] for the frame previous_stacked_frame_.
+  Vector<BaseFloat> stacked_data_;
+  int32 previous_stacked_frame_;
+  /// Temporaries used in LogLikelihoods() and LogLikelihoodsZeroBased().
+  std::vector<int32> states_;
+  std::vector<int32> pending_states_;
 
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmUnmapped);
@@ -100,8 +174,9 @@ class DecodableAmDiagGmm: public DecodableAmDiagGmmUnmapped {
   DecodableAmDiagGmm(const AmDiagGmm &am,
                      const TransitionModel &tm,
                      const Matrix<BaseFloat> &feats,
-                     BaseFloat log_sum_exp_prune = -1.0)
-    : DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune),
+                     BaseFloat log_sum_exp_prune = -1.0,
+                     const AmDiagGmmStackedParams *stacked_params = NULL)
+    : DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune, stacked_params),
       trans_model_(tm) {}
 
   // Note, frames are numbered from zero.
@@ -109,12 +184,16 @@ class DecodableAmDiagGmm: public DecodableAmDiagGmmUnmapped {
     return LogLikelihoodZeroBased(frame,
                                   trans_model_.TransitionIdToPdf(tid));
   }
+
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &tids,
+                              std::vector<BaseFloat> *log_likes);
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
   const TransitionModel *TransModel() { return &trans_model_; }
  private: // want to access public to have pdf id information
   const TransitionModel &trans_model_;  // for tid to pdf mapping
+  std::vector<int32> pdfs_;  // temporary used in LogLikelihoods().
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmm);
 };
 
@@ -124,9 +203,10 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
                            const TransitionModel &tm,
                            const Matrix<BaseFloat> &feats,
                            BaseFloat scale,
-                           BaseFloat log_sum_exp_prune = -1.0):
-      DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune), trans_model_(tm),
-      scale_(scale), delete_feats_(NULL) {}
+                           BaseFloat log_sum_exp_prune = -1.0,
+                           const AmDiagGmmStackedParams *stacked_params = NULL):
+      DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune, stacked_params),
+      trans_model_(tm), scale_(scale), delete_feats_(NULL) {}
 
   // This version of the initializer takes ownership of the pointer
   // "feats" and will delete it when this class is destroyed.
@@ -134,8 +214,9 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
                            const TransitionModel &tm,
                            BaseFloat scale,
                            BaseFloat log_sum_exp_prune,
-                           Matrix<BaseFloat> *feats):
-      DecodableAmDiagGmmUnmapped(am, *feats, log_sum_exp_prune),
+                           Matrix<BaseFloat> *feats,
+                           const AmDiagGmmStackedParams *stacked_params = NULL):
+      DecodableAmDiagGmmUnmapped(am, *feats, log_sum_exp_prune, stacked_params),
       trans_model_(tm),  scale_(scale), delete_feats_(feats) {}
 
   // Note, frames are numbered from zero but transition-ids from one.
@@ -143,6 +224,9 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
     return scale_*LogLikelihoodZeroBased(frame,
                                          trans_model_.TransitionIdToPdf(tid));
   }
+
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &tids,
+                              std::vector<BaseFloat> *log_likes);
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
@@ -156,6 +240,7 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
   const TransitionModel &trans_model_;  // for transition-id to pdf mapping
   BaseFloat scale_;
   Matrix<BaseFloat> *delete_feats_;
+  std::vector<int32> pdfs_;  // temporary used in LogLikelihoods().
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmScaled);
 };
 
@@ -74,10 +74,13 @@ int main(int argc, char *argv[]) {
     string spk2utt_rspecifier;
     BaseFloat logdet_scale = 1.0;
     std::string norm_type = "offset";
+    int32 num_threads = 1;
     po.Register("norm-type", &norm_type, "type of fMLLR applied (\"offset\"|\"none\"|\"diag\")");
     po.Register("spk2utt", &spk2utt_rspecifier, "rspecifier for speaker to "
                 "utterance-list map");
     po.Register("logdet-scale", &logdet_scale, "Scale on log-determinant term in auxiliary function");
+    po.Register("num-threads", &num_threads, "Number of threads to use when "
+                "searching over the warp factors (LVTLN classes)");
 
     po.Read(argc, argv);
 
@@ -154,7 +157,8 @@ int main(int argc, char *argv[]) {
                                  &class_idx,
                                  NULL,
                                  &impr,
-                                 &spk_tot_t);
+                                 &spk_tot_t,
+                                 num_threads);
           class_counts[class_idx]++;
           transform_writer.Write(spk, transform);
           if (warp_wspecifier != "")
@@ -201,7 +205,8 @@ int main(int argc, char *argv[]) {
                                  &class_idx,
                                  NULL,
                                  &impr,
-                                 &utt_tot_t);
+                                 &utt_tot_t,
+                                 num_threads);
           class_counts[class_idx]++;
           transform_writer.Write(utt, transform);
           if (warp_wspecifier != "")
@@ -91,6 +91,12 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
+    // Shared by the decodables of all the threads; it is only used with
+    // --batch-likelihoods.
+    AmDiagGmmStackedParams *stacked_params = NULL;
+    if (latgen_config.batch_likelihoods)
+      stacked_params = new AmDiagGmmStackedParams(am_gmm);
+
     bool determinize = latgen_config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
     LatticeWriter lattice_writer;
@@ -144,7 +150,7 @@ int main(int argc, char *argv[]) {
               new DecodableAmDiagGmmScaled(am_gmm, trans_model,
                                            acoustic_scale,
                                            log_sum_exp_prune,
-                                           features);
+                                           features, stacked_params);
 
           DecodeUtteranceLatticeFasterClass *task =
               new DecodeUtteranceLatticeFasterClass(
@@ -186,7 +192,8 @@ int main(int argc, char *argv[]) {
         // The "decodable" object takes ownership of the features.
         DecodableAmDiagGmmScaled *gmm_decodable =
             new DecodableAmDiagGmmScaled(am_gmm, trans_model, acoustic_scale,
-                                         log_sum_exp_prune, features);
+                                         log_sum_exp_prune, features,
+                                         stacked_params);
 
         DecodeUtteranceLatticeFasterClass *task =
             new DecodeUtteranceLatticeFasterClass(
@@ -202,6 +209,7 @@ int main(int argc, char *argv[]) {
     sequencer.Wait();
 
     delete decode_fst;
+    delete stacked_params;
 
     double elapsed = timer.Elapsed();
     KALDI_LOG << "Decoded with " << sequencer_config.num_threads << " threads.";
@@ -27,6 +27,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-lazy.h"
 #include "gmm/decodable-am-diag-gmm.h"
 #include "base/timer.h"
 #include "feat/feature-functions.h"  // feature reversal
@@ -46,6 +47,7 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
+    bool lazy_likelihoods = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
 
@@ -57,6 +59,11 @@ int main(int argc, char *argv[]) {
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("lazy-likelihoods", &lazy_likelihoods,
+                "If true, cache the likelihoods of only the pdfs used on the "
+                "current frame (see DecodableLazyMapped); with "
+                "--batch-likelihoods=true, each frame's pdfs are computed "
+                "together, which uses fewer, larger matrix-vector products.");
 
     po.Read(argc, argv);
 
@@ -81,6 +88,12 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
+    // Used by the decodables' LogLikelihoods(), which is only called with
+    // --batch-likelihoods or --lazy-likelihoods.
+    AmDiagGmmStackedParams *stacked_params = NULL;
+    if (config.batch_likelihoods || lazy_likelihoods)
+      stacked_params = new AmDiagGmmStackedParams(am_gmm);
+
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
     LatticeWriter lattice_writer;
@@ -123,11 +136,19 @@ int main(int argc, char *argv[]) {
           }
 
           DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                                 acoustic_scale);
+                                                 acoustic_scale, -1.0,
+                                                 stacked_params);
+          DecodableAmDiagGmmUnmapped pdf_decodable(am_gmm, features, -1.0,
+                                                   stacked_params);
+          DecodableLazyMapped lazy_decodable(trans_model, acoustic_scale,
+                                             &pdf_decodable);
+          DecodableInterface &decodable = (lazy_likelihoods ?
+              static_cast<DecodableInterface&>(lazy_decodable) :
+              static_cast<DecodableInterface&>(gmm_decodable));
 
           double like;
           if (DecodeUtteranceLatticeFaster(
-                  decoder, gmm_decodable, trans_model, word_syms, utt,
+                  decoder, decodable, trans_model, word_syms, utt,
                   acoustic_scale, determinize, allow_partial, &alignment_writer,
                   &words_writer, &compact_lattice_writer, &lattice_writer,
                   &like)) {
@@ -158,10 +179,18 @@ int main(int argc, char *argv[]) {
 
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                               acoustic_scale);
+                                               acoustic_scale, -1.0,
+                                               stacked_params);
+        DecodableAmDiagGmmUnmapped pdf_decodable(am_gmm, features, -1.0,
+                                                 stacked_params);
+        DecodableLazyMapped lazy_decodable(trans_model, acoustic_scale,
+                                           &pdf_decodable);
+        DecodableInterface &decodable = (lazy_likelihoods ?
+            static_cast<DecodableInterface&>(lazy_decodable) :
+            static_cast<DecodableInterface&>(gmm_decodable));
         double like;
         if (DecodeUtteranceLatticeFaster(
-                decoder, gmm_decodable, trans_model, word_syms, utt,
+                decoder, decodable, trans_model, word_syms, utt,
                 acoustic_scale, determinize, allow_partial, &alignment_writer,
                 &words_writer, &compact_lattice_writer, &lattice_writer,
                 &like)) {
@@ -181,6 +210,7 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count) << " over "
               << frame_count << " frames.";
 
+    delete stacked_params;
     delete word_syms;
     if (num_done != 0) return 0;
     else return 1;
@@ -21,6 +21,7 @@
 
 #ifndef KALDI_ITF_DECODABLE_ITF_H_
 #define KALDI_ITF_DECODABLE_ITF_H_ 1
+#include <vector>
 #include "base/kaldi-common.h"
 
 namespace kaldi {
@@ -114,6 +115,21 @@ class DecodableInterface {
   /// this is for compatibility with OpenFst).
   virtual int32 NumIndices() const = 0;
 
+  /// Computes the log likelihoods of several indices on the same frame, and
+  /// puts them in "log_likes" in the same order; this is equivalent to calling
+  /// LogLikelihood() for each one, which is what the default implementation
+  /// does.  Decoders may call this once per frame with the indices of all the
+  /// arcs they are going to expand (see the --batch-likelihoods option of
+  /// LatticeFasterDecoder), so decodable objects that can compute many
+  /// likelihoods together more efficiently than one at a time should override
+  /// it.
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &indices,
+                              std::vector<BaseFloat> *log_likes) {
+    log_likes->resize(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+      (*log_likes)[i] = LogLikelihood(frame, indices[i]);
+  }
+
   virtual ~DecodableInterface() {}
 };
 /// @}
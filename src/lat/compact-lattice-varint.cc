@@ -0,0 +1,345 @@
+// lat/compact-lattice-varint.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "lat/compact-lattice-varint.h"
+
+namespace kaldi {
+
+// The format (all integers little-endian) is:
+//   magic number (4 bytes), version (1 byte), size of the rest in bytes (8
+//   bytes), then, varint-coded unless stated otherwise:
+//   flags (bit 0 set if the weights are quantized), [quantum (float, 4 bytes)
+//   if quantized], num-states, start-state + 1 (0 if there is none), and then
+//   for each state:
+//     (num-arcs << 1) | is-final, [final weight and string if final], and for
+//     each arc: (zigzag(ilabel - previous ilabel) << 1) | (olabel != ilabel),
+//     [zigzag(olabel - ilabel) if they differ], zigzag(nextstate - state),
+//     weight, string.
+//   A weight is two costs, which are floats (4 bytes each) if not quantized;
+//   if quantized, each is (zigzag(round(cost / quantum)) << 1), or 1 followed
+//   by the float if it can't be quantized.  A string is its length, followed
+//   by runs of identical transition-ids, each coded as
+//   zigzag(transition-id - previous transition-id in the string) and the
+//   length of the run minus one.
+// "zigzag" maps signed to unsigned integers so that small magnitudes of either
+// sign give small values: 0, -1, 1, -2... -> 0, 1, 2, 3...
+
+static const char kVarintLatticeMagic[4] = { '\xd7', 'K', 'V', 'L' };
+static const int32 kVarintLatticeVersion = 1;
+
+static CompactLatticeFormatOptions g_compact_lattice_write_format;
+
+void SetCompactLatticeWriteFormat(const CompactLatticeFormatOptions &opts) {
+  if (opts.weight_quantum < 0.0)
+    KALDI_ERR << "Invalid --lattice-weight-quantum " << opts.weight_quantum;
+  g_compact_lattice_write_format = opts;
+}
+
+const CompactLatticeFormatOptions &GetCompactLatticeWriteFormat() {
+  return g_compact_lattice_write_format;
+}
+
+bool PeekCompactLatticeVarint(std::istream &is) {
+  return is.peek() == static_cast<unsigned char>(kVarintLatticeMagic[0]);
+}
+
+static inline uint64 ZigZagEncode(int64 i) {
+  return (static_cast<uint64>(i) << 1) ^ static_cast<uint64>(i >> 63);
+}
+
+static inline int64 ZigZagDecode(uint64 u) {
+  return static_cast<int64>(u >> 1) ^ -static_cast<int64>(u & 1);
+}
+
+
+// Appends the varint-coded lattice to a string.
+class VarintLatticeEncoder {
+ public:
+  VarintLatticeEncoder(BaseFloat weight_quantum, std::string *buf):
+      quantum_(weight_quantum), buf_(buf) { }
+
+  void Encode(const CompactLattice &clat) {
+    typedef CompactLattice::StateId StateId;
+    PutVarint(quantum_ > 0.0 ? 1 : 0);
+    if (quantum_ > 0.0)
+      PutFloat(quantum_);
+    StateId num_states = clat.NumStates();
+    PutVarint(num_states);
+    PutVarint(clat.Start() == fst::kNoStateId ? 0 : clat.Start() + 1);
+    for (StateId s = 0; s < num_states; s++) {
+      CompactLatticeWeight final_weight = clat.Final(s);
+      bool is_final = (final_weight != CompactLatticeWeight::Zero());
+      PutVarint((static_cast<uint64>(clat.NumArcs(s)) << 1) | is_final);
+      if (is_final)
+        PutWeight(final_weight);
+      int64 prev_label = 0;
+      for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        bool is_transducer = (arc.olabel != arc.ilabel);
+        PutVarint((ZigZagEncode(arc.ilabel - prev_label) << 1) | is_transducer);
+        if (is_transducer)
+          PutVarint(ZigZagEncode(static_cast<int64>(arc.olabel) - arc.ilabel));
+        prev_label = arc.ilabel;
+        PutVarint(ZigZagEncode(static_cast<int64>(arc.nextstate) - s));
+        PutWeight(arc.weight);
+      }
+    }
+  }
+
+ private:
+  void PutVarint(uint64 i) {
+    while (i >= 128) {
+      buf_->push_back(static_cast<char>((i & 127) | 128));
+      i >>= 7;
+    }
+    buf_->push_back(static_cast<char>(i));
+  }
+
+  void PutFloat(float f) {
+    char bytes[sizeof(f)];
+    memcpy(bytes, &f, sizeof(f));
+    buf_->append(bytes, sizeof(f));
+  }
+
+  void PutCost(float cost) {
+    if (quantum_ > 0.0) {
+      double q = cost / quantum_;
+      // Beyond 2^52 the rounding would not be exact anyway.
+      if (q > -4.5e15 && q < 4.5e15) {  // false if NaN or infinite.
+        PutVarint(ZigZagEncode(static_cast<int64>(std::floor(q + 0.5))) << 1);
+        return;
+      }
+      PutVarint(1);
+    }
+    PutFloat(cost);
+  }
+
+  void PutWeight(const CompactLatticeWeight &weight) {
+    PutCost(weight.Weight().Value1());
+    PutCost(weight.Weight().Value2());
+    const std::vector<int32> &str = weight.String();
+    size_t len = str.size();
+    PutVarint(len);
+    int64 prev = 0;
+    for (size_t i = 0; i < len; ) {
+      size_t j = i + 1;
+      while (j < len && str[j] == str[i]) j++;
+      PutVarint(ZigZagEncode(str[i] - prev));
+      PutVarint(j - i - 1);
+      prev = str[i];
+      i = j;
+    }
+  }
+
+  BaseFloat quantum_;
+  std::string *buf_;
+};
+
+
+// Decodes the lattice from the data in memory.  All the Get*() functions
+// return false if they would read past the end.
+class VarintLatticeDecoder {
+ public:
+  VarintLatticeDecoder(const char *data, size_t size):
+      pos_(data), end_(data + size), quantum_(0.0) { }
+
+  // Returns NULL on error.
+  CompactLattice *Decode() {
+    uint64 flags, num_states, start;
+    if (!GetVarint(&flags) || flags > 1) return NULL;
+    if (flags == 1 && (!GetFloat(&quantum_) || !(quantum_ > 0.0)))
+      return NULL;
+    if (!GetVarint(&num_states) || !GetVarint(&start)) return NULL;
+    // Each state takes at least one byte, which stops us from allocating a
+    // huge amount of memory if the data is corrupted.
+    if (num_states > static_cast<uint64>(end_ - pos_) ||
+        num_states > static_cast<uint64>(std::numeric_limits<int32>::max()) ||
+        start > num_states)
+      return NULL;
+    CompactLattice *clat = new CompactLattice();
+    if (!DecodeStates(num_states, start, clat)) {
+      delete clat;
+      return NULL;
+    }
+    return clat;
+  }
+
+ private:
+  bool DecodeStates(int32 num_states, int32 start, CompactLattice *clat) {
+    typedef CompactLattice::StateId StateId;
+    clat->ReserveStates(num_states);
+    for (StateId s = 0; s < num_states; s++)
+      clat->AddState();
+    if (start > 0)
+      clat->SetStart(start - 1);
+    CompactLatticeArc arc;
+    for (StateId s = 0; s < num_states; s++) {
+      uint64 header;
+      if (!GetVarint(&header)) return false;
+      uint64 num_arcs = header >> 1;
+      // Each arc takes at least 4 bytes.
+      if (num_arcs > static_cast<uint64>(end_ - pos_) / 4) return false;
+      if ((header & 1) != 0) {
+        CompactLatticeWeight final_weight;
+        if (!GetWeight(&final_weight)) return false;
+        clat->SetFinal(s, final_weight);
+      }
+      clat->ReserveArcs(s, num_arcs);
+      int64 prev_label = 0;
+      for (uint64 a = 0; a < num_arcs; a++) {
+        uint64 label_code, olabel_code, nextstate_code;
+        if (!GetVarint(&label_code)) return false;
+        int64 ilabel = prev_label + ZigZagDecode(label_code >> 1),
+            olabel = ilabel;
+        if ((label_code & 1) != 0) {
+          if (!GetVarint(&olabel_code)) return false;
+          olabel = ilabel + ZigZagDecode(olabel_code);
+        }
+        prev_label = ilabel;
+        if (!GetVarint(&nextstate_code)) return false;
+        int64 nextstate = s + ZigZagDecode(nextstate_code);
+        if (nextstate < 0 || nextstate >= num_states) return false;
+        arc.ilabel = ilabel;
+        arc.olabel = olabel;
+        arc.nextstate = nextstate;
+        if (!GetWeight(&arc.weight)) return false;
+        clat->AddArc(s, arc);
+      }
+    }
+    return pos_ == end_;
+  }
+
+  bool GetVarint(uint64 *i) {
+    uint64 ans = 0;
+    for (int32 shift = 0; shift < 64; shift += 7) {
+      if (pos_ == end_) return false;
+      unsigned char c = static_cast<unsigned char>(*(pos_++));
+      ans |= static_cast<uint64>(c & 127) << shift;
+      if (c < 128) {
+        *i = ans;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool GetFloat(float *f) {
+    if (end_ - pos_ < static_cast<ptrdiff_t>(sizeof(*f))) return false;
+    memcpy(f, pos_, sizeof(*f));
+    pos_ += sizeof(*f);
+    return true;
+  }
+
+  bool GetCost(float *cost) {
+    if (quantum_ > 0.0) {
+      uint64 code;
+      if (!GetVarint(&code)) return false;
+      if ((code & 1) == 0) {
+        *cost = ZigZagDecode(code >> 1) * static_cast<double>(quantum_);
+        return true;
+      }
+    }
+    return GetFloat(cost);
+  }
+
+  bool GetWeight(CompactLatticeWeight *weight) {
+    float value1, value2;
+    uint64 len;
+    if (!GetCost(&value1) || !GetCost(&value2) || !GetVarint(&len))
+      return false;
+    std::vector<int32> str;
+    int64 prev = 0;
+    while (str.size() < len) {
+      uint64 tid_code, run_length;
+      if (!GetVarint(&tid_code) || !GetVarint(&run_length) ||
+          run_length >= len - str.size())
+        return false;
+      prev += ZigZagDecode(tid_code);
+      str.insert(str.end(), run_length + 1, static_cast<int32>(prev));
+    }
+    *weight = CompactLatticeWeight(LatticeWeight(value1, value2), str);
+    return true;
+  }
+
+  const char *pos_;
+  const char *end_;
+  float quantum_;
+};
+
+
+bool WriteCompactLatticeVarint(std::ostream &os, const CompactLattice &clat,
+                               BaseFloat weight_quantum) {
+  KALDI_ASSERT(weight_quantum >= 0.0);
+  std::string buf;
+  VarintLatticeEncoder encoder(weight_quantum, &buf);
+  encoder.Encode(clat);
+  os.write(kVarintLatticeMagic, sizeof(kVarintLatticeMagic));
+  os.put(static_cast<char>(kVarintLatticeVersion));
+  uint64 size = buf.size();
+  os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  os.write(buf.data(), buf.size());
+  if (os.fail())
+    KALDI_WARN << "Stream failure detected writing compact lattice.";
+  return os.good();
+}
+
+bool ReadCompactLatticeVarint(std::istream &is, CompactLattice **clat) {
+  KALDI_ASSERT(*clat == NULL);
+  char magic[sizeof(kVarintLatticeMagic)];
+  is.read(magic, sizeof(magic));
+  if (!is.good() || memcmp(magic, kVarintLatticeMagic, sizeof(magic)) != 0) {
+    KALDI_WARN << "Reading compact lattice: bad magic number for varint "
+               << "format.";
+    return false;
+  }
+  int version = is.get();
+  if (version != kVarintLatticeVersion) {
+    KALDI_WARN << "Reading compact lattice: unsupported version " << version
+               << " of the varint format (this code reads version "
+               << kVarintLatticeVersion << ")";
+    return false;
+  }
+  uint64 size;
+  is.read(reinterpret_cast<char*>(&size), sizeof(size));
+  if (!is.good() || size > (static_cast<uint64>(1) << 40)) {
+    KALDI_WARN << "Reading compact lattice: error reading size.";
+    return false;
+  }
+  std::vector<char> buf(size);
+  if (size > 0) is.read(&(buf[0]), size);
+  if (static_cast<uint64>(is.gcount()) != size || is.fail()) {
+    KALDI_WARN << "Reading compact lattice: unexpected end of stream.";
+    return false;
+  }
+  VarintLatticeDecoder decoder(size > 0 ? &(buf[0]) : NULL, size);
+  *clat = decoder.Decode();
+  if (*clat == NULL) {
+    KALDI_WARN << "Reading compact lattice: data in varint format is "
+               << "corrupted.";
+    return false;
+  }
+  return true;
+}
+
+
+}  // namespace kaldi
@@ -0,0 +1,103 @@
+// lat/compact-lattice-varint.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_COMPACT_LATTICE_VARINT_H_
+#define KALDI_LAT_COMPACT_LATTICE_VARINT_H_
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/*
+  This file implements a compact binary format for CompactLattice, as an
+  alternative to the OpenFst format that WriteCompactLattice() writes in binary
+  mode.  The OpenFst format stores each arc as fixed-size int32 labels and
+  next-state, two floats and the whole transition-id string as int32s; here
+  the labels and next-states are stored as deltas (from the previous arc's
+  label and from the source state respectively) coded as variable-length
+  integers ("varints", 7 bits per byte), the transition-id strings are
+  run-length coded (the same transition-id usually repeats for several frames
+  because of self-loops) with varint deltas, and the weights are optionally
+  quantized to multiples of a fixed step and varint coded.  This typically
+  makes lattices several times smaller.  Decoding is also faster than reading
+  the OpenFst format because the whole lattice is read into memory in one go
+  and decoded from there, with the states and arcs reserved in advance.
+
+  The format starts with a magic number that can't be confused with the start
+  of an OpenFst-format lattice or a text-mode one, followed by a version
+  number, so ReadCompactLattice(), ReadLattice() and the table holders read
+  either format transparently.  Lattices are only written in this format if
+  you ask for it, via SetCompactLatticeWriteFormat() (normally from the
+  --write-varint-lattices option of programs that register
+  CompactLatticeFormatOptions); old programs can't read it.
+*/
+
+
+/// Options that say how CompactLatticeHolder (and hence CompactLatticeWriter)
+/// writes lattices in binary mode; see SetCompactLatticeWriteFormat().
+struct CompactLatticeFormatOptions {
+  bool varint;
+  BaseFloat weight_quantum;
+
+  CompactLatticeFormatOptions(): varint(false), weight_quantum(0.0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("write-varint-lattices", &varint, "If true, write "
+                   "lattices in binary mode in the compact varint-coded "
+                   "format (see lat/compact-lattice-varint.h) rather than the "
+                   "OpenFst format.  Kaldi programs read either format.");
+    opts->Register("lattice-weight-quantum", &weight_quantum, "With "
+                   "--write-varint-lattices, if >0 the lattice weights "
+                   "(graph and acoustic costs) are rounded to multiples of this "
+                   "value, which makes the lattices smaller; e.g. 0.001.");
+  }
+};
+
+/// Sets the format in which CompactLatticeHolder writes lattices in binary
+/// mode, for the whole program; the default is the OpenFst format.  Call this
+/// once, after reading the options and before writing any lattices.  Note:
+/// this only affects the table holder, not WriteCompactLattice(), which other
+/// objects use to write lattices inside themselves.
+void SetCompactLatticeWriteFormat(const CompactLatticeFormatOptions &opts);
+
+/// Returns the format set by SetCompactLatticeWriteFormat().
+const CompactLatticeFormatOptions &GetCompactLatticeWriteFormat();
+
+/// Writes the lattice in the varint-coded format.  If weight_quantum > 0, the
+/// costs are rounded to multiples of it (costs that are too large to be
+/// represented that way, or are not finite, are written exactly).  Returns
+/// false on stream failure.
+bool WriteCompactLatticeVarint(std::ostream &os, const CompactLattice &clat,
+                               BaseFloat weight_quantum = 0.0);
+
+/// Reads a lattice written by WriteCompactLatticeVarint(); requires *clat to
+/// be NULL.  Returns false (with a warning) on error.
+bool ReadCompactLatticeVarint(std::istream &is, CompactLattice **clat);
+
+/// Returns true if the next character in the stream is the first character of
+/// the varint lattice format's magic number.  (It is not the first character
+/// of the OpenFst magic number, and is not space).
+bool PeekCompactLatticeVarint(std::istream &is);
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_COMPACT_LATTICE_VARINT_H_
@@ -187,7 +187,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   LatticeDeterminizerPruned(const ExpandedFst<Arc> &ifst,
                             double beam,
                             DeterminizeLatticePrunedOptions opts):
-      num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
+      num_arcs_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
       equal_(opts_.delta), determinized_(false),
       minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
@@ -209,20 +209,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       ifst_ = NULL;
     }
     { MinimalSubsetHash tmp; tmp.swap(minimal_hash_); }
-
-    for (size_t i = 0; i < output_states_.size(); i++) {
-      vector<Element> empty_subset;
-      empty_subset.swap(output_states_[i]->minimal_subset);
-    }
-
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter)
-      delete iter->first;
     { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
-    for (size_t i = 0; i < output_states_.size(); i++) {
-      vector<Element> tmp;
-      tmp.swap(output_states_[i]->minimal_subset);
-    }
+    // This frees the minimal_subset of the output states, as well as the keys
+    // of the hashes.
+    for (size_t i = 0; i < output_states_.size(); i++)
+      output_states_[i]->minimal_subset.size = 0;
+    subset_arena_.Clear();
     { vector<char> tmp;  tmp.swap(isymbol_or_final_); }
     { // Free up the queue.  I'm not sure how to make sure all
       // the memory is really freed (no swap() function)... doesn't really
@@ -271,9 +263,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     for (typename InitialSubsetHash::const_iterator
              iter = initial_hash_.begin();
          iter != initial_hash_.end(); ++iter) {
-      const vector<Element> &vec = *(iter->first);
       Element elem = iter->second;
-      AddStrings(vec, &needed_strings);
+      AddStrings(iter->first, &needed_strings);
       needed_strings.push_back(elem.string);
     }
     std::sort(needed_strings.begin(), needed_strings.end());
@@ -286,21 +277,23 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   }
 
   bool CheckMemoryUsage() {
-    int32 repo_size = repository_.MemSize(),
-        arcs_size = num_arcs_ * sizeof(TempArc),
-        elems_size = num_elems_ * sizeof(Element),
+    // These are computed in 64 bits, as they can be more than 2^31 for large
+    // lattices.
+    int64 repo_size = repository_.MemSize(),
+        arcs_size = static_cast<int64>(num_arcs_) * sizeof(TempArc),
+        elems_size = subset_arena_.MemSize(),
         total_size = repo_size + arcs_size + elems_size;
     if (opts_.max_mem > 0 && total_size > opts_.max_mem) { // We passed the memory threshold.
       // This is usually due to the repository getting large, so we
       // clean this out.
       RebuildRepository();
-      int32 new_repo_size = repository_.MemSize(),
+      int64 new_repo_size = repository_.MemSize(),
           new_total_size = new_repo_size + arcs_size + elems_size;
 
       KALDI_VLOG(2) << "Rebuilt repository in determinize-lattice: repository shrank from "
                     << repo_size << " to " << new_repo_size << " bytes (approximately)";
 
-      if (new_total_size > static_cast<int32>(opts_.max_mem * 0.8)) {
+      if (new_total_size > static_cast<int64>(opts_.max_mem * 0.8)) {
         // Rebuilding didn't help enough-- we need a margin to stop
         // having to rebuild too often.  We'll just return to the user at
         // this point, with a partial lattice that's pruned tighter than
@@ -416,74 +409,16 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     Weight weight;
   };
 
-  // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
-  // The Elements are in sorted order on state id, and without repeated states.
-  // Because the order of Elements is fixed, we can use a hashing function that is
-  // order-dependent.  However the weights are not included in the hashing function--
-  // we hash subsets that differ only in weight to the same key.  This is not optimal
-  // in terms of the O(N) performance but typically if we have a lot of determinized
-  // states that differ only in weight then the input probably was pathological in some way,
-  // or even non-determinizable.
-  //   We don't quantize the weights, in order to avoid inexactness in simple cases.
-  // Instead we apply the delta when comparing subsets for equality, and allow a small
-  // difference.
-
-  class SubsetKey {
-   public:
-    size_t operator ()(const vector<Element> * subset) const {  // hashes only the state and string.
-      size_t hash = 0, factor = 1;
-      for (typename vector<Element>::const_iterator iter= subset->begin(); iter != subset->end(); ++iter) {
-        hash *= factor;
-        hash += iter->state + reinterpret_cast<size_t>(iter->string);
-        factor *= 23531;  // these numbers are primes.
-      }
-      return hash;
-    }
-  };
-
-  // This is the equality operator on subsets.  It checks for exact match on state-id
-  // and string, and approximate match on weights.
-  class SubsetEqual {
-   public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
-      for (; iter1 < iter1_end; ++iter1, ++iter2) {
-        if (iter1->state != iter2->state ||
-           iter1->string != iter2->string ||
-            ! ApproxEqual(iter1->weight, iter2->weight, delta_)) return false;
-      }
-      return true;
-    }
-    float delta_;
-    SubsetEqual(float delta): delta_(delta) {}
-    SubsetEqual(): delta_(kDelta) {}
-  };
-
-  // Operator that says whether two Elements have the same states.
-  // Used only for debug.
-  class SubsetEqualStates {
-   public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
-      for (; iter1 < iter1_end; ++iter1, ++iter2) {
-        if (iter1->state != iter2->state) return false;
-      }
-      return true;
-    }
-  };
+  // The subsets of states that are the keys of the hashes are stored in
+  // subset_arena_; see LatticeSubsetArena for the hash and equality functions.
+  typedef LatticeSubsetArena<Element> SubsetArena;
+  typedef typename SubsetArena::Subset Subset;
+  typedef typename SubsetArena::SubsetKey SubsetKey;
+  typedef typename SubsetArena::SubsetEqual SubsetEqual;
 
   // Define the hash type we use to map subsets (in minimal
   // representation) to OutputStateId.
-  typedef unordered_map<const vector<Element>*, OutputStateId,
+  typedef unordered_map<Subset, OutputStateId,
                         SubsetKey, SubsetEqual> MinimalSubsetHash;
 
   // Define the hash type we use to map subsets (in initial
@@ -491,7 +426,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // extra weight. [note: we interpret the Element.state in here
   // as an OutputStateId even though it's declared as InputStateId;
   // these types are the same anyway].
-  typedef unordered_map<const vector<Element>*, Element,
+  typedef unordered_map<Subset, Element,
                         SubsetKey, SubsetEqual> InitialSubsetHash;
 
 
@@ -519,8 +454,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // transitions.
   OutputStateId MinimalToStateId(const vector<Element> &subset,
                                  const double forward_cost) {
+    Subset key = SubsetArena::Wrap(subset);
     typename MinimalSubsetHash::const_iterator iter
-        = minimal_hash_.find(&subset);
+        = minimal_hash_.find(key);
     if (iter != minimal_hash_.end()) { // Found a matching subset.
       OutputStateId state_id = iter->second;
       const OutputState &state = *(output_states_[state_id]);
@@ -534,10 +470,10 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       return state_id;
     }
     OutputStateId state_id = static_cast<OutputStateId>(output_states_.size());
-    OutputState *new_state = new OutputState(subset, forward_cost);
-    minimal_hash_[&(new_state->minimal_subset)] = state_id;
+    OutputState *new_state = new OutputState(subset_arena_.Copy(key),
+                                             forward_cost);
+    minimal_hash_[new_state->minimal_subset] = state_id;
     output_states_.push_back(new_state);
-    num_elems_ += subset.size();
     // Note: in the previous algorithm, we pushed the new state-id onto the queue
     // at this point.  Here, the queue happens elsewhere, and we directly process
     // the state (which result in stuff getting added to the queue).
@@ -553,8 +489,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                  double forward_cost,
                                  Weight *remaining_weight,
                                  StringId *common_prefix) {
+    Subset key = SubsetArena::Wrap(subset_in);
     typename InitialSubsetHash::const_iterator iter
-        = initial_hash_.find(&subset_in);
+        = initial_hash_.find(key);
     if (iter != initial_hash_.end()) { // Found a matching subset.
       const Element &elem = iter->second;
       *remaining_weight = elem.weight;
@@ -588,10 +525,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Before returning "ans", add the initial subset to the hash,
     // so that we can bypass the epsilon-closure etc., next time
     // we process the same initial subset.
-    vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
     elem.state = ans;
-    initial_hash_[initial_subset_ptr] = elem;
-    num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
+    initial_hash_[subset_arena_.Copy(key)] = elem;
     return ans;
   }
 
@@ -732,7 +667,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   void ProcessFinal(OutputStateId output_state_id) {
     OutputState &state = *(output_states_[output_state_id]);
-    const vector<Element> &minimal_subset = state.minimal_subset;
+    Subset minimal_subset = state.minimal_subset;
     // processes final-weights for this subset.  state.minimal_subset_ may be
     // empty if the graphs is not connected/trimmed, I think, do don't check
     // that it's nonempty.
@@ -740,7 +675,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // compiler happy; if it doesn't get set in the loop, we won't use the value anyway.
     Weight final_weight = Weight::Zero();
     bool is_final = false;
-    typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+    const Element *iter = minimal_subset.begin(), *end = minimal_subset.end();
     for (; iter != end; ++iter) {
       const Element &elem = *iter;
       Weight this_final_weight = Times(elem.weight, ifst_->Final(elem.state));
@@ -900,7 +835,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // the information we need to process the transition.
 
   void ProcessTransitions(OutputStateId output_state_id) {
-    const vector<Element> &minimal_subset = output_states_[output_state_id]->minimal_subset;
+    Subset minimal_subset = output_states_[output_state_id]->minimal_subset;
     // it's possible that minimal_subset could be empty if there are
     // unreachable parts of the graph, so don't check that it's nonempty.
     vector<pair<Label, Element> > &all_elems(all_elems_tmp_); // use class member
@@ -908,7 +843,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     {
       // Push back into "all_elems", elements corresponding to all
       // non-epsilon-input transitions out of all states in "minimal_subset".
-      typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+      const Element *iter = minimal_subset.begin(), *end = minimal_subset.end();
       for (;iter != end; ++iter) {
         const Element &elem = *iter;
         for (ArcIterator<ExpandedFst<Arc> > aiter(*ifst_, elem.state); ! aiter.Done(); aiter.Next()) {
@@ -1077,12 +1012,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       // Weight::One() is the "forward-weight" of this determinized state...
       // i.e. the minimal cost from the start of the determinized FST to this
       // state [One() because it's the start state].
-      OutputState *initial_state = new OutputState(subset, 0);
+      OutputState *initial_state = new OutputState(
+          subset_arena_.Copy(SubsetArena::Wrap(subset)), 0);
       KALDI_ASSERT(output_states_.empty());
       output_states_.push_back(initial_state);
-      num_elems_ += subset.size();
       OutputStateId initial_state_id = 0;
-      minimal_hash_[&(initial_state->minimal_subset)] = initial_state_id;
+      minimal_hash_[initial_state->minimal_subset] = initial_state_id;
       ProcessFinal(initial_state_id);
       ProcessTransitions(initial_state_id); // this will add tasks to
       // the queue, which we'll start processing in Determinize().
@@ -1092,7 +1027,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeDeterminizerPruned);
 
   struct OutputState {
-    vector<Element> minimal_subset;
+    Subset minimal_subset;  // The elements are in subset_arena_.
     vector<TempArc> arcs; // arcs out of the state-- those that have been processed.
     // Note: the final-weight is included here with kNoStateId as the state id.  We
     // always process the final-weight regardless of the beam; when producing the
@@ -1102,7 +1037,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Note: we know this minimal cost from when we first create the OutputState;
     // this is because of the priority-queue we use, that ensures that the
     // "best" path into the state will be expanded first.
-    OutputState(const vector<Element> &minimal_subset,
+    OutputState(const Subset &minimal_subset,
                 double forward_cost): minimal_subset(minimal_subset),
                                       forward_cost(forward_cost) { }
   };
@@ -1110,8 +1045,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   vector<OutputState*> output_states_; // All the info about the output states.
 
   int num_arcs_; // keep track of memory usage: number of arcs in output_states_[ ]->arcs
-  int num_elems_; // keep track of memory usage: number of elems in output_states_ and
-  // the keys of initial_hash_
+  SubsetArena subset_arena_;  // Stores the elements of the minimal subsets of
+                              // output_states_ and the keys of initial_hash_.
 
   const ExpandedFst<Arc> *ifst_;
   std::vector<double> backward_costs_; // This vector stores, for every state in ifst_,
@@ -1130,8 +1065,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // sure this object is used correctly.
   MinimalSubsetHash minimal_hash_;  // hash from Subset to OutputStateId.  Subset is "minimal
                                     // representation" (only include final and states and states with
-                                    // nonzero ilabel on arc out of them.  Owns the pointers
-                                    // in its keys.
+                                    // nonzero ilabel on arc out of them.
   InitialSubsetHash initial_hash_;   // hash from Subset to Element, which
                                      // represents the OutputStateId together
                                      // with an extra weight and string.  Subset
@@ -1139,8 +1073,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                      // weight and string is needed because after
                                      // we convert to minimal representation and
                                      // normalize, there may be an extra weight
-                                     // and string.  Owns the pointers
-                                     // in its keys.
+                                     // and string.
 
   struct Task {
     OutputStateId state; // State from which we're processing the transition.
@@ -1182,6 +1115,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
          iter != vec.end(); ++iter)
       needed_strings->push_back(iter->string);
   }
+
+  void AddStrings(const Subset &subset,
+                  vector<StringId> *needed_strings) {
+    for (const Element *iter = subset.begin(); iter != subset.end(); ++iter)
+      needed_strings->push_back(iter->string);
+  }
 };
 
 
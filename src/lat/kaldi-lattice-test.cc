@@ -19,6 +19,7 @@
 
 
 #include "lat/kaldi-lattice.h"
+#include "lat/compact-lattice-varint.h"
 #include "fstext/rand-fst.h"
 
 
@@ -156,6 +157,48 @@ void TestLatticeTableCross(bool binary) {
 
 
 
+// Write in the varint format, read as CompactLattice and as Lattice.
+void TestCompactLatticeTableVarint(BaseFloat weight_quantum) {
+  CompactLatticeFormatOptions format_opts;
+  format_opts.varint = true;
+  format_opts.weight_quantum = weight_quantum;
+  SetCompactLatticeWriteFormat(format_opts);
+  CompactLatticeWriter writer("ark:tmpf");
+  int N = 10;
+  std::vector<CompactLattice*> lat_vec(N);
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    CompactLattice *fst = RandCompactLattice();
+    lat_vec[i] = fst;
+    writer.Write(key, *fst);
+  }
+  writer.Close();
+  SetCompactLatticeWriteFormat(CompactLatticeFormatOptions());
+
+  RandomAccessCompactLatticeReader reader("ark:tmpf");
+  RandomAccessLatticeReader lat_reader("ark:tmpf");
+  for (int i = 0; i < N; i++) {
+    char buf[2];
+    buf[0] = '0' + i;
+    buf[1] = '\0';
+    std::string key = "key" + std::string(buf);
+    const CompactLattice &fst = reader.Value(key);
+    CompactLattice fst2;
+    ConvertLattice(lat_reader.Value(key), &fst2);
+    if (weight_quantum == 0.0) {
+      KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i])));
+    } else {
+      KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i]), weight_quantum));
+    }
+    KALDI_ASSERT(fst::Equal(fst, fst2));
+    delete lat_vec[i];
+  }
+}
+
+
 } // end namespace kaldi
 
 int main() {
@@ -167,6 +210,8 @@ int main() {
     TestLatticeTable(binary);
     TestLatticeTableCross(binary);
   }
+  TestCompactLatticeTableVarint(0.0);
+  TestCompactLatticeTableVarint(0.01);
   std::cout << "Test OK\n";
   
   unlink("tmpf");
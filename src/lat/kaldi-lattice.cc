@@ -20,6 +20,7 @@
 
 
 #include "lat/kaldi-lattice.h"
+#include "lat/compact-lattice-varint.h"
 #include "fst/script/print-impl.h"
 
 namespace kaldi {
@@ -304,7 +305,9 @@ Lattice *ReadLatticeText(std::istream &is) {
 bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat) {
   KALDI_ASSERT(*clat == NULL);
-  if (binary) {
+  if (binary && PeekCompactLatticeVarint(is)) {
+    return ReadCompactLatticeVarint(is, clat);
+  } else if (binary) {
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading compact lattice: error reading FST header.";
@@ -363,6 +366,14 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 }
 
 
+bool CompactLatticeHolder::Write(std::ostream &os, bool binary,
+                                 const CompactLattice &t) {
+  const CompactLatticeFormatOptions &format = GetCompactLatticeWriteFormat();
+  if (binary && format.varint)
+    return WriteCompactLatticeVarint(os, t, format.weight_quantum);
+  return WriteCompactLattice(os, binary, t);
+}
+
 bool CompactLatticeHolder::Read(std::istream &is) {
   Clear(); // in case anything currently stored.
   int c = is.peek();
@@ -374,6 +385,8 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
+  } else if (PeekCompactLatticeVarint(is)) {
+    return ReadCompactLatticeVarint(is, &t_);
   } else if (c != 214) { // 214 is first char of FST magic number,
     // on little-endian machines which is all we support (\326 octal)
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
@@ -417,7 +430,13 @@ bool WriteLattice(std::ostream &os, bool binary, const Lattice &t) {
 bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat) {
   KALDI_ASSERT(*lat == NULL);
-  if (binary) {
+  if (binary && PeekCompactLatticeVarint(is)) {
+    CompactLattice *clat = NULL;
+    if (!ReadCompactLatticeVarint(is, &clat))
+      return false;
+    *lat = ConvertToLattice(clat);
+    return true;
+  } else if (binary) {
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading lattice: error reading FST header.";
@@ -490,6 +509,8 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
+  } else if (PeekCompactLatticeVarint(is)) {
+    return ReadLattice(is, true, &t_);
   } else if (c != 214) { // 214 is first char of FST magic number,
     // on little-endian machines which is all we support (\326 octal)
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
@@ -57,7 +57,8 @@ bool WriteLattice(std::ostream &os, bool binary,
                   const Lattice &lat);
 
 // the following function requires that *clat be
-// NULL when called.
+// NULL when called.  In binary mode it reads either the OpenFst format or the
+// varint format of compact-lattice-varint.h; ReadLattice() does the same.
 bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat);
 // the following function requires that *lat be
@@ -72,12 +73,11 @@ class CompactLatticeHolder {
 
   CompactLatticeHolder() { t_ = NULL; }
 
-  static bool Write(std::ostream &os, bool binary, const T &t) {
-    // Note: we don't include the binary-mode header when writing
-    // this object to disk; this ensures that if we write to single
-    // files, the result can be read by OpenFst.
-    return WriteCompactLattice(os, binary, t);
-  }
+  // Note: we don't include the binary-mode header when writing this object to
+  // disk; this ensures that if we write to single files, the result can be
+  // read by OpenFst (unless the varint format was selected by
+  // SetCompactLatticeWriteFormat(), see compact-lattice-varint.h).
+  static bool Write(std::ostream &os, bool binary, const T &t);
 
   bool Read(std::istream &is);
 
@@ -23,6 +23,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/compact-lattice-varint.h"
 
 namespace kaldi {
   int32 CopySubsetLattices(std::string filename,
@@ -147,6 +148,7 @@ int main(int argc, char *argv[]) {
         "Only one of --include and --exclude can be supplied.\n"
         "Usage: lattice-copy [options] lattice-rspecifier lattice-wspecifier\n"
         " e.g.: lattice-copy --write-compact=false ark:1.lats ark,t:text.lats\n"
+        "  or:  lattice-copy --write-varint-lattices=true ark:1.lats ark:1.vlats\n"
         "See also: lattice-scale, lattice-to-fst, and\n"
         "   the script egs/wsj/s5/utils/convert_slf.pl\n";
 
@@ -154,6 +156,7 @@ int main(int argc, char *argv[]) {
     bool write_compact = true, ignore_missing = false;
     std::string include_rxfilename;
     std::string exclude_rxfilename;
+    CompactLatticeFormatOptions format_opts;
 
     po.Register("write-compact", &write_compact, "If true, write in normal (compact) form.");
     po.Register("include", &include_rxfilename,
@@ -166,6 +169,7 @@ int main(int argc, char *argv[]) {
                 "whose lattices will be excluded");
     po.Register("ignore-missing", &ignore_missing,
                 "Exit with status 0 even if no lattices are copied");
+    format_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -183,6 +187,10 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0;
 
+    if (format_opts.varint && !write_compact)
+      KALDI_ERR << "--write-varint-lattices requires --write-compact=true";
+    SetCompactLatticeWriteFormat(format_opts);
+
     if (write_compact) {
       SequentialCompactLatticeReader lattice_reader(lats_rspecifier);
       CompactLatticeWriter lattice_writer(lats_wspecifier);
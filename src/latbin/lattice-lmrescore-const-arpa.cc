@@ -24,6 +24,75 @@
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; the lattices are processed in parallel by
+// TaskSequencer, all sharing the (read-only) ConstArpaLm, and written in order
+// by the destructor.
+class ConstArpaRescoreTask {
+ public:
+  // Takes ownership of "clat".
+  ConstArpaRescoreTask(const ConstArpaLm &const_arpa, BaseFloat lm_scale,
+                       const std::string &key, CompactLattice *clat,
+                       CompactLatticeWriter *clat_writer,
+                       int32 *num_done, int32 *num_fail):
+      const_arpa_(const_arpa), lm_scale_(lm_scale), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_fail_(num_fail) { }
+
+  void operator () () {
+    if (lm_scale_ == 0.0)  // Zero scale so nothing to do.
+      return;
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale_), clat_);
+    ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Wraps the ConstArpaLm format language model into FST.  We create it for
+    // each lattice to prevent memory usage increasing with time; it only holds
+    // the LM states seen in this lattice, so each thread has its own.
+    ConstArpaLmDeterministicFst const_arpa_fst(const_arpa_);
+
+    // Composes lattice with language model.
+    CompactLattice composed_clat;
+    ComposeCompactLatticeDeterministic(*clat_,
+                                       &const_arpa_fst, &composed_clat);
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), clat_);
+  }
+
+  ~ConstArpaRescoreTask() {
+    if (lm_scale_ != 0.0 && clat_->Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, *clat_);
+      (*num_done_)++;
+    }
+    delete clat_;
+  }
+
+ private:
+  const ConstArpaLm &const_arpa_;
+  BaseFloat lm_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The input, and then the output.  Owned here.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -41,13 +110,17 @@ int main(int argc, char *argv[]) {
         "Usage: lattice-lmrescore-const-arpa [options] lattice-rspecifier \\\n"
         "                                   const-arpa-in lattice-wspecifier\n"
         " e.g.: lattice-lmrescore-const-arpa --lm-scale=-1.0 ark:in.lats \\\n"
-        "                                   const_arpa ark:out.lats\n";
+        "                                   const_arpa ark:out.lats\n"
+        "With --num-threads > 1, lattices are rescored in parallel, sharing\n"
+        "one copy of the LM; the output order is unchanged.\n";
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -68,51 +141,19 @@ int main(int argc, char *argv[]) {
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
+    TaskSequencer<ConstArpaRescoreTask> sequencer(sequencer_config);
+
     int32 n_done = 0, n_fail = 0;
     for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
+      // Will give ownership to the task below.
+      CompactLattice *clat = new CompactLattice(compact_lattice_reader.Value());
       compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
-          n_done++;
-        }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
-      }
+      sequencer.Run(new ConstArpaRescoreTask(const_arpa, lm_scale, key, clat,
+                                             &compact_lattice_writer,
+                                             &n_done, &n_fail));
     }
+    sequencer.Wait();
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
@@ -28,6 +28,102 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; the lattices are processed in parallel by
+// TaskSequencer and written in order by the destructor.  All the tasks share
+// the RNNLM (via the read-only RnnlmComputeStateInfo) and the old LM, but each
+// has its own KaldiRnnlmDeterministicFst (and ConstArpaLmDeterministicFst, for
+// a const-arpa old LM), since those cache the LM states they have seen.
+class RnnlmRescorePrunedTask {
+ public:
+  // Takes ownership of "clat".  If "lm_to_subtract" is NULL, the old LM is
+  // "const_arpa", scaled by -lm_scale.
+  RnnlmRescorePrunedTask(
+      const ComposeLatticePrunedOptions &compose_opts,
+      const rnnlm::RnnlmComputeStateInfo &info, int32 max_ngram_order,
+      BaseFloat acoustic_scale, BaseFloat lm_scale,
+      fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+      const ConstArpaLm *const_arpa,
+      const std::string &key, CompactLattice *clat,
+      CompactLatticeWriter *clat_writer, int32 *num_done, int32 *num_err):
+      compose_opts_(compose_opts), info_(info),
+      max_ngram_order_(max_ngram_order), acoustic_scale_(acoustic_scale),
+      lm_scale_(lm_scale), lm_to_subtract_(lm_to_subtract),
+      const_arpa_(const_arpa), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    ConstArpaLmDeterministicFst *carpa_lm_to_subtract_fst = NULL;
+    fst::ScaleDeterministicOnDemandFst *carpa_lm_to_subtract_scale = NULL;
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract =
+        lm_to_subtract_;
+    if (lm_to_subtract == NULL) {
+      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa_);
+      lm_to_subtract = carpa_lm_to_subtract_scale =
+          new fst::ScaleDeterministicOnDemandFst(-lm_scale_,
+                                                 carpa_lm_to_subtract_fst);
+    }
+    rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order_, info_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, &lm_to_add_orig);
+
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        lm_to_subtract, &lm_to_add);
+
+    // Composes lattice with language model.
+    ComposeCompactLatticePruned(compose_opts_, *clat_,
+                                &combined_lms, &composed_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    delete carpa_lm_to_subtract_scale;
+    delete carpa_lm_to_subtract_fst;
+
+    if (acoustic_scale_ != 1.0 && composed_clat_.NumStates() != 0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~RnnlmRescorePrunedTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  int32 max_ngram_order_;
+  BaseFloat acoustic_scale_;
+  BaseFloat lm_scale_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_;
+  const ConstArpaLm *const_arpa_;
+  std::string key_;
+  CompactLattice *clat_;  // The lattice we're working on.  Owned locally.
+  CompactLattice composed_clat_;  // The output of our process.  Will be
+                                  // written to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -55,7 +151,9 @@ int main(int argc, char *argv[]) {
         "       lattice-lmrescore-kaldi-rnnlm-pruned --lm-scale=-1.0 fst_words.txt \\\n"
         "              --bos-symbol=1 --eos-symbol=2 \\\n"
         "              data/lang_test_fg/G.carpa word_embedding.mat \\\n"
-        "              final.raw ark:in.lats ark:out.lats\n";
+        "              final.raw ark:in.lats ark:out.lats\n"
+        "With --num-threads > 1, lattices are rescored in parallel, sharing one\n"
+        "copy of the RNNLM and of the old LM; the output order is unchanged.\n";
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
@@ -65,6 +163,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -80,6 +179,7 @@ int main(int argc, char *argv[]) {
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -101,23 +201,19 @@ int main(int argc, char *argv[]) {
     lats_rspecifier = po.GetArg(4);
     lats_wspecifier = po.GetArg(5);
 
-    // for G.fst
+    // for G.fst; for G.carpa, lm_to_subtract_det_scale stays NULL and each
+    // task creates its own (see RnnlmRescorePrunedTask).
     fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
     fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
 
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
       ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
@@ -142,62 +238,30 @@ int main(int argc, char *argv[]) {
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
-    int32 num_done = 0, num_err = 0;
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
+    TaskSequencer<RnnlmRescorePrunedTask> sequencer(sequencer_config);
 
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
+    int32 num_done = 0, num_err = 0;
 
+    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
+      // Will give ownership to the task below.
+      CompactLattice *clat = new CompactLattice(compact_lattice_reader.Value());
       compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
-      }
-      delete lm_to_add;
+      sequencer.Run(new RnnlmRescorePrunedTask(
+          compose_opts, info, max_ngram_order, acoustic_scale, lm_scale,
+          lm_to_subtract_det_scale, const_arpa, key, clat,
+          &compact_lattice_writer, &num_done, &num_err));
     }
+    sequencer.Wait();
 
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
     delete lm_to_subtract_det_backoff;
     delete lm_to_subtract_det_scale;
 
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
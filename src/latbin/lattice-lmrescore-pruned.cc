@@ -26,6 +26,99 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; the lattices are processed in parallel by
+// TaskSequencer and written in order by the destructor.  The LMs are shared
+// between the tasks: the FST-based DeterministicOnDemandFsts don't change when
+// we look up arcs in them, but ConstArpaLmDeterministicFst caches the LM
+// states it has seen, so for a const-arpa LM each task wraps the (read-only)
+// ConstArpaLm itself.
+class LmRescorePrunedTask {
+ public:
+  // Takes ownership of "clat".  If "lm_to_add" is NULL, the LM to add is
+  // "const_arpa", scaled by "lm_scale".
+  LmRescorePrunedTask(const ComposeLatticePrunedOptions &compose_opts,
+                      BaseFloat acoustic_scale, BaseFloat lm_scale,
+                      fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract,
+                      fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add,
+                      const ConstArpaLm *const_arpa,
+                      const std::string &key, CompactLattice *clat,
+                      CompactLatticeWriter *clat_writer,
+                      int32 *num_done, int32 *num_err):
+      compose_opts_(compose_opts), acoustic_scale_(acoustic_scale),
+      lm_scale_(lm_scale), lm_to_subtract_(lm_to_subtract),
+      lm_to_add_(lm_to_add), const_arpa_(const_arpa), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    ConstArpaLmDeterministicFst *const_arpa_fst = NULL;
+    fst::ScaleDeterministicOnDemandFst *const_arpa_scale = NULL;
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add = lm_to_add_;
+    if (lm_to_add == NULL) {
+      lm_to_add = const_arpa_fst = new ConstArpaLmDeterministicFst(*const_arpa_);
+      if (lm_scale_ != 1.0)
+        lm_to_add = const_arpa_scale =
+            new fst::ScaleDeterministicOnDemandFst(lm_scale_, const_arpa_fst);
+    }
+
+    // To avoid memory gradually increasing with time, we reconstruct the
+    // composed-LM FST for each lattice we process.
+    //   It shouldn't make a difference in which order we provide the
+    // arguments to the composition; either way should work.  They are both
+    // acceptors so the result is the same either way.
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        lm_to_subtract_, lm_to_add);
+
+    ComposeCompactLatticePruned(compose_opts_,
+                                *clat_,
+                                &combined_lms,
+                                &composed_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    delete const_arpa_scale;
+    delete const_arpa_fst;
+
+    if (acoustic_scale_ != 1.0 && composed_clat_.NumStates() != 0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~LmRescorePrunedTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat acoustic_scale_;
+  BaseFloat lm_scale_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_;
+  fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_add_;
+  const ConstArpaLm *const_arpa_;
+  std::string key_;
+  CompactLattice *clat_;  // The lattice we're working on.  Owned locally.
+  CompactLattice composed_clat_;  // The output of our process.  Will be
+                                  // written to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -50,7 +143,9 @@ int main(int argc, char *argv[]) {
         " e.g.: lattice-lmrescore-pruned --acoustic-scale=0.1 \\\n"
         "      data/lang/G.fst data/lang_fg/G.fst ark:in.lats ark:out.lats\n"
         " or: lattice-lmrescore-pruned --acoustic-scale=0.1 --add-const-arpa=true\\\n"
-        "      data/lang/G.fst data/lang_fg/G.carpa ark:in.lats ark:out.lats\n";
+        "      data/lang/G.fst data/lang_fg/G.carpa ark:in.lats ark:out.lats\n"
+        "With --num-threads > 1, lattices are rescored in parallel, sharing one\n"
+        "copy of each LM; the output order is unchanged.\n";
 
     ParseOptions po(usage);
 
@@ -60,6 +155,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,6 +165,7 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
+    sequencer_config.Register(&po);
 
 
     po.Read(argc, argv);
@@ -99,18 +196,18 @@ int main(int argc, char *argv[]) {
         -lm_scale, &lm_to_subtract_det_backoff);
 
 
+    // For a const-arpa LM, lm_to_add stays NULL and each task creates its own
+    // (see LmRescorePrunedTask).
     fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
         *lm_to_add = NULL;
-    if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
-    } else {
+    if (!add_const_arpa) {
       lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
           *lm_to_add_fst);
-    }
-    if (lm_scale != 1.0) {
-      lm_to_add_orig = lm_to_add;
-      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
-                                                         lm_to_add_orig);
+      if (lm_scale != 1.0) {
+        lm_to_add_orig = lm_to_add;
+        lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
+                                                           lm_to_add_orig);
+      }
     }
 
     KALDI_LOG << "Done.";
@@ -121,45 +218,25 @@ int main(int argc, char *argv[]) {
     // Write as compact lattice.
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
+    TaskSequencer<LmRescorePrunedTask> sequencer(sequencer_config);
+
     int32 num_done = 0, num_err = 0;
 
     for (; !clat_reader.Done(); clat_reader.Next()) {
       std::string key = clat_reader.Key();
-      CompactLattice &clat = clat_reader.Value();
-
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      // To avoid memory gradually increasing with time, we reconstruct the
-      // composed-LM FST for each lattice we process.
-      //   It shouldn't make a difference in which order we provide the
-      // arguments to the composition; either way should work.  They are both
-      // acceptors so the result is the same either way.
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          &lm_to_subtract_det_scale, lm_to_add);
-
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts,
-                                  clat,
-                                  &combined_lms,
-                                  &composed_clat);
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
-      }
+      // Will give ownership to the task below.
+      CompactLattice *clat = new CompactLattice(clat_reader.Value());
+      clat_reader.FreeCurrent();
+      sequencer.Run(new LmRescorePrunedTask(
+          compose_opts, acoustic_scale, lm_scale, &lm_to_subtract_det_scale,
+          lm_to_add, (add_const_arpa ? &const_arpa : NULL), key, clat,
+          &compact_lattice_writer, &num_done, &num_err));
     }
+    sequencer.Wait();
+
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
     delete lm_to_add_orig;
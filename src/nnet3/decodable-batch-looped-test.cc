@@ -0,0 +1,170 @@
+// nnet3/decodable-batch-looped-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/decodable-batch-looped.h"
+#include "nnet3/decodable-online-looped.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Online feature that returns the rows of a matrix, of which only the first
+// NumFramesReady() are available, to simulate features that arrive over time.
+class PartialMatrixFeature: public OnlineFeatureInterface {
+ public:
+  explicit PartialMatrixFeature(const MatrixBase<BaseFloat> &mat):
+      mat_(mat), num_frames_ready_(0) { }
+  virtual int32 Dim() const { return mat_.NumCols(); }
+  virtual int32 NumFramesReady() const { return num_frames_ready_; }
+  virtual bool IsLastFrame(int32 frame) const {
+    return Finished() && frame == mat_.NumRows() - 1;
+  }
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01; }
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    KALDI_ASSERT(frame >= 0 && frame < num_frames_ready_);
+    feat->CopyFromVec(mat_.Row(frame));
+  }
+  void AdvanceFrames(int32 num_frames) {
+    num_frames_ready_ = std::min(mat_.NumRows(),
+                                 num_frames_ready_ + num_frames);
+  }
+  bool Finished() const { return num_frames_ready_ == mat_.NumRows(); }
+ private:
+  const MatrixBase<BaseFloat> &mat_;
+  int32 num_frames_ready_;
+};
+
+// Checks that decoding several streams with NnetBatchLoopedComputer, with
+// their features arriving at different rates, gives the same log-likelihoods
+// as DecodableAmNnetLoopedOnline on each stream by itself.
+void TestDecodableBatchLooped() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  NnetGenerationOptions gen_config;
+  gen_config.output_dim = trans_model->NumPdfs();
+  gen_config.allow_multiple_inputs = false;
+  gen_config.allow_multiple_outputs = false;
+  gen_config.allow_statistics_pooling = false;
+  std::vector<std::string> configs;
+  GenerateConfigSequence(gen_config, &configs);
+  Nnet nnet;
+  for (size_t j = 0; j < configs.size(); j++) {
+    std::istringstream is(configs[j]);
+    nnet.ReadConfig(is);
+  }
+  SetBatchnormTestMode(true, &nnet);
+  SetDropoutTestMode(true, &nnet);
+
+  NnetSimpleLoopedComputationOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  Vector<BaseFloat> priors;
+  // caution: this may modify nnet, by changing how it consumes iVectors.
+  DecodableNnetSimpleLoopedInfo info(opts, priors, &nnet);
+  int32 input_dim = nnet.InputDim("input"),
+      ivector_dim = std::max<int32>(0, nnet.InputDim("ivector")),
+      num_tids = trans_model->NumTransitionIds();
+
+  int32 num_streams = RandInt(1, 5);
+  NnetBatchLoopedComputer computer(info, RandInt(1, 3));
+  std::vector<Matrix<BaseFloat> > feats(num_streams), ivectors(num_streams);
+  std::vector<PartialMatrixFeature*> feat_sources(num_streams),
+      ivector_sources(num_streams, NULL);
+  std::vector<DecodableAmNnetBatchLoopedOnline*> decodables(num_streams);
+  for (int32 s = 0; s < num_streams; s++) {
+    int32 num_frames = RandInt(1, 100);
+    feats[s].Resize(num_frames, input_dim);
+    feats[s].SetRandn();
+    feat_sources[s] = new PartialMatrixFeature(feats[s]);
+    if (ivector_dim != 0) {
+      // The iVector is the same on all frames, since the single-stream and
+      // batched computations may take it from different frames.
+      Vector<BaseFloat> ivector(ivector_dim);
+      ivector.SetRandn();
+      ivectors[s].Resize(num_frames, ivector_dim);
+      ivectors[s].CopyRowsFromVec(ivector);
+      ivector_sources[s] = new PartialMatrixFeature(ivectors[s]);
+      ivector_sources[s]->AdvanceFrames(num_frames);
+    }
+    decodables[s] = new DecodableAmNnetBatchLoopedOnline(
+        *trans_model, computer, feat_sources[s], ivector_sources[s]);
+  }
+
+  // Give the streams their features bit by bit, and read the log-likelihoods
+  // as they become ready, as a decoder would.
+  std::vector<Matrix<BaseFloat> > loglikes(num_streams);
+  std::vector<int32> num_frames_read(num_streams, 0);
+  bool done = false;
+  while (!done) {
+    done = true;
+    for (int32 s = 0; s < num_streams; s++) {
+      feat_sources[s]->AdvanceFrames(RandInt(0, 30));
+      if (!feat_sources[s]->Finished())
+        done = false;
+    }
+    computer.Compute(decodables);
+    for (int32 s = 0; s < num_streams; s++) {
+      int32 num_frames_ready = decodables[s]->NumFramesReady();
+      loglikes[s].Resize(num_frames_ready, num_tids, kCopyData);
+      for (int32 t = num_frames_read[s]; t < num_frames_ready; t++)
+        for (int32 i = 0; i < num_tids; i++)
+          loglikes[s](t, i) = decodables[s]->LogLikelihood(t, i + 1);
+      num_frames_read[s] = num_frames_ready;
+    }
+  }
+
+  for (int32 s = 0; s < num_streams; s++) {
+    int32 num_frames = feats[s].NumRows();
+    KALDI_ASSERT(num_frames_read[s] == num_frames &&
+                 decodables[s]->IsLastFrame(num_frames - 1));
+    PartialMatrixFeature feat_source(feats[s]),
+        ivector_source(ivectors[s]);
+    feat_source.AdvanceFrames(num_frames);
+    ivector_source.AdvanceFrames(num_frames);
+    DecodableAmNnetLoopedOnline decodable(
+        *trans_model, info, &feat_source,
+        (ivector_dim != 0 ? &ivector_source : NULL));
+    KALDI_ASSERT(decodable.NumFramesReady() == num_frames);
+    Matrix<BaseFloat> ref_loglikes(num_frames, num_tids);
+    for (int32 t = 0; t < num_frames; t++)
+      for (int32 i = 0; i < num_tids; i++)
+        ref_loglikes(t, i) = decodable.LogLikelihood(t, i + 1);
+    // The batched matrix multiplications may round differently.
+    AssertEqual(ref_loglikes, loglikes[s], 0.001);
+  }
+  computer.PrintStats();
+
+  for (int32 s = 0; s < num_streams; s++) {
+    delete decodables[s];
+    delete feat_sources[s];
+    delete ivector_sources[s];
+  }
+  delete trans_model;
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (int32 i = 0; i < 10; i++)
+    TestDecodableBatchLooped();
+  KALDI_LOG << "Success.";
+}
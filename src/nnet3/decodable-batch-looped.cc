@@ -0,0 +1,400 @@
+// nnet3/decodable-batch-looped.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "nnet3/decodable-batch-looped.h"
+#include "nnet3/nnet-compile-looped.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+NnetBatchLoopedComputer::NnetBatchLoopedComputer(
+    const DecodableNnetSimpleLoopedInfo &info, int32 num_streams):
+    info_(info), num_streams_(num_streams), computer_(NULL),
+    num_batches_(0), num_chunks_(0) {
+  KALDI_ASSERT(num_streams_ > 0);
+  // As in DecodableNnetSimpleLoopedInfo::Init(), the iVector period is the
+  // chunk size (and info_.nnet has already been modified for that).
+  int32 ivector_period = info_.frames_per_chunk;
+  CreateLoopedComputationRequest(info_.nnet, info_.frames_per_chunk,
+                                 info_.opts.frame_subsampling_factor,
+                                 ivector_period,
+                                 info_.frames_left_context,
+                                 info_.frames_right_context,
+                                 num_streams_,
+                                 &request1_, &request2_, &request3_);
+  CompileLooped(info_.nnet, info_.opts.optimize_config,
+                request1_, request2_, request3_, &computation_);
+  computation_.ComputeCudaIndexes();
+
+  // Work out which rows of each matrix belong to which sequence, from the
+  // cindexes in the debug info.
+  int32 num_matrices = computation_.matrices.size();
+  if (static_cast<int32>(computation_.matrix_debug_info.size()) !=
+      num_matrices)
+    KALDI_ERR << "Expected the looped computation to have debug info.";
+  rows_.resize(num_matrices);
+  for (int32 m = 0; m < num_matrices; m++) {
+    const std::vector<Cindex> &cindexes =
+        computation_.matrix_debug_info[m].cindexes;
+    KALDI_ASSERT(static_cast<int32>(cindexes.size()) ==
+                 computation_.matrices[m].num_rows);
+    rows_[m].resize(num_streams_);
+    for (size_t r = 0; r < cindexes.size(); r++) {
+      int32 n = cindexes[r].second.n;
+      KALDI_ASSERT(n >= 0 && n < num_streams_);
+      rows_[m][n].push_back(r);
+    }
+    for (int32 n = 1; n < num_streams_; n++)
+      if (rows_[m][n].size() != rows_[m][0].size())
+        KALDI_ERR << "Matrix " << m << " of the looped computation does not "
+                  << "have the same number of rows for each sequence.";
+  }
+  // At the start of the computation, there is no state.
+  state_info_[0] = StateInfo();
+
+  computer_ = new NnetComputer(info_.opts.compute_config, computation_,
+                               info_.nnet, NULL);  // NULL is 'nnet_to_update'
+}
+
+NnetBatchLoopedComputer::~NnetBatchLoopedComputer() {
+  delete computer_;
+}
+
+void NnetBatchLoopedComputer::Compute(
+    const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams) {
+  while (true) {
+    // Group the streams that have a chunk ready by where they are in the
+    // computation.
+    std::map<int32, std::vector<DecodableAmNnetBatchLoopedOnline*> > groups;
+    for (size_t i = 0; i < streams.size(); i++)
+      if (streams[i]->ChunkReady())
+        groups[streams[i]->program_counter_].push_back(streams[i]);
+    if (groups.empty())
+      return;
+    std::map<int32, std::vector<DecodableAmNnetBatchLoopedOnline*> >::iterator
+        iter = groups.begin(), end = groups.end();
+    for (; iter != end; ++iter) {
+      const std::vector<DecodableAmNnetBatchLoopedOnline*> &group =
+          iter->second;
+      for (size_t i = 0; i < group.size(); i += num_streams_) {
+        size_t end_i = std::min(group.size(), i + num_streams_);
+        std::vector<DecodableAmNnetBatchLoopedOnline*> batch(
+            group.begin() + i, group.begin() + end_i);
+        ComputeBatch(batch);
+      }
+    }
+  }
+}
+
+void NnetBatchLoopedComputer::ComputeBatch(
+    const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams) {
+  int32 num_streams = streams.size(),
+      program_counter = streams[0]->program_counter_;
+  KALDI_ASSERT(num_streams > 0 && num_streams <= num_streams_);
+  // Streams at the same point in the computation are either all on their
+  // first chunk or none are.
+  bool first_chunk = (streams[0]->num_chunks_computed_ == 0);
+  const ComputationRequest &request = (first_chunk ? request1_ : request2_);
+
+  KALDI_ASSERT(state_info_.count(program_counter) != 0);
+  computer_->SetProgramCounter(program_counter,
+                               state_info_[program_counter].pending_commands);
+  LoadState(streams);
+  FormatInputs(streams, request);
+  computer_->Run();
+  CuMatrix<BaseFloat> cu_output;
+  computer_->GetOutputDestructive("output", &cu_output);
+  SaveState(streams);
+
+  if (info_.log_priors.Dim() != 0) {
+    // subtract log-prior (divide by prior)
+    cu_output.AddVecToRows(-1.0, info_.log_priors);
+  }
+  // apply the acoustic scale
+  cu_output.Scale(info_.opts.acoustic_scale);
+  Matrix<BaseFloat> output(cu_output);
+
+  // Split the output by stream.
+  const std::vector<Index> &indexes = request.outputs[0].indexes;
+  KALDI_ASSERT(request.outputs[0].name == "output" &&
+               output.NumRows() == static_cast<int32>(indexes.size()));
+  int32 frames_per_chunk = info_.frames_per_chunk /
+      info_.opts.frame_subsampling_factor;
+  std::vector<std::vector<MatrixIndexT> > stream_rows(num_streams);
+  for (size_t r = 0; r < indexes.size(); r++)
+    if (indexes[r].n < num_streams)
+      stream_rows[indexes[r].n].push_back(r);
+  for (int32 i = 0; i < num_streams; i++) {
+    KALDI_ASSERT(static_cast<int32>(stream_rows[i].size()) ==
+                 frames_per_chunk);
+    Matrix<BaseFloat> log_post(frames_per_chunk, output.NumCols(),
+                               kUndefined);
+    log_post.CopyRows(output, &(stream_rows[i][0]));
+    streams[i]->AcceptChunk(log_post);
+  }
+  num_batches_++;
+  num_chunks_ += num_streams;
+}
+
+void NnetBatchLoopedComputer::FormatInputs(
+    const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams,
+    const ComputationRequest &request) {
+  int32 num_streams = streams.size();
+  for (size_t i = 0; i < request.inputs.size(); i++) {
+    const std::string &name = request.inputs[i].name;
+    const std::vector<Index> &indexes = request.inputs[i].indexes;
+    // Rows for sequences that have no stream are left at zero.
+    Matrix<BaseFloat> input(indexes.size(), info_.nnet.InputDim(name));
+    if (name == "input") {
+      for (size_t r = 0; r < indexes.size(); r++) {
+        int32 n = indexes[r].n;
+        if (n >= num_streams)
+          continue;
+        const DecodableAmNnetBatchLoopedOnline &stream = *(streams[n]);
+        // The 't' values in request2_ are for the second chunk; later chunks
+        // are the same but shifted by whole chunks.
+        int32 t = indexes[r].t;
+        if (stream.num_chunks_computed_ > 0)
+          t += (stream.num_chunks_computed_ - 1) * info_.frames_per_chunk;
+        // We pad with copies of the first and last frames as needed.
+        int32 num_frames_ready = stream.input_features_->NumFramesReady();
+        t = std::max(0, std::min(t, num_frames_ready - 1));
+        SubVector<BaseFloat> row(input, r);
+        stream.input_features_->GetFrame(t, &row);
+      }
+    } else if (name == "ivector") {
+      // As in DecodableNnetLoopedOnlineBase::AdvanceChunk(), we use the
+      // iVector from the most recent frame we can, for all the 't' values.
+      std::vector<Vector<BaseFloat> > ivectors(num_streams);
+      for (int32 n = 0; n < num_streams; n++) {
+        OnlineFeatureInterface *ivector_features =
+            streams[n]->ivector_features_;
+        KALDI_ASSERT(ivector_features != NULL);
+        ivectors[n].Resize(ivector_features->Dim());
+        int32 most_recent_input_frame =
+            streams[n]->input_features_->NumFramesReady() - 1,
+            num_ivector_frames_ready = ivector_features->NumFramesReady();
+        if (num_ivector_frames_ready > 0)
+          ivector_features->GetFrame(
+              std::min(most_recent_input_frame, num_ivector_frames_ready - 1),
+              &(ivectors[n]));
+      }
+      for (size_t r = 0; r < indexes.size(); r++)
+        if (indexes[r].n < num_streams)
+          input.Row(r).CopyFromVec(ivectors[indexes[r].n]);
+    } else {
+      KALDI_ERR << "Unexpected input '" << name << "' in looped computation.";
+    }
+    CuMatrix<BaseFloat> cu_input;
+    cu_input.Swap(&input);
+    computer_->AcceptInput(name, &cu_input);
+  }
+}
+
+void NnetBatchLoopedComputer::LoadState(
+    const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams) {
+  const StateInfo &state_info = state_info_[streams[0]->program_counter_];
+  int32 num_matrices = computation_.matrices.size();
+  std::vector<bool> is_state(num_matrices, false);
+  for (size_t j = 0; j < state_info.matrices.size(); j++)
+    is_state[state_info.matrices[j]] = true;
+  // Free anything left over from the last batch that is not part of the
+  // state at this point.
+  for (int32 m = 0; m < num_matrices; m++)
+    if (!is_state[m] && computer_->GetMatrix(m).NumRows() != 0)
+      computer_->GetMatrix(m).Resize(0, 0);
+
+  for (size_t j = 0; j < state_info.matrices.size(); j++) {
+    int32 m = state_info.matrices[j];
+    const NnetComputation::MatrixInfo &matrix_info = computation_.matrices[m];
+    // Rows for sequences that have no stream are set to zero.
+    std::vector<const BaseFloat*> src(matrix_info.num_rows, NULL);
+    for (size_t i = 0; i < streams.size(); i++) {
+      const CuMatrix<BaseFloat> &state = streams[i]->state_[j];
+      const std::vector<int32> &rows = rows_[m][i];
+      KALDI_ASSERT(state.NumRows() == static_cast<int32>(rows.size()));
+      for (size_t k = 0; k < rows.size(); k++)
+        src[rows[k]] = state.RowData(k);
+    }
+    CuMatrix<BaseFloat> &mat = computer_->GetMatrix(m);
+    if (mat.NumRows() != matrix_info.num_rows ||
+        mat.NumCols() != matrix_info.num_cols)
+      mat.Resize(matrix_info.num_rows, matrix_info.num_cols, kUndefined,
+                 matrix_info.stride_type);
+    CuArray<const BaseFloat*> cu_src(src);
+    mat.CopyRows(cu_src);
+  }
+}
+
+void NnetBatchLoopedComputer::SaveState(
+    const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams) {
+  int32 program_counter = computer_->ProgramCounter(),
+      num_matrices = computation_.matrices.size();
+  // The state consists of the matrices that are still allocated.
+  std::vector<int32> matrices;
+  for (int32 m = 0; m < num_matrices; m++)
+    if (computer_->GetMatrix(m).NumRows() != 0)
+      matrices.push_back(m);
+  std::map<int32, StateInfo>::iterator iter =
+      state_info_.find(program_counter);
+  if (iter == state_info_.end()) {
+    StateInfo &state_info = state_info_[program_counter];
+    state_info.pending_commands = computer_->PendingCommands();
+    state_info.matrices = matrices;
+  } else {
+    KALDI_ASSERT(iter->second.matrices == matrices &&
+                 iter->second.pending_commands ==
+                 computer_->PendingCommands());
+  }
+
+  for (size_t i = 0; i < streams.size(); i++) {
+    streams[i]->program_counter_ = program_counter;
+    streams[i]->state_.resize(matrices.size());
+  }
+  for (size_t j = 0; j < matrices.size(); j++) {
+    int32 m = matrices[j];
+    const CuMatrix<BaseFloat> &mat = computer_->GetMatrix(m);
+    KALDI_ASSERT(mat.NumRows() == computation_.matrices[m].num_rows);
+    std::vector<BaseFloat*> dest(mat.NumRows(), NULL);
+    for (size_t i = 0; i < streams.size(); i++) {
+      CuMatrix<BaseFloat> &state = streams[i]->state_[j];
+      const std::vector<int32> &rows = rows_[m][i];
+      state.Resize(rows.size(), mat.NumCols(), kUndefined);
+      for (size_t k = 0; k < rows.size(); k++)
+        dest[rows[k]] = state.RowData(k);
+    }
+    CuArray<BaseFloat*> cu_dest(dest);
+    mat.CopyToRows(cu_dest);
+  }
+}
+
+void NnetBatchLoopedComputer::PrintStats() const {
+  if (num_batches_ == 0)
+    return;
+  KALDI_LOG << "Computed " << num_chunks_ << " chunks in " << num_batches_
+            << " batches, average batch size "
+            << (num_chunks_ / static_cast<BaseFloat>(num_batches_))
+            << " (of " << num_streams_ << ").";
+}
+
+
+DecodableAmNnetBatchLoopedOnline::DecodableAmNnetBatchLoopedOnline(
+    const TransitionModel &trans_model,
+    const NnetBatchLoopedComputer &computer,
+    OnlineFeatureInterface *input_features,
+    OnlineFeatureInterface *ivector_features):
+    trans_model_(trans_model),
+    info_(computer.Info()),
+    input_features_(input_features),
+    ivector_features_(ivector_features),
+    num_chunks_computed_(0),
+    program_counter_(0),
+    log_post_offset_(0),
+    current_frame_(0) {
+  // Check that feature dimensions match.
+  KALDI_ASSERT(input_features_ != NULL);
+  int32 nnet_input_dim = info_.nnet.InputDim("input"),
+      nnet_ivector_dim = info_.nnet.InputDim("ivector"),
+      feat_input_dim = input_features_->Dim(),
+      feat_ivector_dim = (ivector_features_ != NULL ?
+                          ivector_features_->Dim() : -1);
+  if (nnet_input_dim != feat_input_dim) {
+    KALDI_ERR << "Input feature dimension mismatch: got " << feat_input_dim
+              << " but network expects " << nnet_input_dim;
+  }
+  if (nnet_ivector_dim != feat_ivector_dim) {
+    KALDI_ERR << "Ivector feature dimension mismatch: got " << feat_ivector_dim
+              << " but network expects " << nnet_ivector_dim;
+  }
+}
+
+int32 DecodableAmNnetBatchLoopedOnline::NumFramesComputable() const {
+  // This is the same as DecodableNnetLoopedOnlineBase::NumFramesReady().
+  int32 features_ready = input_features_->NumFramesReady();
+  if (features_ready == 0)
+    return 0;
+  bool input_finished = input_features_->IsLastFrame(features_ready - 1);
+  int32 sf = info_.opts.frame_subsampling_factor;
+  if (input_finished) {
+    return (features_ready + sf - 1) / sf;
+  } else {
+    int32 non_subsampled_output_frames_ready =
+        std::max<int32>(0, features_ready - info_.frames_right_context);
+    int32 num_chunks_ready = non_subsampled_output_frames_ready /
+                             info_.frames_per_chunk;
+    return num_chunks_ready * info_.frames_per_chunk / sf;
+  }
+}
+
+bool DecodableAmNnetBatchLoopedOnline::ChunkReady() const {
+  int32 frames_per_chunk = info_.frames_per_chunk /
+      info_.opts.frame_subsampling_factor;
+  return NumFramesComputable() > num_chunks_computed_ * frames_per_chunk;
+}
+
+int32 DecodableAmNnetBatchLoopedOnline::NumFramesReady() const {
+  return std::min(NumFramesComputable(),
+                  log_post_offset_ + log_post_.NumRows());
+}
+
+bool DecodableAmNnetBatchLoopedOnline::IsLastFrame(
+    int32 subsampled_frame) const {
+  // See DecodableNnetLoopedOnlineBase::IsLastFrame().
+  int32 features_ready = input_features_->NumFramesReady();
+  if (features_ready == 0)
+    return (subsampled_frame == -1 && input_features_->IsLastFrame(-1));
+  bool input_finished = input_features_->IsLastFrame(features_ready - 1);
+  if (!input_finished)
+    return false;
+  int32 sf = info_.opts.frame_subsampling_factor,
+     num_subsampled_frames_ready = (features_ready + sf - 1) / sf;
+  return (subsampled_frame == num_subsampled_frames_ready - 1);
+}
+
+BaseFloat DecodableAmNnetBatchLoopedOnline::LogLikelihood(
+    int32 subsampled_frame, int32 transition_id) {
+  KALDI_ASSERT(subsampled_frame >= log_post_offset_ &&
+               subsampled_frame < log_post_offset_ + log_post_.NumRows() &&
+               "Frame not computed yet, or frames not accessed in order.");
+  current_frame_ = subsampled_frame;
+  return log_post_(subsampled_frame - log_post_offset_,
+                   trans_model_.TransitionIdToPdfFast(transition_id));
+}
+
+void DecodableAmNnetBatchLoopedOnline::AcceptChunk(
+    const MatrixBase<BaseFloat> &log_post) {
+  // Discard the frames before current_frame_, which the decoder will not ask
+  // for again.
+  int32 end_frame = log_post_offset_ + log_post_.NumRows(),
+      num_kept = std::max<int32>(0, end_frame - current_frame_);
+  Matrix<BaseFloat> new_log_post(num_kept + log_post.NumRows(),
+                                 log_post.NumCols(), kUndefined);
+  if (num_kept > 0)
+    new_log_post.RowRange(0, num_kept).CopyFromMat(
+        log_post_.RowRange(log_post_.NumRows() - num_kept, num_kept));
+  new_log_post.RowRange(num_kept, log_post.NumRows()).CopyFromMat(log_post);
+  log_post_.Swap(&new_log_post);
+  log_post_offset_ = end_frame - num_kept;
+  num_chunks_computed_++;
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
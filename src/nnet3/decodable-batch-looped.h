@@ -0,0 +1,199 @@
+// nnet3/decodable-batch-looped.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_DECODABLE_BATCH_LOOPED_H_
+#define KALDI_NNET3_DECODABLE_BATCH_LOOPED_H_
+
+#include <map>
+#include <vector>
+#include "itf/online-feature-itf.h"
+#include "itf/decodable-itf.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "hmm/transition-model.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+class DecodableAmNnetBatchLoopedOnline;
+
+
+/**
+   NnetBatchLoopedComputer does the looped neural net computation (see
+   decodable-online-looped.h) for many online decoding sessions ("streams") at
+   once: it gathers the next chunk of each stream that has one ready into a
+   single computation with one sequence ('n' index) per stream, so that the
+   matrix multiplications are done for all of them together instead of one
+   small one per stream.  This is much faster on CPU when there are many
+   concurrent sessions.
+
+   Each stream has its own recurrent state (the activations that the looped
+   computation carries from one chunk to the next).  That is stored in the
+   DecodableAmNnetBatchLoopedOnline object, and before each batch we copy the
+   state of each stream into the rows of the computation's matrices for the
+   'n' index it is given, and afterwards copy it back out.  So streams can
+   start, stop and have chunks ready at different times; streams are batched
+   with others that are at the same point in the computation (the first chunk
+   is different from later ones).
+
+   The computation is compiled for 'num_streams' sequences; if fewer streams
+   have a chunk ready, the remaining sequences are computed with zero input,
+   so 'num_streams' should be about the number of sessions you expect to be
+   active at once.
+
+   This class is not thread-safe: Compute() should be called from one thread,
+   and the decodables should not be used by the decoders while it runs.
+*/
+class NnetBatchLoopedComputer {
+ public:
+  /// 'info' must outlive this object; its options and model are used, but not
+  /// its computation (we compile one for 'num_streams' sequences).
+  NnetBatchLoopedComputer(const DecodableNnetSimpleLoopedInfo &info,
+                          int32 num_streams);
+
+  /// Computes all the chunks of the given streams that are ready (i.e. whose
+  /// features are available), in batches.  Call this after giving the
+  /// sessions more audio and before advancing their decoders.
+  void Compute(const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams);
+
+  const DecodableNnetSimpleLoopedInfo &Info() const { return info_; }
+
+  /// Prints statistics about the batch sizes.
+  void PrintStats() const;
+
+  ~NnetBatchLoopedComputer();
+
+ private:
+  // Information about the state at a point in the computation between chunks.
+  struct StateInfo {
+    // The pending I/O commands (see NnetComputer::PendingCommands()).
+    std::vector<int32> pending_commands;
+    // The matrices that are allocated, i.e. that are part of the state.
+    std::vector<int32> matrices;
+  };
+
+  // Does the computation for the next chunk of up to num_streams_ streams,
+  // which must all be at the same point in the computation.
+  void ComputeBatch(
+      const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams);
+
+  // Sets up the inputs of the computation for these streams.
+  void FormatInputs(
+      const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams,
+      const ComputationRequest &request);
+
+  // Copies the state of 'streams' into the computation's matrices.
+  void LoadState(
+      const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams);
+
+  // Copies the state of the computation's matrices into 'streams', and
+  // records the StateInfo for the current program counter.
+  void SaveState(
+      const std::vector<DecodableAmNnetBatchLoopedOnline*> &streams);
+
+  const DecodableNnetSimpleLoopedInfo &info_;
+  int32 num_streams_;
+
+  ComputationRequest request1_, request2_, request3_;
+  NnetComputation computation_;
+  NnetComputer *computer_;
+
+  // rows_[m][n] is the list of rows of matrix m that belong to sequence n.
+  std::vector<std::vector<std::vector<int32> > > rows_;
+
+  // Indexed by program counter.
+  std::map<int32, StateInfo> state_info_;
+
+  int64 num_batches_;
+  int64 num_chunks_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchLoopedComputer);
+};
+
+
+/**
+   This is like DecodableAmNnetLoopedOnline, but the neural net computation is
+   done by NnetBatchLoopedComputer::Compute(), batched with other streams.  It
+   only reports as ready the frames that have been computed, so the decoder
+   will not ask for others.
+*/
+class DecodableAmNnetBatchLoopedOnline: public DecodableInterface {
+ public:
+  /// 'computer' must outlive this object.  The features are not owned here.
+  DecodableAmNnetBatchLoopedOnline(const TransitionModel &trans_model,
+                                   const NnetBatchLoopedComputer &computer,
+                                   OnlineFeatureInterface *input_features,
+                                   OnlineFeatureInterface *ivector_features);
+
+  virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 transition_id);
+
+  virtual int32 NumFramesReady() const;
+
+  virtual bool IsLastFrame(int32 subsampled_frame) const;
+
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  int32 FrameSubsamplingFactor() const {
+    return info_.opts.frame_subsampling_factor;
+  }
+
+  /// Returns true if the features for the next chunk are ready, so that
+  /// NnetBatchLoopedComputer::Compute() would compute it.
+  bool ChunkReady() const;
+
+ private:
+  friend class NnetBatchLoopedComputer;
+
+  // The number of frames (after subsampling) that we could compute from the
+  // features that are ready.
+  int32 NumFramesComputable() const;
+
+  // Adds the output of the next chunk (after any priors and acoustic scale
+  // have been applied).
+  void AcceptChunk(const MatrixBase<BaseFloat> &log_post);
+
+  const TransitionModel &trans_model_;
+  const DecodableNnetSimpleLoopedInfo &info_;
+  OnlineFeatureInterface *input_features_;
+  OnlineFeatureInterface *ivector_features_;
+
+  int32 num_chunks_computed_;
+
+  // The position in the computation that our state is for (see
+  // NnetBatchLoopedComputer::StateInfo).
+  int32 program_counter_;
+  // The rows of the state matrices for this stream.
+  std::vector<CuMatrix<BaseFloat> > state_;
+
+  // The computed log-likelihoods for frames log_post_offset_ onward; we keep
+  // those from the last frame the decoder asked for, since it never goes back
+  // further than that.
+  Matrix<BaseFloat> log_post_;
+  int32 log_post_offset_;
+  int32 current_frame_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetBatchLoopedOnline);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_DECODABLE_BATCH_LOOPED_H_
@@ -229,6 +229,34 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
       (info_.frames_per_chunk / info_.opts.frame_subsampling_factor);
 }
 
+void DecodableNnetLoopedOnlineBase::WriteState(std::ostream &os,
+                                               bool binary) const {
+  WriteToken(os, binary, "<DecodableNnetLoopedOnlineState>");
+  WriteToken(os, binary, "<NumChunksComputed>");
+  WriteBasicType(os, binary, num_chunks_computed_);
+  WriteToken(os, binary, "<CurrentLogPostOffset>");
+  WriteBasicType(os, binary, current_log_post_subsampled_offset_);
+  WriteToken(os, binary, "<CurrentLogPost>");
+  current_log_post_.Write(os, binary);
+  computer_.WriteState(os, binary);
+  WriteToken(os, binary, "</DecodableNnetLoopedOnlineState>");
+}
+
+void DecodableNnetLoopedOnlineBase::ReadState(std::istream &is,
+                                              bool binary) {
+  KALDI_ASSERT(num_chunks_computed_ == 0 &&
+               "ReadState() called after frames were computed.");
+  ExpectToken(is, binary, "<DecodableNnetLoopedOnlineState>");
+  ExpectToken(is, binary, "<NumChunksComputed>");
+  ReadBasicType(is, binary, &num_chunks_computed_);
+  ExpectToken(is, binary, "<CurrentLogPostOffset>");
+  ReadBasicType(is, binary, &current_log_post_subsampled_offset_);
+  ExpectToken(is, binary, "<CurrentLogPost>");
+  current_log_post_.Read(is, binary);
+  computer_.ReadState(is, binary);
+  ExpectToken(is, binary, "</DecodableNnetLoopedOnlineState>");
+}
+
 BaseFloat DecodableNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
                                                     int32 index) {
   EnsureFrameIsComputed(subsampled_frame);
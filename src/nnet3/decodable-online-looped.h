@@ -81,6 +81,17 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
     return info_.opts.frame_subsampling_factor;
   }
 
+  /// Writes the state of the computation (the recurrent state of the network
+  /// and the outputs of the current chunk), so that decoding can be resumed
+  /// later, possibly in another process; see ReadState().  It does not
+  /// include the state of the input features.
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState(); this object should be newly
+  /// constructed with the same "info", and the input features should have
+  /// had their state restored.
+  void ReadState(std::istream &is, bool binary);
+
 
  protected:
 
@@ -27,6 +27,7 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/decodable-simple-looped.h"
+#include "nnet3/decodable-online-looped.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -144,6 +145,81 @@ void TestNnetDecodable(Nnet *nnet) {
   }
 }
 
+// Online feature that returns the rows of a matrix, all of which are ready.
+class MatrixOnlineFeature: public OnlineFeatureInterface {
+ public:
+  explicit MatrixOnlineFeature(const MatrixBase<BaseFloat> &mat): mat_(mat) { }
+  virtual int32 Dim() const { return mat_.NumCols(); }
+  virtual int32 NumFramesReady() const { return mat_.NumRows(); }
+  virtual bool IsLastFrame(int32 frame) const {
+    return frame == mat_.NumRows() - 1;
+  }
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01; }
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    feat->CopyFromVec(mat_.Row(frame));
+  }
+ private:
+  const MatrixBase<BaseFloat> &mat_;
+};
+
+// Checks that if we write the state of DecodableNnetLoopedOnline part way
+// through, read it into a new object and continue with that, we get the same
+// output as without the interruption.
+void TestNnetDecodableOnlineState(Nnet *nnet) {
+  int32 num_frames = 5 + RandInt(1, 100),
+      input_dim = nnet->InputDim("input"),
+      output_dim = nnet->OutputDim("output"),
+      ivector_dim = std::max<int32>(0, nnet->InputDim("ivector"));
+  Matrix<BaseFloat> input(num_frames, input_dim);
+  input.SetRandn();
+  Vector<BaseFloat> ivector(ivector_dim);
+  ivector.SetRandn();
+  Matrix<BaseFloat> ivectors(num_frames, ivector_dim);
+  if (ivector_dim != 0)
+    ivectors.CopyRowsFromVec(ivector);
+  MatrixOnlineFeature input_feature(input), ivector_feature(ivectors);
+  OnlineFeatureInterface *ivector_feature_ptr =
+      (ivector_dim != 0 ? &ivector_feature : NULL);
+
+  NnetSimpleLoopedComputationOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  Vector<BaseFloat> priors;
+  DecodableNnetSimpleLoopedInfo info(opts, priors, nnet);
+
+  Matrix<BaseFloat> output1(num_frames, output_dim),
+      output2(num_frames, output_dim);
+  {
+    DecodableNnetLoopedOnline decodable(info, &input_feature,
+                                        ivector_feature_ptr);
+    KALDI_ASSERT(decodable.NumFramesReady() == num_frames);
+    for (int32 t = 0; t < num_frames; t++)
+      for (int32 i = 0; i < output_dim; i++)
+        output1(t, i) = decodable.LogLikelihood(t, i + 1);
+  }
+
+  int32 num_frames_before = RandInt(0, num_frames - 1);
+  std::ostringstream os;
+  {
+    DecodableNnetLoopedOnline decodable(info, &input_feature,
+                                        ivector_feature_ptr);
+    for (int32 t = 0; t < num_frames_before; t++)
+      for (int32 i = 0; i < output_dim; i++)
+        output2(t, i) = decodable.LogLikelihood(t, i + 1);
+    decodable.WriteState(os, true);
+  }
+  {
+    DecodableNnetLoopedOnline decodable(info, &input_feature,
+                                        ivector_feature_ptr);
+    std::istringstream is(os.str());
+    decodable.ReadState(is, true);
+    for (int32 t = num_frames_before; t < num_frames; t++)
+      for (int32 i = 0; i < output_dim; i++)
+        output2(t, i) = decodable.LogLikelihood(t, i + 1);
+  }
+  // The state was written in binary, so the output should be exactly the same.
+  KALDI_ASSERT(output1.Equal(output2));
+}
+
 void UnitTestNnetCompute() {
   for (int32 n = 0; n < 20; n++) {
     struct NnetGenerationOptions gen_config;
@@ -273,6 +349,7 @@ void UnitTestNnetCompute() {
       }
     }
     TestNnetDecodable(&nnet);
+    TestNnetDecodableOnlineState(&nnet);
   }
 }
 
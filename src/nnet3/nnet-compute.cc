@@ -588,6 +588,58 @@ void NnetComputer::GetOutputDestructive(const std::string &node_name,
   matrices_[matrix_index].Resize(0, 0);
 }
 
+void NnetComputer::SetProgramCounter(
+    int32 program_counter, const std::vector<int32> &pending_commands) {
+  KALDI_ASSERT(program_counter >= 0 && program_counter <=
+               static_cast<int32>(computation_.commands.size()));
+  program_counter_ = program_counter;
+  pending_commands_ = pending_commands;
+}
+
+void NnetComputer::WriteState(std::ostream &os, bool binary) const {
+  for (size_t i = 0; i < memos_.size(); i++)
+    if (memos_[i] != NULL)
+      KALDI_ERR << "Cannot write the state of a computation with memos.";
+  for (size_t i = 0; i < compressed_matrices_.size(); i++)
+    if (compressed_matrices_[i] != NULL)
+      KALDI_ERR << "Cannot write the state of a computation with compressed "
+                << "matrices.";
+  WriteToken(os, binary, "<NnetComputerState>");
+  WriteToken(os, binary, "<ProgramCounter>");
+  WriteBasicType(os, binary, program_counter_);
+  WriteToken(os, binary, "<PendingCommands>");
+  WriteIntegerVector(os, binary, pending_commands_);
+  WriteToken(os, binary, "<Matrices>");
+  WriteBasicType(os, binary, static_cast<int32>(matrices_.size()));
+  for (size_t i = 0; i < matrices_.size(); i++)
+    matrices_[i].Write(os, binary);
+  WriteToken(os, binary, "</NnetComputerState>");
+}
+
+void NnetComputer::ReadState(std::istream &is, bool binary) {
+  ExpectToken(is, binary, "<NnetComputerState>");
+  ExpectToken(is, binary, "<ProgramCounter>");
+  ReadBasicType(is, binary, &program_counter_);
+  ExpectToken(is, binary, "<PendingCommands>");
+  ReadIntegerVector(is, binary, &pending_commands_);
+  int32 num_matrices;
+  ExpectToken(is, binary, "<Matrices>");
+  ReadBasicType(is, binary, &num_matrices);
+  if (num_matrices != static_cast<int32>(matrices_.size()) ||
+      program_counter_ < 0 ||
+      program_counter_ > static_cast<int32>(computation_.commands.size()))
+    KALDI_ERR << "The computation state does not match the computation.";
+  for (int32 i = 0; i < num_matrices; i++) {
+    // Read() would not respect the stride type the computation asks for.
+    CuMatrix<BaseFloat> mat;
+    mat.Read(is, binary);
+    matrices_[i].Resize(mat.NumRows(), mat.NumCols(), kUndefined,
+                        computation_.matrices[i].stride_type);
+    matrices_[i].CopyFromMat(mat);
+  }
+  ExpectToken(is, binary, "</NnetComputerState>");
+}
+
 
 void NnetComputer::CheckNoPendingIo() {
   const std::vector<NnetComputation::Command> &c = computation_.commands;
@@ -124,6 +124,40 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
+  /// Writes the state of the computation (where we are in the program, and the
+  /// contents of the matrices).  This is for looped computations, where the
+  /// matrices carry the recurrent state from one chunk to the next, so that
+  /// the computation can be resumed later, possibly in another process, by
+  /// calling ReadState() on a NnetComputer with the same computation and nnet.
+  /// It is not supported while there are memos or compressed matrices, i.e.
+  /// in the middle of training.
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState().
+  void ReadState(std::istream &is, bool binary);
+
+  /// The following functions are for NnetBatchLoopedComputer (see
+  /// decodable-batch-looped.h), which runs a looped computation for several
+  /// streams at once and moves the rows of the matrices that belong to each
+  /// stream in and out between chunks.
+
+  /// Returns the index of the next command; between the chunks of a looped
+  /// computation this says where we are in the loop.
+  int32 ProgramCounter() const { return program_counter_; }
+
+  /// Returns the I/O commands that are pending (see GetIoMatrixIndex()).
+  const std::vector<int32> &PendingCommands() const {
+    return pending_commands_;
+  }
+
+  /// Sets the position in the computation, and the pending I/O commands,
+  /// to values obtained from ProgramCounter() and PendingCommands().
+  void SetProgramCounter(int32 program_counter,
+                         const std::vector<int32> &pending_commands);
+
+  /// Returns the matrix with index 'm' in the computation.
+  CuMatrix<BaseFloat> &GetMatrix(int32 m) { return matrices_[m]; }
+
 
   ~NnetComputer();
  private:
@@ -0,0 +1,311 @@
+// nnet3bin/nnet3-latgen-faster-batch-looped.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decoder-wrappers.h"
+#include "nnet3/decodable-batch-looped.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Gives the rows of a matrix as features, of which only the first
+// NumFramesReady() are available, so that we can give the features to
+// NnetBatchLoopedComputer a chunk at a time as they would arrive in online
+// decoding.  Each row is for "period" frames (this is for iVectors); the
+// number of frames is "num_frames".
+class MatrixFeatureSource: public OnlineFeatureInterface {
+ public:
+  MatrixFeatureSource(const Matrix<BaseFloat> &mat, int32 num_frames,
+                      int32 period):
+      mat_(mat), num_frames_(num_frames), period_(period),
+      num_frames_ready_(0) {
+    KALDI_ASSERT(mat_.NumRows() > 0 && period_ > 0);
+  }
+  virtual int32 Dim() const { return mat_.NumCols(); }
+  virtual int32 NumFramesReady() const { return num_frames_ready_; }
+  virtual bool IsLastFrame(int32 frame) const {
+    return Finished() && frame == num_frames_ - 1;
+  }
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01; }
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    KALDI_ASSERT(frame >= 0 && frame < num_frames_ready_);
+    feat->CopyFromVec(mat_.Row(std::min(frame / period_,
+                                        mat_.NumRows() - 1)));
+  }
+  void AdvanceFrames(int32 num_frames) {
+    num_frames_ready_ = std::min(num_frames_, num_frames_ready_ + num_frames);
+  }
+  bool Finished() const { return num_frames_ready_ == num_frames_; }
+ private:
+  Matrix<BaseFloat> mat_;
+  int32 num_frames_;
+  int32 period_;
+  int32 num_frames_ready_;
+};
+
+// An utterance that is being decoded.
+struct BatchUtterance {
+  std::string utt;
+  MatrixFeatureSource *features;
+  MatrixFeatureSource *ivectors;  // NULL if not using iVectors.
+  DecodableAmNnetBatchLoopedOnline *decodable;
+};
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model.  This is like\n"
+        "nnet3-latgen-faster-looped, but the neural net is computed for up to\n"
+        "--num-streams utterances at once, in batches (see\n"
+        "NnetBatchLoopedComputer), as an online server would do for\n"
+        "concurrent sessions; the features are given to it a chunk at a\n"
+        "time.  This is faster on CPU when the batches are full.  Only a\n"
+        "single decoding graph is supported.\n"
+        "Usage: nnet3-latgen-faster-batch-looped [options] <nnet-in> <fst-in> "
+        "<features-rspecifier> <lattice-wspecifier> [ <words-wspecifier> "
+        "[<alignments-wspecifier>] ]\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    int32 num_streams = 16;
+    LatticeFasterDecoderConfig config;
+    NnetSimpleLoopedComputationOptions decodable_opts;
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    po.Register("num-streams", &num_streams, "Number of utterances whose "
+                "neural net computation is done together.");
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utterance to speaker map, used with --ivectors.");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (num_streams <= 0)
+      KALDI_ERR << "--num-streams must be positive.";
+    if (!online_ivector_rspecifier.empty() && online_ivector_period <= 0)
+      KALDI_ERR << "You must set --online-ivector-period with "
+                << "--online-ivectors.";
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    if (ClassifyRspecifier(fst_in_str, NULL, NULL) != kNoRspecifier)
+      KALDI_ERR << "This program does not support a table of graphs.";
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    // this object contains precomputed stuff that is used by all decodable
+    // objects.  It takes a pointer to am_nnet because if it has iVectors it has
+    // to modify the nnet to accept iVectors at intervals.
+    DecodableNnetSimpleLoopedInfo decodable_info(decodable_opts,
+                                                 &am_nnet);
+    NnetBatchLoopedComputer computer(decodable_info, num_streams);
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+    timer.Reset();
+
+    {
+      LatticeFasterDecoder decoder(*decode_fst, config);
+
+      while (!feature_reader.Done()) {
+        // Set up a batch of utterances.
+        std::vector<BatchUtterance> batch;
+        for (; !feature_reader.Done() &&
+                 static_cast<int32>(batch.size()) < num_streams;
+             feature_reader.Next()) {
+          std::string utt = feature_reader.Key();
+          const Matrix<BaseFloat> &features (feature_reader.Value());
+          if (features.NumRows() == 0) {
+            KALDI_WARN << "Zero-length utterance: " << utt;
+            num_fail++;
+            continue;
+          }
+          int32 num_frames = features.NumRows();
+          MatrixFeatureSource *ivectors = NULL;
+          if (!ivector_rspecifier.empty()) {
+            if (!ivector_reader.HasKey(utt)) {
+              KALDI_WARN << "No iVector available for utterance " << utt;
+              num_fail++;
+              continue;
+            }
+            Matrix<BaseFloat> ivector(1, ivector_reader.Value(utt).Dim());
+            ivector.Row(0).CopyFromVec(ivector_reader.Value(utt));
+            ivectors = new MatrixFeatureSource(ivector, num_frames, 1);
+          } else if (!online_ivector_rspecifier.empty()) {
+            if (!online_ivector_reader.HasKey(utt)) {
+              KALDI_WARN << "No online iVector available for utterance "
+                         << utt;
+              num_fail++;
+              continue;
+            }
+            ivectors = new MatrixFeatureSource(
+                online_ivector_reader.Value(utt), num_frames,
+                online_ivector_period);
+          }
+          BatchUtterance utterance;
+          utterance.utt = utt;
+          utterance.features = new MatrixFeatureSource(features, num_frames,
+                                                       1);
+          utterance.ivectors = ivectors;
+          utterance.decodable = new DecodableAmNnetBatchLoopedOnline(
+              trans_model, computer, utterance.features, ivectors);
+          batch.push_back(utterance);
+        }
+
+        // Give the features a chunk at a time, as they would arrive in online
+        // decoding, and compute the neural net output for all the utterances
+        // together.
+        std::vector<DecodableAmNnetBatchLoopedOnline*> decodables;
+        for (size_t i = 0; i < batch.size(); i++)
+          decodables.push_back(batch[i].decodable);
+        bool finished = false;
+        while (!finished) {
+          finished = true;
+          for (size_t i = 0; i < batch.size(); i++) {
+            batch[i].features->AdvanceFrames(decodable_info.frames_per_chunk);
+            if (batch[i].ivectors != NULL)
+              batch[i].ivectors->AdvanceFrames(
+                  decodable_info.frames_per_chunk);
+            if (!batch[i].features->Finished())
+              finished = false;
+          }
+          computer.Compute(decodables);
+        }
+
+        for (size_t i = 0; i < batch.size(); i++) {
+          double like;
+          if (DecodeUtteranceLatticeFaster(
+                  decoder, *(batch[i].decodable), trans_model, word_syms,
+                  batch[i].utt, decodable_opts.acoustic_scale, determinize,
+                  allow_partial, &alignment_writer, &words_writer,
+                  &compact_lattice_writer, &lattice_writer, &like)) {
+            tot_like += like;
+            frame_count += batch[i].decodable->NumFramesReady();
+            num_success++;
+          } else num_fail++;
+          delete batch[i].decodable;
+          delete batch[i].features;
+          delete batch[i].ivectors;
+        }
+      }
+    }
+    delete decode_fst; // delete this only after decoder goes out of scope.
+    computer.PrintStats();
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count <<" frames.";
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
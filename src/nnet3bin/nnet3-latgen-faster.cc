@@ -25,6 +25,7 @@
 #include "hmm/transition-model.h"
 #include "fstext/fstext-lib.h"
 #include "decoder/decoder-wrappers.h"
+#include "decoder/decoder-search-stats.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/nnet-utils.h"
 #include "base/timer.h"
@@ -53,7 +54,8 @@ int main(int argc, char *argv[]) {
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, search_stats_wspecifier;
+    bool print_search_stats = false;
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
@@ -75,6 +77,14 @@ int main(int argc, char *argv[]) {
     po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
                 "between iVectors in matrices supplied to the --online-ivectors "
                 "option");
+    po.Register("search-stats-wspecifier", &search_stats_wspecifier,
+                "If supplied, per-frame statistics about the search (numbers "
+                "of tokens and arcs, time and so on) are written to this table, "
+                "indexed by utterance, for tuning the beams.");
+    po.Register("print-search-stats", &print_search_stats, "If true, print a "
+                "summary of the search statistics for each utterance (a "
+                "summary over all utterances is printed whenever search "
+                "statistics are collected).");
 
     po.Read(argc, argv);
 
@@ -118,6 +128,12 @@ int main(int argc, char *argv[]) {
     Int32VectorWriter words_writer(words_wspecifier);
     Int32VectorWriter alignment_writer(alignment_wspecifier);
 
+    DecoderSearchStatsWriter search_stats_writer(search_stats_wspecifier);
+    bool collect_search_stats = (print_search_stats ||
+                                 !search_stats_wspecifier.empty());
+    DecoderSearchStats search_stats;
+    DecoderSearchStatsSummary search_stats_summary;
+
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_filename != "")
       if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
@@ -141,6 +157,8 @@ int main(int argc, char *argv[]) {
 
       {
         LatticeFasterDecoder decoder(*decode_fst, config);
+        if (collect_search_stats)
+          decoder.SetSearchStats(&search_stats);
 
         for (; !feature_reader.Done(); feature_reader.Next()) {
           std::string utt = feature_reader.Key();
@@ -187,7 +205,19 @@ int main(int argc, char *argv[]) {
             frame_count += nnet_decodable.NumFramesReady();
             num_success++;
           } else num_fail++;
+          if (collect_search_stats) {
+            if (search_stats_writer.IsOpen())
+              search_stats_writer.Write(utt, search_stats);
+            if (print_search_stats) {
+              DecoderSearchStatsSummary utt_summary;
+              utt_summary.Add(search_stats);
+              utt_summary.Print(utt);
+            }
+            search_stats_summary.Add(search_stats);
+          }
         }
+        if (config.adaptive_beam_opts.Enabled())
+          decoder.GetAdaptiveBeamStats().Print();
       }
       delete decode_fst; // delete this only after decoder goes out of scope.
     } else { // We have different FSTs for different utterances.
@@ -209,6 +239,8 @@ int main(int argc, char *argv[]) {
         }
 
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
+        if (collect_search_stats)
+          decoder.SetSearchStats(&search_stats);
 
         const Matrix<BaseFloat> *online_ivectors = NULL;
         const Vector<BaseFloat> *ivector = NULL;
@@ -246,9 +278,22 @@ int main(int argc, char *argv[]) {
           frame_count += nnet_decodable.NumFramesReady();
           num_success++;
         } else num_fail++;
+        if (collect_search_stats) {
+          if (search_stats_writer.IsOpen())
+            search_stats_writer.Write(utt, search_stats);
+          if (print_search_stats) {
+            DecoderSearchStatsSummary utt_summary;
+            utt_summary.Add(search_stats);
+            utt_summary.Print(utt);
+          }
+          search_stats_summary.Add(search_stats);
+        }
       }
     }
 
+    if (collect_search_stats)
+      search_stats_summary.Print("all utterances");
+
     kaldi::int64 input_frame_count =
         frame_count * decodable_opts.frame_subsampling_factor;
 
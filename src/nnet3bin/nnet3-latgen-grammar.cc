@@ -137,7 +137,7 @@ int main(int argc, char *argv[]) {
     SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
     fst::GrammarFst fst;
-    ReadKaldiObject(grammar_fst_rxfilename, &fst);
+    fst::ReadGrammarFst(grammar_fst_rxfilename, &fst);
     timer.Reset();
 
     {
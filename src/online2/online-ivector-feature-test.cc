@@ -0,0 +1,114 @@
+// online2/online-ivector-feature-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "online2/online-ivector-feature.h"
+#include "gmm/model-test-common.h"
+
+namespace kaldi {
+
+// Sets up 'info' with random models for features of dimension 'dim', without
+// splicing, and with an identity matrix as the LDA matrix.
+void InitRandIvectorExtractionInfo(int32 dim,
+                                   OnlineIvectorExtractionInfo *info) {
+  info->lda_mat.Resize(dim, dim);
+  info->lda_mat.SetUnit();
+  // Global CMVN stats with zero mean and unit variance.
+  info->global_cmvn_stats.Resize(2, dim + 1);
+  info->global_cmvn_stats(0, dim) = 100.0;
+  info->global_cmvn_stats.Row(1).Range(0, dim).Set(100.0);
+  info->splice_opts.left_context = 0;
+  info->splice_opts.right_context = 0;
+
+  FullGmm fgmm;
+  unittest::InitRandFullGmm(dim, 2 + Rand() % 5, &fgmm);
+  info->diag_ubm.CopyFromFullGmm(fgmm);
+  IvectorExtractorOptions ivector_opts;
+  ivector_opts.ivector_dim = dim + 2;
+  IvectorExtractor extractor(ivector_opts, fgmm);
+  std::ostringstream os;
+  extractor.Write(os, true);
+  std::istringstream is(os.str());
+  info->extractor.Read(is, true);
+
+  info->ivector_period = 1 + Rand() % 10;
+  info->num_gselect = 5;
+  info->min_post = 0.025;
+  info->posterior_scale = 0.1;
+  info->max_count = 0.0;
+  info->num_cg_iters = 15;
+  info->use_most_recent_ivector = (Rand() % 2 == 0);
+  info->greedy_ivector_extractor = false;
+  info->max_remembered_frames = 1000;
+  info->Check();
+}
+
+// Checks that if we write the state of OnlineIvectorFeature part way through
+// the utterance, read it into a new object and continue with that, we get the
+// same iVectors as without the interruption.
+void TestOnlineIvectorFeatureState() {
+  int32 dim = 3 + Rand() % 5, num_frames = 10 + Rand() % 100;
+  OnlineIvectorExtractionInfo info;
+  InitRandIvectorExtractionInfo(dim, &info);
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+  OnlineMatrixFeature base_feature(feats);
+
+  int32 ivector_dim = info.extractor.IvectorDim();
+  Matrix<BaseFloat> ivectors1(num_frames, ivector_dim),
+      ivectors2(num_frames, ivector_dim);
+  {
+    OnlineIvectorFeature ivector_feature(info, &base_feature);
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(ivectors1, t);
+      ivector_feature.GetFrame(t, &row);
+    }
+  }
+
+  int32 num_frames_before = Rand() % num_frames;
+  std::ostringstream os;
+  {
+    OnlineIvectorFeature ivector_feature(info, &base_feature);
+    for (int32 t = 0; t < num_frames_before; t++) {
+      SubVector<BaseFloat> row(ivectors2, t);
+      ivector_feature.GetFrame(t, &row);
+    }
+    ivector_feature.WriteState(os, true);
+  }
+  {
+    OnlineIvectorFeature ivector_feature(info, &base_feature);
+    std::istringstream is(os.str());
+    ivector_feature.ReadState(is, true);
+    for (int32 t = num_frames_before; t < num_frames; t++) {
+      SubVector<BaseFloat> row(ivectors2, t);
+      ivector_feature.GetFrame(t, &row);
+    }
+  }
+  // The state was written in binary, so the iVectors should be exactly the
+  // same.
+  KALDI_ASSERT(ivectors1.Equal(ivectors2));
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestOnlineIvectorFeatureState();
+  KALDI_LOG << "Success.";
+}
@@ -434,6 +434,97 @@ void OnlineIvectorFeature::SetAdaptationState(
   cmvn_->SetState(adaptation_state.cmvn_state);
 }
 
+void OnlineIvectorFeature::WriteState(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<OnlineIvectorFeatureState>");
+  // The original CMVN state; the CMVN stats of this utterance are recomputed
+  // from the base features as needed.
+  OnlineCmvnState cmvn_state;
+  cmvn_->GetState(-1, &cmvn_state);
+  cmvn_state.Write(os, binary);
+  ivector_stats_.Write(os, binary);
+  WriteToken(os, binary, "<NumFramesStats>");
+  WriteBasicType(os, binary, num_frames_stats_);
+  // Copy the priority queue so we can get its elements.
+  std::priority_queue<std::pair<int32, BaseFloat>,
+                      std::vector<std::pair<int32, BaseFloat> >,
+                      std::greater<std::pair<int32, BaseFloat> > >
+      delta_weights(delta_weights_);
+  WriteToken(os, binary, "<DeltaWeights>");
+  WriteBasicType(os, binary, static_cast<int32>(delta_weights.size()));
+  for (; !delta_weights.empty(); delta_weights.pop()) {
+    WriteBasicType(os, binary, delta_weights.top().first);
+    WriteBasicType(os, binary, delta_weights.top().second);
+  }
+  WriteToken(os, binary, "<FrameWeightDebug>");
+  Vector<BaseFloat> frame_weight_debug(current_frame_weight_debug_.size());
+  for (size_t i = 0; i < current_frame_weight_debug_.size(); i++)
+    frame_weight_debug(i) = current_frame_weight_debug_[i];
+  frame_weight_debug.Write(os, binary);
+  WriteToken(os, binary, "<DeltaWeightsProvided>");
+  WriteBasicType(os, binary, delta_weights_provided_);
+  WriteToken(os, binary, "<UpdatedWithNoDeltaWeights>");
+  WriteBasicType(os, binary, updated_with_no_delta_weights_);
+  WriteToken(os, binary, "<MostRecentFrameWithWeight>");
+  WriteBasicType(os, binary, most_recent_frame_with_weight_);
+  WriteToken(os, binary, "<TotUbmLoglike>");
+  WriteBasicType(os, binary, tot_ubm_loglike_);
+  WriteToken(os, binary, "<CurrentIvector>");
+  current_ivector_.Write(os, binary);
+  WriteToken(os, binary, "<IvectorsHistory>");
+  Matrix<BaseFloat> ivectors_history(ivectors_history_.size(),
+                                     current_ivector_.Dim());
+  for (size_t i = 0; i < ivectors_history_.size(); i++)
+    ivectors_history.Row(i).CopyFromVec(*(ivectors_history_[i]));
+  ivectors_history.Write(os, binary);
+  WriteToken(os, binary, "</OnlineIvectorFeatureState>");
+}
+
+void OnlineIvectorFeature::ReadState(std::istream &is, bool binary) {
+  KALDI_ASSERT(num_frames_stats_ == 0 && ivectors_history_.empty() &&
+               "ReadState called after frames were processed.");
+  ExpectToken(is, binary, "<OnlineIvectorFeatureState>");
+  OnlineCmvnState cmvn_state;
+  cmvn_state.Read(is, binary);
+  cmvn_->SetState(cmvn_state);
+  ivector_stats_.Read(is, binary);
+  KALDI_ASSERT(ivector_stats_.IvectorDim() == info_.extractor.IvectorDim());
+  ExpectToken(is, binary, "<NumFramesStats>");
+  ReadBasicType(is, binary, &num_frames_stats_);
+  int32 num_delta_weights;
+  ExpectToken(is, binary, "<DeltaWeights>");
+  ReadBasicType(is, binary, &num_delta_weights);
+  while (!delta_weights_.empty())
+    delta_weights_.pop();
+  for (int32 i = 0; i < num_delta_weights; i++) {
+    std::pair<int32, BaseFloat> delta_weight;
+    ReadBasicType(is, binary, &(delta_weight.first));
+    ReadBasicType(is, binary, &(delta_weight.second));
+    delta_weights_.push(delta_weight);
+  }
+  ExpectToken(is, binary, "<FrameWeightDebug>");
+  Vector<BaseFloat> frame_weight_debug;
+  frame_weight_debug.Read(is, binary);
+  current_frame_weight_debug_.assign(
+      frame_weight_debug.Data(),
+      frame_weight_debug.Data() + frame_weight_debug.Dim());
+  ExpectToken(is, binary, "<DeltaWeightsProvided>");
+  ReadBasicType(is, binary, &delta_weights_provided_);
+  ExpectToken(is, binary, "<UpdatedWithNoDeltaWeights>");
+  ReadBasicType(is, binary, &updated_with_no_delta_weights_);
+  ExpectToken(is, binary, "<MostRecentFrameWithWeight>");
+  ReadBasicType(is, binary, &most_recent_frame_with_weight_);
+  ExpectToken(is, binary, "<TotUbmLoglike>");
+  ReadBasicType(is, binary, &tot_ubm_loglike_);
+  ExpectToken(is, binary, "<CurrentIvector>");
+  current_ivector_.Read(is, binary);
+  ExpectToken(is, binary, "<IvectorsHistory>");
+  Matrix<BaseFloat> ivectors_history;
+  ivectors_history.Read(is, binary);
+  for (int32 i = 0; i < ivectors_history.NumRows(); i++)
+    ivectors_history_.push_back(new Vector<BaseFloat>(ivectors_history.Row(i)));
+  ExpectToken(is, binary, "</OnlineIvectorFeatureState>");
+}
+
 BaseFloat OnlineIvectorFeature::UbmLogLikePerFrame() const {
   if (NumFrames() == 0) return 0;
   else return tot_ubm_loglike_ / NumFrames();
@@ -282,6 +282,17 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
   void GetAdaptationState(
       OnlineIvectorExtractorAdaptationState *adaptation_state) const;
 
+  /// Writes the state of the iVector estimation within this utterance (unlike
+  /// GetAdaptationState(), which is for carrying over to later utterances), so
+  /// that it can be resumed later, possibly in another process; see
+  /// ReadState().  It does not include the base features.
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState().  Call this on a new object with
+  /// the same OnlineIvectorExtractionInfo, instead of SetAdaptationState(),
+  /// after restoring the state of the base features.
+  void ReadState(std::istream &is, bool binary);
+
   virtual ~OnlineIvectorFeature();
 
   // Some diagnostics (not present in generic interface):
@@ -174,6 +174,43 @@ void OnlineNnet2FeaturePipeline::InputFinished() {
     pitch_->InputFinished();
 }
 
+void OnlineNnet2FeaturePipeline::WriteState(std::ostream &os,
+                                            bool binary) const {
+  if (pitch_ != NULL)
+    KALDI_ERR << "Saving the state of the feature pipeline is not supported "
+              << "with pitch features.";
+  WriteToken(os, binary, "<OnlineNnet2FeaturePipelineState>");
+  if (info_.feature_type == "mfcc") {
+    static_cast<OnlineMfcc*>(base_feature_)->WriteState(os, binary);
+  } else if (info_.feature_type == "plp") {
+    static_cast<OnlinePlp*>(base_feature_)->WriteState(os, binary);
+  } else {
+    KALDI_ASSERT(info_.feature_type == "fbank");
+    static_cast<OnlineFbank*>(base_feature_)->WriteState(os, binary);
+  }
+  if (ivector_feature_ != NULL)
+    ivector_feature_->WriteState(os, binary);
+  WriteToken(os, binary, "</OnlineNnet2FeaturePipelineState>");
+}
+
+void OnlineNnet2FeaturePipeline::ReadState(std::istream &is, bool binary) {
+  if (pitch_ != NULL)
+    KALDI_ERR << "Restoring the state of the feature pipeline is not "
+              << "supported with pitch features.";
+  ExpectToken(is, binary, "<OnlineNnet2FeaturePipelineState>");
+  if (info_.feature_type == "mfcc") {
+    static_cast<OnlineMfcc*>(base_feature_)->ReadState(is, binary);
+  } else if (info_.feature_type == "plp") {
+    static_cast<OnlinePlp*>(base_feature_)->ReadState(is, binary);
+  } else {
+    KALDI_ASSERT(info_.feature_type == "fbank");
+    static_cast<OnlineFbank*>(base_feature_)->ReadState(is, binary);
+  }
+  if (ivector_feature_ != NULL)
+    ivector_feature_->ReadState(is, binary);
+  ExpectToken(is, binary, "</OnlineNnet2FeaturePipelineState>");
+}
+
 BaseFloat OnlineNnet2FeaturePipelineInfo::FrameShiftInSeconds() const {
   if (feature_type == "mfcc") {
     return mfcc_opts.frame_opts.frame_shift_ms / 1000.0f;
@@ -228,6 +228,18 @@ class OnlineNnet2FeaturePipeline: public OnlineFeatureInterface {
   /// rescoring the lattices, this may not be much of an issue.
   void InputFinished();
 
+  /// Writes the state of the feature extraction for this utterance, so that
+  /// it can be resumed later, possibly in another process; this is for
+  /// checkpointing or migrating online decoding sessions (see also
+  /// SingleUtteranceNnet3DecoderTpl::WriteState()).  Not supported with pitch
+  /// features.
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState().  Call this on a newly
+  /// constructed object with the same "info", instead of
+  /// SetAdaptationState().
+  void ReadState(std::istream &is, bool binary);
+
   // This function returns the ivector-extracting part of the feature pipeline
   // (or NULL if iVectors are not being used); the pointer is owned here and not
   // given to the caller.  This function is used in nnet3, and also in the
@@ -31,24 +31,37 @@ SingleUtteranceNnet3DecoderTpl<FST>::SingleUtteranceNnet3DecoderTpl(
     const TransitionModel &trans_model,
     const nnet3::DecodableNnetSimpleLoopedInfo &info,
     const FST &fst,
-    OnlineNnet2FeaturePipeline *features):
+    OnlineNnet2FeaturePipeline *features,
+    const LatticeIncrementalDeterminizerConfig &incremental_opts):
     decoder_opts_(decoder_opts),
     input_feature_frame_shift_in_seconds_(features->FrameShiftInSeconds()),
     trans_model_(trans_model),
     decodable_(trans_model_, info,
                features->InputFeature(), features->IvectorFeature()),
-    decoder_(fst, decoder_opts_) {
+    decoder_(fst, decoder_opts_),
+    incremental_opts_(incremental_opts),
+    determinizer_(incremental_opts_, trans_model_, decoder_),
+    best_path_tracker_(decoder_),
+    listener_(NULL) {
   decoder_.InitDecoding();
+  determinizer_.Init();
+  best_path_tracker_.Init();
 }
 
 template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::AdvanceDecoding() {
   decoder_.AdvanceDecoding(&decodable_);
+  if (listener_ != NULL && best_path_tracker_.Update(false))
+    listener_->PartialResultChanged(best_path_tracker_.Words(),
+                                    best_path_tracker_.NumStableWords());
 }
 
 template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::FinalizeDecoding() {
   decoder_.FinalizeDecoding();
+  if (listener_ != NULL && best_path_tracker_.Update(true))
+    listener_->PartialResultChanged(best_path_tracker_.Words(),
+                                    best_path_tracker_.NumStableWords());
 }
 
 template <typename FST>
@@ -73,12 +86,44 @@ void SingleUtteranceNnet3DecoderTpl<FST>::GetLattice(bool end_of_utterance,
       trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
 }
 
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::GetLatticeIncremental(
+    bool end_of_utterance, CompactLattice *clat) {
+  if (NumFramesDecoded() == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+  determinizer_.AdvanceDeterminization();
+  determinizer_.GetLattice(end_of_utterance, clat);
+}
+
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::AdvanceDeterminization() {
+  determinizer_.AdvanceDeterminization();
+}
+
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::GetPartialResult(
+    bool end_of_utterance, std::vector<int32> *words,
+    int32 *num_stable_words) {
+  best_path_tracker_.Update(end_of_utterance);
+  *words = best_path_tracker_.Words();
+  *num_stable_words = best_path_tracker_.NumStableWords();
+}
+
 template <typename FST>
 void SingleUtteranceNnet3DecoderTpl<FST>::GetBestPath(bool end_of_utterance,
                                               Lattice *best_path) const {
   decoder_.GetBestPath(best_path, end_of_utterance);
 }
 
+template <typename FST>
+bool SingleUtteranceNnet3DecoderTpl<FST>::GetWordConfidences(
+    bool end_of_utterance, BaseFloat acoustic_scale,
+    std::vector<WordConfidence> *words) const {
+  return decoder_.GetWordConfidences(end_of_utterance, acoustic_scale, words);
+}
+
 template <typename FST>
 bool SingleUtteranceNnet3DecoderTpl<FST>::EndpointDetected(
     const OnlineEndpointConfig &config) {
@@ -90,6 +135,28 @@ bool SingleUtteranceNnet3DecoderTpl<FST>::EndpointDetected(
 }
 
 
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::WriteState(std::ostream &os,
+                                                     bool binary) const {
+  WriteToken(os, binary, "<SingleUtteranceNnet3DecoderState>");
+  decodable_.WriteState(os, binary);
+  decoder_.WriteState(os, binary);
+  WriteToken(os, binary, "</SingleUtteranceNnet3DecoderState>");
+}
+
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::ReadState(std::istream &is,
+                                                    bool binary) {
+  ExpectToken(is, binary, "<SingleUtteranceNnet3DecoderState>");
+  decodable_.ReadState(is, binary);
+  decoder_.ReadState(is, binary);
+  ExpectToken(is, binary, "</SingleUtteranceNnet3DecoderState>");
+  // The determinized lattice and the best path are worked out again from the
+  // decoder's tokens when they are next needed.
+  determinizer_.Init();
+  best_path_tracker_.Init();
+}
+
 // Instantiate the template for the types needed.
 template class SingleUtteranceNnet3DecoderTpl<fst::Fst<fst::StdArc> >;
 template class SingleUtteranceNnet3DecoderTpl<fst::GrammarFst>;
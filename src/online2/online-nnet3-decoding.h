@@ -34,6 +34,8 @@
 #include "online2/online-endpoint.h"
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "decoder/lattice-faster-online-decoder.h"
+#include "decoder/lattice-incremental-determinizer.h"
+#include "decoder/best-path-tracker.h"
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 
@@ -42,6 +44,22 @@ namespace kaldi {
 /// @{
 
 
+/**
+   This is an interface for being told about changes in the partial result
+   (the words on the current best path) while decoding; see
+   SingleUtteranceNnet3DecoderTpl::SetPartialResultListener().
+*/
+class PartialResultListener {
+ public:
+  /// Called when the words on the best path have changed.  The first
+  /// 'num_stable_words' of them will not change any more.
+  virtual void PartialResultChanged(const std::vector<int32> &words,
+                                    int32 num_stable_words) = 0;
+
+  virtual ~PartialResultListener() { }
+};
+
+
 /**
    You will instantiate this class when you want to decode a single utterance
    using the online-decoding setup for neural nets.  The template will be
@@ -58,7 +76,10 @@ class SingleUtteranceNnet3DecoderTpl {
                                  const TransitionModel &trans_model,
                                  const nnet3::DecodableNnetSimpleLoopedInfo &info,
                                  const FST &fst,
-                                 OnlineNnet2FeaturePipeline *features);
+                                 OnlineNnet2FeaturePipeline *features,
+                                 const LatticeIncrementalDeterminizerConfig
+                                 &incremental_opts =
+                                 LatticeIncrementalDeterminizerConfig());
 
   /// advance the decoding as far as we can.
   void AdvanceDecoding();
@@ -78,6 +99,21 @@ class SingleUtteranceNnet3DecoderTpl {
   void GetLattice(bool end_of_utterance,
                   CompactLattice *clat) const;
 
+  /// This is like GetLattice(), but it remembers the determinized lattice
+  /// for the frames that are far enough back (see
+  /// LatticeIncrementalDeterminizerConfig), and only determinizes the frames
+  /// after those, so calling it repeatedly during a long utterance takes time
+  /// linear, not quadratic, in the length of the utterance.  The lattice is
+  /// only determinized within the chunks it is determinized in, so it may be
+  /// a little larger than the output of GetLattice().
+  void GetLatticeIncremental(bool end_of_utterance,
+                             CompactLattice *clat);
+
+  /// If you will call GetLatticeIncremental(), you can call this after each
+  /// call to AdvanceDecoding() so that the lattice is determinized as the
+  /// decoding progresses, rather than all at once when it is requested.
+  void AdvanceDeterminization();
+
   /// Outputs an FST corresponding to the single best path through the current
   /// lattice. If "use_final_probs" is true AND we reached the final-state of
   /// the graph then it will include those as final-probs, else it will treat
@@ -85,11 +121,53 @@ class SingleUtteranceNnet3DecoderTpl {
   void GetBestPath(bool end_of_utterance,
                    Lattice *best_path) const;
 
+  /// Outputs the words on the best path with approximate confidences, without
+  /// creating a lattice; see LatticeFasterDecoderTpl::GetWordConfidences().
+  /// Note: "acoustic_scale" is applied on top of the acoustic scale used in
+  /// decoding.  Returns false on error.
+  bool GetWordConfidences(bool end_of_utterance, BaseFloat acoustic_scale,
+                          std::vector<WordConfidence> *words) const;
+
+
+  /// Outputs the words on the current best path, of which the first
+  /// '*num_stable_words' will not change any more.  This remembers the
+  /// best path from last time (see class BestPathTracker), so calling it
+  /// often is cheap even for long utterances.  If "end_of_utterance" is true,
+  /// the final-probs are used (if any final state was reached).
+  void GetPartialResult(bool end_of_utterance,
+                        std::vector<int32> *words,
+                        int32 *num_stable_words);
+
+  /// If you call this, 'listener' will be notified after AdvanceDecoding() or
+  /// FinalizeDecoding() whenever the partial result has changed, so you don't
+  /// have to poll for it.  The listener is not owned by this class; you can
+  /// set it to NULL to stop the notifications.
+  void SetPartialResultListener(PartialResultListener *listener) {
+    listener_ = listener;
+  }
 
   /// This function calls EndpointDetected from online-endpoint.h,
   /// with the required arguments.
   bool EndpointDetected(const OnlineEndpointConfig &config);
 
+  /// Writes the state of the decoding (of the neural net computation and of
+  /// the search), so that it can be resumed later, possibly in another
+  /// process.  This is for checkpointing sessions, migrating them between
+  /// servers, or keeping paused sessions out of memory; the resumed decoding
+  /// gives the same lattice as an uninterrupted one (see
+  /// LatticeFasterDecoderTpl::WriteState()).  To checkpoint, call WriteState()
+  /// on the feature pipeline and then on this object.  To restore, construct a
+  /// new OnlineNnet2FeaturePipeline with the same info and call its
+  /// ReadState(), then construct this object with it (and the same models,
+  /// graph and options) and call ReadState(); then carry on with
+  /// AcceptWaveform() and AdvanceDecoding() as before.  If you use
+  /// OnlineSilenceWeighting, its state is not included; you would have to
+  /// start a new one.
+  void WriteState(std::ostream &os, bool binary) const;
+
+  /// Reads the state written by WriteState(); see its documentation.
+  void ReadState(std::istream &is, bool binary);
+
   const LatticeFasterOnlineDecoderTpl<FST> &Decoder() const { return decoder_; }
 
   ~SingleUtteranceNnet3DecoderTpl() { }
@@ -109,6 +187,16 @@ class SingleUtteranceNnet3DecoderTpl {
 
   LatticeFasterOnlineDecoderTpl<FST> decoder_;
 
+  LatticeIncrementalDeterminizerConfig incremental_opts_;
+
+  // Used by GetLatticeIncremental().
+  LatticeIncrementalDeterminizerTpl<FST, decoder::BackpointerToken>
+      determinizer_;
+
+  // Used by GetPartialResult() and for notifying listener_.
+  BestPathTrackerTpl<FST> best_path_tracker_;
+
+  PartialResultListener *listener_;  // Not owned; may be NULL.
 };
 
 
@@ -0,0 +1,316 @@
+// online2bin/online2-benchmark-features.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <new>
+#if !defined(_MSC_VER) && !defined(__CYGWIN__)
+#include <dlfcn.h>
+#endif
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "feat/feature-fbank.h"
+#include "feat/feature-mfcc.h"
+#include "feat/feature-plp.h"
+#include "feat/feature-spectrogram.h"
+#include "feat/pitch-functions.h"
+#include "feat/resample.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+
+// Counts of allocations, and of bytes requested, for the whole program.  We
+// count calls to operator new, and calls to posix_memalign(), which
+// KALDI_MEMALIGN uses for the storage of Kaldi's Vector and Matrix classes,
+// by defining those functions here.
+static std::atomic<long long> g_num_allocs(0), g_num_alloc_bytes(0);
+
+#if !defined(_MSC_VER) && !defined(__CYGWIN__)
+extern "C" int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  typedef int (*PosixMemalignFn)(void**, size_t, size_t);
+  // The C library's posix_memalign(), which this one hides.
+  static PosixMemalignFn libc_posix_memalign =
+      reinterpret_cast<PosixMemalignFn>(dlsym(RTLD_NEXT, "posix_memalign"));
+  g_num_allocs++;
+  g_num_alloc_bytes += size;
+  return libc_posix_memalign(memptr, alignment, size);
+}
+#endif
+
+void *operator new(size_t size) {
+  g_num_allocs++;
+  g_num_alloc_bytes += size;
+  void *ans = malloc(size == 0 ? 1 : size);
+  if (ans == NULL) throw std::bad_alloc();
+  return ans;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+
+namespace kaldi {
+
+// Creates a synthetic, roughly speech-like signal: a harmonic series with a
+// slowly varying fundamental and amplitude, plus some noise, scaled like
+// 16-bit audio.  The varying fundamental gives the pitch extractor something
+// to track.
+void SynthesizeAudio(BaseFloat samp_freq, BaseFloat duration,
+                     Vector<BaseFloat> *wave) {
+  int32 num_samp = static_cast<int32>(samp_freq * duration);
+  wave->Resize(num_samp);
+  double phase = 0.0;
+  for (int32 i = 0; i < num_samp; i++) {
+    double t = i / samp_freq,
+        f0 = 150.0 + 50.0 * std::sin(2.0 * M_PI * 0.5 * t),
+        amplitude = 2000.0 * (1.2 + std::sin(2.0 * M_PI * 3.0 * t));
+    phase += 2.0 * M_PI * f0 / samp_freq;
+    double sample = 0.0;
+    for (int32 h = 1; h <= 10 && h * f0 < 0.5 * samp_freq; h++)
+      sample += std::sin(h * phase) / h;
+    (*wave)(i) = amplitude * sample + 100.0 * RandGauss();
+  }
+}
+
+
+// Timing and allocation counts for one thing being benchmarked.
+struct BenchmarkResult {
+  std::string name;
+  int64 num_frames;  // total over all repeats.
+  double seconds;    // total over all repeats.
+  long long num_allocs;
+  long long num_alloc_bytes;
+};
+
+
+// Helper class that records the time and allocations between its
+// construction and the call to Finish().
+class BenchmarkTimer {
+ public:
+  explicit BenchmarkTimer(const std::string &name):
+      name_(name), start_allocs_(g_num_allocs),
+      start_alloc_bytes_(g_num_alloc_bytes) { }
+
+  void Finish(int64 num_frames, std::vector<BenchmarkResult> *results) {
+    BenchmarkResult r;
+    r.seconds = timer_.Elapsed();
+    r.name = name_;
+    r.num_frames = num_frames;
+    r.num_allocs = g_num_allocs - start_allocs_;
+    r.num_alloc_bytes = g_num_alloc_bytes - start_alloc_bytes_;
+    KALDI_LOG << name_ << ": " << num_frames << " frames in " << r.seconds
+              << " seconds.";
+    results->push_back(r);
+  }
+ private:
+  std::string name_;
+  Timer timer_;
+  long long start_allocs_;
+  long long start_alloc_bytes_;
+};
+
+
+template <class F>
+void BenchmarkOfflineFeature(const std::string &name,
+                             const typename F::Options &opts,
+                             const Vector<BaseFloat> &wave,
+                             int32 num_repeats,
+                             std::vector<BenchmarkResult> *results) {
+  F computer(opts);
+  BaseFloat samp_freq = opts.frame_opts.samp_freq;
+  BenchmarkTimer timer(name);
+  int64 num_frames = 0;
+  for (int32 n = 0; n < num_repeats; n++) {
+    Matrix<BaseFloat> feats;
+    computer.ComputeFeatures(wave, samp_freq, 1.0, &feats);
+    num_frames += feats.NumRows();
+  }
+  timer.Finish(num_frames, results);
+}
+
+
+void WriteBenchmarkResultsJson(BaseFloat samp_freq,
+                               BaseFloat duration,
+                               int32 num_repeats,
+                               const std::vector<BenchmarkResult> &results,
+                               std::ostream &os) {
+  os << "{\n  \"sample_frequency\": " << samp_freq
+     << ",\n  \"duration_seconds\": " << duration
+     << ",\n  \"num_repeats\": " << num_repeats
+     << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchmarkResult &r = results[i];
+    double frames = std::max<int64>(r.num_frames, 1);
+    os << (i == 0 ? "\n" : ",\n")
+       << "    {\"name\": \"" << r.name << "\""
+       << ", \"frames\": " << r.num_frames
+       << ", \"seconds\": " << r.seconds
+       << ", \"frames_per_sec\": " << (r.num_frames / r.seconds)
+       << ", \"ns_per_frame\": " << (1.0e+09 * r.seconds / frames)
+       << ", \"real_time_factor\": "
+       << (r.seconds / (duration * num_repeats))
+       << ", \"allocs\": " << r.num_allocs
+       << ", \"alloc_bytes\": " << r.num_alloc_bytes
+       << ", \"allocs_per_frame\": " << (r.num_allocs / frames) << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Benchmark the feature-extraction code on synthetic audio.  Times\n"
+        "filterbank, MFCC, PLP, spectrogram, pitch and pitch post-processing\n"
+        "features, resampling to half the sample rate, and the online feature\n"
+        "pipeline used for nnet2/nnet3 decoding (OnlineNnet2FeaturePipeline,\n"
+        "fed --chunk-length seconds of audio at a time), and writes frames/sec,\n"
+        "ns/frame, real-time factor and allocation counts as JSON.  For\n"
+        "resampling, 'frames' are 10ms frames of input audio.  Allocation\n"
+        "counts include calls to operator new and to posix_memalign(), which\n"
+        "allocates the storage of Kaldi vectors and matrices (other calls to\n"
+        "malloc() are not counted; nor is posix_memalign() on Windows).\n"
+        "The feature options are taken from the same configuration files as\n"
+        "online2-wav-nnet3-latgen-faster uses, with the sample frequency\n"
+        "overridden by --sample-frequency.\n"
+        "\n"
+        "Usage: online2-benchmark-features [options] [<json-wxfilename>]\n"
+        "e.g.: online2-benchmark-features --duration=60 --sample-frequency=8000 -\n";
+
+    ParseOptions po(usage);
+    OnlineNnet2FeaturePipelineConfig feature_config;
+    BaseFloat samp_freq = 16000.0, duration = 10.0, chunk_length = 0.05;
+    int32 num_repeats = 3, srand_seed = 0;
+    po.Register("sample-frequency", &samp_freq, "Sample frequency of the "
+                "synthetic audio, in Hz");
+    po.Register("duration", &duration, "Length of the synthetic audio, in "
+                "seconds");
+    po.Register("num-repeats", &num_repeats, "Number of times to process the "
+                "audio with each feature type");
+    po.Register("chunk-length", &chunk_length, "Length of the pieces of audio "
+                "given to the online feature pipeline, in seconds");
+    po.Register("srand", &srand_seed, "Seed for the random number generator");
+    feature_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() > 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    std::string json_wxfilename = po.GetOptArg(1);
+    if (json_wxfilename == "") json_wxfilename = "-";
+    if (duration <= 0.0 || num_repeats <= 0 || chunk_length <= 0.0)
+      KALDI_ERR << "--duration, --num-repeats and --chunk-length must be "
+                << "positive.";
+
+    srand(srand_seed);
+    OnlineNnet2FeaturePipelineInfo info(feature_config);
+    info.mfcc_opts.frame_opts.samp_freq = samp_freq;
+    info.fbank_opts.frame_opts.samp_freq = samp_freq;
+    info.plp_opts.frame_opts.samp_freq = samp_freq;
+    info.pitch_opts.samp_freq = samp_freq;
+    SpectrogramOptions spectrogram_opts;
+    spectrogram_opts.frame_opts.samp_freq = samp_freq;
+
+    Vector<BaseFloat> wave;
+    SynthesizeAudio(samp_freq, duration, &wave);
+
+    std::vector<BenchmarkResult> results;
+    BenchmarkOfflineFeature<Fbank>("fbank", info.fbank_opts, wave,
+                                   num_repeats, &results);
+    BenchmarkOfflineFeature<Mfcc>("mfcc", info.mfcc_opts, wave,
+                                  num_repeats, &results);
+    BenchmarkOfflineFeature<Plp>("plp", info.plp_opts, wave,
+                                 num_repeats, &results);
+    BenchmarkOfflineFeature<Spectrogram>("spectrogram", spectrogram_opts,
+                                         wave, num_repeats, &results);
+
+    Matrix<BaseFloat> pitch;
+    {
+      BenchmarkTimer timer("pitch");
+      int64 num_frames = 0;
+      for (int32 n = 0; n < num_repeats; n++) {
+        ComputeKaldiPitch(info.pitch_opts, wave, &pitch);
+        num_frames += pitch.NumRows();
+      }
+      timer.Finish(num_frames, &results);
+    }
+    {
+      BenchmarkTimer timer("process-pitch");
+      int64 num_frames = 0;
+      for (int32 n = 0; n < num_repeats; n++) {
+        Matrix<BaseFloat> processed_pitch;
+        ProcessPitch(info.pitch_process_opts, pitch, &processed_pitch);
+        num_frames += processed_pitch.NumRows();
+      }
+      timer.Finish(num_frames, &results);
+    }
+    {
+      int32 samp_rate_in = static_cast<int32>(samp_freq),
+          samp_rate_out = samp_rate_in / 2;
+      LinearResample resampler(samp_rate_in, samp_rate_out,
+                               0.99 * 0.5 * samp_rate_out, 6);
+      BenchmarkTimer timer("resample");
+      for (int32 n = 0; n < num_repeats; n++) {
+        Vector<BaseFloat> resampled;
+        resampler.Resample(wave, true, &resampled);
+        resampler.Reset();
+      }
+      timer.Finish(static_cast<int64>(duration * 100) * num_repeats,
+                   &results);
+    }
+    {
+      BenchmarkTimer timer("online-nnet2-feature-pipeline");
+      int32 chunk_samples = std::max<int32>(1, chunk_length * samp_freq);
+      int64 num_frames = 0;
+      for (int32 n = 0; n < num_repeats; n++) {
+        OnlineNnet2FeaturePipeline pipeline(info);
+        Vector<BaseFloat> frame(pipeline.Dim());
+        int32 frames_done = 0;
+        for (int32 offset = 0; offset < wave.Dim(); offset += chunk_samples) {
+          int32 this_chunk = std::min(chunk_samples, wave.Dim() - offset);
+          SubVector<BaseFloat> chunk(wave, offset, this_chunk);
+          pipeline.AcceptWaveform(samp_freq, chunk);
+          if (offset + this_chunk == wave.Dim())
+            pipeline.InputFinished();
+          // Read out the frames that are ready, as a decoder would.
+          for (; frames_done < pipeline.NumFramesReady(); frames_done++)
+            pipeline.GetFrame(frames_done, &frame);
+        }
+        num_frames += frames_done;
+      }
+      timer.Finish(num_frames, &results);
+    }
+
+    Output ko(json_wxfilename, false);
+    WriteBenchmarkResultsJson(samp_freq, duration, num_repeats, results,
+                              ko.Stream());
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -72,6 +72,34 @@ void GetDiagnosticsAndPrintOutput(const std::string &utt,
   }
 }
 
+// Prints the partial results to the log as they change, with the words that
+// may still change in brackets.
+class PartialResultPrinter: public PartialResultListener {
+ public:
+  PartialResultPrinter(const std::string &utt,
+                       const fst::SymbolTable *word_syms):
+      utt_(utt), word_syms_(word_syms) { }
+
+  virtual void PartialResultChanged(const std::vector<int32> &words,
+                                    int32 num_stable_words) {
+    std::ostringstream os;
+    for (size_t i = 0; i < words.size(); i++) {
+      if (static_cast<int32>(i) == num_stable_words)
+        os << "[ ";
+      if (word_syms_ != NULL)
+        os << word_syms_->Find(words[i]) << ' ';
+      else
+        os << words[i] << ' ';
+    }
+    if (num_stable_words < static_cast<int32>(words.size()))
+      os << "]";
+    KALDI_LOG << "Partial result for " << utt_ << ": " << os.str();
+  }
+ private:
+  std::string utt_;
+  const fst::SymbolTable *word_syms_;
+};
+
 }
 
 int main(int argc, char *argv[]) {
@@ -95,7 +123,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
 
-    std::string word_syms_rxfilename;
+    std::string word_syms_rxfilename, ctm_wxfilename;
 
     // feature_opts includes configuration for the iVector adaptation,
     // as well as the basic features.
@@ -103,10 +131,15 @@ int main(int argc, char *argv[]) {
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
     LatticeFasterDecoderConfig decoder_opts;
     OnlineEndpointConfig endpoint_opts;
+    LatticeIncrementalDeterminizerConfig incremental_opts;
 
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
     bool online = true;
+    bool print_partial_results = false;
+    bool incremental_lattice = false;
+    BaseFloat confidence_acoustic_scale = 0.1;
+    int32 confidence_digits = 2;
 
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
@@ -124,6 +157,27 @@ int main(int argc, char *argv[]) {
                 "--use-most-recent-ivector=true and --greedy-ivector-extractor=true "
                 "in the file given to --ivector-extraction-config, and "
                 "--chunk-length=-1.");
+    po.Register("print-partial-results", &print_partial_results,
+                "If true, print the partial results (words on the best path) "
+                "to the log whenever they change; the words that may still "
+                "change are shown in brackets.");
+    po.Register("incremental-lattice", &incremental_lattice,
+                "If true, determinize the lattice in chunks while decoding "
+                "(see --determinize-delay and --determinize-period), so that "
+                "little work is left at the end of a long utterance.");
+    po.Register("ctm-wxfilename", &ctm_wxfilename, "If set, write a ctm with "
+                "word confidences to this file.  The confidences are "
+                "approximate word posteriors computed from the decoder's "
+                "lattice without determinizing it, so this is much faster "
+                "than lattice-to-ctm-conf; the times go from each word to the "
+                "next one.  Words are written as integers.");
+    po.Register("confidence-acoustic-scale", &confidence_acoustic_scale,
+                "Scaling factor for the acoustic log-likelihoods when "
+                "computing the confidences for --ctm-wxfilename (like "
+                "--acoustic-scale of lattice-to-ctm-conf; it does not include "
+                "--acoustic-scale).");
+    po.Register("confidence-digits", &confidence_digits, "Number of decimal "
+                "digits for the confidences in --ctm-wxfilename.");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
 
@@ -131,6 +185,7 @@ int main(int argc, char *argv[]) {
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
     endpoint_opts.Register(&po);
+    incremental_opts.Register(&po);
 
 
     po.Read(argc, argv);
@@ -189,7 +244,21 @@ int main(int argc, char *argv[]) {
     RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
     CompactLatticeWriter clat_writer(clat_wspecifier);
 
+    Output *ctm_output = NULL;
+    if (ctm_wxfilename != "") {
+      if (ClassifyWspecifier(ctm_wxfilename, NULL, NULL, NULL) != kNoWspecifier)
+        KALDI_ERR << "The ctm output should be a filename, not a wspecifier: "
+                  << ctm_wxfilename;
+      ctm_output = new Output(ctm_wxfilename, false);
+      ctm_output->Stream() << std::fixed;
+      ctm_output->Stream().precision(confidence_digits);
+    }
+    // The time in seconds of each frame of the decoder's output.
+    BaseFloat output_frame_shift = feature_info.FrameShiftInSeconds() *
+        decodable_opts.frame_subsampling_factor;
+
     OnlineTimingStats timing_stats;
+    AdaptiveBeamStats adaptive_beam_stats;
 
     for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
       std::string spk = spk2utt_reader.Key();
@@ -218,7 +287,11 @@ int main(int argc, char *argv[]) {
 
         SingleUtteranceNnet3Decoder decoder(decoder_opts, trans_model,
                                             decodable_info,
-                                            *decode_fst, &feature_pipeline);
+                                            *decode_fst, &feature_pipeline,
+                                            incremental_opts);
+        PartialResultPrinter partial_result_printer(utt, word_syms);
+        if (print_partial_results)
+          decoder.SetPartialResultListener(&partial_result_printer);
         OnlineTimer decoding_timer(utt);
 
         BaseFloat samp_freq = wave_data.SampFreq();
@@ -257,6 +330,8 @@ int main(int argc, char *argv[]) {
           }
 
           decoder.AdvanceDecoding();
+          if (incremental_lattice)
+            decoder.AdvanceDeterminization();
 
           if (do_endpointing && decoder.EndpointDetected(endpoint_opts)) {
             break;
@@ -266,12 +341,34 @@ int main(int argc, char *argv[]) {
 
         CompactLattice clat;
         bool end_of_utterance = true;
-        decoder.GetLattice(end_of_utterance, &clat);
+        if (incremental_lattice)
+          decoder.GetLatticeIncremental(end_of_utterance, &clat);
+        else
+          decoder.GetLattice(end_of_utterance, &clat);
 
         GetDiagnosticsAndPrintOutput(utt, word_syms, clat,
                                      &num_frames, &tot_like);
 
+        if (ctm_output != NULL) {
+          // The decoder's acoustic costs are already scaled by
+          // --acoustic-scale.
+          std::vector<WordConfidence> words;
+          if (decoder.GetWordConfidences(
+                  end_of_utterance,
+                  confidence_acoustic_scale / decodable_opts.acoustic_scale,
+                  &words)) {
+            for (size_t w = 0; w < words.size(); w++)
+              ctm_output->Stream()
+                  << utt << " 1 " << (output_frame_shift * words[w].start_frame)
+                  << ' ' << (output_frame_shift * words[w].num_frames) << ' '
+                  << words[w].word << ' ' << words[w].confidence << '\n';
+          } else {
+            KALDI_WARN << "Could not compute confidences for utterance " << utt;
+          }
+        }
+
         decoding_timer.OutputStats(&timing_stats);
+        adaptive_beam_stats.Add(decoder.Decoder().GetAdaptiveBeamStats());
 
         // In an application you might avoid updating the adaptation state if
         // you felt the utterance had low confidence.  See lat/confidence.h
@@ -288,11 +385,14 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    if (decoder_opts.adaptive_beam_opts.Enabled())
+      adaptive_beam_stats.Print();
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
     KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
               << " per frame over " << num_frames << " frames.";
+    delete ctm_output;  // will delete if non-NULL.
     delete decode_fst;
     delete word_syms; // will delete if non-NULL.
     return (num_done != 0 ? 0 : 1);
@@ -177,7 +177,7 @@ int main(int argc, char *argv[]) {
 
 
     fst::GrammarFst fst;
-    ReadKaldiObject(fst_rxfilename, &fst);
+    ReadGrammarFst(fst_rxfilename, &fst);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
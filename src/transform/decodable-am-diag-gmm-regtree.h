@@ -54,6 +54,12 @@ class DecodableAmDiagGmmRegtreeFmllr: public DecodableAmDiagGmmUnmapped {
                                          trans_model_.TransitionIdToPdfFast(tid));
   }
 
+  // The base class would compute these from the untransformed model.
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &tids,
+                              std::vector<BaseFloat> *log_likes) {
+    DecodableInterface::LogLikelihoods(frame, tids, log_likes);
+  }
+
   virtual int32 NumFramesReady() const { return feature_matrix_.NumRows(); }
 
   // Indices are one-based!  This is for compatibility with OpenFst.
@@ -97,6 +103,12 @@ class DecodableAmDiagGmmRegtreeMllr: public DecodableAmDiagGmmUnmapped {
                                          trans_model_.TransitionIdToPdfFast(tid));
   }
 
+  // The base class would compute these from the untransformed model.
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &tids,
+                              std::vector<BaseFloat> *log_likes) {
+    DecodableInterface::LogLikelihoods(frame, tids, log_likes);
+  }
+
   virtual int32 NumFramesReady() const { return feature_matrix_.NumRows(); }
 
   // Indices are one-based!  This is for compatibility with OpenFst.
@@ -23,9 +23,52 @@
 using std::vector;
 
 #include "transform/lvtln.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
+// This class is used by LinearVtln::ComputeTransform() to evaluate the
+// classes in parallel.  For each class i handled by this thread, it computes
+// the fMLLR transform estimated on top of A[i], composed with A[i], and its
+// auxiliary function; each class is written to its own element of the
+// outputs, so the threads never write to the same place.
+class LinearVtlnClassEvaluator: public MultiThreadable {
+ public:
+  LinearVtlnClassEvaluator(const std::vector<Matrix<BaseFloat> > &A,
+                           const FmllrDiagGmmAccs &accs,
+                           const std::string &norm_type,
+                           std::vector<Matrix<BaseFloat> > *transforms,
+                           std::vector<BaseFloat> *objfs):
+      A_(A), accs_(accs), norm_type_(norm_type), transforms_(transforms),
+      objfs_(objfs) { }
+
+  void operator () () {
+    int32 dim = accs_.Dim(), num_classes = A_.size();
+    for (int32 i = thread_id_; i < num_classes; i += num_threads_) {
+      FmllrDiagGmmAccs accs_tmp(accs_);
+      ApplyFeatureTransformToStats(A_[i], &accs_tmp);
+      // "old_trans" just needed by next function as "initial" transform.
+      Matrix<BaseFloat> old_trans(dim, dim+1); old_trans.SetUnit();
+      Matrix<BaseFloat> trans(dim, dim+1);
+      ComputeFmllrMatrixDiagGmm(old_trans, accs_tmp, norm_type_,
+                                100,  // num iters.. don't care since norm_type != "full"
+                                &trans);
+      Matrix<BaseFloat> &product = (*transforms_)[i];
+      product.Resize(dim, dim+1);
+      // product = trans * A_[i] (modulo messing about with offsets)
+      ComposeTransforms(trans, A_[i], false, &product);
+      (*objfs_)[i] = FmllrAuxFuncDiagGmm(product, accs_);
+    }
+  }
+ private:
+  const std::vector<Matrix<BaseFloat> > &A_;
+  const FmllrDiagGmmAccs &accs_;
+  const std::string &norm_type_;
+  std::vector<Matrix<BaseFloat> > *transforms_;
+  std::vector<BaseFloat> *objfs_;
+};
+
+
 LinearVtln::LinearVtln(int32 dim, int32 num_classes, int32 default_class) {
   default_class_ = default_class;
   KALDI_ASSERT(default_class >= 0 && default_class < num_classes);
@@ -101,7 +144,8 @@ void LinearVtln::ComputeTransform(const FmllrDiagGmmAccs &accs,
                                   int32 *class_idx,  // the transform that was chosen...
                                   BaseFloat *logdet_out,
                                   BaseFloat *objf_impr,  // versus no transform
-                                  BaseFloat *count) {
+                                  BaseFloat *count,
+                                  int32 num_threads) {
   int32 dim = Dim();
   KALDI_ASSERT(dim != 0);
   if (norm_type != "none"  && norm_type != "offset" && norm_type != "diag")
@@ -129,20 +173,19 @@ void LinearVtln::ComputeTransform(const FmllrDiagGmmAccs &accs,
       best_objf = -1.0e+100;
   int32 best_class = -1;
 
+  std::vector<Matrix<BaseFloat> > transforms(NumClasses());
+  std::vector<BaseFloat> objfs(NumClasses());
+  {
+    LinearVtlnClassEvaluator evaluator(A_, accs, norm_type,
+                                       &transforms, &objfs);
+    // num_threads == 0 makes MultiThreader run it in this thread.
+    MultiThreader<LinearVtlnClassEvaluator> m(
+        num_threads > 1 ? std::min(num_threads, NumClasses()) : 0,
+        evaluator);
+  }
+
   for (int32 i = 0; i < NumClasses(); i++) {
-    FmllrDiagGmmAccs accs_tmp(accs);
-    ApplyFeatureTransformToStats(A_[i], &accs_tmp);
-    // "old_trans" just needed by next function as "initial" transform.
-    Matrix<BaseFloat> old_trans(dim, dim+1); old_trans.SetUnit();
-    Matrix<BaseFloat> trans(dim, dim+1);
-    ComputeFmllrMatrixDiagGmm(old_trans, accs_tmp, norm_type,
-                              100,  // num iters.. don't care since norm_type != "full"
-                              &trans);
-    Matrix<BaseFloat> product(dim, dim+1);
-    // product = trans * A_[i] (modulo messing about with offsets)
-    ComposeTransforms(trans, A_[i], false, &product);
-
-    BaseFloat objf = FmllrAuxFuncDiagGmm(product, accs);
+    BaseFloat objf = objfs[i];
 
     if (logdet_scale != 1.0)
       objf += accs.beta_ * (logdet_scale - 1.0) * logdets_[i];
@@ -150,7 +193,7 @@ void LinearVtln::ComputeTransform(const FmllrDiagGmmAccs &accs,
     if (objf > best_objf) {
       best_objf = objf;
       best_class = i;
-      best_transform.CopyFromMat(product);
+      best_transform.CopyFromMat(transforms[i]);
     }
   }
   KALDI_ASSERT(best_class != -1);
@@ -60,7 +60,9 @@ class LinearVtln {
   void GetTransform(int32 i, MatrixBase<BaseFloat> *transform) const;
 
 
-  /// Compute the transform for the speaker.
+  /// Compute the transform for the speaker.  The classes (warp factors) are
+  /// evaluated independently, so if num_threads > 1 they are divided among
+  /// that many threads; the result does not depend on the number of threads.
   void ComputeTransform(const FmllrDiagGmmAccs &accs,
                         std::string norm_type,  // type of regular fMLLR computation: "none", "offset", "diag"
                         BaseFloat logdet_scale,  // scale on logdet (1.0 is "correct" but less may work better)
@@ -68,7 +70,8 @@ class LinearVtln {
                         int32 *class_idx,  // the transform that was chosen...
                         BaseFloat *logdet_out,
                         BaseFloat *objf_impr = NULL,  // versus no transform
-                        BaseFloat *count = NULL);
+                        BaseFloat *count = NULL,
+                        int32 num_threads = 1);
 
   void Read(std::istream &is, bool binary);
 
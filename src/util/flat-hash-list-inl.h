@@ -0,0 +1,166 @@
+// util/flat-hash-list-inl.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_FLAT_HASH_LIST_INL_H_
+#define KALDI_UTIL_FLAT_HASH_LIST_INL_H_
+
+// Do not include this file directly.  It is included by flat-hash-list.h
+
+
+namespace kaldi {
+
+template<class I, class T> FlatHashList<I, T>::FlatHashList():
+    list_head_(NULL), list_tail_(NULL), num_elems_(0),
+    freed_head_(NULL) {
+  hash_size_ = 0;
+  SetSize(16);
+}
+
+template<class I, class T> void FlatHashList<I, T>::SetSize(size_t size) {
+  KALDI_ASSERT(list_head_ == NULL && used_slots_.empty());  // make sure empty.
+  size_t sz = 2;
+  int32 log_sz = 1;
+  while (sz < size) {
+    sz *= 2;
+    log_sz++;
+  }
+  hash_size_ = sz;
+  hash_shift_ = 64 - log_sz;
+  if (sz > slots_.size()) {
+    Slot empty_slot;
+    empty_slot.key = I();
+    empty_slot.elem = NULL;
+    slots_.resize(sz, empty_slot);
+  }
+}
+
+template<class I, class T> void FlatHashList<I, T>::Rehash(size_t size) {
+  for (size_t i = 0; i < used_slots_.size(); i++)
+    slots_[used_slots_[i]].elem = NULL;
+  used_slots_.clear();
+  Elem *list_head = list_head_;
+  list_head_ = NULL;  // so SetSize() does not complain.
+  SetSize(size);
+  list_head_ = list_head;
+  size_t mask = hash_size_ - 1;
+  for (Elem *e = list_head_; e != NULL; e = e->tail) {
+    size_t index = Hash(e->key);
+    while (slots_[index].elem != NULL)
+      index = (index + 1) & mask;
+    slots_[index].key = e->key;
+    slots_[index].elem = e;
+    used_slots_.push_back(index);
+  }
+}
+
+template<class I, class T>
+typename FlatHashList<I, T>::Elem* FlatHashList<I, T>::Clear() {
+  // Clears the hashtable and gives ownership of the currently contained list
+  // to the user.
+  for (size_t i = 0; i < used_slots_.size(); i++)
+    slots_[used_slots_[i]].elem = NULL;  // this is how we indicate "empty".
+  used_slots_.clear();
+  Elem *ans = list_head_;
+  list_head_ = list_tail_ = NULL;
+  num_elems_ = 0;
+  return ans;
+}
+
+template<class I, class T>
+inline void FlatHashList<I, T>::Delete(Elem *e) {
+  e->tail = freed_head_;
+  freed_head_ = e;
+}
+
+template<class I, class T>
+inline typename FlatHashList<I, T>::Elem* FlatHashList<I, T>::Find(
+    I key) const {
+  size_t mask = hash_size_ - 1;
+  for (size_t index = Hash(key); ; index = (index + 1) & mask) {
+    const Slot &slot = slots_[index];
+    if (slot.elem == NULL) return NULL;  // Not found.
+    if (slot.key == key) return slot.elem;
+  }
+}
+
+template<class I, class T>
+inline typename FlatHashList<I, T>::Elem* FlatHashList<I, T>::New() {
+  if (freed_head_) {
+    Elem *ans = freed_head_;
+    freed_head_ = freed_head_->tail;
+    return ans;
+  } else {
+    Elem *tmp = new Elem[allocate_block_size_];
+    for (size_t i = 0; i+1 < allocate_block_size_; i++)
+      tmp[i].tail = tmp+i+1;
+    tmp[allocate_block_size_-1].tail = NULL;
+    freed_head_ = tmp;
+    allocated_.push_back(tmp);
+    return this->New();
+  }
+}
+
+template<class I, class T>
+FlatHashList<I, T>::~FlatHashList() {
+  // First test whether we had any memory leak within the
+  // FlatHashList, i.e. things for which the user did not call Delete().  The
+  // elements of the current list are still ours.
+  size_t num_in_list = num_elems_, num_allocated = 0;
+  for (Elem *e = freed_head_; e != NULL; e = e->tail)
+    num_in_list++;
+  for (size_t i = 0; i < allocated_.size(); i++) {
+    num_allocated += allocate_block_size_;
+    delete[] allocated_[i];
+  }
+  if (num_in_list != num_allocated) {
+    KALDI_WARN << "Possible memory leak: " << num_in_list
+               << " != " << num_allocated
+               << ": you might have forgotten to call Delete on "
+               << "some Elems";
+  }
+}
+
+
+template<class I, class T>
+void FlatHashList<I, T>::Insert(I key, T val) {
+  // Keep the hash at most half full, so the probe sequences stay short.
+  if (2 * (num_elems_ + 1) > hash_size_)
+    Rehash(2 * hash_size_);
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = NULL;
+  if (list_tail_ == NULL) list_head_ = elem;
+  else list_tail_->tail = elem;
+  list_tail_ = elem;
+  num_elems_++;
+
+  size_t mask = hash_size_ - 1, index = Hash(key);
+  while (slots_[index].elem != NULL)
+    index = (index + 1) & mask;
+  slots_[index].key = key;
+  slots_[index].elem = elem;
+  used_slots_.push_back(index);
+}
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_FLAT_HASH_LIST_INL_H_
@@ -0,0 +1,150 @@
+// util/flat-hash-list-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/flat-hash-list.h"
+#include <set>
+#include <vector>
+
+namespace kaldi {
+
+// The number of warnings logged, while CountWarnings is the log handler.
+static int32 num_warnings = 0;
+
+static void CountWarnings(const LogMessageEnvelope &envelope,
+                          const char *message) {
+  if (envelope.severity == LogMessageEnvelope::kWarning)
+    num_warnings++;
+}
+
+static bool IsPowerOfTwo(size_t n) {
+  return n != 0 && (n & (n - 1)) == 0;
+}
+
+// Inserts keys that are all multiples of a large power of two, which would all
+// land in the same bucket with a hash that just masks off the low bits, so
+// they test the probing; and checks that the hash grows to stay at most half
+// full, and that this does not move the elements.
+template<class Int> void TestFlatHashListGrowth() {
+  typedef typename FlatHashList<Int, int32>::Elem Elem;
+  FlatHashList<Int, int32> hash;
+  hash.SetSize(RandInt(0, 1) == 0 ? 2 : 64);  // only a hint.
+  Int stride = static_cast<Int>(1) << RandInt(0, 8 * sizeof(Int) - 12);
+  int32 num_keys = RandInt(1, 1000);
+  std::vector<Elem*> elems;
+  for (int32 i = 0; i < num_keys; i++) {
+    Int key = static_cast<Int>(i) * stride;
+    KALDI_ASSERT(hash.Find(key) == NULL);
+    hash.Insert(key, i);
+    elems.push_back(hash.Find(key));
+    KALDI_ASSERT(elems.back() != NULL && elems.back()->val == i);
+    KALDI_ASSERT(hash.NumElems() == static_cast<size_t>(i + 1));
+    KALDI_ASSERT(IsPowerOfTwo(hash.Size()) &&
+                 2 * hash.NumElems() <= hash.Size());
+  }
+  // The elements did not move when the hash grew, and keys that were never
+  // inserted are not found, even though they land among the occupied slots.
+  for (int32 i = 0; i < num_keys; i++) {
+    Int key = static_cast<Int>(i) * stride;
+    KALDI_ASSERT(hash.Find(key) == elems[i]);
+    if (stride > 1)
+      KALDI_ASSERT(hash.Find(key + 1) == NULL);
+  }
+  KALDI_ASSERT(hash.Find(static_cast<Int>(num_keys) * stride) == NULL);
+
+  // The list is in insertion order.
+  int32 i = 0;
+  for (const Elem *e = hash.GetList(); e != NULL; e = e->tail, i++)
+    KALDI_ASSERT(e == elems[i]);
+  KALDI_ASSERT(i == num_keys);
+}
+
+// Checks that Clear() empties all the slots it used, including when the hash
+// is then made smaller than it was (the slot array is kept), and that
+// Delete()d elements are reused by later insertions.
+template<class Int> void TestFlatHashListClearAndReuse() {
+  typedef typename FlatHashList<Int, int32>::Elem Elem;
+  FlatHashList<Int, int32> hash;
+  std::set<Elem*> deleted;
+  Int offset = 0;
+  for (int32 n = 0; n < 10; n++) {
+    int32 num_keys = RandInt(0, 300);
+    for (int32 i = 0; i < num_keys; i++)
+      hash.Insert(offset + static_cast<Int>(i), i);
+    // New elements come from the ones we deleted, as long as there are any.
+    size_t num_reused = 0;
+    for (const Elem *e = hash.GetList(); e != NULL; e = e->tail)
+      if (deleted.count(const_cast<Elem*>(e)) != 0)
+        num_reused++;
+    KALDI_ASSERT(num_reused == std::min(deleted.size(),
+                                        static_cast<size_t>(num_keys)));
+
+    Elem *list = hash.Clear(), *next;
+    KALDI_ASSERT(hash.GetList() == NULL && hash.NumElems() == 0);
+    hash.SetSize(RandInt(0, 20));
+    for (int32 i = 0; i < num_keys; i++)
+      KALDI_ASSERT(hash.Find(offset + static_cast<Int>(i)) == NULL);
+    deleted.clear();
+    for (; list != NULL; list = next) {
+      next = list->tail;
+      deleted.insert(list);
+      hash.Delete(list);
+    }
+    // Make the keys of the next round overlap these ones.
+    offset += static_cast<Int>(RandInt(0, num_keys));
+  }
+}
+
+// Checks that the destructor only warns about elements that the user took
+// with Clear() and did not Delete().
+void TestFlatHashListLeakWarning() {
+  LogHandler old_handler = SetLogHandler(CountWarnings);
+  num_warnings = 0;
+  {
+    FlatHashList<int32, int32> hash;
+    for (int32 i = 0; i < 100; i++)
+      hash.Insert(i, i);
+  }
+  KALDI_ASSERT(num_warnings == 0);
+  {
+    FlatHashList<int32, int32> hash;
+    for (int32 i = 0; i < 100; i++)
+      hash.Insert(i, i);
+    FlatHashList<int32, int32>::Elem *list = hash.Clear();
+    hash.Delete(list);  // but not the rest of the list.
+  }
+  KALDI_ASSERT(num_warnings == 1);
+  SetLogHandler(old_handler);
+}
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    TestFlatHashListGrowth<int32>();
+    TestFlatHashListGrowth<uint32>();
+    TestFlatHashListGrowth<int64>();
+    TestFlatHashListClearAndReuse<int32>();
+    TestFlatHashListClearAndReuse<uint64>();
+  }
+  TestFlatHashListLeakWarning();
+  KALDI_LOG << "Test OK.";
+}
@@ -0,0 +1,143 @@
+// util/flat-hash-list.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_FLAT_HASH_LIST_H_
+#define KALDI_UTIL_FLAT_HASH_LIST_H_
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* This header provides FlatHashList, which has the same interface as HashList
+   (see hash-list.h) and is used in the same way by the decoders, but whose
+   hash is implemented with open addressing.  The keys are stored in a flat
+   array of slots next to the pointers to the list elements, so Find() usually
+   touches a single cache line and never follows a chain of list pointers, and
+   Clear() only visits the slots that were used.
+
+   The list that Clear() and GetList() give you is in insertion order, and the
+   Elems are allocated in large blocks and recycled, so iterating over it
+   mostly walks through contiguous memory.
+
+   Unlike HashList, the hash grows automatically when it gets more than half
+   full (this does not invalidate any Elem pointers), so SetSize() is only a
+   hint; and there is no InsertMore(), i.e. keys must be unique.  The elements
+   of the current list belong to this object, so it is not a leak if they are
+   still there when it is destroyed.
+
+   See flat-hash-list-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class I, class T> class FlatHashList {
+ public:
+  struct Elem {
+    I key;
+    T val;
+    Elem *tail;
+  };
+
+  /// Constructor takes no arguments.
+  /// Call SetSize to inform it of the likely size.
+  FlatHashList();
+
+  /// Clears the hash and gives the head of the current list to the user;
+  /// ownership is transferred to the user (the user must call Delete()
+  /// for each element in the list, at his/her leisure).
+  Elem *Clear();
+
+  /// Gives the head of the current list to the user.  Ownership retained in the
+  /// class.
+  const Elem *GetList() const { return list_head_; }
+
+  /// Think of this like delete().  It is to be called for each Elem in turn
+  /// after you "obtained ownership" by doing Clear().
+  inline void Delete(Elem *e);
+
+  /// This should probably not be needed to be called directly by the user.
+  /// Think of it as opposite to Delete();
+  inline Elem *New();
+
+  /// Find tries to find this element in the current list using the hashtable.
+  /// It returns NULL if not present.  The Elem it returns is not owned by the
+  /// user, it is part of the internal list owned by this object, but the user
+  /// is free to modify the "val" element.
+  inline Elem *Find(I key) const;
+
+  /// Insert inserts a new element into the hashtable/stored list.  By calling
+  /// this, the user asserts that it is not already present (e.g. Find was
+  /// called and returned NULL).
+  inline void Insert(I key, T val);
+
+  /// SetSize tells the object how many hash slots to allocate (it is rounded
+  /// up to a power of two).  It must be called while the hash is empty.
+  void SetSize(size_t sz);
+
+  /// Returns current number of hash slots.
+  inline size_t Size() const { return hash_size_; }
+
+  /// Returns the number of elements in the current list.
+  inline size_t NumElems() const { return num_elems_; }
+
+  ~FlatHashList();
+ private:
+  struct Slot {
+    I key;
+    Elem *elem;  // NULL if this slot is empty.
+  };
+
+  // Returns the slot index where the search for 'key' starts.
+  inline size_t Hash(I key) const {
+    // Fibonacci hashing: multiply, then take the top bits.
+    return static_cast<size_t>(
+        (static_cast<uint64>(key) * 11400714819323198485ull) >> hash_shift_);
+  }
+
+  // Changes the number of slots to the power of two 'sz' and re-inserts the
+  // current elements.
+  void Rehash(size_t sz);
+
+  Elem *list_head_;  // head of currently stored list.
+  Elem *list_tail_;  // tail of currently stored list.
+  size_t num_elems_;  // number of elements in the current list.
+
+  size_t hash_size_;  // number of slots in use; a power of two.
+  int32 hash_shift_;  // 64 - log2(hash_size_).
+  std::vector<Slot> slots_;  // size is >= hash_size_.
+  std::vector<size_t> used_slots_;  // indexes of the occupied slots.
+
+  Elem *freed_head_;  // head of list of currently freed elements. [ready for
+  // allocation]
+
+  std::vector<Elem*> allocated_;  // list of allocated blocks.
+
+  static const size_t allocate_block_size_ = 1024;  // Number of Elements to
+  // allocate in one block.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(FlatHashList);
+};
+
+
+}  // end namespace kaldi
+
+#include "util/flat-hash-list-inl.h"
+
+#endif  // KALDI_UTIL_FLAT_HASH_LIST_H_
@@ -80,6 +80,17 @@ void TestThreads() {
   }
 }
 
+void TestWorkerThreads() {
+  // The same threads should be reused for each job.
+  WorkerThreads worker_threads(1 + Rand() % 8);
+  for (int32 i = 0; i < 100; i++) {
+    int32 max_to_count = Rand() % 10000, tot = 0;
+    MyThreadClass c(max_to_count, &tot);
+    worker_threads.Run(c);
+    KALDI_ASSERT(tot == (max_to_count * (max_to_count - 1)) / 2);
+  }
+}
+
 class MyTaskClass { // spins for a while, then outputs a pre-given integer.
  public:
   MyTaskClass(int32 i, std::vector<int32> *vec):
@@ -128,6 +139,7 @@ void TestTaskSequencer() {
 int main() {
   using namespace kaldi;
   TestThreads();
+  TestWorkerThreads();
   for (int32 i = 0; i < 10; i++)
     TestTaskSequencer();
 }
@@ -28,6 +28,55 @@ MultiThreadable::~MultiThreadable() {
   // default implementation does nothing
 }
 
+WorkerThreads::WorkerThreads(int32 num_threads):
+    num_threads_(std::max<int32>(1, num_threads)), jobs_(num_threads_, NULL),
+    num_runs_(0), num_running_(0), exit_(false) {
+  // Thread 0 is the calling thread.
+  for (int32 i = 1; i < num_threads_; i++)
+    threads_.push_back(std::thread(&WorkerThreads::ThreadMain, this, i));
+}
+
+void WorkerThreads::RunJobs() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_runs_++;
+    num_running_ = num_threads_ - 1;
+  }
+  start_cond_.notify_all();
+  (*(jobs_[0]))();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_running_ != 0)
+    done_cond_.wait(lock);
+}
+
+void WorkerThreads::ThreadMain(int32 thread_id) {
+  int64 num_runs = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!exit_ && num_runs_ == num_runs)
+        start_cond_.wait(lock);
+      if (exit_)
+        return;
+      num_runs = num_runs_;
+    }
+    (*(jobs_[thread_id]))();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--num_running_ == 0)
+      done_cond_.notify_one();
+  }
+}
+
+WorkerThreads::~WorkerThreads() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  start_cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+}
+
 
 
 }  // end namespace kaldi
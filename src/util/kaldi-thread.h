@@ -22,6 +22,8 @@
 #ifndef KALDI_THREAD_KALDI_THREAD_H_
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
@@ -143,6 +145,60 @@ class MultiThreader {
   std::vector<C> cvec_;
 };
 
+/// WorkerThreads is like MultiThreader, but it keeps its threads alive
+/// between jobs, so it can be used for small jobs that are run very often
+/// (e.g. once per frame in a decoder), where starting new threads each time
+/// would cost too much.  Run() runs a job on NumThreads() threads, one of
+/// which is the calling thread, and returns when they have all finished.
+/// Only one thread should call Run() at a time.
+class WorkerThreads {
+ public:
+  /// If num_threads <= 1, the jobs are run in the calling thread and no
+  /// threads are created.
+  explicit WorkerThreads(int32 num_threads);
+
+  int32 NumThreads() const { return num_threads_; }
+
+  /// Class C should inherit from MultiThreadable.  As with MultiThreader, "c"
+  /// is copied for each thread, with thread_id_ and num_threads_ set, and the
+  /// copies are destroyed (in the calling thread) before this returns.
+  template<class C> void Run(const C &c_in) {
+    std::vector<C> cvec(num_threads_, c_in);
+    for (int32 i = 0; i < num_threads_; i++) {
+      cvec[i].thread_id_ = i;
+      cvec[i].num_threads_ = num_threads_;
+      jobs_[i] = &(cvec[i]);
+    }
+    RunJobs();
+  }
+
+  /// Waits for the threads to exit.
+  ~WorkerThreads();
+
+ private:
+  // Runs jobs_[0] in this thread and the others in the worker threads, and
+  // waits for them to finish.
+  void RunJobs();
+  // The function that worker thread "thread_id" runs.
+  void ThreadMain(int32 thread_id);
+
+  int32 num_threads_;
+  std::vector<MultiThreadable*> jobs_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  // Signalled when new jobs are available, or when the threads should exit.
+  std::condition_variable start_cond_;
+  // Signalled when the last worker thread has finished its job.
+  std::condition_variable done_cond_;
+  // Incremented each time RunJobs() is called.
+  int64 num_runs_;
+  // The number of worker threads that have not finished the current job.
+  int32 num_running_;
+  bool exit_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(WorkerThreads);
+};
+
 /// Here, class C should inherit from MultiThreadable.  Note: if you want to
 /// control the number of threads yourself, or need to do something in the main
 /// thread of the program while the objects exist, just initialize the
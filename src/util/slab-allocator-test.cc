@@ -0,0 +1,101 @@
+// util/slab-allocator-test.cc
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/slab-allocator.h"
+#include <iostream>
+#include <set>
+
+namespace kaldi {
+
+// A type that counts its live instances, so we can check that the
+// constructors and destructors are called.
+struct TestObject {
+  static int32 num_alive;
+  double a;
+  int32 b;
+  TestObject *next;
+  TestObject(double a, int32 b, TestObject *next): a(a), b(b), next(next) {
+    num_alive++;
+  }
+  ~TestObject() { num_alive--; }
+};
+int32 TestObject::num_alive = 0;
+
+
+void TestSlabAllocator(bool enabled) {
+  size_t block_size = 1 + Rand() % 20;
+  SlabAllocator<TestObject> allocator(enabled, block_size);
+  std::vector<TestObject*> objects;
+  for (int32 iter = 0; iter < 2000; iter++) {
+    if (objects.empty() || Rand() % 3 != 0) {
+      TestObject *next = (objects.empty() ? NULL : objects.back());
+      TestObject *obj = new (allocator.Allocate()) TestObject(0.5 * iter, iter,
+                                                            next);
+      KALDI_ASSERT(obj->a == 0.5 * iter && obj->b == iter && obj->next == next);
+      objects.push_back(obj);
+    } else {
+      size_t i = Rand() % objects.size();
+      allocator.Deallocate(objects[i]);
+      objects[i] = objects.back();
+      objects.pop_back();
+    }
+    KALDI_ASSERT(allocator.NumInUse() == objects.size() &&
+                 TestObject::num_alive == static_cast<int32>(objects.size()));
+  }
+  // All live objects must be distinct and must still have their values.
+  std::set<TestObject*> distinct(objects.begin(), objects.end());
+  KALDI_ASSERT(distinct.size() == objects.size());
+  for (size_t i = 0; i < objects.size(); i++)
+    KALDI_ASSERT(objects[i]->a == 0.5 * objects[i]->b);
+
+  size_t bytes = allocator.BytesAllocated();
+  KALDI_ASSERT(enabled == (bytes > 0));
+  for (size_t i = 0; i < objects.size(); i++)
+    allocator.Deallocate(objects[i]);
+  objects.clear();
+  KALDI_ASSERT(allocator.NumInUse() == 0 && TestObject::num_alive == 0);
+
+  // Re-allocating no more objects than before should reuse freed memory.
+  for (int32 i = 0; i < 100; i++)
+    objects.push_back(new (allocator.Allocate()) TestObject(0.0, 0, NULL));
+  if (allocator.BytesAllocated() != bytes)
+    KALDI_ASSERT(objects.size() > bytes / sizeof(TestObject));
+  for (size_t i = 0; i < objects.size(); i++)
+    allocator.Deallocate(objects[i]);
+
+  allocator.SetEnabled(!enabled);
+  TestObject *obj = new (allocator.Allocate()) TestObject(1.0, 2, NULL);
+  allocator.Deallocate(obj);
+  allocator.FreeMemory();
+  KALDI_ASSERT(allocator.BytesAllocated() == 0);
+}
+
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    TestSlabAllocator(true);
+    TestSlabAllocator(false);
+  }
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,155 @@
+// util/slab-allocator.h
+
+// Copyright 2018
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_SLAB_ALLOCATOR_H_
+#define KALDI_UTIL_SLAB_ALLOCATOR_H_
+
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a simple allocator for fixed-size objects that are
+   created and destroyed in very large numbers, such as the Tokens and
+   ForwardLinks of the lattice decoders.  Memory is obtained from the system in
+   blocks ("slabs") of many objects at a time; objects that are deleted go onto
+   a free list and are recycled by later calls to Allocate().  Memory is only
+   given back to the system when the allocator is destroyed (or FreeMemory() is
+   called), so a decoder that is reused for many utterances stops calling
+   malloc() once it has seen its largest utterance, and long-running processes
+   do not fragment the heap.
+
+   The idea is the same as the Elem allocation inside HashList (see
+   hash-list.h), but here the objects are constructed and destroyed properly so
+   it can be used for any type.
+
+   If the allocator is constructed with enabled == false, Allocate() and
+   Deallocate() just call operator new and delete; this is useful for comparing
+   speed and memory use, and for tools like valgrind.
+
+   This class is not thread-safe.
+*/
+
+namespace kaldi {
+
+template<class T> class SlabAllocator {
+ public:
+  /// 'block_size' is the number of objects we allocate at one time.
+  explicit SlabAllocator(bool enabled = true, size_t block_size = 1024):
+      enabled_(enabled), block_size_(block_size), free_head_(NULL),
+      num_in_use_(0) {
+    KALDI_ASSERT(block_size > 0);
+  }
+
+  /// Returns uninitialized memory for one object of type T; the user should
+  /// construct the object with placement new, e.g.
+  /// "T *t = new (allocator.Allocate()) T(a, b);".
+  inline void *Allocate() {
+    num_in_use_++;
+    if (!enabled_)
+      return ::operator new(sizeof(T));
+    if (free_head_ == NULL)
+      AllocateBlock();
+    Slot *slot = free_head_;
+    free_head_ = slot->next;
+    return static_cast<void*>(slot);
+  }
+
+  /// Destroys an object that was constructed in memory returned by
+  /// Allocate(), and frees the memory; think of it like "delete t".
+  inline void Deallocate(T *t) {
+    KALDI_PARANOID_ASSERT(num_in_use_ > 0);
+    num_in_use_--;
+    t->~T();
+    if (!enabled_) {
+      ::operator delete(static_cast<void*>(t));
+      return;
+    }
+    Slot *slot = reinterpret_cast<Slot*>(t);
+    slot->next = free_head_;
+    free_head_ = slot;
+  }
+
+  /// Switches between slab allocation and plain new/delete.  May only be
+  /// called while no objects are in use (e.g. at the start of an utterance).
+  void SetEnabled(bool enabled) {
+    KALDI_ASSERT(num_in_use_ == 0 &&
+                 "SetEnabled() called while objects are in use");
+    enabled_ = enabled;
+  }
+
+  bool Enabled() const { return enabled_; }
+
+  /// Returns the number of objects currently in use.
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the number of bytes this object has obtained from the system.
+  size_t BytesAllocated() const {
+    return blocks_.size() * block_size_ * sizeof(Slot);
+  }
+
+  /// Frees all memory; may only be called while no objects are in use.
+  void FreeMemory() {
+    KALDI_ASSERT(num_in_use_ == 0 &&
+                 "FreeMemory() called while objects are in use");
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+    blocks_.clear();
+    free_head_ = NULL;
+  }
+
+  ~SlabAllocator() {
+    if (num_in_use_ != 0)
+      KALDI_WARN << "Possible memory leak: " << num_in_use_
+                 << " objects were not deleted before the allocator was "
+                 << "destroyed.";
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+  }
+
+ private:
+  // A Slot is either an object in use, or a link in the free list.
+  union Slot {
+    Slot *next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void AllocateBlock() {
+    Slot *block = new Slot[block_size_];
+    for (size_t i = 0; i + 1 < block_size_; i++)
+      block[i].next = block + i + 1;
+    block[block_size_ - 1].next = free_head_;
+    free_head_ = block;
+    blocks_.push_back(block);
+  }
+
+  bool enabled_;
+  size_t block_size_;
+  Slot *free_head_;  // head of the list of free slots.
+  size_t num_in_use_;
+  std::vector<Slot*> blocks_;  // the blocks we allocated.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_SLAB_ALLOCATOR_H_